@@ -0,0 +1,524 @@
+/*************************************************************************************************
+* Description: Implementation of late-bound access to IAccessible through IDispatch.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "AccDispatch.h"
+
+struct DispatchName
+{
+    const OLECHAR* Name;
+    DISPID DispId;
+};
+
+// Names are hashed with FNV-1a, ignoring case, starting from NameHashSeed; the
+// top NameHashBits bits of the hash give the slot. The seed is the first for
+// which no two names share a slot, found by trying seeds in turn, so a new name
+// may need a new seed and a new order. A name that hashes to a slot holding a
+// different name is unknown.
+static const unsigned int NameHashSeed = 0x114;
+static const int NameHashBits = 5;
+
+static const DispatchName DispatchNames[1 << NameHashBits] =
+{
+    { L"accHelpTopic",          DISPID_ACC_HELPTOPIC },
+    { NULL, 0 },
+    { NULL, 0 },
+    { L"accDescription",        DISPID_ACC_DESCRIPTION },
+    { L"accLocation",           DISPID_ACC_LOCATION },
+    { NULL, 0 },
+    { L"accHitTest",            DISPID_ACC_HITTEST },
+    { NULL, 0 },
+    { L"accRole",               DISPID_ACC_ROLE },
+    { L"accChild",              DISPID_ACC_CHILD },
+    { L"accDoDefaultAction",    DISPID_ACC_DODEFAULTACTION },
+    { NULL, 0 },
+    { L"accKeyboardShortcut",   DISPID_ACC_KEYBOARDSHORTCUT },
+    { L"accHelp",               DISPID_ACC_HELP },
+    { NULL, 0 },
+    { L"accFocus",              DISPID_ACC_FOCUS },
+    { L"accChildCount",         DISPID_ACC_CHILDCOUNT },
+    { NULL, 0 },
+    { NULL, 0 },
+    { L"accNavigate",           DISPID_ACC_NAVIGATE },
+    { L"accParent",             DISPID_ACC_PARENT },
+    { L"accValue",              DISPID_ACC_VALUE },
+    { NULL, 0 },
+    { L"accDefaultAction",      DISPID_ACC_DEFAULTACTION },
+    { L"accName",               DISPID_ACC_NAME },
+    { L"accSelect",             DISPID_ACC_SELECT },
+    { NULL, 0 },
+    { NULL, 0 },
+    { L"accState",              DISPID_ACC_STATE },
+    { NULL, 0 },
+    { L"accSelection",          DISPID_ACC_SELECTION },
+    { NULL, 0 },
+};
+
+// Properties of a child that are a string or a variant.
+typedef HRESULT (STDMETHODCALLTYPE IAccessible::*GetStringMethod)(VARIANT varChild, BSTR* pszResult);
+typedef HRESULT (STDMETHODCALLTYPE IAccessible::*GetVariantMethod)(VARIANT varChild, VARIANT* pvarResult);
+
+static OLECHAR FoldCase(OLECHAR c)
+{
+    return ((c >= L'A') && (c <= L'Z')) ? static_cast<OLECHAR>(c - L'A' + L'a') : c;
+}
+
+// Finds the DISPID of a member by name, ignoring case. Does not allocate.
+//
+bool AccDispatch::FindDispId(const OLECHAR* name, DISPID* pDispId)
+{
+    unsigned int hash = NameHashSeed;
+    for (const OLECHAR* p = name; *p != 0; p++)
+    {
+        hash = (hash ^ FoldCase(*p)) * 16777619u;
+    }
+    const DispatchName& entry = DispatchNames[hash >> (32 - NameHashBits)];
+    if (entry.Name == NULL)
+    {
+        return false;
+    }
+    const OLECHAR* p = name;
+    const OLECHAR* q = entry.Name;
+    while ((*p != 0) && (FoldCase(*p) == FoldCase(*q)))
+    {
+        p++;
+        q++;
+    }
+    if (*p != *q)
+    {
+        return false;
+    }
+    *pDispId = entry.DispId;
+    return true;
+}
+
+// Maps a member name to its DISPID. The members take no named arguments, so
+// any argument names are unknown.
+//
+HRESULT AccDispatch::GetIDsOfNames(OLECHAR** rgszNames, UINT cNames, DISPID* rgdispid)
+{
+    if ((rgszNames == NULL) || (rgdispid == NULL) || (cNames == 0))
+    {
+        return E_INVALIDARG;
+    }
+    HRESULT hr = S_OK;
+    if ((rgszNames[0] == NULL) || !FindDispId(rgszNames[0], &rgdispid[0]))
+    {
+        rgdispid[0] = DISPID_UNKNOWN;
+        hr = DISP_E_UNKNOWNNAME;
+    }
+    for (UINT i = 1; i < cNames; i++)
+    {
+        rgdispid[i] = DISPID_UNKNOWN;
+        hr = DISP_E_UNKNOWNNAME;
+    }
+    return hr;
+}
+
+// Gets a positional argument, which DISPPARAMS holds last first, or NULL if it
+// was not passed or was passed as missing.
+//
+static VARIANT* GetArg(DISPPARAMS* pParams, UINT position)
+{
+    if (position >= pParams->cArgs - pParams->cNamedArgs)
+    {
+        return NULL;
+    }
+    VARIANT* pArg = &pParams->rgvarg[pParams->cArgs - 1 - position];
+    if (pArg->vt == (VT_BYREF | VT_VARIANT))
+    {
+        pArg = pArg->pvarVal;
+    }
+    if ((pArg->vt == VT_EMPTY) || ((pArg->vt == VT_ERROR) && (pArg->scode == DISP_E_PARAMNOTFOUND)))
+    {
+        return NULL;
+    }
+    return pArg;
+}
+
+// Coerces an argument to a long. A missing argument is an error unless a
+// default is given.
+//
+static HRESULT GetLongArg(DISPPARAMS* pParams, UINT position, bool optional, long defaultValue,
+    long* pValue, UINT* puArgErr)
+{
+    VARIANT* pArg = GetArg(pParams, position);
+    if (pArg == NULL)
+    {
+        *pValue = defaultValue;
+        return optional ? S_OK : DISP_E_PARAMNOTOPTIONAL;
+    }
+    VARIANT value;
+    VariantInit(&value);
+    if (FAILED(VariantChangeType(&value, pArg, 0, VT_I4)))
+    {
+        if (puArgErr != NULL)
+        {
+            *puArgErr = pParams->cArgs - 1 - position;
+        }
+        return DISP_E_TYPEMISMATCH;
+    }
+    *pValue = value.lVal;
+    return S_OK;
+}
+
+// Coerces a child argument, which defaults to the object itself, to VT_I4.
+//
+static HRESULT GetChildArg(DISPPARAMS* pParams, UINT position, VARIANT* pChild, UINT* puArgErr)
+{
+    VariantInit(pChild);
+    pChild->vt = VT_I4;
+    return GetLongArg(pParams, position, true, CHILDID_SELF, &pChild->lVal, puArgErr);
+}
+
+// Gets an argument that the method writes to, which must be passed by
+// reference as vt.
+//
+static HRESULT GetOutArg(DISPPARAMS* pParams, UINT position, VARTYPE vt, VARIANT** ppArg, UINT* puArgErr)
+{
+    VARIANT* pArg = GetArg(pParams, position);
+    if (pArg == NULL)
+    {
+        return DISP_E_PARAMNOTOPTIONAL;
+    }
+    if (pArg->vt != (VT_BYREF | vt))
+    {
+        if (puArgErr != NULL)
+        {
+            *puArgErr = pParams->cArgs - 1 - position;
+        }
+        return DISP_E_TYPEMISMATCH;
+    }
+    *ppArg = pArg;
+    return S_OK;
+}
+
+// Gets the most positional arguments a member takes and the ways it can be
+// invoked. Returns false if there is no such member.
+//
+static bool GetMemberInfo(DISPID dispidMember, UINT* pMaxArgs, WORD* pFlags)
+{
+    const WORD propertyGet = DISPATCH_PROPERTYGET | DISPATCH_METHOD;
+    switch (dispidMember)
+    {
+    case DISPID_ACC_NAME:
+    case DISPID_ACC_VALUE:
+        *pMaxArgs = 1;
+        *pFlags = propertyGet | DISPATCH_PROPERTYPUT;
+        return true;
+    case DISPID_ACC_DESCRIPTION:
+    case DISPID_ACC_HELP:
+    case DISPID_ACC_KEYBOARDSHORTCUT:
+    case DISPID_ACC_DEFAULTACTION:
+    case DISPID_ACC_ROLE:
+    case DISPID_ACC_STATE:
+    case DISPID_ACC_CHILD:
+        *pMaxArgs = 1;
+        *pFlags = propertyGet;
+        return true;
+    case DISPID_ACC_PARENT:
+    case DISPID_ACC_CHILDCOUNT:
+    case DISPID_ACC_FOCUS:
+    case DISPID_ACC_SELECTION:
+        *pMaxArgs = 0;
+        *pFlags = propertyGet;
+        return true;
+    case DISPID_ACC_HELPTOPIC:
+        *pMaxArgs = 2;
+        *pFlags = propertyGet;
+        return true;
+    case DISPID_ACC_SELECT:
+    case DISPID_ACC_NAVIGATE:
+    case DISPID_ACC_HITTEST:
+        *pMaxArgs = 2;
+        *pFlags = DISPATCH_METHOD;
+        return true;
+    case DISPID_ACC_LOCATION:
+        *pMaxArgs = 5;
+        *pFlags = DISPATCH_METHOD;
+        return true;
+    case DISPID_ACC_DODEFAULTACTION:
+        *pMaxArgs = 1;
+        *pFlags = DISPATCH_METHOD;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Calls the property put of accName or accValue.
+//
+static HRESULT PutString(IAccessible* pAcc, DISPID dispidMember, DISPPARAMS* pParams, UINT* puArgErr)
+{
+    // The named argument, which comes first, is the value.
+    VARIANT value;
+    VariantInit(&value);
+    if (FAILED(VariantChangeType(&value, &pParams->rgvarg[0], 0, VT_BSTR)))
+    {
+        if (puArgErr != NULL)
+        {
+            *puArgErr = 0;
+        }
+        return DISP_E_TYPEMISMATCH;
+    }
+    VARIANT child;
+    HRESULT hr = GetChildArg(pParams, 0, &child, puArgErr);
+    if (SUCCEEDED(hr))
+    {
+        hr = (dispidMember == DISPID_ACC_NAME) ? pAcc->put_accName(child, value.bstrVal)
+            : pAcc->put_accValue(child, value.bstrVal);
+    }
+    VariantClear(&value);
+    return hr;
+}
+
+// Calls an IAccessible method for a DISPID, coercing the arguments as the type
+// library describes them. A method's failure is reported as DISP_E_EXCEPTION,
+// with its HRESULT in the EXCEPINFO, as ITypeInfo::Invoke does.
+//
+HRESULT AccDispatch::Invoke(IAccessible* pAcc, DISPID dispidMember, WORD wFlags, DISPPARAMS* pdispparams,
+    VARIANT* pvarResult, EXCEPINFO* pexcepinfo, UINT* puArgErr)
+{
+    UINT maxArgs = 0;
+    WORD allowedFlags = 0;
+    if (!GetMemberInfo(dispidMember, &maxArgs, &allowedFlags) || ((wFlags & allowedFlags) == 0))
+    {
+        return DISP_E_MEMBERNOTFOUND;
+    }
+    DISPPARAMS noParams = { NULL, NULL, 0, 0 };
+    DISPPARAMS* pParams = (pdispparams != NULL) ? pdispparams : &noParams;
+    bool put = (wFlags & allowedFlags & DISPATCH_PROPERTYPUT) != 0;
+    if (put)
+    {
+        if ((pParams->cNamedArgs != 1) || (pParams->rgdispidNamedArgs[0] != DISPID_PROPERTYPUT))
+        {
+            return DISP_E_PARAMNOTOPTIONAL;
+        }
+    }
+    else if (pParams->cNamedArgs > 0)
+    {
+        return DISP_E_NONAMEDARGS;
+    }
+    if (pParams->cArgs - pParams->cNamedArgs > maxArgs)
+    {
+        return DISP_E_BADPARAMCOUNT;
+    }
+    if (pvarResult != NULL)
+    {
+        VariantInit(pvarResult);
+    }
+
+    VARIANT child;
+    VARIANT result;
+    VariantInit(&result);
+    GetStringMethod getString = NULL;
+    GetVariantMethod getVariant = NULL;
+    HRESULT hr = S_OK;
+    switch (dispidMember)
+    {
+    case DISPID_ACC_NAME:
+        if (put)
+        {
+            hr = PutString(pAcc, dispidMember, pParams, puArgErr);
+        }
+        else
+        {
+            getString = &IAccessible::get_accName;
+        }
+        break;
+    case DISPID_ACC_VALUE:
+        if (put)
+        {
+            hr = PutString(pAcc, dispidMember, pParams, puArgErr);
+        }
+        else
+        {
+            getString = &IAccessible::get_accValue;
+        }
+        break;
+    case DISPID_ACC_DESCRIPTION:
+        getString = &IAccessible::get_accDescription;
+        break;
+    case DISPID_ACC_HELP:
+        getString = &IAccessible::get_accHelp;
+        break;
+    case DISPID_ACC_KEYBOARDSHORTCUT:
+        getString = &IAccessible::get_accKeyboardShortcut;
+        break;
+    case DISPID_ACC_DEFAULTACTION:
+        getString = &IAccessible::get_accDefaultAction;
+        break;
+    case DISPID_ACC_ROLE:
+        getVariant = &IAccessible::get_accRole;
+        break;
+    case DISPID_ACC_STATE:
+        getVariant = &IAccessible::get_accState;
+        break;
+    case DISPID_ACC_PARENT:
+        result.vt = VT_DISPATCH;
+        hr = pAcc->get_accParent(&result.pdispVal);
+        break;
+    case DISPID_ACC_CHILDCOUNT:
+        result.vt = VT_I4;
+        hr = pAcc->get_accChildCount(&result.lVal);
+        break;
+    case DISPID_ACC_CHILD:
+        hr = GetChildArg(pParams, 0, &child, puArgErr);
+        if (SUCCEEDED(hr))
+        {
+            result.vt = VT_DISPATCH;
+            result.pdispVal = NULL;
+            hr = pAcc->get_accChild(child, &result.pdispVal);
+        }
+        break;
+    case DISPID_ACC_FOCUS:
+        hr = pAcc->get_accFocus(&result);
+        break;
+    case DISPID_ACC_SELECTION:
+        hr = pAcc->get_accSelection(&result);
+        break;
+    case DISPID_ACC_HELPTOPIC:
+        {
+            // accHelpTopic(helpFile, [child]) returns the help file through its
+            // first argument, and the topic as the result.
+            VARIANT* pHelpFile = NULL;
+            hr = GetOutArg(pParams, 0, VT_BSTR, &pHelpFile, puArgErr);
+            if (SUCCEEDED(hr))
+            {
+                hr = GetChildArg(pParams, 1, &child, puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                SysFreeString(*pHelpFile->pbstrVal);
+                *pHelpFile->pbstrVal = NULL;
+                result.vt = VT_I4;
+                hr = pAcc->get_accHelpTopic(pHelpFile->pbstrVal, child, &result.lVal);
+            }
+        }
+        break;
+    case DISPID_ACC_SELECT:
+        {
+            long flags = 0;
+            hr = GetLongArg(pParams, 0, false, 0, &flags, puArgErr);
+            if (SUCCEEDED(hr))
+            {
+                hr = GetChildArg(pParams, 1, &child, puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = pAcc->accSelect(flags, child);
+            }
+        }
+        break;
+    case DISPID_ACC_LOCATION:
+        {
+            // accLocation(left, top, width, height, [child]) returns the
+            // rectangle through its first four arguments.
+            VARIANT* pOut[4] = { NULL, NULL, NULL, NULL };
+            for (UINT i = 0; (i < 4) && SUCCEEDED(hr); i++)
+            {
+                hr = GetOutArg(pParams, i, VT_I4, &pOut[i], puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = GetChildArg(pParams, 4, &child, puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = pAcc->accLocation(pOut[0]->plVal, pOut[1]->plVal, pOut[2]->plVal, pOut[3]->plVal, child);
+            }
+        }
+        break;
+    case DISPID_ACC_NAVIGATE:
+        {
+            long navDir = 0;
+            hr = GetLongArg(pParams, 0, false, 0, &navDir, puArgErr);
+            if (SUCCEEDED(hr))
+            {
+                hr = GetChildArg(pParams, 1, &child, puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = pAcc->accNavigate(navDir, child, &result);
+            }
+        }
+        break;
+    case DISPID_ACC_HITTEST:
+        {
+            long x = 0;
+            long y = 0;
+            hr = GetLongArg(pParams, 0, false, 0, &x, puArgErr);
+            if (SUCCEEDED(hr))
+            {
+                hr = GetLongArg(pParams, 1, false, 0, &y, puArgErr);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = pAcc->accHitTest(x, y, &result);
+            }
+        }
+        break;
+    case DISPID_ACC_DODEFAULTACTION:
+        hr = GetChildArg(pParams, 0, &child, puArgErr);
+        if (SUCCEEDED(hr))
+        {
+            hr = pAcc->accDoDefaultAction(child);
+        }
+        break;
+    }
+
+    // The properties of a child that are a string or a variant.
+    if ((getString != NULL) || (getVariant != NULL))
+    {
+        hr = GetChildArg(pParams, 0, &child, puArgErr);
+        if (SUCCEEDED(hr) && (getString != NULL))
+        {
+            result.vt = VT_BSTR;
+            result.bstrVal = NULL;
+            hr = (pAcc->*getString)(child, &result.bstrVal);
+        }
+        else if (SUCCEEDED(hr))
+        {
+            hr = (pAcc->*getVariant)(child, &result);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        VariantClear(&result);
+        if ((hr == DISP_E_TYPEMISMATCH) || (hr == DISP_E_PARAMNOTOPTIONAL))
+        {
+            // Errors in the arguments are returned as they are.
+            return hr;
+        }
+        if (pexcepinfo != NULL)
+        {
+            ZeroMemory(pexcepinfo, sizeof(EXCEPINFO));
+            pexcepinfo->scode = hr;
+        }
+        return DISP_E_EXCEPTION;
+    }
+    if (pvarResult != NULL)
+    {
+        *pvarResult = result;
+    }
+    else
+    {
+        VariantClear(&result);
+    }
+    return S_OK;
+}
@@ -0,0 +1,35 @@
+/*************************************************************************************************
+* Description: Declarations for late-bound access to IAccessible through IDispatch.
+*
+* Scripts and some test tools call the accessible object through IDispatch, by name. The
+* usual way to support them is to load the oleacc type library and forward to
+* ITypeInfo::Invoke, which interprets the method's description on every call. Here, names
+* are looked up in a fixed perfect hash table, and Invoke is a switch on the DISPID that
+* coerces the arguments and calls the IAccessible method directly. The names, DISPIDs,
+* optional arguments and failure reporting follow the type library, so clients cannot tell
+* the difference.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <ole2.h>
+#include <oleacc.h>
+
+namespace AccDispatch
+{
+    bool FindDispId(const OLECHAR* name, DISPID* pDispId);
+    HRESULT GetIDsOfNames(OLECHAR** rgszNames, UINT cNames, DISPID* rgdispid);
+    HRESULT Invoke(IAccessible* pAcc, DISPID dispidMember, WORD wFlags, DISPPARAMS* pdispparams,
+        VARIANT* pvarResult, EXCEPINFO* pexcepinfo, UINT* puArgErr);
+}
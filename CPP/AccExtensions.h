@@ -0,0 +1,80 @@
+/*************************************************************************************************
+* Description: Declarations for the interfaces that the accessible object supports in addition
+* to IAccessible.
+*
+* Clients get these interfaces by calling QueryInterface on the IAccessible for the list.
+* AccExtensions.idl defines the same interfaces for the type library that lets them be used
+* from other processes; the two must be kept in step.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <ole2.h>
+
+// Gets the properties of a range of children in one call, instead of one call
+// per property per child.
+//
+// The records are returned as a byte string (allocated with SysAllocStringByteLen;
+// use SysStringByteLen for its size) in the format described in ChildRecords.h.
+// Each record holds the child ID, role, state, screen rectangle, name and help
+// text, as IAccessible would return them for that child.
+//
+// Like the other interfaces here, it uses only Automation types, so it is
+// marshaled by the type library marshaler once the type library is registered.
+//
+MIDL_INTERFACE("92c77d7d-df34-418a-a955-8bf1b57128ff")
+IAccChildRecords : public IUnknown
+{
+public:
+    // Gets records for up to maxChildren children, starting with the 1-based
+    // child ID firstChild. Returns S_FALSE if fewer children were returned.
+    virtual HRESULT STDMETHODCALLTYPE GetChildRecords(long firstChild, long maxChildren,
+        long* pChildCount, BSTR* pRecords) = 0;
+};
+
+// Lets a client keep a mirror of the list up to date by reading only what has
+// changed, instead of reading every child after each event.
+//
+// Start with GetSnapshot, which returns every child (with its stable item ID)
+// and the sequence number of the latest change already reflected in it. Then,
+// whenever the list raises an event, call GetChanges with the last sequence
+// number seen. The changes are returned as a byte string in the format
+// described in ChangeLog.cpp. If the log no longer holds all the changes that
+// were asked for, GetChanges returns S_FALSE and no changes, and the client
+// must call GetSnapshot again.
+//
+MIDL_INTERFACE("5a882d47-d3ea-42f8-9462-0f2c3d75c16c")
+IAccChangeLog : public IUnknown
+{
+public:
+    virtual HRESULT STDMETHODCALLTYPE GetSnapshot(LONGLONG* pSequence, BSTR* pRecords) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetChanges(LONGLONG sinceSequence, LONGLONG* pLatestSequence,
+        BSTR* pChanges) = 0;
+};
+
+// Finds children by name and status in one call, instead of reading the name
+// of every child.
+//
+// match is a NameMatch value (see ContactIndex.h) and status is a ContactStatus
+// value, or -1 for any status. The child IDs of the matches are returned in
+// ascending order as a VT_ARRAY | VT_I4 VARIANT; if nothing matches, the
+// method returns S_FALSE and VT_EMPTY.
+//
+MIDL_INTERFACE("c7c96336-f41b-4833-8540-f428736879e5")
+IAccQuery : public IUnknown
+{
+public:
+    virtual HRESULT STDMETHODCALLTYPE FindChildren(BSTR name, long match, long status,
+        VARIANT* pvarChildren) = 0;
+};
@@ -17,6 +17,60 @@
 * 
 *************************************************************************************************/
 #include "AccServer.h"
+#include "AccDispatch.h"
+#include "AccStats.h"
+#include "ChildRecords.h"
+#include "MemoryStats.h"
+#include "QueryRecorder.h"
+#include "TraceLog.h"
+#include <algorithm>
+
+// Allocates a string to return to a client, which frees it.
+//
+static BSTR AllocClientString(const OLECHAR* text)
+{
+    BSTR result = SysAllocString(text);
+    if (result != NULL)
+    {
+        MEMSTATS_HANDOFF(MemoryTag_AccStrings, sizeof(DWORD) + SysStringByteLen(result) + sizeof(OLECHAR));
+    }
+    return result;
+}
+
+// Allocates a BSTR holding binary data to return to a client, which frees it.
+//
+static BSTR AllocClientBytes(LPCSTR pData, UINT size)
+{
+    BSTR result = SysAllocStringByteLen(pData, size);
+    if (result != NULL)
+    {
+        MEMSTATS_HANDOFF(MemoryTag_AccStrings, sizeof(DWORD) + size + sizeof(OLECHAR));
+    }
+    return result;
+}
+
+// Registers the type library for the current user. Unlike LoadTypeLibEx with
+// REGKIND_REGISTER, which registers it for the machine, this needs no
+// administrator rights.
+//
+HRESULT RegisterExtensionTypeLib(HINSTANCE hInstance)
+{
+    WCHAR modulePath[MAX_PATH];
+    DWORD modulePathLength = GetModuleFileName(hInstance, modulePath, MAX_PATH);
+    if ((modulePathLength == 0) || (modulePathLength >= MAX_PATH))
+    {
+        return E_FAIL;
+    }
+    // LoadTypeLibEx finds the TYPELIB resource in the executable.
+    ITypeLib* pTypeLib = NULL;
+    HRESULT hr = LoadTypeLibEx(modulePath, REGKIND_NONE, &pTypeLib);
+    if (SUCCEEDED(hr))
+    {
+        hr = RegisterTypeLibForUser(pTypeLib, modulePath, NULL);
+        pTypeLib->Release();
+    }
+    return hr;
+}
 
 AccServer::AccServer(HWND hwnd, CustomListControl* pOwnerControl):
     m_pControl(pOwnerControl), m_hwnd(hwnd), m_refCount(1), m_enumCount(0)
@@ -75,6 +129,18 @@ IFACEMETHODIMP AccServer::QueryInterface(REFIID riid, void** ppInterface)
     {
         *ppInterface = static_cast<IEnumVARIANT*>(this);
     }
+    else if (riid == __uuidof(IAccChildRecords))
+    {
+        *ppInterface = static_cast<IAccChildRecords*>(this);
+    }
+    else if (riid == __uuidof(IAccChangeLog))
+    {
+        *ppInterface = static_cast<IAccChangeLog*>(this);
+    }
+    else if (riid == __uuidof(IAccQuery))
+    {
+        *ppInterface = static_cast<IAccQuery*>(this);
+    }
     else
     {
         *ppInterface = NULL;
@@ -86,43 +152,55 @@ IFACEMETHODIMP AccServer::QueryInterface(REFIID riid, void** ppInterface)
 
 
 // IDispatch methods.
-// Under Oleacc.dll v. 2, these don't have to be implemented.
-// However, COM requires that any out parameters be cleared.
+// Under Oleacc.dll v. 2, these don't have to be implemented, but scripts and
+// some test tools call IAccessible by name. There is no type information;
+// names and calls are resolved by AccDispatch without the type library.
 
 IFACEMETHODIMP AccServer::GetTypeInfoCount(UINT* pctinfo)
 {
     *pctinfo = 0;
-    return E_NOTIMPL;
+    return S_OK;
 }
 
 IFACEMETHODIMP AccServer::GetTypeInfo(UINT /*itinfo*/, LCID /*lcid*/, ITypeInfo** pptinfo)
 {
     *pptinfo = NULL;
-    return E_NOTIMPL;
+    return DISP_E_BADINDEX;
 }
 
-IFACEMETHODIMP AccServer::GetIDsOfNames(REFIID /*riid*/, OLECHAR** rgszNames, UINT /*cNames*/,
+IFACEMETHODIMP AccServer::GetIDsOfNames(REFIID riid, OLECHAR** rgszNames, UINT cNames,
                                                    LCID /*lcid*/, DISPID* rgdispid)
 {
-    *rgszNames = NULL;
-    *rgdispid = 0;
-    return E_NOTIMPL;
+    TRACE_SPAN("IDispatch::GetIDsOfNames");
+    ACCSTATS_SCOPE(AccMethod_GetIDsOfNames);
+    MEMSTATS_BUDGET("GetIDsOfNames", 0);
+    if (riid != IID_NULL)
+    {
+        ACCSTATS_RETURN(DISP_E_UNKNOWNINTERFACE);
+    }
+    ACCSTATS_RETURN(AccDispatch::GetIDsOfNames(rgszNames, cNames, rgdispid));
 }
 
-IFACEMETHODIMP AccServer::Invoke(DISPID /*dispidMember*/, REFIID /*riid*/, LCID /*lcid*/, WORD /*wFlags*/,
+IFACEMETHODIMP AccServer::Invoke(DISPID dispidMember, REFIID riid, LCID /*lcid*/, WORD wFlags,
                                             DISPPARAMS* pdispparams, VARIANT* pvarResult,
                                             EXCEPINFO* pexcepinfo, UINT* puArgErr)
 {
+    TRACE_SPAN("IDispatch::Invoke");
+    ACCSTATS_SCOPE(AccMethod_Invoke);
+    if (pvarResult != NULL)
+    {
+        VariantInit(pvarResult);
+    }
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
-
-    pdispparams = NULL;
-    pvarResult->vt = VT_EMPTY;
-    pexcepinfo = NULL;
-    puArgErr = NULL;
-    return E_NOTIMPL;
+    if (riid != IID_NULL)
+    {
+        ACCSTATS_RETURN(DISP_E_UNKNOWNINTERFACE);
+    }
+    ACCSTATS_RETURN(AccDispatch::Invoke(this, dispidMember, wFlags, pdispparams, pvarResult, pexcepinfo,
+        puArgErr));
 }
 
 
@@ -133,19 +211,23 @@ IFACEMETHODIMP AccServer::Next(
         VARIANT *rgVar,      // Array of returned elements.
         ULONG *pCeltFetched) // Number actually returned.   
 {
+    TRACE_SPAN("IEnumVARIANT::Next");
+    ACCSTATS_SCOPE(AccMethod_Next);
+    MEMSTATS_BUDGET("IEnumVARIANT::Next", 0);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_Next, static_cast<LONG>(celt));
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    ULONG childCount = static_cast<ULONG>(m_pControl->GetCount());
+    ULONG childCount = static_cast<ULONG>(m_pControl->GetChildCount());
     if (pCeltFetched != NULL)
     {
         *pCeltFetched = 0;
     }
     if (!rgVar) 
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     ULONG fetched = 0;
     for (ULONG x = 0; x < celt; x++)
@@ -171,18 +253,22 @@ IFACEMETHODIMP AccServer::Next(
     //
     // Return S_FALSE if we grabbed fewer items than requested
     //
-    return((fetched < celt) ? S_FALSE : S_OK);
+    ACCSTATS_RETURN((fetched < celt) ? S_FALSE : S_OK);
 }
 
     
 IFACEMETHODIMP AccServer::Skip(ULONG celt)
 {
+    TRACE_SPAN("IEnumVARIANT::Skip");
+    ACCSTATS_SCOPE(AccMethod_Skip);
+    MEMSTATS_BUDGET("IEnumVARIANT::Skip", 0);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_Skip, static_cast<LONG>(celt));
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    ULONG childCount = static_cast<ULONG>(m_pControl->GetCount());
+    ULONG childCount = static_cast<ULONG>(m_pControl->GetChildCount());
 
     m_enumCount += celt;
     if (m_enumCount > childCount)
@@ -193,23 +279,32 @@ IFACEMETHODIMP AccServer::Skip(ULONG celt)
     //
     // We return S_FALSE if at the end
     //
-    return((m_enumCount >= childCount) ? S_FALSE : S_OK);
+    ACCSTATS_RETURN((m_enumCount >= childCount) ? S_FALSE : S_OK);
 }
     
 IFACEMETHODIMP AccServer::Reset()
 {
+    TRACE_SPAN("IEnumVARIANT::Reset");
+    ACCSTATS_SCOPE(AccMethod_Reset);
+    MEMSTATS_BUDGET("IEnumVARIANT::Reset", 0);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_Reset);
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
     m_enumCount = 0;
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
     
 IFACEMETHODIMP AccServer::Clone(IEnumVARIANT **ppEnum)
 {
+    TRACE_SPAN("IEnumVARIANT::Clone");
+    ACCSTATS_SCOPE(AccMethod_Clone);
+    MEMSTATS_BUDGET("IEnumVARIANT::Clone", 1);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_Clone);
     *ppEnum = NULL;
+    MEMSTATS_SCOPE(MemoryTag_Enumerators);
     AccServer* pAcc = new (std::nothrow) AccServer(m_hwnd, m_pControl);
     HRESULT hr = (pAcc != NULL) ? S_OK : E_OUTOFMEMORY;
     if (SUCCEEDED(hr))
@@ -217,7 +312,7 @@ IFACEMETHODIMP AccServer::Clone(IEnumVARIANT **ppEnum)
         pAcc->m_enumCount = m_enumCount;
         *ppEnum = pAcc;
     }
-    return hr;
+    ACCSTATS_RETURN(hr);
 }
         
 // IAccessible methods.
@@ -227,13 +322,16 @@ IFACEMETHODIMP AccServer::Clone(IEnumVARIANT **ppEnum)
 IFACEMETHODIMP AccServer::get_accParent( 
     IDispatch **ppdispParent)
 {
+    TRACE_SPAN("IAccessible::get_accParent");
+    ACCSTATS_SCOPE(AccMethod_get_accParent);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_get_accParent);
     *ppdispParent = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    return m_pStdAccessibleObject->get_accParent(ppdispParent);
+    ACCSTATS_RETURN(m_pStdAccessibleObject->get_accParent(ppdispParent));
 }
 
 // Gets the count of child objects or elements.
@@ -241,14 +339,18 @@ IFACEMETHODIMP AccServer::get_accParent(
 IFACEMETHODIMP AccServer::get_accChildCount( 
     long *pcountChildren)
 {
+    TRACE_SPAN("IAccessible::get_accChildCount");
+    ACCSTATS_SCOPE(AccMethod_get_accChildCount);
+    MEMSTATS_BUDGET("get_accChildCount", 0);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_get_accChildCount);
     *pcountChildren = 0;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    *pcountChildren = m_pControl->GetCount(); 
-    return S_OK;
+    *pcountChildren = m_pControl->GetChildCount(); 
+    ACCSTATS_RETURN(S_OK);
 }
 
 
@@ -259,17 +361,21 @@ IFACEMETHODIMP AccServer::get_accChild(
     VARIANT varChild,
     IDispatch **ppdispChild)
 {
+    TRACE_SPAN("IAccessible::get_accChild");
+    ACCSTATS_SCOPE(AccMethod_get_accChild);
+    MEMSTATS_BUDGET("get_accChild", 0);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accChild, varChild);
     *ppdispChild = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
-    return S_FALSE;     
+    ACCSTATS_RETURN(S_FALSE);     
 }
 
 // Get the name of the control or one of its children.
@@ -279,51 +385,80 @@ IFACEMETHODIMP AccServer::get_accName(
     BSTR *pszName)
 
 {
+    TRACE_SPAN("IAccessible::get_accName");
+    ACCSTATS_SCOPE(AccMethod_get_accName);
+    MEMSTATS_BUDGET("get_accName", 1);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accName, varChild);
     *pszName = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
         *pszName = NULL;
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     // For the control itself, let the standard accessible object return the name
     // assigned by the application. This is either the "caption" property or, if
     // there is no caption, the text of any label.
     if (varChild.lVal == CHILDID_SELF)
     {
-        return m_pStdAccessibleObject->get_accName(varChild, pszName);          
+        ACCSTATS_RETURN(m_pStdAccessibleObject->get_accName(varChild, pszName));          
     }
     else
     {
-        LISTITERATOR item = m_pControl->GetItemAt(varChild.lVal - 1);
-        CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
-        *pszName = SysAllocString(pItem->GetName());
+        int index = m_pControl->ItemFromChild(varChild.lVal);
+        if (index < 0)
+        {
+            *pszName = AllocClientString(m_pControl->GetGroupName(m_pControl->GroupFromChild(varChild.lVal)));
+        }
+        else
+        {
+            LISTITERATOR item = m_pControl->GetItemAt(index);
+            CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
+            *pszName = AllocClientString(pItem->GetName());
+        }
         if (!pszName)
         {
-            return E_OUTOFMEMORY;
+            ACCSTATS_RETURN(E_OUTOFMEMORY);
         }
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
-// Get the value of the control or one of its children.
-// Not implemented for a list box.
+// Get the value of the control or one of its children. Not implemented for a
+// list box. In the grouped view, as in a tree view, the value of a child is
+// its level in the outline.
 
 IFACEMETHODIMP AccServer::get_accValue( 
-    VARIANT /*varChild*/,
+    VARIANT varChild,
     BSTR *pszValue)
 {
+    TRACE_SPAN("IAccessible::get_accValue");
+    ACCSTATS_SCOPE(AccMethod_get_accValue);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accValue, varChild);
     *pszValue = NULL;   
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    return DISP_E_MEMBERNOTFOUND;
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
+    }
+    if (!m_pControl->IsGrouped() || (varChild.lVal == CHILDID_SELF))
+    {
+        ACCSTATS_RETURN(DISP_E_MEMBERNOTFOUND);
+    }
+    *pszValue = AllocClientString((m_pControl->GroupFromChild(varChild.lVal) >= 0) ? L"0" : L"1");
+    if (*pszValue == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    ACCSTATS_RETURN(S_OK);
 }
 
 
@@ -336,25 +471,37 @@ IFACEMETHODIMP AccServer::get_accDescription(
     VARIANT varChild,
     BSTR *pszDescription)
 {
+    TRACE_SPAN("IAccessible::get_accDescription");
+    ACCSTATS_SCOPE(AccMethod_get_accDescription);
+    MEMSTATS_BUDGET("get_accDescription", 1);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accDescription, varChild);
     *pszDescription = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (varChild.lVal == CHILDID_SELF)
     {
-        *pszDescription = SysAllocString(L"List of contacts.");         
+        *pszDescription = AllocClientString(L"List of contacts.");         
+    }
+    else if (m_pControl->GroupFromChild(varChild.lVal) >= 0)
+    {
+        // The number of members is known whether or not the group is expanded.
+        int count = m_pControl->GetGroupMemberCount(m_pControl->GroupFromChild(varChild.lVal));
+        WCHAR description[32];
+        swprintf_s(description, _countof(description), (count == 1) ? L"%d contact." : L"%d contacts.", count);
+        *pszDescription = AllocClientString(description);
     }
     else
     {
-        *pszDescription = SysAllocString(L"A contact.");            
+        *pszDescription = AllocClientString(L"A contact.");            
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 
@@ -364,27 +511,32 @@ IFACEMETHODIMP AccServer::get_accRole(
     VARIANT varChild,
     VARIANT *pvarRole)
 {
+    TRACE_SPAN("IAccessible::get_accRole");
+    ACCSTATS_SCOPE(AccMethod_get_accRole);
+    MEMSTATS_BUDGET("get_accRole", 0);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accRole, varChild);
     pvarRole->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
         pvarRole->vt = VT_EMPTY;
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     pvarRole->vt = VT_I4;
+    // The grouped view is an outline, whose children are the groups and their members.
     if (varChild.lVal == CHILDID_SELF)
     {
-        pvarRole->lVal = ROLE_SYSTEM_LIST;
+        pvarRole->lVal = m_pControl->IsGrouped() ? ROLE_SYSTEM_OUTLINE : ROLE_SYSTEM_LIST;
     }
     else
     {
-        pvarRole->lVal = ROLE_SYSTEM_LISTITEM;
+        pvarRole->lVal = m_pControl->IsGrouped() ? ROLE_SYSTEM_OUTLINEITEM : ROLE_SYSTEM_LISTITEM;
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 
@@ -394,37 +546,36 @@ IFACEMETHODIMP AccServer::get_accState(
     VARIANT varChild,
     VARIANT *pvarState)
 {
+    TRACE_SPAN("IAccessible::get_accState");
+    ACCSTATS_SCOPE(AccMethod_get_accState);
+    MEMSTATS_BUDGET("get_accState", 0);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accState, varChild);
     pvarState->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
         pvarState->vt = VT_EMPTY;
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (varChild.lVal == CHILDID_SELF)
     {
-        return m_pStdAccessibleObject->get_accState(varChild, pvarState);
-    }
-    else  // For list items.
-    {
-        DWORD flags = STATE_SYSTEM_SELECTABLE | STATE_SYSTEM_FOCUSABLE;
-        int index = static_cast<int>(varChild.lVal - 1);
-        if (index == m_pControl->GetSelectedIndex())
+        HRESULT hr = m_pStdAccessibleObject->get_accState(varChild, pvarState);
+        if (SUCCEEDED(hr) && (pvarState->vt == VT_I4))
         {
-            flags |= STATE_SYSTEM_SELECTED;
-            if (GetFocus() == m_hwnd)
-            {
-                flags |= STATE_SYSTEM_FOCUSED;
-            }
+            pvarState->lVal |= STATE_SYSTEM_MULTISELECTABLE | STATE_SYSTEM_EXTSELECTABLE;
         }
+        ACCSTATS_RETURN(hr);
+    }
+    else  // For list items and groups.
+    {
         pvarState->vt = VT_I4;
-        pvarState->lVal = flags; 
+        pvarState->lVal = m_pControl->GetChildState(varChild.lVal);
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 // Get a help string for the control or one of its children.
@@ -434,52 +585,49 @@ IFACEMETHODIMP AccServer::get_accHelp(
     VARIANT varChild,
     BSTR *pszHelp)
 {
+    TRACE_SPAN("IAccessible::get_accHelp");
+    ACCSTATS_SCOPE(AccMethod_get_accHelp);
+    MEMSTATS_BUDGET("get_accHelp", 1);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accHelp, varChild);
     *pszHelp = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
         *pszHelp = NULL;
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (varChild.lVal == CHILDID_SELF)
     {
-        *pszHelp = SysAllocString(L"Contact list.");
+        *pszHelp = AllocClientString(L"Contact list.");
     }
     else
     {
-        int index = static_cast<int>(varChild.lVal - 1);
-        LISTITERATOR item = m_pControl->GetItemAt(index);
-        CustomListControlItem* pItem = (CustomListControlItem*)(*item);
-        if (pItem->GetStatus() == Status_Online)
-        {
-            *pszHelp = SysAllocString(L"Online contact.");
-        }
-        else 
-        {
-            *pszHelp = SysAllocString(L"Offline contact.");
-        }
+        *pszHelp = AllocClientString(m_pControl->GetChildHelp(varChild.lVal));
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 // Get a help file for the control or one of its children.
 //
 IFACEMETHODIMP AccServer::get_accHelpTopic( 
     BSTR *pszHelpFile,
-    VARIANT /*varChild*/,
+    VARIANT varChild,
     long * /*pidTopic*/)
 {
+    TRACE_SPAN("IAccessible::get_accHelpTopic");
+    ACCSTATS_SCOPE(AccMethod_get_accHelpTopic);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accHelpTopic, varChild);
     *pszHelpFile = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    return S_FALSE;
+    ACCSTATS_RETURN(S_FALSE);
 }
 
 // Get a keyboard shortcut for the control.
@@ -488,13 +636,16 @@ IFACEMETHODIMP AccServer::get_accKeyboardShortcut(
     VARIANT varChild,
     BSTR *pszKeyboardShortcut)
 {
+    TRACE_SPAN("IAccessible::get_accKeyboardShortcut");
+    ACCSTATS_SCOPE(AccMethod_get_accKeyboardShortcut);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accKeyboardShortcut, varChild);
     *pszKeyboardShortcut = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    return m_pStdAccessibleObject->get_accKeyboardShortcut(varChild, pszKeyboardShortcut);
+    ACCSTATS_RETURN(m_pStdAccessibleObject->get_accKeyboardShortcut(varChild, pszKeyboardShortcut));
 }
 
 
@@ -502,57 +653,84 @@ IFACEMETHODIMP AccServer::get_accKeyboardShortcut(
 
 IFACEMETHODIMP AccServer::get_accFocus(VARIANT *pvarChild)
 {
+    TRACE_SPAN("IAccessible::get_accFocus");
+    ACCSTATS_SCOPE(AccMethod_get_accFocus);
+    MEMSTATS_BUDGET("get_accFocus", 0);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_get_accFocus);
     pvarChild->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
     HRESULT hr = m_pStdAccessibleObject->get_accFocus(pvarChild); 
     // If the HWND does not have the focus, the variant type is set to VT_EMPTY.
     if ((pvarChild->vt != VT_I4) || (FAILED(hr)))
     {
-        return hr;
+        ACCSTATS_RETURN(hr);
     }
     else
     {
-        int index = m_pControl->GetSelectedIndex();
-        if (index < 0)
-        {
-            pvarChild->lVal = CHILDID_SELF;
-        }
-        else
-        {
-            // Convert to 1-based index for child ID.
-            pvarChild->lVal = index + 1;
-        }
+        // CHILDID_SELF if no child has the focus rectangle.
+        pvarChild->lVal = m_pControl->GetFocusChild();
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 
 
-// Get the index of the selected child. 
+// Get the selected children. A single selection is returned as a child ID; 
+// several are returned through an IEnumVARIANT.
 //
 IFACEMETHODIMP AccServer::get_accSelection(VARIANT *pvarChildren)
 {
+    TRACE_SPAN("IAccessible::get_accSelection");
+    ACCSTATS_SCOPE(AccMethod_get_accSelection);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_get_accSelection);
     pvarChildren->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    // In the grouped view, the selected children are not the selected items,
+    // so the ranges are worked out from them.
+    const SelectionRangeSet& selection = m_pControl->GetSelection();
+    const std::vector<SelectionRangeSet::Range>* pRanges = &selection.GetRanges();
+    int count = selection.GetCount();
+    std::vector<SelectionRangeSet::Range> groupedRanges;
+    if (m_pControl->IsGrouped())
+    {
+        m_pControl->GetSelectedChildren(&groupedRanges);
+        pRanges = &groupedRanges;
+        count = 0;
+        for (size_t r = 0; r < groupedRanges.size(); r++)
+        {
+            count += groupedRanges[r].Last - groupedRanges[r].First;
+        }
     }
 
-    int childID = m_pControl->GetSelectedIndex() + 1; // Convert from 0-based.
-    if (childID <= 0)
+    if (count <= 0)
     {
         pvarChildren->vt = VT_EMPTY;
     }
-    else 
+    else if (count == 1)
     {
         pvarChildren->vt = VT_I4;
-        pvarChildren->lVal = childID;
+        pvarChildren->lVal = (*pRanges)[0].First + 1; // Convert from 0-based.
     }
-    return S_OK;
+    else 
+    {
+        MEMSTATS_SCOPE(MemoryTag_Enumerators);
+        SelectionEnumerator* pEnum = new (std::nothrow) SelectionEnumerator(*pRanges, m_pControl);
+        if (pEnum == NULL)
+        {
+            ACCSTATS_RETURN(E_OUTOFMEMORY);
+        }
+        pvarChildren->vt = VT_UNKNOWN;
+        pvarChildren->punkVal = static_cast<IUnknown*>(pEnum);
+    }
+    ACCSTATS_RETURN(S_OK);
 }
 
 // Get a description of the default action.
@@ -561,65 +739,136 @@ IFACEMETHODIMP AccServer::get_accDefaultAction(
     VARIANT varChild,
     BSTR *pszDefaultAction)
 {
+    TRACE_SPAN("IAccessible::get_accDefaultAction");
+    ACCSTATS_SCOPE(AccMethod_get_accDefaultAction);
+    MEMSTATS_BUDGET("get_accDefaultAction", 1);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_get_accDefaultAction, varChild);
     *pszDefaultAction = NULL;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
         *pszDefaultAction = NULL;
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (varChild.lVal == CHILDID_SELF)
     {
         *pszDefaultAction = NULL;
-        return DISP_E_MEMBERNOTFOUND;
+        ACCSTATS_RETURN(DISP_E_MEMBERNOTFOUND);
+    }
+    else if (m_pControl->GroupFromChild(varChild.lVal) >= 0)
+    {
+        *pszDefaultAction = AllocClientString(
+            m_pControl->IsGroupExpanded(m_pControl->GroupFromChild(varChild.lVal)) ? L"Collapse" : L"Expand");
     }
     else
     {
-        *pszDefaultAction = SysAllocString(L"Double-click");
+        *pszDefaultAction = AllocClientString(L"Double-click");
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
-// Select an item. Allow only single selection.
+// Select an item. Supports single and multiple selection.
 
 IFACEMETHODIMP AccServer::accSelect( 
     long flagsSelect, VARIANT varChild)
 {
-    // Check parameters. We don't support the following:
-    // SELFLAG_NONE
-    // SELFLAG_ADDSELECTION
-    // SELFLAG_REMOVESELECTION
-    // SELFLAG_EXTENDSELECTION
-    // SELFLAG_VALID
-    DWORD allowedFlags = SELFLAG_TAKEFOCUS | SELFLAG_TAKESELECTION;
-    if ((flagsSelect | allowedFlags) != allowedFlags)
+    TRACE_SPAN("IAccessible::accSelect");
+    ACCSTATS_SCOPE(AccMethod_accSelect);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_accSelect, varChild, flagsSelect);
+    // Check parameters. SELFLAG_ADDSELECTION and SELFLAG_REMOVESELECTION 
+    // cannot be combined, nor can either be combined with SELFLAG_TAKESELECTION.
+    if ((flagsSelect & ~SELFLAG_VALID) != 0)
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
+    }
+    if (((flagsSelect & SELFLAG_ADDSELECTION) && (flagsSelect & SELFLAG_REMOVESELECTION))
+        || ((flagsSelect & SELFLAG_TAKESELECTION) 
+            && (flagsSelect & (SELFLAG_ADDSELECTION | SELFLAG_REMOVESELECTION | SELFLAG_EXTENDSELECTION))))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    // Groups can take the focus, but cannot be selected.
+    int group = m_pControl->GroupFromChild(varChild.lVal);
+    if ((group >= 0) && ((flagsSelect & ~SELFLAG_TAKEFOCUS) != 0))
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
+    }
+
+    // Move the focus to the list box. Only SELFLAG_TAKEFOCUS moves the focus.
+    if (flagsSelect & SELFLAG_TAKEFOCUS)
+    {
+        SetFocus(m_hwnd);
     }
 
-    // Move the focus to the list box.
-    SetFocus(m_hwnd);
+    if (varChild.lVal == CHILDID_SELF)
+    {
+        ACCSTATS_RETURN(S_OK);
+    }
+    if (group >= 0)
+    {
+        m_pControl->SetFocusedGroup(group);
+        ACCSTATS_RETURN(S_OK);
+    }
+    int selection = m_pControl->ItemFromChild(varChild.lVal);
 
     // Move the selection if called on to do so.
-    if (((flagsSelect & (SELFLAG_TAKESELECTION | SELFLAG_TAKEFOCUS)) != 0) 
-        && (varChild.lVal != CHILDID_SELF))
+    if (flagsSelect & SELFLAG_EXTENDSELECTION)
+    {
+        ExtendMode mode = Extend_MatchAnchor;
+        if (flagsSelect & SELFLAG_ADDSELECTION)
+        {
+            mode = Extend_Add;
+        }
+        else if (flagsSelect & SELFLAG_REMOVESELECTION)
+        {
+            mode = Extend_Remove;
+        }
+        m_pControl->ExtendSelection(selection, mode, (flagsSelect & SELFLAG_TAKEFOCUS) != 0);
+    }
+    else if (flagsSelect & SELFLAG_ADDSELECTION)
+    {
+        if (flagsSelect & SELFLAG_TAKEFOCUS)
+        {
+            m_pControl->AddToSelection(selection);
+        }
+        else
+        {
+            m_pControl->SetItemSelected(selection, true);
+        }
+    }
+    else if (flagsSelect & SELFLAG_REMOVESELECTION)
+    {
+        if (flagsSelect & SELFLAG_TAKEFOCUS)
+        {
+            m_pControl->RemoveFromSelection(selection);
+        }
+        else
+        {
+            m_pControl->SetItemSelected(selection, false);
+        }
+    }
+    else if (flagsSelect & SELFLAG_TAKESELECTION)
     {
-        int selection = static_cast<int>(varChild.lVal) - 1;
         m_pControl->SelectItem(selection);
     }
-    return S_OK;
+    else if (flagsSelect & SELFLAG_TAKEFOCUS)
+    {
+        m_pControl->SetFocusedItem(selection);
+    }
+    ACCSTATS_RETURN(S_OK);
 }
 
 // Get the location of the control or the list item.
@@ -631,29 +880,33 @@ IFACEMETHODIMP AccServer::accLocation(
     long *pcyHeight,
     VARIANT varChild)
 {
+    TRACE_SPAN("IAccessible::accLocation");
+    ACCSTATS_SCOPE(AccMethod_accLocation);
+    MEMSTATS_BUDGET("accLocation", 0);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_accLocation, varChild);
     *pxLeft = 0;
     *pyTop = 0;
     *pcxWidth = 0;
     *pcyHeight = 0;
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
     if (varChild.lVal == CHILDID_SELF)
     {
-        return m_pStdAccessibleObject->accLocation(pxLeft, pyTop, pcxWidth, pcyHeight, varChild);
+        ACCSTATS_RETURN(m_pStdAccessibleObject->accLocation(pxLeft, pyTop, pcxWidth, pcyHeight, varChild));
     }
     else
     {
         RECT rect;
-        if (m_pControl->GetItemScreenRect(varChild.lVal - 1, &rect) == FALSE)
+        if (m_pControl->GetChildScreenRect(varChild.lVal, &rect) == FALSE)
         {
-            return E_INVALIDARG;
+            ACCSTATS_RETURN(E_INVALIDARG);
         }
         else
         {
@@ -661,7 +914,7 @@ IFACEMETHODIMP AccServer::accLocation(
             *pyTop = rect.top;
             *pcxWidth = rect.right - rect.left;
             *pcyHeight = rect.bottom - rect.top;
-            return S_OK;    
+            ACCSTATS_RETURN(S_OK);    
         }
     }
 }
@@ -673,41 +926,62 @@ IFACEMETHODIMP AccServer::accNavigate(
     VARIANT varStart,
     VARIANT *pvarEndUpAt)
 {
+    TRACE_SPAN("IAccessible::accNavigate");
+    ACCSTATS_SCOPE(AccMethod_accNavigate);
+    MEMSTATS_BUDGET("accNavigate", 0);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_accNavigate, varStart, navDir);
     // Default value.
     pvarEndUpAt->vt = VT_EMPTY;
 
-    if ((varStart.vt != VT_I4) || (varStart.lVal > m_pControl->GetCount()))
+    if ((varStart.vt != VT_I4) || (varStart.lVal < 0) || (varStart.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    // In the tile view, the directions are spatial: left and right move along
+    // a row, and up and down to the tile above or below.
+    if (m_pControl->IsTiled() && (varStart.lVal != CHILDID_SELF) && ((navDir == NAVDIR_LEFT)
+        || (navDir == NAVDIR_RIGHT) || (navDir == NAVDIR_UP) || (navDir == NAVDIR_DOWN)))
+    {
+        int columns = (navDir == NAVDIR_LEFT) ? -1 : ((navDir == NAVDIR_RIGHT) ? 1 : 0);
+        int rows = (navDir == NAVDIR_UP) ? -1 : ((navDir == NAVDIR_DOWN) ? 1 : 0);
+        long childId = m_pControl->GetTileNeighbor(varStart.lVal, columns, rows);
+        if (childId == CHILDID_SELF)
+        {
+            ACCSTATS_RETURN(S_FALSE);
+        }
+        pvarEndUpAt->vt = VT_I4;
+        pvarEndUpAt->lVal = childId;
+        ACCSTATS_RETURN(S_OK);
     }
 
     switch (navDir)
     {
     case NAVDIR_FIRSTCHILD:
-        if ((varStart.lVal == CHILDID_SELF) && (m_pControl->GetCount() > 0))
+        if ((varStart.lVal == CHILDID_SELF) && (m_pControl->GetChildCount() > 0))
         {
             pvarEndUpAt->vt = VT_I4;
             pvarEndUpAt->lVal = 1;
         }
         else  
         {
-            return S_FALSE;
+            ACCSTATS_RETURN(S_FALSE);
         }
         break;
 
     case NAVDIR_LASTCHILD:
-        if ((varStart.lVal == CHILDID_SELF) && (m_pControl->GetCount() > 0))
+        if ((varStart.lVal == CHILDID_SELF) && (m_pControl->GetChildCount() > 0))
         {
             pvarEndUpAt->vt = VT_I4;
-            pvarEndUpAt->lVal = m_pControl->GetCount();
+            pvarEndUpAt->lVal = m_pControl->GetChildCount();
         }
         else    
         {
-            return S_FALSE;
+            ACCSTATS_RETURN(S_FALSE);
         }
         break;
 
@@ -718,15 +992,15 @@ IFACEMETHODIMP AccServer::accNavigate(
             pvarEndUpAt->vt = VT_I4;
             pvarEndUpAt->lVal = varStart.lVal + 1;
             // Out of range.
-            if (pvarEndUpAt->lVal > m_pControl->GetCount())
+            if (pvarEndUpAt->lVal > m_pControl->GetChildCount())
             {
                 pvarEndUpAt->vt = VT_EMPTY;
-                return S_FALSE;
+                ACCSTATS_RETURN(S_FALSE);
             }
         }
         else  // Call through to method on standard container.
         {
-            return m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt);
+            ACCSTATS_RETURN(m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt));
         }
         break;
 
@@ -740,30 +1014,47 @@ IFACEMETHODIMP AccServer::accNavigate(
             if (pvarEndUpAt->lVal < 1)
             {
                 pvarEndUpAt->vt = VT_EMPTY;
-                return S_FALSE;
+                ACCSTATS_RETURN(S_FALSE);
             }
         }
         else  // Call through to method on standard container.
         {
-            return m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt);
+            ACCSTATS_RETURN(m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt));
         }
         break;
 
-        // Unsupported directions.
+        // In the grouped view, left goes from an item to its group, and right
+        // from an expanded group to its first item. Otherwise unsupported.
     case NAVDIR_LEFT:
     case NAVDIR_RIGHT:
         if (varStart.lVal == CHILDID_SELF)
         {
-            return m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt);
+            ACCSTATS_RETURN(m_pStdAccessibleObject->accNavigate(navDir, varStart, pvarEndUpAt));
         }
         else 
         {
-            pvarEndUpAt->vt = VT_EMPTY;
-            return S_FALSE;
+            int group = m_pControl->GroupFromChild(varStart.lVal);
+            int index = m_pControl->ItemFromChild(varStart.lVal);
+            if ((navDir == NAVDIR_LEFT) && m_pControl->IsGrouped() && (index >= 0))
+            {
+                pvarEndUpAt->vt = VT_I4;
+                pvarEndUpAt->lVal = m_pControl->ChildFromGroup(m_pControl->GetItemGroup(index));
+            }
+            else if ((navDir == NAVDIR_RIGHT) && (group >= 0) && m_pControl->IsGroupExpanded(group)
+                && (m_pControl->GetGroupMemberCount(group) > 0))
+            {
+                pvarEndUpAt->vt = VT_I4;
+                pvarEndUpAt->lVal = varStart.lVal + 1;
+            }
+            else
+            {
+                pvarEndUpAt->vt = VT_EMPTY;
+                ACCSTATS_RETURN(S_FALSE);
+            }
         }
         break;
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 IFACEMETHODIMP AccServer::accHitTest( 
@@ -772,10 +1063,14 @@ IFACEMETHODIMP AccServer::accHitTest(
     VARIANT *pvarChild) 
 
 {
+    TRACE_SPAN("IAccessible::accHitTest");
+    ACCSTATS_SCOPE(AccMethod_accHitTest);
+    MEMSTATS_BUDGET("accHitTest", 0);
+    QueryRecorder::RecordHitTest(m_pControl, m_hwnd, xLeft, yTop);
     pvarChild->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
     // Does the control window contain the point?
@@ -789,7 +1084,7 @@ IFACEMETHODIMP AccServer::accHitTest(
     // Not in our window.
     if (!inWindow)
     {
-        return S_FALSE;
+        ACCSTATS_RETURN(S_FALSE);
     }
     else  // In our window; return list item, or self if in blank space.
     {
@@ -798,17 +1093,9 @@ IFACEMETHODIMP AccServer::accHitTest(
         pt.x = xLeft;
         pt.y = yTop;
         ScreenToClient(m_hwnd, &pt);
-        int index = m_pControl->IndexFromY(pt.y);
-        if (index >= 0)
-        {
-            pvarChild->lVal = index + 1;
-        }
-        else
-        {
-            pvarChild->lVal = CHILDID_SELF;
-
-        }
-        return S_OK;
+        // CHILDID_SELF if in blank space.
+        pvarChild->lVal = m_pControl->ChildFromPoint(pt.x, pt.y);
+        ACCSTATS_RETURN(S_OK);
     }
 }
 
@@ -816,50 +1103,394 @@ IFACEMETHODIMP AccServer::accDoDefaultAction(
     VARIANT varChild) 
 
 {
-    if ((varChild.vt != VT_I4) || (varChild.lVal > m_pControl->GetCount()))
+    TRACE_SPAN("IAccessible::accDoDefaultAction");
+    ACCSTATS_SCOPE(AccMethod_accDoDefaultAction);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_accDoDefaultAction, varChild);
+    if ((varChild.vt != VT_I4) || (varChild.lVal < 0) || (varChild.lVal > m_pControl->GetChildCount()))
     {
-        return E_INVALIDARG;
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    if (varChild.lVal != CHILDID_SELF)
+    int group = m_pControl->GroupFromChild(varChild.lVal);
+    if (group >= 0)
+    {
+        // The action for a group expands or collapses it.
+        m_pControl->SetGroupExpanded(group, !m_pControl->IsGroupExpanded(group));
+    }
+    else if (varChild.lVal != CHILDID_SELF)
     {
         // Because our sample action is to open a dialog box (thus blocking), 
-        // do it indirectly. First select the item.
-        if (SUCCEEDED(accSelect(SELFLAG_TAKESELECTION, varChild)))
-        {
-            PostMessage(m_hwnd, CUSTOMLB_DEFERDOUBLECLICK, 0, 0);
-        }
+        // do it indirectly. First select the item, as accSelect would for
+        // SELFLAG_TAKESELECTION.
+        SetFocus(m_hwnd);
+        m_pControl->SelectItem(m_pControl->ItemFromChild(varChild.lVal));
+        PostMessage(m_hwnd, CUSTOMLB_DEFERDOUBLECLICK, 0, 0);
     }
-    return S_OK;
+    ACCSTATS_RETURN(S_OK);
 }
 
 IFACEMETHODIMP AccServer::put_accName( 
-    VARIANT /*varChild*/,
+    VARIANT varChild,
     BSTR /*szName*/) 
 
 {
+    TRACE_SPAN("IAccessible::put_accName");
+    ACCSTATS_SCOPE(AccMethod_put_accName);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_put_accName, varChild);
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
     }
 
-    return E_NOTIMPL;
+    ACCSTATS_RETURN(E_NOTIMPL);
 }
 
 IFACEMETHODIMP AccServer::put_accValue( 
-    VARIANT /*varChild*/,
+    VARIANT varChild,
     BSTR /*szValue*/) 
 
 {
+    TRACE_SPAN("IAccessible::put_accValue");
+    ACCSTATS_SCOPE(AccMethod_put_accValue);
+    QueryRecorder::RecordChildCall(m_pControl, AccMethod_put_accValue, varChild);
+    if (!m_controlIsAlive) 
+    { 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    ACCSTATS_RETURN(E_NOTIMPL);
+}
+
+
+// IAccChildRecords methods.
+
+// Get the properties of a range of children, packed into one byte string.
+//
+IFACEMETHODIMP AccServer::GetChildRecords(
+    long firstChild,
+    long maxChildren,
+    long *pChildCount,
+    BSTR *pRecords)
+{
+    TRACE_SPAN("IAccChildRecords::GetChildRecords");
+    ACCSTATS_SCOPE(AccMethod_GetChildRecords);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_GetChildRecords, firstChild, maxChildren);
+    *pChildCount = 0;
+    *pRecords = NULL;
+    if (!m_controlIsAlive) 
+    { 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    long count = m_pControl->GetChildCount();
+    if ((firstChild < 1) || (firstChild > count + 1) || (maxChildren < 0))
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
+    }
+    long lastChild = (maxChildren < count - firstChild + 1) ? firstChild + maxChildren - 1 : count;
+
+    *pRecords = PackChildRecords(firstChild, lastChild, false, pChildCount);
+    if (*pRecords == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    ACCSTATS_RETURN((*pChildCount < maxChildren) ? S_FALSE : S_OK);
+}
+
+// Packs the records for children firstChild through lastChild into a byte string.
+// With listOrder, they are the records for the items in the flat list, whatever
+// the view. Returns NULL if out of memory.
+//
+BSTR AccServer::PackChildRecords(long firstChild, long lastChild, bool listOrder, long* pChildCount)
+{
+    ChildRecords::Writer writer;
+    for (long childId = firstChild; childId <= lastChild; childId++)
+    {
+        RECT rect = {};
+        ChildRecords::Record record;
+        if (listOrder)
+        {
+            // An item in a collapsed group has an empty rectangle.
+            int index = static_cast<int>(childId - 1);
+            m_pControl->GetItemScreenRect(index, &rect);
+            m_pControl->GetItemRecord(index, rect, &record);
+        }
+        else
+        {
+            m_pControl->GetChildScreenRect(childId, &rect);
+            m_pControl->GetChildRecord(childId, rect, &record);
+        }
+        writer.Append(record);
+    }
+    *pChildCount = static_cast<long>(writer.GetRecordCount());
+    return AllocClientBytes(reinterpret_cast<LPCSTR>(writer.GetData()),
+        static_cast<UINT>(writer.GetSize()));
+}
+
+// IAccChangeLog methods.
+
+// Get every child and the sequence number of the latest change.
+//
+IFACEMETHODIMP AccServer::GetSnapshot(
+    LONGLONG *pSequence,
+    BSTR *pRecords)
+{
+    TRACE_SPAN("IAccChangeLog::GetSnapshot");
+    ACCSTATS_SCOPE(AccMethod_GetSnapshot);
+    QueryRecorder::RecordCall(m_pControl, AccMethod_GetSnapshot);
+    *pSequence = 0;
+    *pRecords = NULL;
+    if (!m_controlIsAlive) 
+    { 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    long childCount;
+    // The snapshot is in list order, to match the changes in the log.
+    *pRecords = PackChildRecords(1, m_pControl->GetCount(), true, &childCount);
+    if (*pRecords == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    *pSequence = static_cast<LONGLONG>(m_pControl->GetChangeLog().GetLatestSequence());
+    ACCSTATS_RETURN(S_OK);
+}
+
+// Get the changes made after a sequence number.
+//
+IFACEMETHODIMP AccServer::GetChanges(
+    LONGLONG sinceSequence,
+    LONGLONG *pLatestSequence,
+    BSTR *pChanges)
+{
+    TRACE_SPAN("IAccChangeLog::GetChanges");
+    ACCSTATS_SCOPE(AccMethod_GetChanges);
+    // The sequence is 64 bits, so it is recorded as its low and high halves.
+    QueryRecorder::RecordCall(m_pControl, AccMethod_GetChanges, static_cast<LONG>(sinceSequence & 0xFFFFFFFF),
+        static_cast<LONG>(sinceSequence >> 32));
+    *pLatestSequence = 0;
+    *pChanges = NULL;
+    if (!m_controlIsAlive) 
+    { 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+
+    const ChangeLog& changeLog = m_pControl->GetChangeLog();
+    *pLatestSequence = static_cast<LONGLONG>(changeLog.GetLatestSequence());
+    std::vector<ChangeEntry> changes;
+    if ((sinceSequence < 0) || 
+        !changeLog.GetChangesSince(static_cast<unsigned long long>(sinceSequence), &changes))
+    {
+        // The client must start again from a snapshot.
+        ACCSTATS_RETURN(S_FALSE);
+    }
+    std::vector<unsigned char> packed;
+    ChangeLog::Pack(changes, &packed);
+    *pChanges = AllocClientBytes(packed.empty() ? NULL : reinterpret_cast<LPCSTR>(&packed[0]),
+        static_cast<UINT>(packed.size()));
+    if (*pChanges == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    ACCSTATS_RETURN(S_OK);
+}
+
+// IAccQuery methods.
+
+// Find the children whose name and status match a query.
+//
+IFACEMETHODIMP AccServer::FindChildren(
+    BSTR name,
+    long match,
+    long status,
+    VARIANT *pvarChildren)
+{
+    TRACE_SPAN("IAccQuery::FindChildren");
+    ACCSTATS_SCOPE(AccMethod_FindChildren);
+    QueryRecorder::RecordFindChildren(m_pControl, name, match, status);
+    pvarChildren->vt = VT_EMPTY;
     if (!m_controlIsAlive) 
     { 
-        return RPC_E_DISCONNECTED; 
+        ACCSTATS_RETURN(RPC_E_DISCONNECTED); 
+    }
+    if ((match < Match_AnyName) || (match > Match_Substring) || (status < AnyStatus))
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
     }
 
-    return E_NOTIMPL;
+    std::vector<int> indexes;
+    m_pControl->FindItems((name != NULL) ? name : L"", static_cast<NameMatch>(match), status, &indexes);
+
+    // In the grouped view, items in collapsed groups are not children.
+    std::vector<LONG> childIds;
+    childIds.reserve(indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        LONG childId = m_pControl->ChildFromItem(indexes[i]);
+        if (childId != CHILDID_SELF)
+        {
+            childIds.push_back(childId);
+        }
+    }
+    std::sort(childIds.begin(), childIds.end());
+    if (childIds.empty())
+    {
+        ACCSTATS_RETURN(S_FALSE);
+    }
+    SAFEARRAY* pArray = SafeArrayCreateVector(VT_I4, 0, static_cast<ULONG>(childIds.size()));
+    if (pArray == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    LONG* pChildIds = NULL;
+    SafeArrayAccessData(pArray, reinterpret_cast<void**>(&pChildIds));
+    for (size_t i = 0; i < childIds.size(); i++)
+    {
+        pChildIds[i] = childIds[i];
+    }
+    SafeArrayUnaccessData(pArray);
+    pvarChildren->vt = VT_ARRAY | VT_I4;
+    pvarChildren->parray = pArray;
+    ACCSTATS_RETURN(S_OK);
 }
 
+
+// SelectionEnumerator class.
+//
+SelectionEnumerator::SelectionEnumerator(const std::vector<SelectionRangeSet::Range>& ranges,
+    const CustomListControl* pOwnerControl) :
+    m_refCount(1), m_ranges(ranges), m_rangeIndex(0), m_offset(0), m_pOwnerControl(pOwnerControl)
+{
+}
+
+SelectionEnumerator::~SelectionEnumerator()
+{
+}
+
+// IUnknown methods.
+//
+IFACEMETHODIMP_(ULONG) SelectionEnumerator::AddRef()
+{
+    return ++m_refCount;
+}
+
+IFACEMETHODIMP_(ULONG) SelectionEnumerator::Release()
+{
+    if (--m_refCount <= 0)
+    {
+        delete this;
+        return 0;             
+    }
+    return m_refCount;
+}
+
+IFACEMETHODIMP SelectionEnumerator::QueryInterface(REFIID riid, void** ppInterface)
+{
+    if ((riid == __uuidof(IUnknown)) || (riid == __uuidof(IEnumVARIANT)))
+    {
+        *ppInterface = static_cast<IEnumVARIANT*>(this);
+    }
+    else
+    {
+        *ppInterface = NULL;
+        return E_NOINTERFACE;
+    }
+    AddRef();
+    return S_OK;
+}
+
+// IEnumVARIANT methods.
+
+IFACEMETHODIMP SelectionEnumerator::Next( 
+        ULONG celt,          // Number of elements to return.
+        VARIANT *rgVar,      // Array of returned elements.
+        ULONG *pCeltFetched) // Number actually returned.   
+{
+    TRACE_SPAN("SelectionEnumerator::Next");
+    ACCSTATS_SCOPE(AccMethod_SelectionNext);
+    QueryRecorder::RecordCall(m_pOwnerControl, AccMethod_SelectionNext, static_cast<LONG>(celt));
+    if (pCeltFetched != NULL)
+    {
+        *pCeltFetched = 0;
+    }
+    if (!rgVar) 
+    {
+        ACCSTATS_RETURN(E_INVALIDARG);
+    }
+    ULONG fetched = 0;
+    while ((fetched < celt) && (m_rangeIndex < m_ranges.size()))
+    {
+        const SelectionRangeSet::Range& range = m_ranges[m_rangeIndex];
+        rgVar[fetched].vt = VT_I4;
+        rgVar[fetched].lVal = range.First + m_offset + 1;  // Convert to child ID.
+        fetched++;
+        if (range.First + ++m_offset >= range.Last)
+        {
+            m_rangeIndex++;
+            m_offset = 0;
+        }
+    }
+    if (pCeltFetched != NULL)
+    {
+        *pCeltFetched = fetched;
+    }
+    ACCSTATS_RETURN((fetched < celt) ? S_FALSE : S_OK);
+}
+
+// Skips whole ranges where it can, so this is proportional to the number of ranges.
+//
+IFACEMETHODIMP SelectionEnumerator::Skip(ULONG celt)
+{
+    TRACE_SPAN("SelectionEnumerator::Skip");
+    ACCSTATS_SCOPE(AccMethod_SelectionSkip);
+    QueryRecorder::RecordCall(m_pOwnerControl, AccMethod_SelectionSkip, static_cast<LONG>(celt));
+    while ((celt > 0) && (m_rangeIndex < m_ranges.size()))
+    {
+        const SelectionRangeSet::Range& range = m_ranges[m_rangeIndex];
+        ULONG remaining = static_cast<ULONG>(range.Last - range.First - m_offset);
+        if (celt < remaining)
+        {
+            m_offset += static_cast<int>(celt);
+            celt = 0;
+        }
+        else
+        {
+            celt -= remaining;
+            m_rangeIndex++;
+            m_offset = 0;
+        }
+    }
+    ACCSTATS_RETURN((celt > 0) ? S_FALSE : S_OK);
+}
+
+IFACEMETHODIMP SelectionEnumerator::Reset()
+{
+    TRACE_SPAN("SelectionEnumerator::Reset");
+    ACCSTATS_SCOPE(AccMethod_SelectionReset);
+    QueryRecorder::RecordCall(m_pOwnerControl, AccMethod_SelectionReset);
+    m_rangeIndex = 0;
+    m_offset = 0;
+    ACCSTATS_RETURN(S_OK);
+}
+
+IFACEMETHODIMP SelectionEnumerator::Clone(IEnumVARIANT **ppEnum)
+{
+    TRACE_SPAN("SelectionEnumerator::Clone");
+    ACCSTATS_SCOPE(AccMethod_SelectionClone);
+    QueryRecorder::RecordCall(m_pOwnerControl, AccMethod_SelectionClone);
+    *ppEnum = NULL;
+    MEMSTATS_SCOPE(MemoryTag_Enumerators);
+    SelectionEnumerator* pEnum = new (std::nothrow) SelectionEnumerator(m_ranges, m_pOwnerControl);
+    if (pEnum == NULL)
+    {
+        ACCSTATS_RETURN(E_OUTOFMEMORY);
+    }
+    pEnum->m_rangeIndex = m_rangeIndex;
+    pEnum->m_offset = m_offset;
+    *ppEnum = pEnum;
+    ACCSTATS_RETURN(S_OK);
+}
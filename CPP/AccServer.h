@@ -16,9 +16,11 @@
 #pragma once
 #include <oleacc.h>
 #include "CustomControl.h"
+#include "AccExtensions.h"
 
 class AccServer :
-    public IAccessible, public IEnumVARIANT
+    public IAccessible, public IEnumVARIANT, public IAccChildRecords, public IAccChangeLog,
+    public IAccQuery
 {
 private:
     ULONG               m_refCount;             // The COM reference count.
@@ -29,6 +31,7 @@ private:
     ULONG               m_enumCount;            // Current count for EnumVARIANT::Next.
 
     virtual ~AccServer();
+    BSTR PackChildRecords(long firstChild, long lastChild, bool listOrder, long* pChildCount);
 
 public:
     AccServer(HWND, CustomListControl*);
@@ -78,5 +81,49 @@ public:
     IFACEMETHODIMP Reset();
     IFACEMETHODIMP Clone(IEnumVARIANT **ppEnum);
 
+    // IAccChildRecords methods.
+    IFACEMETHODIMP GetChildRecords(long firstChild, long maxChildren, long *pChildCount, BSTR *pRecords);
 
+    // IAccChangeLog methods.
+    IFACEMETHODIMP GetSnapshot(LONGLONG *pSequence, BSTR *pRecords);
+    IFACEMETHODIMP GetChanges(LONGLONG sinceSequence, LONGLONG *pLatestSequence, BSTR *pChanges);
+
+    // IAccQuery methods.
+    IFACEMETHODIMP FindChildren(BSTR name, long match, long status, VARIANT *pvarChildren);
+};
+
+// Registers the type library for the interfaces in AccExtensions.h, which is
+// built into the executable, so that clients in other processes can use them.
+//
+HRESULT RegisterExtensionTypeLib(HINSTANCE hInstance);
+
+// Enumerates the child IDs of the selected items for IAccessible::get_accSelection.
+// Works from a copy of the selection ranges, so the cost does not depend on the 
+// number of selected items, and the list can change while the enumerator is in use.
+//
+class SelectionEnumerator :
+    public IEnumVARIANT
+{
+private:
+    ULONG               m_refCount;             // The COM reference count.
+    std::vector<SelectionRangeSet::Range> m_ranges; // Snapshot of the selection.
+    size_t              m_rangeIndex;           // Current range for Next.
+    int                 m_offset;               // Current position within that range.
+    const CustomListControl* m_pOwnerControl;   // Only compared, to record calls; it may be gone.
+
+    virtual ~SelectionEnumerator();
+
+public:
+    SelectionEnumerator(const std::vector<SelectionRangeSet::Range>& ranges, const CustomListControl* pOwnerControl);
+
+    // IUnknown methods.
+    IFACEMETHODIMP_(ULONG) AddRef();
+    IFACEMETHODIMP_(ULONG) Release();
+    IFACEMETHODIMP QueryInterface(REFIID riid, void**ppInterface);
+
+    // IEnumVARIANT methods.
+    IFACEMETHODIMP Next(ULONG celt, VARIANT *rgVar, ULONG *pCeltFetched);
+    IFACEMETHODIMP Skip(ULONG celt);
+    IFACEMETHODIMP Reset();
+    IFACEMETHODIMP Clone(IEnumVARIANT **ppEnum);
 };
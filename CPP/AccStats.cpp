@@ -0,0 +1,339 @@
+/*************************************************************************************************
+* Description: Implementation of call counters and latency histograms on the accessible object.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "AccStats.h"
+
+// Names of the methods, in the order of the AccMethod enumeration.
+static const char* const MethodNames[AccMethod_Count] =
+{
+    "get_accParent",
+    "get_accChildCount",
+    "get_accChild",
+    "get_accName",
+    "get_accValue",
+    "get_accDescription",
+    "get_accRole",
+    "get_accState",
+    "get_accHelp",
+    "get_accHelpTopic",
+    "get_accKeyboardShortcut",
+    "get_accFocus",
+    "get_accSelection",
+    "get_accDefaultAction",
+    "accSelect",
+    "accLocation",
+    "accNavigate",
+    "accHitTest",
+    "accDoDefaultAction",
+    "put_accName",
+    "put_accValue",
+    "IEnumVARIANT::Next",
+    "IEnumVARIANT::Skip",
+    "IEnumVARIANT::Reset",
+    "IEnumVARIANT::Clone",
+    "SelectionEnumerator::Next",
+    "SelectionEnumerator::Skip",
+    "SelectionEnumerator::Reset",
+    "SelectionEnumerator::Clone",
+    "IAccChildRecords::GetChildRecords",
+    "IAccChangeLog::GetSnapshot",
+    "IAccChangeLog::GetChanges",
+    "IAccQuery::FindChildren",
+    "IDispatch::GetIDsOfNames",
+    "IDispatch::Invoke",
+};
+
+// Gets the name of a method, for reports.
+//
+const char* GetAccMethodName(AccMethod method)
+{
+    return ((method >= 0) && (method < AccMethod_Count)) ? MethodNames[method] : "unknown";
+}
+
+#ifdef ACCSERVER_STATS
+
+#include <oleacc.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string>
+
+// Names of the result buckets, in the order of the AccResult enumeration.
+static const char* const ResultNames[AccResult_Count] =
+{
+    "S_OK",
+    "S_FALSE",
+    "E_INVALIDARG",
+    "DISP_E_MEMBERNOTFOUND",
+    "E_NOTIMPL",
+    "E_OUTOFMEMORY",
+    "RPC_E_DISCONNECTED",
+    "other failure",
+    "other success",
+};
+
+// Names of the cached properties, in the order of the AccCache enumeration.
+static const char* const CacheNames[AccCache_Count] =
+{
+    "state",
+    "help",
+    "rect",
+};
+
+// Counters for the current thread, created on first use.
+static __declspec(thread) AccThreadStats* t_pThreadStats = NULL;
+
+// All the per-thread counters ever created. Entries are never removed, so that
+// the counts from threads that have exited are still reported.
+static AccThreadStats* volatile s_pAllThreads = NULL;
+
+// Gets the counters for the current thread.
+//
+static AccThreadStats* GetThreadStats()
+{
+    AccThreadStats* pStats = t_pThreadStats;
+    if (pStats == NULL)
+    {
+        pStats = static_cast<AccThreadStats*>(_aligned_malloc(sizeof(AccThreadStats), 64));
+        if (pStats == NULL)
+        {
+            return NULL;
+        }
+        ZeroMemory(pStats, sizeof(AccThreadStats));
+
+        // Push onto the list of all threads.
+        AccThreadStats* pHead;
+        do
+        {
+            pHead = s_pAllThreads;
+            pStats->pNext = pHead;
+        }
+        while (InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&s_pAllThreads),
+            pStats, pHead) != pHead);
+        t_pThreadStats = pStats;
+    }
+    return pStats;
+}
+
+// Maps an HRESULT to its bucket.
+//
+static AccResult ResultBucket(HRESULT hr)
+{
+    switch (hr)
+    {
+    case S_OK:                  return AccResult_S_OK;
+    case S_FALSE:               return AccResult_S_FALSE;
+    case E_INVALIDARG:          return AccResult_E_INVALIDARG;
+    case DISP_E_MEMBERNOTFOUND: return AccResult_DISP_E_MEMBERNOTFOUND;
+    case E_NOTIMPL:             return AccResult_E_NOTIMPL;
+    case E_OUTOFMEMORY:         return AccResult_E_OUTOFMEMORY;
+    case RPC_E_DISCONNECTED:    return AccResult_RPC_E_DISCONNECTED;
+    }
+    return FAILED(hr) ? AccResult_OtherFailure : AccResult_OtherSuccess;
+}
+
+// Maps a duration to its latency bucket: the position of the highest set bit.
+//
+static int LatencyBucket(ULONGLONG nanoseconds)
+{
+    int bucket = 0;
+    while ((nanoseconds >>= 1) != 0)
+    {
+        bucket++;
+    }
+    return (bucket < AccLatencyBucketCount) ? bucket : AccLatencyBucketCount - 1;
+}
+
+// Records one call on the current thread.
+//
+void AccStats::Record(AccMethod method, HRESULT hr, ULONGLONG nanoseconds)
+{
+    AccThreadStats* pStats = GetThreadStats();
+    if (pStats == NULL)
+    {
+        return;
+    }
+    AccMethodCounters& counters = pStats->Methods[method];
+    counters.Calls++;
+    counters.TotalNanoseconds += nanoseconds;
+    counters.Results[ResultBucket(hr)]++;
+    counters.Latency[LatencyBucket(nanoseconds)]++;
+}
+
+// Records a lookup in the control's cache of child properties.
+//
+void AccStats::RecordCacheLookup(AccCache cache, bool hit)
+{
+    AccThreadStats* pStats = GetThreadStats();
+    if (pStats == NULL)
+    {
+        return;
+    }
+    if (hit)
+    {
+        pStats->CacheHits[cache]++;
+    }
+    else
+    {
+        pStats->CacheMisses[cache]++;
+    }
+}
+
+// Gets the current value of the performance counter.
+//
+ULONGLONG AccStats::GetTimestamp()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<ULONGLONG>(now.QuadPart);
+}
+
+// Gets the time since a value returned by GetTimestamp.
+//
+ULONGLONG AccStats::ElapsedNanoseconds(ULONGLONG startTimestamp)
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    ULONGLONG ticks = GetTimestamp() - startTimestamp;
+    // Split the conversion so that the multiplication cannot overflow.
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Adds up the counters from all threads. The counters are read while other
+// threads may be writing them, so the totals are approximate.
+//
+void AccStats::Collect(AccMethodCounters* pTotals)
+{
+    ZeroMemory(pTotals, sizeof(AccMethodCounters) * AccMethod_Count);
+    for (AccThreadStats* pStats = s_pAllThreads; pStats != NULL; pStats = pStats->pNext)
+    {
+        for (int m = 0; m < AccMethod_Count; m++)
+        {
+            const AccMethodCounters& source = pStats->Methods[m];
+            AccMethodCounters& total = pTotals[m];
+            total.Calls += source.Calls;
+            total.TotalNanoseconds += source.TotalNanoseconds;
+            for (int r = 0; r < AccResult_Count; r++)
+            {
+                total.Results[r] += source.Results[r];
+            }
+            for (int b = 0; b < AccLatencyBucketCount; b++)
+            {
+                total.Latency[b] += source.Latency[b];
+            }
+        }
+    }
+}
+
+// Formats the totals as text, one block per method that was called.
+//
+static std::string FormatReport()
+{
+    AccMethodCounters* pTotals = static_cast<AccMethodCounters*>(
+        _aligned_malloc(sizeof(AccMethodCounters) * AccMethod_Count, 64));
+    if (pTotals == NULL)
+    {
+        return std::string();
+    }
+    AccStats::Collect(pTotals);
+
+    std::string report("AccServer call statistics\n");
+    char line[128];
+    for (int m = 0; m < AccMethod_Count; m++)
+    {
+        const AccMethodCounters& counters = pTotals[m];
+        if (counters.Calls == 0)
+        {
+            continue;
+        }
+        _snprintf_s(line, _countof(line), _TRUNCATE, "%s: %I64u calls, %I64u ns average\n",
+            GetAccMethodName(static_cast<AccMethod>(m)), counters.Calls, counters.TotalNanoseconds / counters.Calls);
+        report += line;
+        for (int r = 0; r < AccResult_Count; r++)
+        {
+            if (counters.Results[r] != 0)
+            {
+                _snprintf_s(line, _countof(line), _TRUNCATE, "    %-22s %I64u\n",
+                    ResultNames[r], counters.Results[r]);
+                report += line;
+            }
+        }
+        for (int b = 0; b < AccLatencyBucketCount; b++)
+        {
+            if (counters.Latency[b] != 0)
+            {
+                _snprintf_s(line, _countof(line), _TRUNCATE, "    < %-12I64u ns  %I64u\n",
+                    2ULL << b, counters.Latency[b]);
+                report += line;
+            }
+        }
+    }
+    _aligned_free(pTotals);
+
+    // The control looks up cached properties on the UI thread, but the counts
+    // from every thread are added up like the calls.
+    ULONGLONG hits[AccCache_Count] = {};
+    ULONGLONG misses[AccCache_Count] = {};
+    for (AccThreadStats* pStats = s_pAllThreads; pStats != NULL; pStats = pStats->pNext)
+    {
+        for (int c = 0; c < AccCache_Count; c++)
+        {
+            hits[c] += pStats->CacheHits[c];
+            misses[c] += pStats->CacheMisses[c];
+        }
+    }
+    for (int c = 0; c < AccCache_Count; c++)
+    {
+        ULONGLONG lookups = hits[c] + misses[c];
+        if (lookups != 0)
+        {
+            _snprintf_s(line, _countof(line), _TRUNCATE, "cached %s: %I64u lookups, %I64u%% hits\n",
+                CacheNames[c], lookups, (hits[c] * 100) / lookups);
+            report += line;
+        }
+    }
+    return report;
+}
+
+// Writes the statistics to a text file.
+//
+bool AccStats::DumpToFile(const WCHAR* path)
+{
+    std::string report = FormatReport();
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, path, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    bool written = (fwrite(report.c_str(), 1, report.size(), pFile) == report.size());
+    fclose(pFile);
+    return written;
+}
+
+// Writes the statistics to the debugger output window.
+//
+void AccStats::DumpToDebugger()
+{
+    OutputDebugStringA(FormatReport().c_str());
+}
+
+#endif // ACCSERVER_STATS
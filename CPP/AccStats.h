@@ -0,0 +1,168 @@
+/*************************************************************************************************
+* Description: Declarations for call counters and latency histograms on the accessible object.
+*
+* Statistics are compiled in only when ACCSERVER_STATS is defined. Otherwise the macros
+* below expand to nothing and no code or data is generated.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+
+// Methods that are counted. Keep in sync with the names in AccStats.cpp.
+enum AccMethod
+{
+    AccMethod_get_accParent,
+    AccMethod_get_accChildCount,
+    AccMethod_get_accChild,
+    AccMethod_get_accName,
+    AccMethod_get_accValue,
+    AccMethod_get_accDescription,
+    AccMethod_get_accRole,
+    AccMethod_get_accState,
+    AccMethod_get_accHelp,
+    AccMethod_get_accHelpTopic,
+    AccMethod_get_accKeyboardShortcut,
+    AccMethod_get_accFocus,
+    AccMethod_get_accSelection,
+    AccMethod_get_accDefaultAction,
+    AccMethod_accSelect,
+    AccMethod_accLocation,
+    AccMethod_accNavigate,
+    AccMethod_accHitTest,
+    AccMethod_accDoDefaultAction,
+    AccMethod_put_accName,
+    AccMethod_put_accValue,
+    AccMethod_Next,
+    AccMethod_Skip,
+    AccMethod_Reset,
+    AccMethod_Clone,
+    AccMethod_SelectionNext,
+    AccMethod_SelectionSkip,
+    AccMethod_SelectionReset,
+    AccMethod_SelectionClone,
+    AccMethod_GetChildRecords,
+    AccMethod_GetSnapshot,
+    AccMethod_GetChanges,
+    AccMethod_FindChildren,
+    AccMethod_GetIDsOfNames,
+    AccMethod_Invoke,
+    AccMethod_Count
+};
+
+const char* GetAccMethodName(AccMethod method);
+
+#ifdef ACCSERVER_STATS
+
+// Buckets for the HRESULTs returned by a method.
+enum AccResult
+{
+    AccResult_S_OK,
+    AccResult_S_FALSE,
+    AccResult_E_INVALIDARG,
+    AccResult_DISP_E_MEMBERNOTFOUND,
+    AccResult_E_NOTIMPL,
+    AccResult_E_OUTOFMEMORY,
+    AccResult_RPC_E_DISCONNECTED,
+    AccResult_OtherFailure,
+    AccResult_OtherSuccess,
+    AccResult_Count
+};
+
+// Properties of children that the control caches between changes. Keep in
+// sync with the names in AccStats.cpp.
+enum AccCache
+{
+    AccCache_State,
+    AccCache_Help,
+    AccCache_Rect,
+    AccCache_Count
+};
+
+// Latency bucket N counts calls that took from 2^N up to 2^(N+1) nanoseconds.
+const int AccLatencyBucketCount = 32;
+
+// Counters for one method on one thread. Each set starts on its own cache line,
+// so threads never write to the same line.
+//
+struct __declspec(align(64)) AccMethodCounters
+{
+    ULONGLONG Calls;
+    ULONGLONG TotalNanoseconds;
+    ULONGLONG Results[AccResult_Count];
+    ULONGLONG Latency[AccLatencyBucketCount];
+};
+
+// Counters for all methods on one thread.
+//
+struct AccThreadStats
+{
+    AccMethodCounters Methods[AccMethod_Count];
+    ULONGLONG CacheHits[AccCache_Count];
+    ULONGLONG CacheMisses[AccCache_Count];
+    AccThreadStats* pNext;      // Next thread in the list of all threads.
+};
+
+namespace AccStats
+{
+    void Record(AccMethod method, HRESULT hr, ULONGLONG nanoseconds);
+    void RecordCacheLookup(AccCache cache, bool hit);
+    ULONGLONG GetTimestamp();
+    ULONGLONG ElapsedNanoseconds(ULONGLONG startTimestamp);
+    void Collect(AccMethodCounters* pTotals);
+    bool DumpToFile(const WCHAR* path);
+    void DumpToDebugger();
+}
+
+// Times a method from construction to destruction, and records the result
+// passed to Complete.
+//
+class AccCallScope
+{
+private:
+    AccMethod m_method;
+    HRESULT   m_result;
+    ULONGLONG m_start;
+
+public:
+    AccCallScope(AccMethod method) :
+        m_method(method), m_result(E_UNEXPECTED), m_start(AccStats::GetTimestamp())
+    {
+    }
+
+    ~AccCallScope()
+    {
+        AccStats::Record(m_method, m_result, AccStats::ElapsedNanoseconds(m_start));
+    }
+
+    HRESULT Complete(HRESULT hr)
+    {
+        m_result = hr;
+        return hr;
+    }
+};
+
+#define ACCSTATS_SCOPE(method)  AccCallScope accCallScope(method)
+#define ACCSTATS_RETURN(hr)     return accCallScope.Complete(hr)
+#define ACCSTATS_DUMP()         AccStats::DumpToDebugger()
+#define ACCSTATS_CACHE(cache, hit)  AccStats::RecordCacheLookup(cache, hit)
+
+#else
+
+#define ACCSTATS_SCOPE(method)
+#define ACCSTATS_RETURN(hr)     return (hr)
+#define ACCSTATS_DUMP()
+#define ACCSTATS_CACHE(cache, hit)
+
+#endif // ACCSERVER_STATS
@@ -0,0 +1,202 @@
+/*************************************************************************************************
+* Description: Implementation of the change log kept by the custom list control.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "ChangeLog.h"
+
+// Packed format, used by IAccChangeLog. All integers are 32-bit little-endian.
+//
+//   Header:  Signature 'ACL1', entry count
+//   Entry:   Length, sequence (low, high), type, item ID, index, new index, status,
+//            name length, name as UTF-16 code units padded to four bytes
+//
+static const unsigned int Signature = 0x314c4341;  // 'ACL1'
+static const size_t HeaderSize = 8;
+static const size_t FixedEntrySize = 9 * 4;
+
+ChangeLog::ChangeLog(size_t capacity) :
+    m_entries(capacity > 0 ? capacity : 1), m_nextSequence(1), m_resetSequence(0)
+{
+}
+
+// Claims the next slot in the ring buffer.
+//
+ChangeEntry& ChangeLog::Append(ChangeType type, unsigned int itemId, int index)
+{
+    ChangeEntry& entry = m_entries[m_nextSequence % m_entries.size()];
+    entry.Sequence = m_nextSequence++;
+    entry.Type = type;
+    entry.ItemId = itemId;
+    entry.Index = index;
+    entry.NewIndex = index;
+    entry.Status = 0;
+    entry.Name.clear();
+    return entry;
+}
+
+void ChangeLog::AddInsert(unsigned int itemId, int index, const wchar_t* name, int status)
+{
+    ChangeEntry& entry = Append(Change_Insert, itemId, index);
+    entry.Name = (name != NULL) ? name : L"";
+    entry.Status = status;
+}
+
+void ChangeLog::AddRemove(unsigned int itemId, int index)
+{
+    Append(Change_Remove, itemId, index);
+}
+
+void ChangeLog::AddMove(unsigned int itemId, int index, int newIndex)
+{
+    Append(Change_Move, itemId, index).NewIndex = newIndex;
+}
+
+void ChangeLog::AddRename(unsigned int itemId, int index, const wchar_t* name)
+{
+    Append(Change_Rename, itemId, index).Name = (name != NULL) ? name : L"";
+}
+
+void ChangeLog::AddStatus(unsigned int itemId, int index, int status)
+{
+    Append(Change_Status, itemId, index).Status = status;
+}
+
+// Records a change too large to describe entry by entry, such as a sort. The
+// change takes a sequence number, and clients that have not seen it must read
+// the whole list again.
+//
+void ChangeLog::Reset()
+{
+    m_resetSequence = m_nextSequence++;
+}
+
+// Gets the sequence number of the latest change, or 0 if there has been none.
+//
+unsigned long long ChangeLog::GetLatestSequence() const
+{
+    return m_nextSequence - 1;
+}
+
+// Gets the changes made after the given sequence number, oldest first.
+// Returns false if some of them have already been discarded or were made
+// by Reset, or if the sequence number is newer than any change; the client
+// must then read the whole list again, starting from GetLatestSequence.
+//
+bool ChangeLog::GetChangesSince(unsigned long long sequence, std::vector<ChangeEntry>* pChanges) const
+{
+    pChanges->clear();
+    unsigned long long oldest = (m_nextSequence > m_entries.size()) ? m_nextSequence - m_entries.size() : 1;
+    if ((sequence + 1 < oldest) || (sequence < m_resetSequence) || (sequence >= m_nextSequence))
+    {
+        return false;
+    }
+    pChanges->reserve(static_cast<size_t>(m_nextSequence - sequence - 1));
+    for (unsigned long long s = sequence + 1; s < m_nextSequence; s++)
+    {
+        pChanges->push_back(m_entries[s % m_entries.size()]);
+    }
+    return true;
+}
+
+static void AppendInt(std::vector<unsigned char>* pBuffer, unsigned int value)
+{
+    pBuffer->push_back(static_cast<unsigned char>(value));
+    pBuffer->push_back(static_cast<unsigned char>(value >> 8));
+    pBuffer->push_back(static_cast<unsigned char>(value >> 16));
+    pBuffer->push_back(static_cast<unsigned char>(value >> 24));
+}
+
+static unsigned int ReadInt(const unsigned char* p)
+{
+    return static_cast<unsigned int>(p[0]) | (static_cast<unsigned int>(p[1]) << 8)
+        | (static_cast<unsigned int>(p[2]) << 16) | (static_cast<unsigned int>(p[3]) << 24);
+}
+
+// Packs changes into a buffer.
+//
+void ChangeLog::Pack(const std::vector<ChangeEntry>& changes, std::vector<unsigned char>* pBuffer)
+{
+    pBuffer->clear();
+    AppendInt(pBuffer, Signature);
+    AppendInt(pBuffer, static_cast<unsigned int>(changes.size()));
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        const ChangeEntry& entry = changes[i];
+        unsigned int nameLength = static_cast<unsigned int>(entry.Name.size());
+        size_t paddedName = (static_cast<size_t>(nameLength) * 2 + 3) & ~static_cast<size_t>(3);
+        AppendInt(pBuffer, static_cast<unsigned int>(FixedEntrySize + paddedName));
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.Sequence));
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.Sequence >> 32));
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.Type));
+        AppendInt(pBuffer, entry.ItemId);
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.Index));
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.NewIndex));
+        AppendInt(pBuffer, static_cast<unsigned int>(entry.Status));
+        AppendInt(pBuffer, nameLength);
+        for (unsigned int c = 0; c < nameLength; c++)
+        {
+            unsigned int unit = static_cast<unsigned int>(entry.Name[c]);
+            pBuffer->push_back(static_cast<unsigned char>(unit));
+            pBuffer->push_back(static_cast<unsigned char>(unit >> 8));
+        }
+        pBuffer->resize(pBuffer->size() + paddedName - nameLength * 2, 0);
+    }
+}
+
+// Unpacks a buffer made by Pack. Returns false if it is malformed.
+//
+bool ChangeLog::Unpack(const void* data, size_t size, std::vector<ChangeEntry>* pChanges)
+{
+    pChanges->clear();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    if ((p == NULL) || (size < HeaderSize) || (ReadInt(p) != Signature))
+    {
+        return false;
+    }
+    unsigned int count = ReadInt(p + 4);
+    size_t offset = HeaderSize;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        size_t remaining = size - offset;
+        size_t length = (remaining >= 4) ? ReadInt(p + offset) : 0;
+        if ((length < FixedEntrySize) || (length > remaining))
+        {
+            return false;
+        }
+        const unsigned char* q = p + offset;
+        ChangeEntry entry;
+        entry.Sequence = ReadInt(q + 4) | (static_cast<unsigned long long>(ReadInt(q + 8)) << 32);
+        entry.Type = static_cast<ChangeType>(ReadInt(q + 12));
+        entry.ItemId = ReadInt(q + 16);
+        entry.Index = static_cast<int>(ReadInt(q + 20));
+        entry.NewIndex = static_cast<int>(ReadInt(q + 24));
+        entry.Status = static_cast<int>(ReadInt(q + 28));
+        unsigned int nameLength = ReadInt(q + 32);
+        if (nameLength > (length - FixedEntrySize) / 2)
+        {
+            return false;
+        }
+        entry.Name.resize(nameLength);
+        for (unsigned int c = 0; c < nameLength; c++)
+        {
+            entry.Name[c] = static_cast<wchar_t>(q[FixedEntrySize + c * 2] | (q[FixedEntrySize + c * 2 + 1] << 8));
+        }
+        pChanges->push_back(entry);
+        offset += length;
+    }
+    return offset == size;
+}
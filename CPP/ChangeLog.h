@@ -0,0 +1,80 @@
+/*************************************************************************************************
+* Description: Declarations for the change log kept by the custom list control.
+*
+* Every change to the list is appended with a sequence number and the stable ID of the
+* item it affects. A client that mirrors the list remembers the last sequence number it
+* has seen and asks only for the changes after it. The log holds a fixed number of
+* entries; a client that falls further behind than that must read the whole list again.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Kinds of change.
+enum ChangeType
+{
+    Change_Insert,          // Item inserted at Index, with Name and Status.
+    Change_Remove,          // Item removed from Index.
+    Change_Move,            // Item moved from Index to NewIndex.
+    Change_Rename,          // Item at Index renamed to Name.
+    Change_Status           // Status of item at Index changed to Status.
+};
+
+// One change. Index is the item's position when the change was made.
+struct ChangeEntry
+{
+    unsigned long long Sequence;
+    ChangeType Type;
+    unsigned int ItemId;
+    int Index;
+    int NewIndex;
+    int Status;
+    std::wstring Name;
+};
+
+// A bounded log of changes, oldest first.
+//
+class ChangeLog
+{
+private:
+    std::vector<ChangeEntry> m_entries;     // Ring buffer.
+    unsigned long long m_nextSequence;      // Sequence number of the next entry.
+    unsigned long long m_resetSequence;     // Clients older than this must read the whole list.
+
+    ChangeEntry& Append(ChangeType type, unsigned int itemId, int index);
+
+public:
+    static const size_t DefaultCapacity = 1024;
+
+    ChangeLog(size_t capacity = DefaultCapacity);
+
+    void AddInsert(unsigned int itemId, int index, const wchar_t* name, int status);
+    void AddRemove(unsigned int itemId, int index);
+    void AddMove(unsigned int itemId, int index, int newIndex);
+    void AddRename(unsigned int itemId, int index, const wchar_t* name);
+    void AddStatus(unsigned int itemId, int index, int status);
+    void Reset();
+
+    unsigned long long GetLatestSequence() const;
+    bool GetChangesSince(unsigned long long sequence, std::vector<ChangeEntry>* pChanges) const;
+
+    static void Pack(const std::vector<ChangeEntry>& changes, std::vector<unsigned char>* pBuffer);
+    static bool Unpack(const void* data, size_t size, std::vector<ChangeEntry>* pChanges);
+};
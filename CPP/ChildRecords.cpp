@@ -0,0 +1,185 @@
+/*************************************************************************************************
+* Description: Implementation of the packed child records returned by IAccChildRecords.
+*
+* See ChildRecords.h for the buffer layout.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "ChildRecords.h"
+
+using namespace ChildRecords;
+
+static const unsigned int Signature = 0x31524341;  // 'ACR1'
+static const size_t HeaderSize = 8;
+static const size_t FixedRecordSize = 8 * 4;        // Length through height.
+
+// Reads a little-endian integer.
+//
+static unsigned int ReadInt(const unsigned char* p)
+{
+    return static_cast<unsigned int>(p[0]) | (static_cast<unsigned int>(p[1]) << 8)
+        | (static_cast<unsigned int>(p[2]) << 16) | (static_cast<unsigned int>(p[3]) << 24);
+}
+
+static void WriteInt(unsigned char* p, unsigned int value)
+{
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+    p[2] = static_cast<unsigned char>(value >> 16);
+    p[3] = static_cast<unsigned char>(value >> 24);
+}
+
+// Gets the number of bytes a string takes, including padding.
+//
+static size_t PaddedStringSize(unsigned int length)
+{
+    return (static_cast<size_t>(length) * 2 + 3) & ~static_cast<size_t>(3);
+}
+
+Writer::Writer() : m_buffer(HeaderSize), m_recordCount(0)
+{
+    WriteInt(&m_buffer[0], Signature);
+}
+
+void Writer::AppendInt(unsigned int value)
+{
+    size_t offset = m_buffer.size();
+    m_buffer.resize(offset + 4);
+    WriteInt(&m_buffer[offset], value);
+}
+
+void Writer::AppendString(const unsigned short* units, unsigned int length)
+{
+    AppendInt(length);
+    size_t offset = m_buffer.size();
+    m_buffer.resize(offset + PaddedStringSize(length), 0);
+    for (unsigned int i = 0; i < length; i++)
+    {
+        m_buffer[offset + i * 2] = static_cast<unsigned char>(units[i]);
+        m_buffer[offset + i * 2 + 1] = static_cast<unsigned char>(units[i] >> 8);
+    }
+}
+
+// Adds a record. The strings are copied.
+//
+void Writer::Append(const Record& record)
+{
+    size_t start = m_buffer.size();
+    size_t length = FixedRecordSize + 4 + PaddedStringSize(record.NameLength) + 4 + PaddedStringSize(record.HelpLength) + 4;
+    m_buffer.reserve(start + length);
+
+    AppendInt(static_cast<unsigned int>(length));
+    AppendInt(record.ChildId);
+    AppendInt(record.Role);
+    AppendInt(record.State);
+    AppendInt(static_cast<unsigned int>(record.Left));
+    AppendInt(static_cast<unsigned int>(record.Top));
+    AppendInt(static_cast<unsigned int>(record.Width));
+    AppendInt(static_cast<unsigned int>(record.Height));
+    AppendString(record.Name, record.NameLength);
+    AppendString(record.Help, record.HelpLength);
+    AppendInt(record.ItemId);
+    m_recordCount++;
+}
+
+// Gets the packed buffer, with the record count filled in.
+//
+const unsigned char* Writer::GetData()
+{
+    WriteInt(&m_buffer[4], m_recordCount);
+    return &m_buffer[0];
+}
+
+size_t Writer::GetSize() const
+{
+    return m_buffer.size();
+}
+
+unsigned int Writer::GetRecordCount() const
+{
+    return m_recordCount;
+}
+
+Reader::Reader(const void* data, size_t size) :
+    m_data(static_cast<const unsigned char*>(data)), m_size(size), m_offset(HeaderSize),
+    m_recordCount(0), m_valid(false)
+{
+    if ((m_data != NULL) && (m_size >= HeaderSize) && (ReadInt(m_data) == Signature))
+    {
+        m_recordCount = ReadInt(m_data + 4);
+        m_valid = true;
+    }
+}
+
+bool Reader::IsValid() const
+{
+    return m_valid;
+}
+
+unsigned int Reader::GetRecordCount() const
+{
+    return m_recordCount;
+}
+
+// Gets the next record. Returns false at the end of the buffer, or if the
+// buffer is malformed, in which case IsValid also returns false.
+//
+bool Reader::Next(Record* pRecord)
+{
+    if (!m_valid || (m_offset == m_size))
+    {
+        return false;
+    }
+    const unsigned char* p = m_data + m_offset;
+    size_t remaining = m_size - m_offset;
+    size_t length = (remaining >= 4) ? ReadInt(p) : 0;
+    if ((length < FixedRecordSize + 8) || (length > remaining) || ((length & 3) != 0))
+    {
+        m_valid = false;
+        return false;
+    }
+
+    pRecord->ChildId = ReadInt(p + 4);
+    pRecord->Role = ReadInt(p + 8);
+    pRecord->State = ReadInt(p + 12);
+    pRecord->Left = static_cast<int>(ReadInt(p + 16));
+    pRecord->Top = static_cast<int>(ReadInt(p + 20));
+    pRecord->Width = static_cast<int>(ReadInt(p + 24));
+    pRecord->Height = static_cast<int>(ReadInt(p + 28));
+
+    // Strings are used in place, which assumes a little-endian host.
+    size_t offset = FixedRecordSize;
+    pRecord->NameLength = ReadInt(p + offset);
+    offset += 4;
+    if ((pRecord->NameLength > length / 2) || (PaddedStringSize(pRecord->NameLength) + 4 > length - offset))
+    {
+        m_valid = false;
+        return false;
+    }
+    pRecord->Name = reinterpret_cast<const unsigned short*>(p + offset);
+    offset += PaddedStringSize(pRecord->NameLength);
+    pRecord->HelpLength = ReadInt(p + offset);
+    offset += 4;
+    if ((pRecord->HelpLength > length / 2) || (PaddedStringSize(pRecord->HelpLength) > length - offset))
+    {
+        m_valid = false;
+        return false;
+    }
+    pRecord->Help = reinterpret_cast<const unsigned short*>(p + offset);
+    offset += PaddedStringSize(pRecord->HelpLength);
+    pRecord->ItemId = (length - offset >= 4) ? ReadInt(p + offset) : 0;
+
+    m_offset += length;
+    return true;
+}
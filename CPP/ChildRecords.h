@@ -0,0 +1,94 @@
+/*************************************************************************************************
+* Description: Declarations for the packed child records returned by IAccChildRecords.
+*
+* The buffer starts with a header, followed by one record per child. Every record starts
+* with its own length in bytes, so that a reader can skip fields added by later versions.
+* All integers are 32-bit little-endian; strings are UTF-16 code units, padded to a
+* multiple of four bytes.
+*
+*   Header:  Signature 'ACR1', record count
+*   Record:  Length, child ID, role, state, left, top, width, height,
+*            name length, name units, help length, help units, item ID
+*
+* The item ID is the stable ID used by the change log (see ChangeLog.h). It was added
+* after the other fields, so readers treat it as 0 if a record ends before it.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace ChildRecords
+{
+    // The properties of one child. String pointers are not null-terminated.
+    struct Record
+    {
+        unsigned int ChildId;
+        unsigned int Role;
+        unsigned int State;
+        int Left;
+        int Top;
+        int Width;
+        int Height;
+        const unsigned short* Name;
+        unsigned int NameLength;        // In UTF-16 code units.
+        const unsigned short* Help;
+        unsigned int HelpLength;
+        unsigned int ItemId;            // Stable across insertions and removals.
+    };
+
+    // Packs records into a buffer.
+    //
+    class Writer
+    {
+    private:
+        std::vector<unsigned char> m_buffer;
+        unsigned int m_recordCount;
+
+        void AppendInt(unsigned int value);
+        void AppendString(const unsigned short* units, unsigned int length);
+
+    public:
+        Writer();
+
+        void Append(const Record& record);
+        const unsigned char* GetData();
+        size_t GetSize() const;
+        unsigned int GetRecordCount() const;
+    };
+
+    // Unpacks records from a buffer. The strings in the records point into the
+    // buffer, which must stay valid and be aligned to four bytes.
+    //
+    class Reader
+    {
+    private:
+        const unsigned char* m_data;
+        size_t m_size;
+        size_t m_offset;
+        unsigned int m_recordCount;
+        bool m_valid;
+
+    public:
+        Reader(const void* data, size_t size);
+
+        bool IsValid() const;
+        unsigned int GetRecordCount() const;
+        bool Next(Record* pRecord);
+    };
+}
@@ -0,0 +1,1378 @@
+/*************************************************************************************************
+* Description: Implementation of the component test.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "ComponentTest.h"
+#include "CustomControl.h"
+#include "ChildRecords.h"
+#include "ChangeLog.h"
+#include "ContactIndex.h"
+#include "ContactModel.h"
+#include "MemoryStats.h"
+#include "NameSearch.h"
+#include "RosterDiff.h"
+#include "SharedSnapshot.h"
+#include "TrigramIndex.h"
+#include "WorkExecutor.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG ComponentClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+void ComponentTest::GetDefaultOptions(ComponentTestOptions* pOptions)
+{
+    pOptions->Seconds = 2;
+    pOptions->Threads = 0;
+    pOptions->Names = 1000000;
+}
+
+// Gets the number of threads to use for the parts that run on several.
+//
+static ULONG GetThreadCount(const ComponentTestOptions& options)
+{
+    if (options.Threads != 0)
+    {
+        return options.Threads;
+    }
+    ULONG processors = std::thread::hardware_concurrency();
+    return (processors > 1) ? processors - 1 : 1;
+}
+
+
+// Snapshot.
+//
+
+// Number of records in the snapshot of a generation, so that the size varies.
+//
+static unsigned int SnapshotRecordCount(unsigned int generation)
+{
+    return 1 + generation % 50;
+}
+
+// Packs the snapshot of a generation. Every record carries the generation in
+// its state and in its name, so a read that mixes two snapshots shows.
+//
+static void PackSnapshot(unsigned int generation, ChildRecords::Writer* pWriter)
+{
+    unsigned short name[8];
+    for (int k = 0; k < 8; k++)
+    {
+        name[k] = static_cast<unsigned short>(generation);
+    }
+    for (unsigned int i = 0; i < SnapshotRecordCount(generation); i++)
+    {
+        ChildRecords::Record record = { i + 1, 0x22, generation, 0, static_cast<int>(i) * 15, 100, 15,
+            name, 8, name, 0, i + 1 };
+        pWriter->Append(record);
+    }
+}
+
+// Checks that a snapshot read is one whole generation.
+//
+static bool IsWholeSnapshot(const std::vector<unsigned char>& data, unsigned int generation)
+{
+    ChildRecords::Reader reader(data.empty() ? NULL : &data[0], data.size());
+    ChildRecords::Record record;
+    unsigned int count = 0;
+    while (reader.Next(&record))
+    {
+        if ((record.ChildId != count + 1) || (record.State != generation) || (record.NameLength != 8) ||
+            (record.Name[7] != static_cast<unsigned short>(generation)))
+        {
+            return false;
+        }
+        count++;
+    }
+    return reader.IsValid() && (count == SnapshotRecordCount(generation));
+}
+
+// Publishes snapshots on one thread while readers check them on others.
+//
+static bool TestSnapshot(const ComponentTestOptions& options, SnapshotTestResult* pResult)
+{
+    // Owners are window handles, so the process ID cannot clash with a real one.
+    unsigned long long owner = (static_cast<unsigned long long>(GetCurrentProcessId()) << 32) | 1;
+    SnapshotPublisher publisher;
+    if (!publisher.Create(owner))
+    {
+        return false;
+    }
+    pResult->Readers = GetThreadCount(options);
+
+    std::atomic<bool> stop(false);
+    std::atomic<ULONGLONG> reads(0);
+    std::atomic<ULONGLONG> busyReads(0);
+    std::atomic<ULONGLONG> readNanoseconds(0);
+    std::atomic<ULONGLONG> tornReads(0);
+    std::vector<std::thread> readers;
+    for (ULONG r = 0; r < pResult->Readers; r++)
+    {
+        readers.push_back(std::thread([&]()
+        {
+            SnapshotReader reader;
+            if (!reader.Open(owner))
+            {
+                return;
+            }
+            std::vector<unsigned char> data;
+            ULONGLONG localReads = 0;
+            ULONGLONG localNanoseconds = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                unsigned int generation = 0;
+                ULONGLONG start = ComponentClock();
+                SharedSnapshot::ReadResult result = reader.Read(&data, &generation);
+                localNanoseconds += ComponentClock() - start;
+                if (result == SharedSnapshot::Read_Busy)
+                {
+                    busyReads++;
+                }
+                else if (result == SharedSnapshot::Read_OK)
+                {
+                    localReads++;
+                    if (!IsWholeSnapshot(data, generation))
+                    {
+                        tornReads++;
+                    }
+                }
+            }
+            reads += localReads;
+            readNanoseconds += localNanoseconds;
+        }));
+    }
+
+    ULONGLONG end = ComponentClock() + options.Seconds * 1000000000ULL;
+    unsigned int generation = 0;
+    while (ComponentClock() < end)
+    {
+        ChildRecords::Writer writer;
+        PackSnapshot(++generation, &writer);
+        publisher.Publish(writer.GetData(), writer.GetSize());
+    }
+    stop = true;
+    for (size_t r = 0; r < readers.size(); r++)
+    {
+        readers[r].join();
+    }
+    pResult->Publishes = generation;
+    pResult->Reads = reads;
+    pResult->BusyReads = busyReads;
+    pResult->ReadNanoseconds = readNanoseconds;
+    pResult->TornReads = tornReads;
+
+    // A snapshot too large for a buffer is reported to readers as overflowed.
+    std::vector<unsigned char> oversized(SharedSnapshot::BufferCapacity + 1);
+    bool published = publisher.Publish(&oversized[0], oversized.size());
+    SnapshotReader reader;
+    std::vector<unsigned char> data;
+    unsigned int overflowGeneration = 0;
+    pResult->OverflowReported = !published && reader.Open(owner) &&
+        (reader.Read(&data, &overflowGeneration) == SharedSnapshot::Read_Overflow);
+    return true;
+}
+
+
+// Change log.
+//
+
+// An item of the list that the change log describes.
+struct LoggedItem
+{
+    unsigned int Id;
+    std::wstring Name;
+    int Status;
+};
+
+// Gets a pseudo-random number, the same sequence on every run.
+//
+static unsigned int NextRandom(unsigned int* pState)
+{
+    *pState = *pState * 1103515245 + 12345;
+    return *pState >> 16;
+}
+
+// Applies logged changes to a mirror of the list. Returns false if a change
+// does not fit the mirror.
+//
+static bool ApplyChanges(const std::vector<ChangeEntry>& changes, std::vector<LoggedItem>* pMirror)
+{
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        const ChangeEntry& change = changes[i];
+        int count = static_cast<int>(pMirror->size());
+        int limit = (change.Type == Change_Insert) ? count + 1 : count;
+        if ((change.Index < 0) || (change.Index >= limit))
+        {
+            return false;
+        }
+        std::vector<LoggedItem>::iterator position = pMirror->begin() + change.Index;
+        if ((change.Type != Change_Insert) && (position->Id != change.ItemId))
+        {
+            return false;
+        }
+        switch (change.Type)
+        {
+        case Change_Insert:
+            {
+                LoggedItem item = { change.ItemId, change.Name, change.Status };
+                pMirror->insert(position, item);
+                break;
+            }
+        case Change_Remove:
+            pMirror->erase(position);
+            break;
+        case Change_Move:
+            {
+                if ((change.NewIndex < 0) || (change.NewIndex >= count))
+                {
+                    return false;
+                }
+                LoggedItem item = *position;
+                pMirror->erase(position);
+                pMirror->insert(pMirror->begin() + change.NewIndex, item);
+                break;
+            }
+        case Change_Rename:
+            position->Name = change.Name;
+            break;
+        case Change_Status:
+            position->Status = change.Status;
+            break;
+        }
+    }
+    return true;
+}
+
+// Checks that a mirror is the same as the list.
+//
+static bool IsSameList(const std::vector<LoggedItem>& list, const std::vector<LoggedItem>& mirror)
+{
+    if (list.size() != mirror.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        if ((list[i].Id != mirror[i].Id) || (list[i].Name != mirror[i].Name) || (list[i].Status != mirror[i].Status))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Changes a list at random and logs each change, while a mirror of the list
+// catches up from the log now and then. The log is kept small, so that the
+// mirror sometimes falls too far behind and must copy the list instead.
+//
+static void TestChangeLog(ChangeLogTestResult* pResult)
+{
+    const ULONG Changes = 200000;
+    ChangeLog log(64);
+    std::vector<LoggedItem> list;
+    std::vector<LoggedItem> mirror;
+    unsigned long long seen = 0;
+    unsigned int nextId = 1;
+    unsigned int random = 1;
+    std::vector<ChangeEntry> changes;
+    std::vector<unsigned char> packed;
+    std::vector<ChangeEntry> unpacked;
+    for (ULONG step = 0; step < Changes; step++)
+    {
+        unsigned int operation = NextRandom(&random) % 5;
+        int count = static_cast<int>(list.size());
+        int index = (count > 0) ? static_cast<int>(NextRandom(&random) % count) : 0;
+        if ((operation == 0) || (count == 0))
+        {
+            WCHAR name[16];
+            _snwprintf_s(name, _countof(name), _TRUNCATE, L"Contact %u", NextRandom(&random) % 100);
+            LoggedItem item = { nextId++, name, static_cast<int>(NextRandom(&random) % 2) };
+            index = static_cast<int>(NextRandom(&random) % (count + 1));
+            list.insert(list.begin() + index, item);
+            log.AddInsert(item.Id, index, item.Name.c_str(), item.Status);
+        }
+        else if (operation == 1)
+        {
+            log.AddRemove(list[index].Id, index);
+            list.erase(list.begin() + index);
+        }
+        else if (operation == 2)
+        {
+            int newIndex = static_cast<int>(NextRandom(&random) % count);
+            LoggedItem item = list[index];
+            list.erase(list.begin() + index);
+            list.insert(list.begin() + newIndex, item);
+            log.AddMove(item.Id, index, newIndex);
+        }
+        else if (operation == 3)
+        {
+            WCHAR name[16];
+            _snwprintf_s(name, _countof(name), _TRUNCATE, L"Renamed %lu", step);
+            list[index].Name = name;
+            log.AddRename(list[index].Id, index, name);
+        }
+        else
+        {
+            list[index].Status ^= 1;
+            log.AddStatus(list[index].Id, index, list[index].Status);
+        }
+
+        if (NextRandom(&random) % (1 + NextRandom(&random) % 100) != 0)
+        {
+            continue;
+        }
+        if (!log.GetChangesSince(seen, &changes))
+        {
+            mirror = list;
+            seen = log.GetLatestSequence();
+            pResult->Resyncs++;
+            continue;
+        }
+        ChangeLog::Pack(changes, &packed);
+        pResult->CatchUps++;
+        if (!ChangeLog::Unpack(&packed[0], packed.size(), &unpacked) || (unpacked.size() != changes.size())
+            || !ApplyChanges(unpacked, &mirror) || !IsSameList(list, mirror))
+        {
+            pResult->Mismatches++;
+            mirror = list;
+        }
+        seen = log.GetLatestSequence();
+    }
+    pResult->Changes = Changes;
+    pResult->FutureRefused = !log.GetChangesSince(log.GetLatestSequence() + 1, &changes);
+}
+
+
+// Roster.
+//
+
+// Applies edits from RosterDiff to a roster, counting the moves. Returns false
+// if an edit does not fit the roster or the result is not the new roster.
+//
+static bool ApplyRosterEdits(std::vector<unsigned int> ids, const std::vector<unsigned int>& newIds,
+    const std::vector<RosterEdit>& edits, size_t* pMoves)
+{
+    *pMoves = 0;
+    for (size_t i = 0; i < edits.size(); i++)
+    {
+        const RosterEdit& edit = edits[i];
+        if (edit.Type != RosterEdit_Insert)
+        {
+            if ((edit.Index < 0) || (edit.Index >= static_cast<int>(ids.size())) || (ids[edit.Index] != edit.Id))
+            {
+                return false;
+            }
+            ids.erase(ids.begin() + edit.Index);
+        }
+        if (edit.Type != RosterEdit_Remove)
+        {
+            int index = (edit.Type == RosterEdit_Move) ? edit.NewIndex : edit.Index;
+            if ((index < 0) || (index > static_cast<int>(ids.size())) || (newIds[edit.Source] != edit.Id))
+            {
+                return false;
+            }
+            ids.insert(ids.begin() + index, edit.Id);
+        }
+        if (edit.Type == RosterEdit_Move)
+        {
+            (*pMoves)++;
+        }
+    }
+    return ids == newIds;
+}
+
+// Gets the fewest moves that turn one roster into another: the items both
+// have, less the longest run of them that is already in order.
+//
+static size_t GetFewestMoves(const std::vector<unsigned int>& oldIds, const std::vector<unsigned int>& newIds)
+{
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < oldIds.size(); i++)
+    {
+        std::vector<unsigned int>::const_iterator found = std::find(newIds.begin(), newIds.end(), oldIds[i]);
+        if (found != newIds.end())
+        {
+            positions.push_back(found - newIds.begin());
+        }
+    }
+    std::vector<size_t> tails;
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        std::vector<size_t>::iterator tail = std::lower_bound(tails.begin(), tails.end(), positions[i]);
+        if (tail == tails.end())
+        {
+            tails.push_back(positions[i]);
+        }
+        else
+        {
+            *tail = positions[i];
+        }
+    }
+    return positions.size() - tails.size();
+}
+
+// Makes a new roster from an old one, removing, adding and moving one contact
+// in every perMille thousand on average each.
+//
+static void ChurnRoster(const std::vector<unsigned int>& oldIds, unsigned int perMille, unsigned int* pRandom,
+    std::vector<unsigned int>* pNewIds)
+{
+    unsigned int nextId = static_cast<unsigned int>(oldIds.size()) * 2 + 2;
+    std::vector<unsigned int> moving;
+    pNewIds->clear();
+    pNewIds->reserve(oldIds.size() + oldIds.size() * perMille / 1000 + 1);
+    for (size_t i = 0; i < oldIds.size(); i++)
+    {
+        unsigned int draw = NextRandom(pRandom) % 3000;
+        if (draw < perMille)
+        {
+            continue;
+        }
+        if (draw < perMille * 2)
+        {
+            moving.push_back(oldIds[i]);
+            continue;
+        }
+        if (draw < perMille * 3)
+        {
+            pNewIds->push_back(nextId++);
+        }
+        else if ((draw < perMille * 4) && !moving.empty())
+        {
+            // Take a random one of the contacts being moved.
+            size_t taken = NextRandom(pRandom) % moving.size();
+            pNewIds->push_back(moving[taken]);
+            moving[taken] = moving.back();
+            moving.pop_back();
+        }
+        pNewIds->push_back(oldIds[i]);
+    }
+    pNewIds->insert(pNewIds->end(), moving.begin(), moving.end());
+}
+
+// Checks RosterDiff on small random rosters, then times it on a large one.
+//
+static void TestRoster(const ComponentTestOptions& options, RosterTestResult* pResult)
+{
+    const ULONG trials = 20000;
+    unsigned int random = 5;
+    std::vector<unsigned int> oldIds;
+    std::vector<unsigned int> newIds;
+    std::vector<RosterEdit> edits;
+    for (ULONG t = 0; t < trials; t++)
+    {
+        oldIds.resize(NextRandom(&random) % 30);
+        for (size_t i = 0; i < oldIds.size(); i++)
+        {
+            oldIds[i] = static_cast<unsigned int>(i) * 2 + 1;
+        }
+        ChurnRoster(oldIds, NextRandom(&random) % 1000, &random, &newIds);
+        if ((t % 5) == 0)
+        {
+            // Some rosters are shuffled, to give many moves.
+            for (size_t i = newIds.size(); i > 1; i--)
+            {
+                std::swap(newIds[i - 1], newIds[NextRandom(&random) % i]);
+            }
+        }
+        size_t moves = 0;
+        if (!RosterDiff::Compute(oldIds, newIds, &edits) || !ApplyRosterEdits(oldIds, newIds, edits, &moves))
+        {
+            pResult->Mismatches++;
+        }
+        else if (moves != GetFewestMoves(oldIds, newIds))
+        {
+            pResult->NotMinimal++;
+        }
+        pResult->Trials++;
+    }
+
+    // 1% churn is a third of a percent each of removals, additions and moves.
+    pResult->Entries = options.Names;
+    oldIds.resize(options.Names);
+    for (size_t i = 0; i < oldIds.size(); i++)
+    {
+        oldIds[i] = static_cast<unsigned int>(i) * 2 + 1;
+    }
+    ChurnRoster(oldIds, 10, &random, &newIds);
+    ULONGLONG duration = options.Seconds * 500000000ULL;
+    ULONGLONG start = ComponentClock();
+    do
+    {
+        if (!RosterDiff::Compute(oldIds, newIds, &edits))
+        {
+            pResult->Mismatches++;
+            break;
+        }
+        pResult->Diffs++;
+    } while (ComponentClock() - start < duration);
+    pResult->Nanoseconds = ComponentClock() - start;
+    pResult->Edits = static_cast<ULONG>(edits.size());
+}
+
+
+// Search.
+//
+
+// Gets a generated name, folded as the contact index folds names.
+//
+static std::wstring GenerateName(unsigned int* pRandom)
+{
+    static const wchar_t* const firstNames[] = { L"frank", L"sandra", L"kim", L"prakesh", L"silvio",
+        L"maria", L"john", L"wei", L"olga", L"ahmed" };
+    static const wchar_t* const lastNames[] = { L"smith", L"garcia", L"nguyen", L"kumar", L"rossi",
+        L"muller", L"tanaka", L"okafor" };
+    unsigned int first = NextRandom(pRandom) % _countof(firstNames);
+    unsigned int last = NextRandom(pRandom) % _countof(lastNames);
+    WCHAR name[64];
+    _snwprintf_s(name, _countof(name), _TRUNCATE, L"%ls %ls %u", firstNames[first], lastNames[last],
+        NextRandom(pRandom) % 100000);
+    return name;
+}
+
+// Finds names through the trigram index, keeping the candidates that do
+// contain the query, as ContactIndex does.
+//
+static void FindWithTrigrams(const TrigramIndex& trigrams, const std::vector<std::wstring>& names,
+    const wchar_t* query, std::vector<unsigned int>* pItemIds)
+{
+    trigrams.Find(query, pItemIds);
+    size_t kept = 0;
+    for (size_t i = 0; i < pItemIds->size(); i++)
+    {
+        unsigned int id = (*pItemIds)[i];
+        if (names[id - 1].find(query) != std::wstring::npos)
+        {
+            (*pItemIds)[kept++] = id;
+        }
+    }
+    pItemIds->resize(kept);
+}
+
+// Indexes generated names with the trigram index and the linear scan, checks
+// that both find the same names, and times each. Returns false if the index
+// could not be saved and mapped.
+//
+static bool TestSearch(const ComponentTestOptions& options, SearchTestResult* pResult)
+{
+    static const wchar_t* const queries[] = { L"prakesh kumar 4242", L"rossi 777", L"91234", L"kim",
+        L"olga okafor", L"wei tanaka 1", L"garcia 5", L"dra sm" };
+    pResult->Names = options.Names;
+    pResult->Queries = _countof(queries);
+
+    unsigned int random = 3;
+    std::vector<std::wstring> names(options.Names);
+    NameSearch scan;
+    TrigramIndex trigrams;
+    ULONGLONG start = ComponentClock();
+    for (ULONG i = 0; i < options.Names; i++)
+    {
+        names[i] = GenerateName(&random);
+        trigrams.Add(i + 1, names[i].c_str());
+    }
+    char directory[MAX_PATH];
+    char path[MAX_PATH];
+    if ((GetTempPathA(MAX_PATH, directory) == 0) || (GetTempFileNameA(directory, "tgi", 0, path) == 0))
+    {
+        return false;
+    }
+    bool saved = trigrams.Save(path, options.Names);
+    pResult->BuildNanoseconds = ComponentClock() - start;
+    start = ComponentClock();
+    bool loaded = saved && trigrams.Load(path, options.Names);
+    pResult->LoadNanoseconds = ComponentClock() - start;
+    if (!loaded)
+    {
+        trigrams.Clear();
+        DeleteFileA(path);
+        return false;
+    }
+    pResult->ImageBytes = trigrams.GetImageSize();
+    for (ULONG i = 0; i < options.Names; i++)
+    {
+        scan.Add(i + 1, names[i].c_str());
+    }
+
+    std::vector<unsigned int> found;
+    std::vector<unsigned int> scanned;
+    for (size_t q = 0; q < _countof(queries); q++)
+    {
+        FindWithTrigrams(trigrams, names, queries[q], &found);
+        scan.Find(queries[q], &scanned);
+        if (found != scanned)
+        {
+            pResult->Mismatches++;
+        }
+    }
+
+    // Each path gets half the time.
+    ULONGLONG duration = options.Seconds * 500000000ULL;
+    start = ComponentClock();
+    do
+    {
+        FindWithTrigrams(trigrams, names, queries[pResult->TrigramSearches % _countof(queries)], &found);
+        pResult->TrigramSearches++;
+    } while (ComponentClock() - start < duration);
+    pResult->TrigramNanoseconds = ComponentClock() - start;
+    start = ComponentClock();
+    do
+    {
+        scan.Find(queries[pResult->ScanSearches % _countof(queries)], &scanned);
+        pResult->ScanSearches++;
+    } while (ComponentClock() - start < duration);
+    pResult->ScanNanoseconds = ComponentClock() - start;
+
+    // The mapped file is closed before it is deleted.
+    trigrams.Clear();
+    DeleteFileA(path);
+    return true;
+}
+
+// Times the linear scan over generated names, as type-ahead searches them.
+//
+static void RunSubstringSearches(const ComponentTestOptions& options, ULONG names, SubstringRun* pRun)
+{
+    static const wchar_t* const queries[] = { L"prakesh kumar 4242", L"rossi 777", L"91234", L"kim",
+        L"olga okafor", L"wei tanaka 1", L"garcia 5", L"dra sm" };
+    pRun->Names = names;
+    unsigned int random = 3;
+    NameSearch scan;
+    for (ULONG i = 0; i < names; i++)
+    {
+        scan.Add(i + 1, GenerateName(&random).c_str());
+    }
+    pRun->TextBytes = scan.GetTextSize() * sizeof(unsigned short);
+
+    // Each run gets half the time.
+    std::vector<unsigned int> found;
+    ULONGLONG duration = options.Seconds * 500000000ULL;
+    ULONGLONG start = ComponentClock();
+    ULONGLONG now = start;
+    do
+    {
+        ULONGLONG searchStart = now;
+        scan.Find(queries[pRun->Searches % _countof(queries)], &found);
+        now = ComponentClock();
+        pRun->LongestNanoseconds = (std::max)(pRun->LongestNanoseconds, now - searchStart);
+        pRun->Searches++;
+    } while (now - start < duration);
+    pRun->Nanoseconds = now - start;
+}
+
+// Times the linear scan over the given number of names and ten times as many.
+//
+static void TestSubstring(const ComponentTestOptions& options, SubstringTestResult* pResult)
+{
+    RunSubstringSearches(options, options.Names, &pResult->Runs[pResult->RunCount++]);
+    RunSubstringSearches(options, options.Names * 10, &pResult->Runs[pResult->RunCount++]);
+}
+
+// Gets a name in upper case. Generated names are ASCII.
+//
+static std::wstring ToUpper(const std::wstring& name)
+{
+    std::wstring upper(name);
+    for (size_t i = 0; i < upper.size(); i++)
+    {
+        if ((upper[i] >= L'a') && (upper[i] <= L'z'))
+        {
+            upper[i] = static_cast<wchar_t>(upper[i] - L'a' + L'A');
+        }
+    }
+    return upper;
+}
+
+// Indexes generated names, looks names taken from them up in the ways the
+// find query can, checks that each lookup finds the name, and times each way.
+//
+static void TestLookup(const ComponentTestOptions& options, LookupTestResult* pResult)
+{
+    static const NameMatch matches[LookupTestResult::KindCount] = { Match_Exact, Match_ExactIgnoreCase,
+        Match_Prefix, Match_PrefixIgnoreCase };
+    pResult->Names = options.Names;
+
+    unsigned int random = 5;
+    std::vector<std::wstring> names(options.Names);
+    ContactIndex index;
+    ULONGLONG start = ComponentClock();
+    for (ULONG i = 0; i < options.Names; i++)
+    {
+        names[i] = GenerateName(&random);
+        index.Add(i + 1, names[i].c_str(), i % 4);
+    }
+    pResult->BuildNanoseconds = ComponentClock() - start;
+
+    // Each kind of lookup gets a quarter of the time. The prefixes leave off
+    // the last two digits, so that each matches up to a hundred names.
+    std::vector<unsigned int> found;
+    ULONGLONG duration = options.Seconds * 250000000ULL;
+    for (ULONG kind = 0; kind < LookupTestResult::KindCount; kind++)
+    {
+        NameMatch match = matches[kind];
+        start = ComponentClock();
+        ULONGLONG now = start;
+        do
+        {
+            unsigned int id = ((NextRandom(&random) << 16) | NextRandom(&random)) % options.Names + 1;
+            std::wstring query = names[id - 1];
+            if ((match == Match_Prefix) || (match == Match_PrefixIgnoreCase))
+            {
+                query.resize(query.size() - 2);
+            }
+            if ((match == Match_ExactIgnoreCase) || (match == Match_PrefixIgnoreCase))
+            {
+                query = ToUpper(query);
+            }
+            ULONGLONG lookupStart = ComponentClock();
+            index.Find(query.c_str(), match, AnyStatus, &found);
+            now = ComponentClock();
+            pResult->LongestNanoseconds[kind] = (std::max)(pResult->LongestNanoseconds[kind], now - lookupStart);
+            pResult->Nanoseconds[kind] += now - lookupStart;
+            pResult->Results[kind] += found.size();
+            pResult->Lookups[kind]++;
+            if (std::find(found.begin(), found.end(), id) == found.end())
+            {
+                pResult->Misses++;
+            }
+        } while (now - start < duration);
+    }
+}
+
+// Checks whether two approximate searches found the same names.
+//
+static bool IsSameMatches(const std::vector<ApproximateMatch>& first, const std::vector<ApproximateMatch>& second)
+{
+    if (first.size() != second.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < first.size(); i++)
+    {
+        if ((first[i].ItemId != second[i].ItemId) || (first[i].Errors != second[i].Errors))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Times approximate searches for each prefix of a misspelled name, as it is
+// typed, on the calling thread and with a pool, and checks that both find the
+// same names. Then times how quickly a slow search stops once cancelled.
+//
+static void TestFuzzy(const ComponentTestOptions& options, FuzzyTestResult* pResult)
+{
+    // The generated names have "prakesh kumar", so the typed name is one error
+    // away. Type-ahead allows one error and takes the best match.
+    static const wchar_t typed[] = L"prakash kumar";
+    const size_t keys = _countof(typed) - 1;
+    const size_t maxResults = 10;
+    pResult->Names = options.Names;
+
+    unsigned int random = 3;
+    NameSearch scan;
+    for (ULONG i = 0; i < options.Names; i++)
+    {
+        scan.Add(i + 1, GenerateName(&random).c_str());
+    }
+    std::vector<std::vector<ApproximateMatch> > expected(keys);
+    for (size_t k = 0; k < keys; k++)
+    {
+        scan.FindApproximate(std::wstring(typed, k + 1).c_str(), 1, maxResults, &expected[k]);
+    }
+    pResult->BestFound = !expected[keys - 1].empty() && (expected[keys - 1][0].Errors == 1);
+
+    // Each run gets half the time.
+    WorkExecutor executor;
+    ULONG threads = GetThreadCount(options);
+    if (!executor.Start(threads, NULL, NULL))
+    {
+        threads = 0;
+    }
+    std::vector<ApproximateMatch> matches;
+    ULONGLONG duration = options.Seconds * 500000000ULL;
+    for (ULONG r = 0; r < FuzzyTestResult::MaxRuns; r++)
+    {
+        FuzzyRun& run = pResult->Runs[pResult->RunCount++];
+        run.Threads = (r == 0) ? 0 : threads;
+        WorkExecutor* pExecutor = (run.Threads > 0) ? &executor : NULL;
+        ULONGLONG start = ComponentClock();
+        ULONGLONG now = start;
+        do
+        {
+            size_t k = static_cast<size_t>(run.Keystrokes % keys);
+            ULONGLONG searchStart = now;
+            scan.FindApproximate(std::wstring(typed, k + 1).c_str(), 1, maxResults, &matches, pExecutor);
+            now = ComponentClock();
+            run.LongestNanoseconds = (std::max)(run.LongestNanoseconds, now - searchStart);
+            run.Keystrokes++;
+            if (!IsSameMatches(matches, expected[k]))
+            {
+                pResult->Mismatches++;
+            }
+        } while (now - start < duration);
+        run.Nanoseconds = now - start;
+        if (threads == 0)
+        {
+            break;
+        }
+    }
+
+    // A long query with three errors allowed is slow enough to be cancelled
+    // part way through.
+    SearchCancellation cancel;
+    unsigned int generation = cancel.Begin();
+    std::atomic<ULONGLONG> returned(0);
+    bool found = true;
+    std::thread searcher(
+        [&]()
+        {
+            std::vector<ApproximateMatch> slowMatches;
+            found = scan.FindApproximate(L"sandra garcia 12345", 3, maxResults, &slowMatches, NULL, &cancel,
+                generation);
+            returned = ComponentClock();
+        });
+    Sleep(1);
+    ULONGLONG cancelled = ComponentClock();
+    cancel.Cancel();
+    searcher.join();
+    pResult->Cancelled = !found;
+    pResult->CancelNanoseconds = found ? 0 : returned - cancelled;
+    executor.Stop();
+}
+
+
+// Footprint.
+//
+
+#ifdef ACCSERVER_STATS
+
+// Gets the bytes in use, by tag.
+//
+static void GetLiveBytes(ULONGLONG* pLiveBytes)
+{
+    MemoryTagStats stats[MemoryTag_Count + 1];
+    MemoryStats::Collect(stats);
+    for (int tag = 0; tag < MemoryTag_Count; tag++)
+    {
+        pLiveBytes[tag] = stats[tag].LiveBytes;
+    }
+}
+
+// Builds a contact model of generated contacts, and measures the memory it
+// uses and the memory it leaves in use once it is released.
+//
+static void MeasureFootprint(ULONG contacts, FootprintRun* pRun)
+{
+    pRun->Contacts = contacts;
+    ULONGLONG before[MemoryTag_Count];
+    GetLiveBytes(before);
+    ContactModel* pModel = new (std::nothrow) ContactModel();
+    if (pModel == NULL)
+    {
+        return;
+    }
+    unsigned int random = 3;
+    pModel->BeginUpdate();
+    for (ULONG i = 0; i < contacts; i++)
+    {
+        WCHAR name[64];
+        wcscpy_s(name, _countof(name), GenerateName(&random).c_str());
+        pModel->AddItem(static_cast<ContactStatus>(i % 4), name);
+    }
+    pModel->EndUpdate();
+
+    ULONGLONG after[MemoryTag_Count];
+    GetLiveBytes(after);
+    for (int tag = 0; tag < MemoryTag_Count; tag++)
+    {
+        ULONGLONG bytes = (after[tag] > before[tag]) ? after[tag] - before[tag] : 0;
+        switch (tag)
+        {
+        case MemoryTag_Items:
+            pRun->ItemBytes = bytes;
+            break;
+        case MemoryTag_Names:
+            pRun->NameBytes = bytes;
+            break;
+        case MemoryTag_Indexes:
+            pRun->IndexBytes = bytes;
+            break;
+        default:
+            pRun->OtherBytes += bytes;
+            break;
+        }
+    }
+
+    pModel->Release();
+    GetLiveBytes(after);
+    for (int tag = 0; tag < MemoryTag_Count; tag++)
+    {
+        pRun->LeakedBytes += (after[tag] > before[tag]) ? after[tag] - before[tag] : 0;
+    }
+}
+
+#endif
+
+// Measures the memory used per contact at each size, if memory is counted.
+//
+static void TestFootprint(FootprintTestResult* pResult)
+{
+#ifdef ACCSERVER_STATS
+    static const ULONG sizes[FootprintTestResult::MaxRuns] = { 1000, 100000, 1000000 };
+    pResult->Counted = true;
+    for (ULONG i = 0; i < FootprintTestResult::MaxRuns; i++)
+    {
+        MeasureFootprint(sizes[i], &pResult->Runs[pResult->RunCount++]);
+    }
+#else
+    pResult->Counted = false;
+#endif
+}
+
+
+// Executor.
+//
+
+// Does a fixed amount of work that the compiler cannot leave out.
+//
+static unsigned int SpinWork(unsigned int seed)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+    }
+    return seed;
+}
+
+// Runs a batch of items on a pool of the given size, and checks that each ran
+// and completed as it should. Returns the number of items that did not.
+//
+static ULONG RunExecutorBatch(ULONG threads, ULONG items, ULONGLONG* pNanoseconds)
+{
+    WorkExecutor executor;
+    if (!executor.Start(threads, NULL, NULL))
+    {
+        return items;
+    }
+    std::vector<unsigned int> results(items, 0);
+    std::vector<unsigned char> completions(items, 0);
+    std::vector<unsigned char> cancellations(items, 0);
+    ULONG completed = 0;
+    CancellationSource source;
+    CancellationSource never;
+    ULONGLONG start = ComponentClock();
+    for (ULONG i = 0; i < items; i++)
+    {
+        // Every tenth item can be cancelled, and is, once half have been submitted.
+        if (i == items / 2)
+        {
+            source.Cancel();
+        }
+        unsigned int* pResult = &results[i];
+        executor.Submit(
+            [pResult, i](const CancellationToken& /*token*/)
+            {
+                *pResult = SpinWork(i) | 1;
+            },
+            [&completions, &cancellations, &completed, i](bool cancelled)
+            {
+                completions[i]++;
+                cancellations[i] = cancelled ? 1 : 0;
+                completed++;
+            },
+            (i % 10 == 9) ? source.GetToken() : never.GetToken(), static_cast<WorkPriority>(i % WorkPriority_Count));
+    }
+    while (completed < items)
+    {
+        executor.RunCompletions();
+        Sleep(0);
+    }
+    *pNanoseconds = ComponentClock() - start;
+    executor.Stop();
+
+    // Items cancelled before they were submitted must not run; the others must.
+    ULONG errors = 0;
+    for (ULONG i = 0; i < items; i++)
+    {
+        bool cancellable = (i % 10 == 9);
+        bool cancelledFirst = cancellable && (i >= items / 2);
+        bool ran = (results[i] != 0);
+        if ((completions[i] != 1) || (cancelledFirst && ran) || (!cancellable && (!ran || cancellations[i])))
+        {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+// Runs the batch on pools of growing size, then checks that Stop discards
+// queued items rather than running them.
+//
+static void TestExecutor(const ComponentTestOptions& options, ExecutorTestResult* pResult)
+{
+    pResult->Items = 20000;
+    ULONG maxThreads = GetThreadCount(options);
+    for (ULONG threads = 1; pResult->RunCount < ExecutorTestResult::MaxRuns; threads *= 2)
+    {
+        threads = (std::min)(threads, maxThreads);
+        ExecutorRun& run = pResult->Runs[pResult->RunCount++];
+        run.Threads = threads;
+        pResult->Errors += RunExecutorBatch(threads, pResult->Items, &run.Nanoseconds);
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    WorkExecutor executor;
+    if (!executor.Start(1, NULL, NULL))
+    {
+        return;
+    }
+    std::atomic<ULONG> ran(0);
+    pResult->StopQueued = 1000;
+    for (ULONG i = 0; i < pResult->StopQueued; i++)
+    {
+        executor.Submit(
+            [&ran](const CancellationToken& /*token*/)
+            {
+                Sleep(1);
+                ran++;
+            },
+            WorkExecutor::CompletionFunction(), CancellationToken());
+    }
+    ULONGLONG start = ComponentClock();
+    executor.Stop();
+    pResult->StopNanoseconds = ComponentClock() - start;
+    pResult->StopRan = ran;
+}
+
+
+// Layout.
+//
+
+// A layout that is not specialized: the height is a member, and the control
+// would call it through the base class.
+class GenericLayout
+{
+public:
+    virtual ~GenericLayout()
+    {
+    }
+    virtual int IndexFromY(int y, int count) const = 0;
+    virtual int GetItemTop(int index) const = 0;
+};
+
+class RuntimeHeightLayout : public GenericLayout
+{
+private:
+    int m_height;
+
+public:
+    RuntimeHeightLayout(int height) : m_height(height)
+    {
+    }
+    virtual int IndexFromY(int y, int count) const
+    {
+        int index = y / m_height;
+        return ((index < 0) || (count <= index)) ? -1 : index;
+    }
+    virtual int GetItemTop(int index) const
+    {
+        return index * m_height;
+    }
+};
+
+// Maps every point of a long list to an item, and every item to its top, with
+// the control's layout and with the generic one, and checks that they agree.
+//
+static void TestLayout(const ComponentTestOptions& options, LayoutTestResult* pResult)
+{
+    const int count = 100000;
+    const int extent = count * ItemLayout::ItemHeight;
+    ItemLayout fixed;
+
+    // The compiler cannot see through a volatile pointer, or a height read from
+    // a volatile, so the calls stay virtual and the divisions stay divisions.
+    volatile int height = ItemLayout::ItemHeight;
+    RuntimeHeightLayout runtime(height);
+    GenericLayout* volatile pVolatileGeneric = &runtime;
+    GenericLayout* pGeneric = pVolatileGeneric;
+
+    for (int y = -ItemLayout::ItemHeight; y < extent + ItemLayout::ItemHeight; y++)
+    {
+        if (fixed.IndexFromY(y, count) != pGeneric->IndexFromY(y, count))
+        {
+            pResult->Mismatches++;
+        }
+    }
+    for (int index = 0; index < count; index++)
+    {
+        if (fixed.GetItemTop(index) != pGeneric->GetItemTop(index))
+        {
+            pResult->Mismatches++;
+        }
+    }
+
+    // Each layout gets half the time, in whole passes over the list.
+    ULONGLONG duration = options.Seconds * 500000000ULL;
+    unsigned int sink = 0;
+    ULONGLONG start = ComponentClock();
+    ULONGLONG passes = 0;
+    do
+    {
+        for (int y = 0; y < extent; y++)
+        {
+            sink += static_cast<unsigned int>(fixed.IndexFromY(y, count));
+        }
+        for (int index = 0; index < extent; index++)
+        {
+            sink += static_cast<unsigned int>(fixed.GetItemTop(index % count));
+        }
+        passes++;
+    } while (ComponentClock() - start < duration);
+    pResult->FixedNanoseconds = ComponentClock() - start;
+    ULONGLONG fixedPasses = passes;
+
+    start = ComponentClock();
+    passes = 0;
+    do
+    {
+        for (int y = 0; y < extent; y++)
+        {
+            sink += static_cast<unsigned int>(pGeneric->IndexFromY(y, count));
+        }
+        for (int index = 0; index < extent; index++)
+        {
+            sink += static_cast<unsigned int>(pGeneric->GetItemTop(index % count));
+        }
+        passes++;
+    } while (ComponentClock() - start < duration);
+    pResult->GenericNanoseconds = ComponentClock() - start;
+
+    // Report the time for the same number of calls on each.
+    pResult->Calls = fixedPasses * extent * 2;
+    pResult->GenericNanoseconds = pResult->GenericNanoseconds * fixedPasses / passes;
+    volatile unsigned int result = sink;
+    (void)result;
+}
+
+
+// Runs every part. Returns false if a part could not be run at all.
+//
+bool ComponentTest::Run(const ComponentTestOptions& options, ComponentTestReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(ComponentTestReport));
+    pReport->Options = options;
+
+    if (!TestSnapshot(options, &pReport->Snapshot))
+    {
+        return false;
+    }
+    if ((pReport->Snapshot.TornReads != 0) || !pReport->Snapshot.OverflowReported)
+    {
+        pReport->Failures++;
+    }
+
+    TestChangeLog(&pReport->ChangeLog);
+    if ((pReport->ChangeLog.Mismatches != 0) || !pReport->ChangeLog.FutureRefused)
+    {
+        pReport->Failures++;
+    }
+
+    if (pReport->Options.Names > 0)
+    {
+        TestRoster(options, &pReport->Roster);
+    }
+    if ((pReport->Roster.Mismatches != 0) || (pReport->Roster.NotMinimal != 0))
+    {
+        pReport->Failures++;
+    }
+
+    if ((pReport->Options.Names > 0) && !TestSearch(options, &pReport->Search))
+    {
+        return false;
+    }
+    if (pReport->Search.Mismatches != 0)
+    {
+        pReport->Failures++;
+    }
+
+    if (pReport->Options.Names > 0)
+    {
+        TestSubstring(options, &pReport->Substring);
+        TestLookup(options, &pReport->Lookup);
+        TestFuzzy(options, &pReport->Fuzzy);
+    }
+    if (pReport->Lookup.Misses != 0)
+    {
+        pReport->Failures++;
+    }
+    if ((pReport->Options.Names > 0) && ((pReport->Fuzzy.Mismatches != 0) || !pReport->Fuzzy.BestFound))
+    {
+        pReport->Failures++;
+    }
+
+    TestFootprint(&pReport->Footprint);
+    for (ULONG i = 0; i < pReport->Footprint.RunCount; i++)
+    {
+        if (pReport->Footprint.Runs[i].LeakedBytes != 0)
+        {
+            pReport->Failures++;
+        }
+    }
+
+    TestExecutor(options, &pReport->Executor);
+    if ((pReport->Executor.Errors != 0) || (pReport->Executor.StopRan == pReport->Executor.StopQueued))
+    {
+        pReport->Failures++;
+    }
+
+    TestLayout(options, &pReport->Layout);
+    if (pReport->Layout.Mismatches != 0)
+    {
+        pReport->Failures++;
+    }
+    return true;
+}
+
+bool ComponentTest::WriteReport(const ComponentTestReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    const SnapshotTestResult& snapshot = report.Snapshot;
+    double seconds = (report.Options.Seconds > 0) ? report.Options.Seconds : 1.0;
+    fprintf(pFile, "snapshot: %I64u published, %lu readers, %I64u reads (%.0f/s), %.0f ns/read, %I64u busy, "
+        "%I64u torn, overflow %s\n",
+        snapshot.Publishes, snapshot.Readers, snapshot.Reads, snapshot.Reads / seconds,
+        (snapshot.Reads > 0) ? static_cast<double>(snapshot.ReadNanoseconds) / snapshot.Reads : 0.0,
+        snapshot.BusyReads, snapshot.TornReads, snapshot.OverflowReported ? "reported" : "NOT reported");
+    const ChangeLogTestResult& changeLog = report.ChangeLog;
+    fprintf(pFile, "changelog: %lu changes, %lu catch-ups, %lu resyncs, %lu mismatches, future sequence %s\n",
+        changeLog.Changes, changeLog.CatchUps, changeLog.Resyncs, changeLog.Mismatches,
+        changeLog.FutureRefused ? "refused" : "NOT refused");
+    const RosterTestResult& roster = report.Roster;
+    fprintf(pFile, "roster: %lu checked, %lu mismatches, %lu not minimal; %lu entries, %lu edits, %.1f ms/diff\n",
+        roster.Trials, roster.Mismatches, roster.NotMinimal, roster.Entries, roster.Edits,
+        (roster.Diffs > 0) ? roster.Nanoseconds / 1e6 / roster.Diffs : 0.0);
+    const SearchTestResult& search = report.Search;
+    fprintf(pFile, "search: %lu names, index %I64u bytes (%.2f per name), built and saved in %.1f ms, mapped in %.2f ms, "
+        "%lu queries, %lu mismatches\n",
+        search.Names, search.ImageBytes, (search.Names > 0) ? static_cast<double>(search.ImageBytes) / search.Names : 0.0,
+        search.BuildNanoseconds / 1e6, search.LoadNanoseconds / 1e6, search.Queries, search.Mismatches);
+    fprintf(pFile, "search: trigram index %.1f us/query, linear scan %.1f us/query\n",
+        (search.TrigramSearches > 0) ? search.TrigramNanoseconds / 1e3 / search.TrigramSearches : 0.0,
+        (search.ScanSearches > 0) ? search.ScanNanoseconds / 1e3 / search.ScanSearches : 0.0);
+    const SubstringTestResult& substring = report.Substring;
+    for (ULONG i = 0; i < substring.RunCount; i++)
+    {
+        const SubstringRun& run = substring.Runs[i];
+        fprintf(pFile, "substring: %lu names, %I64u bytes, %.1f us/query, longest %.1f us, %.2f GB/s\n",
+            run.Names, run.TextBytes, (run.Searches > 0) ? run.Nanoseconds / 1e3 / run.Searches : 0.0,
+            run.LongestNanoseconds / 1e3,
+            (run.Nanoseconds > 0) ? static_cast<double>(run.TextBytes) * run.Searches / run.Nanoseconds : 0.0);
+    }
+    static const char* const lookupKinds[LookupTestResult::KindCount] = { "exact", "exact ignoring case",
+        "prefix", "prefix ignoring case" };
+    const LookupTestResult& lookup = report.Lookup;
+    fprintf(pFile, "lookup: %lu names, indexed in %.1f ms, %lu misses\n",
+        lookup.Names, lookup.BuildNanoseconds / 1e6, lookup.Misses);
+    for (ULONG i = 0; i < LookupTestResult::KindCount; i++)
+    {
+        fprintf(pFile, "lookup: %s %.2f us/lookup, longest %.1f us, %.1f results/lookup\n", lookupKinds[i],
+            (lookup.Lookups[i] > 0) ? lookup.Nanoseconds[i] / 1e3 / lookup.Lookups[i] : 0.0,
+            lookup.LongestNanoseconds[i] / 1e3,
+            (lookup.Lookups[i] > 0) ? static_cast<double>(lookup.Results[i]) / lookup.Lookups[i] : 0.0);
+    }
+    const FuzzyTestResult& fuzzy = report.Fuzzy;
+    for (ULONG i = 0; i < fuzzy.RunCount; i++)
+    {
+        const FuzzyRun& run = fuzzy.Runs[i];
+        fprintf(pFile, "fuzzy: %lu names, %lu helping threads, %.2f ms/keystroke, longest %.2f ms, %.0f names/s\n",
+            fuzzy.Names, run.Threads, (run.Keystrokes > 0) ? run.Nanoseconds / 1e6 / run.Keystrokes : 0.0,
+            run.LongestNanoseconds / 1e6,
+            (run.Nanoseconds > 0) ? static_cast<double>(fuzzy.Names) * run.Keystrokes * 1e9 / run.Nanoseconds : 0.0);
+    }
+    if (fuzzy.Cancelled)
+    {
+        fprintf(pFile, "fuzzy: %lu mismatches, best match %s, cancelled search returned in %.2f ms\n",
+            fuzzy.Mismatches, fuzzy.BestFound ? "found" : "NOT found", fuzzy.CancelNanoseconds / 1e6);
+    }
+    else
+    {
+        fprintf(pFile, "fuzzy: %lu mismatches, best match %s, search finished before it was cancelled\n",
+            fuzzy.Mismatches, fuzzy.BestFound ? "found" : "NOT found");
+    }
+    const FootprintTestResult& footprint = report.Footprint;
+    if (!footprint.Counted)
+    {
+        fprintf(pFile, "footprint: not compiled in (build with ACCSERVER_STATS defined)\n");
+    }
+    for (ULONG i = 0; i < footprint.RunCount; i++)
+    {
+        const FootprintRun& run = footprint.Runs[i];
+        double contacts = (run.Contacts > 0) ? run.Contacts : 1.0;
+        fprintf(pFile, "footprint: %lu contacts, %.1f bytes/contact (items %.1f, names %.1f, indexes %.1f, "
+            "other %.1f), %I64u bytes not freed\n",
+            run.Contacts, (run.ItemBytes + run.NameBytes + run.IndexBytes + run.OtherBytes) / contacts,
+            run.ItemBytes / contacts, run.NameBytes / contacts, run.IndexBytes / contacts, run.OtherBytes / contacts,
+            run.LeakedBytes);
+    }
+    const ExecutorTestResult& executor = report.Executor;
+    for (ULONG i = 0; i < executor.RunCount; i++)
+    {
+        const ExecutorRun& run = executor.Runs[i];
+        double itemsPerSecond = (run.Nanoseconds > 0) ? executor.Items * 1e9 / run.Nanoseconds : 0.0;
+        double speedup = (run.Nanoseconds > 0) ? static_cast<double>(executor.Runs[0].Nanoseconds) / run.Nanoseconds : 0.0;
+        fprintf(pFile, "executor: %lu threads, %.0f items/s, %.2fx one thread\n", run.Threads, itemsPerSecond, speedup);
+    }
+    fprintf(pFile, "executor: %lu errors, Stop took %.1f ms and ran %lu of %lu queued items\n",
+        executor.Errors, executor.StopNanoseconds / 1e6, executor.StopRan, executor.StopQueued);
+    const LayoutTestResult& layout = report.Layout;
+    fprintf(pFile, "layout: fixed height %.2f ns/call, generic %.2f ns/call, %lu mismatches\n",
+        (layout.Calls > 0) ? static_cast<double>(layout.FixedNanoseconds) / layout.Calls : 0.0,
+        (layout.Calls > 0) ? static_cast<double>(layout.GenericNanoseconds) / layout.Calls : 0.0, layout.Mismatches);
+    fprintf(pFile, "result: %lu failed\n", report.Failures);
+#ifdef ACCSERVER_STATS
+    fputs(MemoryStats::FormatReport().c_str(), pFile);
+#endif
+    fclose(pFile);
+    return true;
+}
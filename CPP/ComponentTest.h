@@ -0,0 +1,244 @@
+/*************************************************************************************************
+* Description: Declarations for the component test, which checks the building blocks of the
+* sample on their own, without a window, and measures them.
+*
+* Each part of the report covers one component:
+*   snapshot    A publisher thread publishes snapshots, each tagged with its generation in
+*               every record, while reader threads read them. A read that mixes two snapshots
+*               is counted as torn. The report gives the reads per second and per read.
+*   changelog   Random inserts, removals, moves, renames and status changes are made to a
+*               list and logged, while a mirror of the list catches up from the log at random
+*               intervals, through Pack and Unpack as a client would. Any difference between
+*               the mirror and the list is counted.
+*   roster      RosterDiff computes the edits between many small random rosters, which are
+*               applied to the old roster and checked against the new one; edit scripts that
+*               do not produce it, or that move more items than the fewest possible, are
+*               counted. The report gives the time to diff a roster of the given number of
+*               contacts with 1% churn: a third removed, a third added and a third moved.
+*   search      Generated names are indexed both ways that substring searches use: the
+*               trigram index, saved to a temporary file and mapped from it as at startup,
+*               and the linear scan of NameSearch. The same queries are made through both,
+*               and a query whose verified trigram candidates differ from the scan's results
+*               is counted. The report gives the time per query on each path.
+*   substring   The linear scan that type-ahead and substring searches use runs over the given
+*               number of generated names and over ten times as many. The report gives, for
+*               each, the time per query, the longest query, and the rate at which the folded
+*               names are scanned.
+*   lookup      The given number of generated names are added to the contact index, and names
+*               taken from them at random are looked up exactly and by prefix, each as given
+*               and in upper case to ignore case, through the hash and the sorted name indexes.
+*               A lookup that does not find the name it was taken from is counted. The report
+*               gives, for each kind of lookup, the time per lookup, the longest lookup, and
+*               the results per lookup.
+*   fuzzy       A misspelled name is typed, a character at a time, into approximate searches
+*               over the given number of generated names, with one error allowed, on the
+*               calling thread alone and with a pool of the given number of threads helping.
+*               Keystrokes whose matches differ between the two are counted, as is a best
+*               match for the whole name that does not need the one error. The report gives
+*               the time per keystroke, the longest, and the names searched per second; and
+*               how long a slow search takes to return once it is cancelled.
+*   footprint   Contact models of a thousand, a hundred thousand and a million generated
+*               contacts are built, and the memory they use is taken from the memory stats,
+*               by subsystem. Memory still in use once a model is released is counted. This
+*               part runs only in builds with ACCSERVER_STATS defined; otherwise the report
+*               says that it was not compiled in.
+*   executor    The same batch of work items, a tenth of them cancelled half way through,
+*               runs on pools of 1, 2, 4 and so on up to the given number of threads. Items
+*               that run when they should not, or whose completion does not run once, are
+*               counted. The report gives the items per second at each size, and how long
+*               Stop takes with a long queue, which it should discard.
+*   layout      The control's list layout, whose item height is a template argument, maps
+*               points to items and items to positions, and so does a layout that keeps the
+*               height in a member and is called through a virtual function, as a control
+*               would without the layout policy. Results that differ are counted. The report
+*               gives the time per call of each.
+*
+* The test fails if any check finds an inconsistency.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+
+struct ComponentTestOptions
+{
+    ULONG Seconds;          // For each timed part.
+    ULONG Threads;          // Readers and workers, or zero for one fewer than the processors.
+    ULONG Names;            // For the search part.
+};
+
+struct SnapshotTestResult
+{
+    ULONG Readers;
+    ULONGLONG Publishes;
+    ULONGLONG Reads;
+    ULONGLONG BusyReads;            // Every attempt overlapped a write.
+    ULONGLONG ReadNanoseconds;      // Summed over the readers.
+    ULONGLONG TornReads;
+    bool OverflowReported;          // An oversized snapshot was reported as overflowed.
+};
+
+struct ChangeLogTestResult
+{
+    ULONG Changes;
+    ULONG CatchUps;                 // The mirror applied the changes since it last looked.
+    ULONG Resyncs;                  // The changes had been discarded, so the mirror copied the list.
+    ULONG Mismatches;               // Catch-ups after which the mirror differed from the list.
+    bool FutureRefused;             // A sequence number newer than any change was refused.
+};
+
+struct RosterTestResult
+{
+    ULONG Trials;                   // Small rosters diffed and checked.
+    ULONG Mismatches;               // Edits that did not turn the old roster into the new one.
+    ULONG NotMinimal;               // Edits with more moves than the fewest possible.
+    ULONG Entries;                  // In the large roster.
+    ULONG Edits;                    // Between the large rosters.
+    ULONG Diffs;                    // Timed diffs of the large roster.
+    ULONGLONG Nanoseconds;
+};
+
+struct SearchTestResult
+{
+    ULONG Names;
+    ULONGLONG BuildNanoseconds;     // Adding the names to the trigram index and saving it.
+    ULONGLONG LoadNanoseconds;      // Mapping the saved index.
+    ULONGLONG ImageBytes;
+    ULONG Queries;                  // Different queries, each checked once.
+    ULONG Mismatches;
+    ULONGLONG TrigramSearches;      // Timed searches, cycling through the queries.
+    ULONGLONG TrigramNanoseconds;
+    ULONGLONG ScanSearches;
+    ULONGLONG ScanNanoseconds;
+};
+
+struct SubstringRun
+{
+    ULONG Names;
+    ULONGLONG TextBytes;            // Folded names and separators, as scanned.
+    ULONGLONG Searches;
+    ULONGLONG Nanoseconds;
+    ULONGLONG LongestNanoseconds;   // Of one search.
+};
+
+struct SubstringTestResult
+{
+    static const ULONG MaxRuns = 2;
+
+    ULONG RunCount;
+    SubstringRun Runs[MaxRuns];
+};
+
+struct LookupTestResult
+{
+    static const ULONG KindCount = 4;   // Exact, exact ignoring case, prefix, prefix ignoring case.
+
+    ULONG Names;
+    ULONGLONG BuildNanoseconds;     // Adding the names to the index.
+    ULONG Misses;                   // Lookups that did not find the name they were taken from.
+    ULONGLONG Lookups[KindCount];
+    ULONGLONG Results[KindCount];
+    ULONGLONG Nanoseconds[KindCount];
+    ULONGLONG LongestNanoseconds[KindCount];
+};
+
+struct FuzzyRun
+{
+    ULONG Threads;                  // Helping the calling thread.
+    ULONGLONG Keystrokes;           // Searches, cycling through the prefixes of the query.
+    ULONGLONG Nanoseconds;
+    ULONGLONG LongestNanoseconds;   // Of one keystroke.
+};
+
+struct FuzzyTestResult
+{
+    static const ULONG MaxRuns = 2;
+
+    ULONG Names;
+    ULONG RunCount;
+    FuzzyRun Runs[MaxRuns];
+    ULONG Mismatches;               // Keystrokes whose matches depended on the threads.
+    bool BestFound;                 // The misspelled name's best match needed one error.
+    bool Cancelled;                 // The slow search returned as cancelled.
+    ULONGLONG CancelNanoseconds;    // From Cancel to the slow search returning.
+};
+
+struct FootprintRun
+{
+    ULONG Contacts;
+    ULONGLONG ItemBytes;            // Items and the containers that hold them.
+    ULONGLONG NameBytes;
+    ULONGLONG IndexBytes;
+    ULONGLONG OtherBytes;
+    ULONGLONG LeakedBytes;          // Still in use once the model was released.
+};
+
+struct FootprintTestResult
+{
+    static const ULONG MaxRuns = 3;
+
+    bool Counted;                   // The build has ACCSERVER_STATS defined.
+    ULONG RunCount;
+    FootprintRun Runs[MaxRuns];
+};
+
+struct ExecutorRun
+{
+    ULONG Threads;
+    ULONGLONG Nanoseconds;          // From the first submission to the last completion.
+};
+
+struct ExecutorTestResult
+{
+    static const ULONG MaxRuns = 8;
+
+    ULONG Items;                    // In each batch.
+    ULONG RunCount;
+    ExecutorRun Runs[MaxRuns];
+    ULONG Errors;                   // Items that ran or completed wrongly, over all runs.
+    ULONG StopQueued;               // Slow items queued when Stop was called.
+    ULONG StopRan;                  // Of those, the ones that ran.
+    ULONGLONG StopNanoseconds;
+};
+
+struct LayoutTestResult
+{
+    ULONGLONG Calls;                // On each layout, half mapping points and half items.
+    ULONGLONG FixedNanoseconds;
+    ULONGLONG GenericNanoseconds;
+    ULONG Mismatches;
+};
+
+struct ComponentTestReport
+{
+    ComponentTestOptions Options;
+    ULONG Failures;                 // Checks that found an inconsistency.
+    SnapshotTestResult Snapshot;
+    ChangeLogTestResult ChangeLog;
+    RosterTestResult Roster;
+    SearchTestResult Search;
+    SubstringTestResult Substring;
+    LookupTestResult Lookup;
+    FuzzyTestResult Fuzzy;
+    FootprintTestResult Footprint;
+    ExecutorTestResult Executor;
+    LayoutTestResult Layout;
+};
+
+namespace ComponentTest
+{
+    void GetDefaultOptions(ComponentTestOptions* pOptions);
+    bool Run(const ComponentTestOptions& options, ComponentTestReport* pReport);
+    bool WriteReport(const ComponentTestReport& report, const WCHAR* reportPath);
+}
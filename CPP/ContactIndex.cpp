@@ -0,0 +1,307 @@
+/*************************************************************************************************
+* Description: Implementation of the name and status index used to answer find queries.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "ContactIndex.h"
+#include "MemoryStats.h"
+#include <algorithm>
+#include <wctype.h>
+
+ContactIndex::ContactIndex() : m_trigramsEnabled(false), m_fingerprint(0)
+{
+}
+
+// Folds text to lower case for case-insensitive comparison. This is a simple
+// per-character mapping, which is enough for matching contact names.
+//
+std::wstring ContactIndex::Fold(const std::wstring& text)
+{
+    std::wstring folded(text);
+    for (size_t i = 0; i < folded.size(); i++)
+    {
+        folded[i] = static_cast<wchar_t>(towlower(folded[i]));
+    }
+    return folded;
+}
+
+// Hashes an item ID and name. The hashes of all the entries are added up to
+// identify the names that a saved trigram index was built from.
+//
+unsigned long long ContactIndex::NameFingerprint(unsigned int itemId, const std::wstring& foldedName)
+{
+    // 64-bit FNV-1a.
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < 4; i++)
+    {
+        hash = (hash ^ ((itemId >> (i * 8)) & 0xff)) * 1099511628211ULL;
+    }
+    for (size_t i = 0; i < foldedName.size(); i++)
+    {
+        hash = (hash ^ (foldedName[i] & 0xff)) * 1099511628211ULL;
+        hash = (hash ^ ((foldedName[i] >> 8) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+void ContactIndex::IndexName(unsigned int itemId, const Entry& entry)
+{
+    m_byFoldedName.insert(NameHash::value_type(entry.FoldedName, itemId));
+    m_sortedNames.insert(NameSet::value_type(entry.FoldedName, itemId));
+    m_nameSearch.Add(itemId, entry.FoldedName.c_str());
+    m_fingerprint += NameFingerprint(itemId, entry.FoldedName);
+    if (m_trigramsEnabled)
+    {
+        m_trigrams.Add(itemId, entry.FoldedName.c_str());
+    }
+}
+
+void ContactIndex::UnindexName(unsigned int itemId, const Entry& entry)
+{
+    std::pair<NameHash::iterator, NameHash::iterator> range = m_byFoldedName.equal_range(entry.FoldedName);
+    for (NameHash::iterator it = range.first; it != range.second; ++it)
+    {
+        if (it->second == itemId)
+        {
+            m_byFoldedName.erase(it);
+            break;
+        }
+    }
+    m_sortedNames.erase(NameSet::value_type(entry.FoldedName, itemId));
+    m_nameSearch.Remove(itemId);
+    m_fingerprint -= NameFingerprint(itemId, entry.FoldedName);
+    if (m_trigramsEnabled)
+    {
+        m_trigrams.Remove(itemId, entry.FoldedName.c_str());
+    }
+}
+
+void ContactIndex::Clear()
+{
+    m_entries.clear();
+    m_byFoldedName.clear();
+    m_sortedNames.clear();
+    m_byStatus.clear();
+    m_nameSearch.Clear();
+    m_trigrams.Clear();
+    m_fingerprint = 0;
+}
+
+void ContactIndex::Add(unsigned int itemId, const wchar_t* name, int status)
+{
+    MEMSTATS_SCOPE(MemoryTag_Indexes);
+    Remove(itemId);
+    Entry& entry = m_entries[itemId];
+    entry.Name = (name != NULL) ? name : L"";
+    entry.FoldedName = Fold(entry.Name);
+    entry.Status = status;
+    IndexName(itemId, entry);
+    m_byStatus[status].insert(itemId);
+}
+
+void ContactIndex::Remove(unsigned int itemId)
+{
+    MEMSTATS_SCOPE(MemoryTag_Indexes);
+    std::unordered_map<unsigned int, Entry>::iterator it = m_entries.find(itemId);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    UnindexName(itemId, it->second);
+    m_byStatus[it->second.Status].erase(itemId);
+    m_entries.erase(it);
+}
+
+void ContactIndex::Rename(unsigned int itemId, const wchar_t* name)
+{
+    MEMSTATS_SCOPE(MemoryTag_Indexes);
+    std::unordered_map<unsigned int, Entry>::iterator it = m_entries.find(itemId);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    Entry& entry = it->second;
+    UnindexName(itemId, entry);
+    entry.Name = (name != NULL) ? name : L"";
+    entry.FoldedName = Fold(entry.Name);
+    IndexName(itemId, entry);
+}
+
+void ContactIndex::SetStatus(unsigned int itemId, int status)
+{
+    MEMSTATS_SCOPE(MemoryTag_Indexes);
+    std::unordered_map<unsigned int, Entry>::iterator it = m_entries.find(itemId);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    m_byStatus[it->second.Status].erase(itemId);
+    it->second.Status = status;
+    m_byStatus[status].insert(itemId);
+}
+
+size_t ContactIndex::GetCount() const
+{
+    return m_entries.size();
+}
+
+// Checks the parts of a query that the index used for the lookup did not.
+//
+bool ContactIndex::Matches(const Entry& entry, const std::wstring& name, NameMatch match, int status)
+{
+    if ((status != AnyStatus) && (entry.Status != status))
+    {
+        return false;
+    }
+    switch (match)
+    {
+    case Match_Exact:
+        return entry.Name == name;
+    case Match_Prefix:
+        return entry.Name.compare(0, name.size(), name) == 0;
+    default:
+        // The lookup has already matched the folded name.
+        return true;
+    }
+}
+
+// Finds the items that match a query, in no particular order.
+//
+void ContactIndex::Find(const wchar_t* name, NameMatch match, int status, std::vector<unsigned int>* pItemIds) const
+{
+    pItemIds->clear();
+    if (match == Match_AnyName)
+    {
+        if (status == AnyStatus)
+        {
+            pItemIds->reserve(m_entries.size());
+            for (std::unordered_map<unsigned int, Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+            {
+                pItemIds->push_back(it->first);
+            }
+        }
+        else
+        {
+            std::unordered_map<int, std::set<unsigned int> >::const_iterator it = m_byStatus.find(status);
+            if (it != m_byStatus.end())
+            {
+                pItemIds->assign(it->second.begin(), it->second.end());
+            }
+        }
+        return;
+    }
+
+    std::wstring query((name != NULL) ? name : L"");
+    std::wstring folded = Fold(query);
+    if ((match == Match_Exact) || (match == Match_ExactIgnoreCase))
+    {
+        std::pair<NameHash::const_iterator, NameHash::const_iterator> range = m_byFoldedName.equal_range(folded);
+        for (NameHash::const_iterator it = range.first; it != range.second; ++it)
+        {
+            if (Matches(m_entries.find(it->second)->second, query, match, status))
+            {
+                pItemIds->push_back(it->second);
+            }
+        }
+    }
+    else if (match == Match_Substring)
+    {
+        std::vector<unsigned int> itemIds;
+        if (m_trigramsEnabled && m_trigrams.Find(folded.c_str(), &itemIds))
+        {
+            // The trigram index gives the names that may contain the query.
+            for (size_t i = 0; i < itemIds.size(); i++)
+            {
+                const Entry& entry = m_entries.find(itemIds[i])->second;
+                if ((entry.FoldedName.find(folded) != std::wstring::npos) && Matches(entry, query, match, status))
+                {
+                    pItemIds->push_back(itemIds[i]);
+                }
+            }
+        }
+        else
+        {
+            m_nameSearch.Find(folded.c_str(), &itemIds);
+            for (size_t i = 0; i < itemIds.size(); i++)
+            {
+                if (Matches(m_entries.find(itemIds[i])->second, query, match, status))
+                {
+                    pItemIds->push_back(itemIds[i]);
+                }
+            }
+        }
+    }
+    else
+    {
+        // Names with the prefix are adjacent in the sorted index.
+        for (NameSet::const_iterator it = m_sortedNames.lower_bound(NameSet::value_type(folded, 0));
+            (it != m_sortedNames.end()) && (it->first.compare(0, folded.size(), folded) == 0); ++it)
+        {
+            if (Matches(m_entries.find(it->second)->second, query, match, status))
+            {
+                pItemIds->push_back(it->second);
+            }
+        }
+    }
+}
+
+// Finds the items whose names contain a string with at most maxErrors edits,
+// ignoring case, best matches first. See NameSearch::FindApproximate.
+//
+bool ContactIndex::FindApproximate(const wchar_t* name, int maxErrors, size_t maxResults,
+    std::vector<ApproximateMatch>* pMatches, WorkExecutor* pExecutor, const SearchCancellation* pCancel,
+    unsigned int generation) const
+{
+    std::wstring folded = Fold((name != NULL) ? name : L"");
+    return m_nameSearch.FindApproximate(folded.c_str(), maxErrors, maxResults, pMatches, pExecutor, pCancel,
+        generation);
+}
+
+// Starts using a trigram index for substring queries, mapping it from a file
+// saved by SaveTrigramIndex if the file was saved for the current names.
+// Otherwise the index is built from the names. Returns true if the file was used.
+//
+bool ContactIndex::OpenTrigramIndex(const char* path)
+{
+    MEMSTATS_SCOPE(MemoryTag_Indexes);
+    m_trigramsEnabled = true;
+    if (m_trigrams.Load(path, m_fingerprint))
+    {
+        return true;
+    }
+
+    // Adding in order of ID is fastest.
+    std::vector<unsigned int> itemIds;
+    itemIds.reserve(m_entries.size());
+    for (std::unordered_map<unsigned int, Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        itemIds.push_back(it->first);
+    }
+    std::sort(itemIds.begin(), itemIds.end());
+    for (size_t i = 0; i < itemIds.size(); i++)
+    {
+        m_trigrams.Add(itemIds[i], m_entries[itemIds[i]].FoldedName.c_str());
+    }
+    return false;
+}
+
+// Saves the trigram index, so that OpenTrigramIndex can map it instead of
+// building it the next time.
+//
+bool ContactIndex::SaveTrigramIndex(const char* path)
+{
+    return m_trigramsEnabled && m_trigrams.Save(path, m_fingerprint);
+}
@@ -0,0 +1,91 @@
+/*************************************************************************************************
+* Description: Declarations for the name and status index used to answer find queries.
+*
+* The index is keyed by stable item ID (see ChangeLog.h), so that it does not have to
+* be renumbered when items are inserted or removed. It is updated incrementally as
+* items are added, removed, renamed or change status.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include "NameSearch.h"
+#include "TrigramIndex.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How a query matches names.
+enum NameMatch
+{
+    Match_AnyName,              // Ignore the name; match on status only.
+    Match_Exact,
+    Match_ExactIgnoreCase,
+    Match_Prefix,
+    Match_PrefixIgnoreCase,
+    Match_Substring             // Case-insensitive; see NameSearch.h.
+};
+
+// Status value that matches any status.
+const int AnyStatus = -1;
+
+class ContactIndex
+{
+private:
+    struct Entry
+    {
+        std::wstring Name;
+        std::wstring FoldedName;    // Lower case, for case-insensitive matches.
+        int Status;
+    };
+
+    typedef std::unordered_multimap<std::wstring, unsigned int> NameHash;
+    typedef std::set<std::pair<std::wstring, unsigned int> > NameSet;
+
+    std::unordered_map<unsigned int, Entry> m_entries;
+    NameHash m_byFoldedName;        // Exact and case-insensitive lookups.
+    NameSet m_sortedNames;          // Prefix lookups, by folded name.
+    std::unordered_map<int, std::set<unsigned int> > m_byStatus;
+    NameSearch m_nameSearch;        // Substring lookups.
+    TrigramIndex m_trigrams;        // Substring lookups on very large lists, if enabled.
+    bool m_trigramsEnabled;
+    unsigned long long m_fingerprint;   // Sum of NameFingerprint for every entry.
+
+    void IndexName(unsigned int itemId, const Entry& entry);
+    void UnindexName(unsigned int itemId, const Entry& entry);
+    static bool Matches(const Entry& entry, const std::wstring& name, NameMatch match, int status);
+    static unsigned long long NameFingerprint(unsigned int itemId, const std::wstring& foldedName);
+
+public:
+    static std::wstring Fold(const std::wstring& text);
+
+    ContactIndex();
+
+    void Clear();
+    void Add(unsigned int itemId, const wchar_t* name, int status);
+    void Remove(unsigned int itemId);
+    void Rename(unsigned int itemId, const wchar_t* name);
+    void SetStatus(unsigned int itemId, int status);
+    size_t GetCount() const;
+    void Find(const wchar_t* name, NameMatch match, int status, std::vector<unsigned int>* pItemIds) const;
+    bool FindApproximate(const wchar_t* name, int maxErrors, size_t maxResults,
+        std::vector<ApproximateMatch>* pMatches, WorkExecutor* pExecutor = NULL,
+        const SearchCancellation* pCancel = NULL, unsigned int generation = 0) const;
+    bool OpenTrigramIndex(const char* path);
+    bool SaveTrigramIndex(const char* path);
+};
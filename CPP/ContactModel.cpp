@@ -0,0 +1,389 @@
+/*************************************************************************************************
+* Description: Implementation of the contact model.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "ContactModel.h"
+#include "MemoryStats.h"
+#include <algorithm>
+#include <unordered_set>
+
+// ContactModel class.
+//
+// Creates an empty model, with one reference for the caller.
+//
+ContactModel::ContactModel() :
+    m_refCount(1), m_nextItemId(1), m_updateDepth(0)
+{
+}
+
+// Destructor. The views have released the model, so none refer to the items.
+//
+ContactModel::~ContactModel()
+{
+    // Save the trigram index, so that it does not have to be rebuilt.
+    if (!m_searchIndexPath.empty())
+    {
+        m_contactIndex.SaveTrigramIndex(m_searchIndexPath.c_str());
+    }
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        delete m_items[i];
+    }
+}
+
+ULONG ContactModel::AddRef()
+{
+    return ++m_refCount;
+}
+
+ULONG ContactModel::Release()
+{
+    ULONG refCount = --m_refCount;
+    if (refCount == 0)
+    {
+        delete this;
+    }
+    return refCount;
+}
+
+// Adds a view to be told of changes.
+//
+void ContactModel::AddObserver(ContactModelObserver* pObserver)
+{
+    m_observers.push_back(pObserver);
+}
+
+void ContactModel::RemoveObserver(ContactModelObserver* pObserver)
+{
+    m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), pObserver), m_observers.end());
+}
+
+// Starts a commit. Calls may be nested; the views are told when the outermost
+// commit ends.
+//
+void ContactModel::BeginUpdate()
+{
+    m_updateDepth++;
+}
+
+// Ends a commit, telling the views of its changes.
+//
+void ContactModel::EndUpdate()
+{
+    if ((--m_updateDepth > 0) || m_pending.empty())
+    {
+        return;
+    }
+    std::vector<ModelChange> changes;
+    changes.swap(m_pending);
+
+    // A view may stop observing while it is told, so the list is copied.
+    std::vector<ContactModelObserver*> observers(m_observers);
+    for (size_t i = 0; i < observers.size(); i++)
+    {
+        observers[i]->OnModelChanged(changes);
+    }
+
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        if (changes[i].Type == ModelChange_Remove)
+        {
+            MEMSTATS_SCOPE(MemoryTag_Items);
+            delete changes[i].pItem;
+        }
+    }
+}
+
+// Records a change. A change made outside BeginUpdate and EndUpdate is a
+// commit of its own.
+//
+void ContactModel::AddChange(ModelChangeType type, CustomListControlItem* pItem, ContactStatus oldStatus)
+{
+    ModelChange change = { type, pItem, oldStatus, pItem->GetStatus() };
+    BeginUpdate();
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_pending.push_back(change);
+    }
+    EndUpdate();
+}
+
+int ContactModel::GetCount()
+{
+    return static_cast<int>(m_items.size());
+}
+
+// Gets an item, in the order the items were added.
+//
+CustomListControlItem* ContactModel::GetItem(int index)
+{
+    return m_items[index];
+}
+
+// Gets the item with an ID, or NULL if there is none.
+//
+CustomListControlItem* ContactModel::FindItem(unsigned int id)
+{
+    std::unordered_map<unsigned int, CustomListControlItem*>::iterator found = m_itemsById.find(id);
+    return (found != m_itemsById.end()) ? found->second : NULL;
+}
+
+// Adds a contact, with the next free ID. Returns NULL if memory runs out.
+//
+CustomListControlItem* ContactModel::AddItem(ContactStatus status, WCHAR* name)
+{
+    CustomListControlItem* pItem = NULL;
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        pItem = new (std::nothrow) CustomListControlItem(m_nextItemId, name);
+    }
+    if (pItem == NULL)
+    {
+        return NULL;
+    }
+    pItem->SetStatus(status);
+    AddItem(pItem);
+    return pItem;
+}
+
+// Adds an item that the caller has created, which the model then owns.
+// Returns false, and leaves the item to the caller, if its ID is in use.
+//
+bool ContactModel::AddItem(CustomListControlItem* pItem)
+{
+    if (FindItem(pItem->GetId()) != NULL)
+    {
+        return false;
+    }
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_items.push_back(pItem);
+        m_itemsById[pItem->GetId()] = pItem;
+    }
+    if (pItem->GetId() >= m_nextItemId)
+    {
+        m_nextItemId = pItem->GetId() + 1;
+    }
+    m_contactIndex.Add(pItem->GetId(), pItem->GetName(), pItem->GetStatus());
+    AddChange(ModelChange_Add, pItem, pItem->GetStatus());
+    return true;
+}
+
+// Removes an item. It is deleted when the commit ends.
+//
+void ContactModel::RemoveItem(CustomListControlItem* pItem)
+{
+    RemoveItems(std::vector<CustomListControlItem*>(1, pItem));
+}
+
+// Removes items, in one pass over the list however many there are, as one
+// commit. They are deleted when the commit ends. Items that are not in the
+// model are ignored.
+//
+void ContactModel::RemoveItems(const std::vector<CustomListControlItem*>& items)
+{
+    std::unordered_set<CustomListControlItem*> removing;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        std::unordered_map<unsigned int, CustomListControlItem*>::iterator found = m_itemsById.find(items[i]->GetId());
+        if ((found != m_itemsById.end()) && (found->second == items[i]))
+        {
+            removing.insert(items[i]);
+            m_itemsById.erase(found);
+        }
+    }
+    if (removing.empty())
+    {
+        return;
+    }
+    std::vector<CustomListControlItem*>::iterator kept = m_items.begin();
+    for (std::vector<CustomListControlItem*>::iterator it = m_items.begin(); it != m_items.end(); ++it)
+    {
+        if (removing.find(*it) == removing.end())
+        {
+            *kept++ = *it;
+        }
+    }
+    m_items.erase(kept, m_items.end());
+
+    BeginUpdate();
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (removing.find(items[i]) != removing.end())
+        {
+            m_contactIndex.Remove(items[i]->GetId());
+            AddChange(ModelChange_Remove, items[i], items[i]->GetStatus());
+        }
+    }
+    EndUpdate();
+}
+
+// Renames an item. On failure, the old name is kept.
+//
+bool ContactModel::SetItemName(CustomListControlItem* pItem, WCHAR* name)
+{
+    if (!pItem->SetName(name))
+    {
+        return false;
+    }
+    m_contactIndex.Rename(pItem->GetId(), pItem->GetName());
+    AddChange(ModelChange_Rename, pItem, pItem->GetStatus());
+    return true;
+}
+
+// Changes the status of an item.
+//
+void ContactModel::SetItemStatus(CustomListControlItem* pItem, ContactStatus status)
+{
+    ContactStatus oldStatus = pItem->GetStatus();
+    if (oldStatus == status)
+    {
+        return;
+    }
+    pItem->SetStatus(status);
+    m_contactIndex.SetStatus(pItem->GetId(), status);
+    AddChange(ModelChange_Status, pItem, oldStatus);
+}
+
+// Gets the index of names and statuses. Views map the IDs it finds to their
+// own indexes.
+//
+const ContactIndex& ContactModel::GetContactIndex()
+{
+    return m_contactIndex;
+}
+
+// Answers substring searches from a trigram index, which is mapped from a file
+// if one was saved for the current names, and saved there when the model is
+// deleted.
+//
+void ContactModel::OpenSearchIndex(const char* path)
+{
+    m_searchIndexPath = path;
+    m_contactIndex.OpenTrigramIndex(path);
+}
+
+// Gives the contacts payloads from a store, which the model then owns, through
+// a new cache. Returns false, leaving the contacts without payloads, if memory
+// runs out.
+//
+bool ContactModel::SetPayloadStore(PayloadStore* pStore, const PayloadCacheOptions& options)
+{
+    m_pPayloads.reset();
+    PayloadCache* pCache = new (std::nothrow) PayloadCache(pStore);
+    if (pCache == NULL)
+    {
+        delete pStore;
+        return false;
+    }
+    m_pPayloads.reset(pCache);
+    if (!m_pPayloads->Initialize(options))
+    {
+        m_pPayloads.reset();
+        return false;
+    }
+    return true;
+}
+
+// Gets the cache of payloads, or NULL if the contacts have none.
+//
+const std::shared_ptr<PayloadCache>& ContactModel::GetPayloads()
+{
+    return m_pPayloads;
+}
+
+// Tells the views that a payload is in the cache, so that those showing the
+// contact can paint it.
+//
+void ContactModel::NotifyPayloadLoaded(unsigned int id)
+{
+    std::vector<ContactModelObserver*> observers(m_observers);
+    for (size_t i = 0; i < observers.size(); i++)
+    {
+        observers[i]->OnPayloadLoaded(id);
+    }
+}
+
+
+// CustomListControlItem class.
+//
+CustomListControlItem::CustomListControlItem(unsigned int id, WCHAR* name) :
+    m_status(Status_Offline), m_id(id)
+{
+    // In case of failure, name will be set to NULL, which is acceptable.
+    m_name = _wcsdup(name);
+    if (m_name != NULL)
+    {
+        MEMSTATS_ALLOC(MemoryTag_Names, (wcslen(m_name) + 1) * sizeof(WCHAR));
+    }
+}
+
+CustomListControlItem::~CustomListControlItem()
+{
+    if (m_name != NULL)
+    {
+        MEMSTATS_FREE(MemoryTag_Names, (wcslen(m_name) + 1) * sizeof(WCHAR));
+    }
+    free(m_name);
+}
+
+// Gets the status (online/offline) of this contact.
+//
+ContactStatus CustomListControlItem::GetStatus()
+{
+    return m_status;
+}
+
+// Sets the status (online/offline) of this contact.
+//
+void CustomListControlItem::SetStatus(ContactStatus status)
+{
+    m_status = status;
+}
+
+// Gets the name of the contact.
+//
+WCHAR* CustomListControlItem::GetName()
+{
+    return m_name;
+}
+
+// Sets the name of the contact. On failure, the old name is kept.
+//
+bool CustomListControlItem::SetName(WCHAR* name)
+{
+    WCHAR* newName = _wcsdup(name);
+    if (newName == NULL)
+    {
+        return false;
+    }
+    MEMSTATS_ALLOC(MemoryTag_Names, (wcslen(newName) + 1) * sizeof(WCHAR));
+    if (m_name != NULL)
+    {
+        MEMSTATS_FREE(MemoryTag_Names, (wcslen(m_name) + 1) * sizeof(WCHAR));
+    }
+    free(m_name);
+    m_name = newName;
+    return true;
+}
+
+// Gets the ID of the contact, which does not change while it is in the list.
+//
+unsigned int CustomListControlItem::GetId()
+{
+    return m_id;
+}
@@ -0,0 +1,143 @@
+/*************************************************************************************************
+* Description: Declarations for the contact model, which holds the contacts that one or more
+* list controls show.
+*
+* The model owns the contacts and the index used to find them. Each control is a view of a
+* model, with its own order, filter, selection and accessible object, and keeps only pointers
+* to the contacts, so showing the same roster in another view does not copy the names or the
+* index. Views observe the model. Changes made between BeginUpdate and EndUpdate are a single
+* commit: each view is told once, with every change in the commit, and removed contacts are
+* deleted after the views have been told.
+*
+* The model may also have a cache of payloads, such as avatars, which the views share.
+*
+* The model is reference counted; each view holds a reference, and the model is deleted with
+* the last of them. It is used only on the UI thread.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ContactIndex.h"
+#include "PayloadCache.h"
+
+// Values for status of contacts.
+enum ContactStatus
+{
+    Status_Offline,
+    Status_Online
+};
+
+// CustomListItem control class -- an item in the list.
+//
+class CustomListControlItem
+{
+private:
+    WCHAR* m_name;
+    ContactStatus m_status;
+    unsigned int m_id;
+
+public:
+    CustomListControlItem(unsigned int id, WCHAR* name);
+    ~CustomListControlItem();
+    ContactStatus GetStatus();
+    void SetStatus(ContactStatus status);
+    WCHAR* GetName();
+    bool SetName(WCHAR* name);
+    unsigned int GetId();
+};
+
+// Kinds of change to the model.
+enum ModelChangeType
+{
+    ModelChange_Add,
+    ModelChange_Remove,         // The item is deleted after the views have been told.
+    ModelChange_Rename,
+    ModelChange_Status          // From OldStatus to NewStatus.
+};
+
+struct ModelChange
+{
+    ModelChangeType Type;
+    CustomListControlItem* pItem;
+    ContactStatus OldStatus;
+    ContactStatus NewStatus;
+};
+
+// Interface for views of the model.
+//
+class ContactModelObserver
+{
+public:
+    virtual ~ContactModelObserver() {}
+
+    // Called once for each commit, with its changes in the order they were made.
+    virtual void OnModelChanged(const std::vector<ModelChange>& changes) = 0;
+
+    // Called when the payload of a contact has been loaded into the cache.
+    virtual void OnPayloadLoaded(unsigned int id)
+    {
+    }
+};
+
+class ContactModel
+{
+private:
+    ULONG m_refCount;
+    std::vector<CustomListControlItem*> m_items;    // In the order they were added.
+    std::unordered_map<unsigned int, CustomListControlItem*> m_itemsById;
+    unsigned int m_nextItemId;      // Stable ID for the next item added.
+    ContactIndex m_contactIndex;    // Names and statuses, for finding items.
+    std::string m_searchIndexPath;  // File the trigram index is saved to, if used.
+    std::vector<ContactModelObserver*> m_observers;
+    std::vector<ModelChange> m_pending;     // Changes in the commit being made.
+    int m_updateDepth;
+    std::shared_ptr<PayloadCache> m_pPayloads;  // NULL if contacts have no payloads.
+
+    ~ContactModel();
+    void AddChange(ModelChangeType type, CustomListControlItem* pItem, ContactStatus oldStatus);
+
+public:
+    ContactModel();
+    ULONG AddRef();
+    ULONG Release();
+
+    void AddObserver(ContactModelObserver* pObserver);
+    void RemoveObserver(ContactModelObserver* pObserver);
+    void BeginUpdate();
+    void EndUpdate();
+
+    int GetCount();
+    CustomListControlItem* GetItem(int index);
+    CustomListControlItem* FindItem(unsigned int id);
+    CustomListControlItem* AddItem(ContactStatus status, WCHAR* name);
+    bool AddItem(CustomListControlItem* pItem);
+    void RemoveItem(CustomListControlItem* pItem);
+    void RemoveItems(const std::vector<CustomListControlItem*>& items);
+    bool SetItemName(CustomListControlItem* pItem, WCHAR* name);
+    void SetItemStatus(CustomListControlItem* pItem, ContactStatus status);
+
+    const ContactIndex& GetContactIndex();
+    void OpenSearchIndex(const char* path);
+
+    bool SetPayloadStore(PayloadStore* pStore, const PayloadCacheOptions& options);
+    const std::shared_ptr<PayloadCache>& GetPayloads();
+    void NotifyPayloadLoaded(unsigned int id);
+};
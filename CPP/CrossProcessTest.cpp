@@ -0,0 +1,351 @@
+/*************************************************************************************************
+* Description: Implementation of the cross-process test.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "CrossProcessTest.h"
+#include "AccExtensions.h"
+#include "ChildRecords.h"
+#include "ContactIndex.h"
+#include "CustomControl.h"
+#include <oleacc.h>
+#include <stdio.h>
+#include <string.h>
+
+// How long the server waits for the client before giving up on it.
+const ULONGLONG ClientTimeoutMilliseconds = 60000;
+
+// The type library in AccExtensions.idl, and the type library marshaler
+// (PSOAInterface) that registering it names for each interface.
+static const GUID ExtensionTypeLibId =
+    { 0x2bd3b294, 0x1edd, 0x44d2, { 0x8f, 0x17, 0x32, 0x35, 0xf5, 0x28, 0xd6, 0x46 } };
+static const CLSID TypeLibMarshalerId =
+    { 0x00020424, 0x0000, 0x0000, { 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+// Names of the interfaces in CrossProcessReport, in order.
+static const char* const InterfaceNames[CrossProcessReport::InterfaceCount] =
+    { "IAccChildRecords", "IAccChangeLog", "IAccQuery" };
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG CrossProcessClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Starts the client on a hidden list control, and dispatches messages, which
+// carry the client's calls, until it exits. Returns true if the client passed.
+//
+bool CrossProcessTest::Serve(HINSTANCE hInstance, const WCHAR* reportPath)
+{
+    WCHAR modulePath[MAX_PATH];
+    DWORD modulePathLength = GetModuleFileName(hInstance, modulePath, MAX_PATH);
+    if ((modulePathLength == 0) || (modulePathLength >= MAX_PATH))
+    {
+        return false;
+    }
+
+    // The control creates its accessible object when the client asks for it.
+    HWND hwnd = CreateWindowEx(0, TEXT("CONTACTLIST"), TEXT("Cross-process test"), WS_POPUP,
+        0, 0, 200, 200, NULL, NULL, hInstance, NULL);
+    CustomListControl* pControl = (hwnd != NULL) ? GetControl(hwnd) : NULL;
+    if (pControl == NULL)
+    {
+        if (hwnd != NULL)
+        {
+            DestroyWindow(hwnd);
+        }
+        return false;
+    }
+    for (int i = 0; i < CustomListControl::MaxItems; i++)
+    {
+        WCHAR name[32];
+        swprintf_s(name, _countof(name), L"Contact %d", i + 1);
+        pControl->AddItem(((i % 3) == 0) ? Status_Offline : Status_Online, name);
+    }
+
+    // CreateProcess may write to the command line, so it must not be constant.
+    WCHAR commandLine[2 * MAX_PATH + 64];
+    int commandLength = _snwprintf_s(commandLine, _countof(commandLine), _TRUNCATE,
+        L"\"%s\" /client %Iu \"%s\"", modulePath, reinterpret_cast<UINT_PTR>(hwnd), reportPath);
+    STARTUPINFO startupInfo = {};
+    startupInfo.cb = sizeof(startupInfo);
+    PROCESS_INFORMATION processInfo = {};
+    if ((commandLength < 0) ||
+        !CreateProcess(NULL, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo))
+    {
+        DestroyWindow(hwnd);
+        return false;
+    }
+    CloseHandle(processInfo.hThread);
+
+    DWORD exitCode = 1;
+    ULONGLONG deadline = GetTickCount64() + ClientTimeoutMilliseconds;
+    for (;;)
+    {
+        ULONGLONG now = GetTickCount64();
+        DWORD timeout = (now < deadline) ? static_cast<DWORD>(deadline - now) : 0;
+        DWORD wait = MsgWaitForMultipleObjects(1, &processInfo.hProcess, FALSE, timeout, QS_ALLINPUT);
+        if (wait == WAIT_OBJECT_0 + 1)
+        {
+            MSG msg;
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+            {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+            continue;
+        }
+        if (wait == WAIT_OBJECT_0)
+        {
+            GetExitCodeProcess(processInfo.hProcess, &exitCode);
+        }
+        else
+        {
+            TerminateProcess(processInfo.hProcess, 1);
+        }
+        break;
+    }
+    CloseHandle(processInfo.hProcess);
+    DestroyWindow(hwnd);
+    return exitCode == 0;
+}
+
+// Compares a packed child record with what IAccessible returns for the same
+// child, and counts the properties that differ.
+//
+static void CompareRecord(IAccessible* pAcc, const ChildRecords::Record& record, CrossProcessReport* pReport)
+{
+    VARIANT varChild;
+    varChild.vt = VT_I4;
+    varChild.lVal = static_cast<LONG>(record.ChildId);
+
+    BSTR name = NULL;
+    bool sameName = SUCCEEDED(pAcc->get_accName(varChild, &name)) && (name != NULL) &&
+        (SysStringLen(name) == record.NameLength) &&
+        (memcmp(name, record.Name, record.NameLength * sizeof(WCHAR)) == 0);
+    SysFreeString(name);
+
+    VARIANT role;
+    VariantInit(&role);
+    bool sameRole = SUCCEEDED(pAcc->get_accRole(varChild, &role)) && (role.vt == VT_I4) &&
+        (static_cast<unsigned int>(role.lVal) == record.Role);
+    VariantClear(&role);
+
+    VARIANT state;
+    VariantInit(&state);
+    bool sameState = SUCCEEDED(pAcc->get_accState(varChild, &state)) && (state.vt == VT_I4) &&
+        (static_cast<unsigned int>(state.lVal) == record.State);
+    VariantClear(&state);
+
+    long left, top, width, height;
+    bool sameLocation = SUCCEEDED(pAcc->accLocation(&left, &top, &width, &height, varChild)) &&
+        (left == record.Left) && (top == record.Top) && (width == record.Width) && (height == record.Height);
+
+    pReport->Compared += 4;
+    pReport->Mismatches += (sameName ? 0 : 1) + (sameRole ? 0 : 1) + (sameState ? 0 : 1) +
+        (sameLocation ? 0 : 1);
+}
+
+// Checks that a packed snapshot holds a record for each child.
+//
+static bool CheckRecordCount(BSTR records, long childCount)
+{
+    ChildRecords::Reader reader(records, SysStringByteLen(records));
+    return reader.IsValid() && (reader.GetRecordCount() == static_cast<unsigned int>(childCount));
+}
+
+// Runs the client half of the test against the control in another process.
+// Returns false if the accessible object or any of its interfaces cannot be had.
+//
+bool CrossProcessTest::RunClient(HWND hwnd, ULONG passes, CrossProcessReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(CrossProcessReport));
+    pReport->Passes = passes;
+    const IID* interfaceIds[CrossProcessReport::InterfaceCount] =
+        { &__uuidof(IAccChildRecords), &__uuidof(IAccChangeLog), &__uuidof(IAccQuery) };
+
+    // The interfaces can be marshaled only if the type library is registered,
+    // and names the type library marshaler for each of them.
+    ITypeLib* pTypeLib = NULL;
+    pReport->TypeLibResult = LoadRegTypeLib(ExtensionTypeLibId, 1, 0, 0, &pTypeLib);
+    if (pTypeLib != NULL)
+    {
+        pTypeLib->Release();
+    }
+    for (ULONG i = 0; i < CrossProcessReport::InterfaceCount; i++)
+    {
+        CLSID marshaler;
+        pReport->MarshalerResults[i] = CoGetPSClsid(*interfaceIds[i], &marshaler);
+        pReport->TypeLibMarshaled[i] = SUCCEEDED(pReport->MarshalerResults[i]) &&
+            IsEqualCLSID(marshaler, TypeLibMarshalerId);
+    }
+
+    IAccessible* pAcc = NULL;
+    pReport->ObjectResult = AccessibleObjectFromWindow(hwnd, static_cast<DWORD>(OBJID_CLIENT), IID_IAccessible,
+        reinterpret_cast<void**>(&pAcc));
+    if (FAILED(pReport->ObjectResult))
+    {
+        return false;
+    }
+    IAccChildRecords* pChildRecords = NULL;
+    IAccChangeLog* pChangeLog = NULL;
+    IAccQuery* pQuery = NULL;
+    void** interfaces[CrossProcessReport::InterfaceCount] = { reinterpret_cast<void**>(&pChildRecords),
+        reinterpret_cast<void**>(&pChangeLog), reinterpret_cast<void**>(&pQuery) };
+    bool queried = true;
+    for (ULONG i = 0; i < CrossProcessReport::InterfaceCount; i++)
+    {
+        pReport->QueryResults[i] = pAcc->QueryInterface(*interfaceIds[i], interfaces[i]);
+        queried = queried && SUCCEEDED(pReport->QueryResults[i]);
+    }
+    long childCount = 0;
+    if (!queried || FAILED(pAcc->get_accChildCount(&childCount)) || (childCount == 0))
+    {
+        if (pQuery != NULL)
+        {
+            pQuery->Release();
+        }
+        if (pChangeLog != NULL)
+        {
+            pChangeLog->Release();
+        }
+        if (pChildRecords != NULL)
+        {
+            pChildRecords->Release();
+        }
+        pAcc->Release();
+        return false;
+    }
+    pReport->Children = childCount;
+
+    // Every child's record matches IAccessible.
+    long recordCount = 0;
+    BSTR records = NULL;
+    HRESULT hr = pChildRecords->GetChildRecords(1, childCount, &recordCount, &records);
+    pReport->Compared++;
+    if ((hr != S_OK) || (recordCount != childCount) || !CheckRecordCount(records, childCount))
+    {
+        pReport->Mismatches++;
+    }
+    else
+    {
+        ChildRecords::Reader reader(records, SysStringByteLen(records));
+        ChildRecords::Record record;
+        while (reader.Next(&record))
+        {
+            CompareRecord(pAcc, record, pReport);
+        }
+    }
+    SysFreeString(records);
+
+    // The snapshot holds every child, and nothing has changed since it was taken.
+    LONGLONG sequence = 0;
+    BSTR snapshot = NULL;
+    hr = pChangeLog->GetSnapshot(&sequence, &snapshot);
+    pReport->Compared++;
+    pReport->Mismatches += ((hr == S_OK) && CheckRecordCount(snapshot, childCount)) ? 0 : 1;
+    SysFreeString(snapshot);
+    LONGLONG latestSequence = -1;
+    BSTR changes = NULL;
+    hr = pChangeLog->GetChanges(sequence, &latestSequence, &changes);
+    pReport->Compared++;
+    pReport->Mismatches += ((hr == S_OK) && (latestSequence == sequence)) ? 0 : 1;
+    SysFreeString(changes);
+
+    // The server named every contact "Contact <n>".
+    BSTR prefix = SysAllocString(L"Contact");
+    VARIANT found;
+    VariantInit(&found);
+    hr = pQuery->FindChildren(prefix, Match_Prefix, AnyStatus, &found);
+    LONG upperBound = -1;
+    pReport->Compared++;
+    pReport->Mismatches += ((hr == S_OK) && (found.vt == (VT_ARRAY | VT_I4)) &&
+        SUCCEEDED(SafeArrayGetUBound(found.parray, 1, &upperBound)) && (upperBound + 1 == childCount)) ? 0 : 1;
+    VariantClear(&found);
+    SysFreeString(prefix);
+
+    // Time reading every child in one call, and one call per property per child.
+    ULONGLONG start = CrossProcessClock();
+    for (ULONG pass = 0; pass < passes; pass++)
+    {
+        pChildRecords->GetChildRecords(1, childCount, &recordCount, &records);
+        SysFreeString(records);
+    }
+    pReport->RecordsNanoseconds = CrossProcessClock() - start;
+    start = CrossProcessClock();
+    for (ULONG pass = 0; pass < passes; pass++)
+    {
+        for (long childId = 1; childId <= childCount; childId++)
+        {
+            VARIANT varChild;
+            varChild.vt = VT_I4;
+            varChild.lVal = childId;
+            BSTR name = NULL;
+            pAcc->get_accName(varChild, &name);
+            SysFreeString(name);
+            VARIANT value;
+            pAcc->get_accRole(varChild, &value);
+            pAcc->get_accState(varChild, &value);
+            long left, top, width, height;
+            pAcc->accLocation(&left, &top, &width, &height, varChild);
+        }
+    }
+    pReport->PropertiesNanoseconds = CrossProcessClock() - start;
+
+    pQuery->Release();
+    pChangeLog->Release();
+    pChildRecords->Release();
+    pAcc->Release();
+    return true;
+}
+
+bool CrossProcessTest::WriteReport(const CrossProcessReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    fprintf(pFile, "typelib: LoadRegTypeLib 0x%08lx\n", static_cast<unsigned long>(report.TypeLibResult));
+    for (ULONG i = 0; i < CrossProcessReport::InterfaceCount; i++)
+    {
+        fprintf(pFile, "interface: %s marshaler %s (CoGetPSClsid 0x%08lx), QueryInterface 0x%08lx\n",
+            InterfaceNames[i], report.TypeLibMarshaled[i] ? "type library" :
+            (SUCCEEDED(report.MarshalerResults[i]) ? "NOT type library" : "NOT registered"),
+            static_cast<unsigned long>(report.MarshalerResults[i]), static_cast<unsigned long>(report.QueryResults[i]));
+    }
+    fprintf(pFile, "object: AccessibleObjectFromWindow 0x%08lx\n", static_cast<unsigned long>(report.ObjectResult));
+    double passes = (report.Passes > 0) ? report.Passes : 1.0;
+    double records = report.RecordsNanoseconds / passes;
+    double properties = report.PropertiesNanoseconds / passes;
+    fprintf(pFile, "children: %ld, read %lu times on each path\n", report.Children, report.Passes);
+    fprintf(pFile, "read: child records %.0f ns/pass, IAccessible properties %.0f ns/pass (%.1fx)\n",
+        records, properties, (records > 0) ? properties / records : 0.0);
+    fprintf(pFile, "results: %lu compared, %lu mismatches\n", report.Compared, report.Mismatches);
+    fclose(pFile);
+    return true;
+}
@@ -0,0 +1,54 @@
+/*************************************************************************************************
+* Description: Declarations for the cross-process test, which uses the accessible object from
+* another process, as screen readers and other clients do.
+*
+* The server process fills a hidden control with contacts and starts a second copy of the
+* executable as the client, then pumps messages so that COM can deliver the client's calls.
+* The client gets the IAccessible for the control with AccessibleObjectFromWindow, queries it
+* for each of the interfaces in AccExtensions.h, and compares what they return with what
+* IAccessible returns for the same children. It then times reading every child both ways, and
+* writes the report. The test passes if every interface could be queried and nothing differs.
+*
+* So that a failure can be told apart from a registration problem, the report also gives,
+* whether or not the test got that far, the result of loading the registered type library,
+* the marshaler registered for each interface, and the result of each QueryInterface.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+
+struct CrossProcessReport
+{
+    static const ULONG InterfaceCount = 3;  // IAccChildRecords, IAccChangeLog and IAccQuery.
+
+    HRESULT TypeLibResult;              // LoadRegTypeLib for the extensions' type library.
+    HRESULT MarshalerResults[InterfaceCount];   // CoGetPSClsid for each interface.
+    bool TypeLibMarshaled[InterfaceCount];      // Its marshaler is the type library marshaler.
+    HRESULT ObjectResult;               // AccessibleObjectFromWindow.
+    HRESULT QueryResults[InterfaceCount];
+    long Children;
+    ULONG Passes;                       // Over every child, on each path.
+    ULONGLONG RecordsNanoseconds;       // One GetChildRecords call per pass.
+    ULONGLONG PropertiesNanoseconds;    // IAccessible calls for each child per pass.
+    ULONG Compared;                     // Results compared between the two paths.
+    ULONG Mismatches;
+};
+
+namespace CrossProcessTest
+{
+    bool Serve(HINSTANCE hInstance, const WCHAR* reportPath);
+    bool RunClient(HWND hwnd, ULONG passes, CrossProcessReport* pReport);
+    bool WriteReport(const CrossProcessReport& report, const WCHAR* reportPath);
+}
@@ -18,23 +18,156 @@
 *************************************************************************************************/
 #include "CustomControl.h"
 #include "AccServer.h"
+#include "AccStats.h"
+#include "MemoryStats.h"
+#include "QueryRecorder.h"
+#include "TraceLog.h"
+#include <algorithm>
+#include <unordered_set>
+
+// Asks the control to run the completions of background work. Called on a
+// worker thread.
+//
+static void PostWorkComplete(void* context)
+{
+    PostMessage(static_cast<HWND>(context), CUSTOMLB_WORKCOMPLETE, 0, 0);
+}
+
+// Gets the group that contacts with a status are shown in.
+//
+static ContactGroup GroupFromStatus(ContactStatus status)
+{
+    return (status == Status_Online) ? Group_Online : Group_Offline;
+}
+
+// Timer that runs the next slice of the jobs when input is waiting.
+static const UINT_PTR JobTimerId = 1;
+
+// Timer that writes the memory counters to the debugger, in builds that keep them.
+static const UINT_PTR MemoryTimerId = 2;
+static const UINT MemoryDumpMilliseconds = 60000;
+
+// SortByNameJob class: sorts the items by name, a slice at a time.
+//
+// The sort works on a copy of the item list. If the list changes before the sort
+// is committed, the sort starts again on the new list; after MaxRestarts, it
+// sorts the list in a single step instead, so that a list that keeps changing is
+// still sorted, at the cost of one long slice.
+//
+struct CompareItemNames
+{
+    bool operator()(CustomListControlItem* pLeft, CustomListControlItem* pRight) const
+    {
+        return _wcsicmp(pLeft->GetName(), pRight->GetName()) < 0;
+    }
+};
+
+class SortByNameJob : public TimeSlicedJob
+{
+private:
+    CustomListControl* m_pControl;
+    unsigned int m_generation;      // Generation of the list that was copied.
+    int m_restarts;
+    SlicedMergeSort<CustomListControlItem*, CompareItemNames> m_sort;
+
+    void CopyItems(std::vector<CustomListControlItem*>* pItems)
+    {
+        m_generation = m_pControl->GetGeneration();
+        pItems->clear();
+        for (int i = 0; i < m_pControl->GetCount(); i++)
+        {
+            pItems->push_back(*m_pControl->GetItemAt(i));
+        }
+    }
+
+public:
+    // Items merged in each step.
+    static const size_t ItemsPerStep = 1024;
+    // Times the sort starts again before it sorts in one step.
+    static const int MaxRestarts = 3;
+
+    SortByNameJob(CustomListControl* pControl) : m_pControl(pControl), m_restarts(0)
+    {
+        std::vector<CustomListControlItem*> items;
+        CopyItems(&items);
+        m_sort.Reset(items);
+    }
+
+    virtual bool Step()
+    {
+        if (m_pControl->GetGeneration() != m_generation)
+        {
+            std::vector<CustomListControlItem*> items;
+            CopyItems(&items);
+            if (++m_restarts > MaxRestarts)
+            {
+                std::stable_sort(items.begin(), items.end(), CompareItemNames());
+                m_sort.GetItems().swap(items);
+                return true;
+            }
+            m_sort.Reset(items);
+        }
+        return m_sort.Step(ItemsPerStep);
+    }
+
+    virtual void Commit()
+    {
+        m_pControl->CommitOrder(m_sort.GetItems());
+        QueryRecorder::RecordSortByName(m_pControl);
+    }
+};
+
 
 // CustomListControl class.
 //
 CustomListControl::CustomListControl(HWND hwnd) :
-    m_selectedIndex(-1), m_controlHwnd(hwnd), m_pAccServer(NULL)
+    m_hasFocus(false), m_selectedIndex(-1), m_anchorIndex(-1), m_controlHwnd(hwnd), m_pAccServer(NULL),
+    m_snapshotPending(false), m_pModel(new (std::nothrow) ContactModel()), m_filter(NULL), m_pFilterContext(NULL),
+    m_pSyncOrder(NULL), m_itemPositionsValid(true), m_jobsPending(false),
+    m_generation(0), m_groups(Group_Count), m_grouped(false), m_tiled(false), m_focusedGroup(-1), m_viewEpoch(0),
+    m_stateEpoch(0), m_typedTime(0), m_avatarDC(NULL), m_avatarBitmap(NULL), m_oldAvatarBitmap(NULL),
+    m_pAvatarBits(NULL)
 {
+    // Online contacts are shown to start with; offline ones are counted, but
+    // not listed until their group is expanded.
+    m_groups.SetExpanded(Group_Online, true);
+
+    // The control starts with a model of its own. If it cannot be created, the
+    // window is not created.
+    if (m_pModel != NULL)
+    {
+        m_pModel->AddObserver(this);
+    }
+
+    // There is an entry for every child there can be, so that a lookup never
+    // allocates.
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_childProperties.resize(MaxItems + Group_Count);
+        m_payloadRequests.reserve(MaxItems);
+    }
+
+    // If the region cannot be created, readers simply find no snapshot.
+    m_snapshot.Create(reinterpret_cast<ULONG_PTR>(hwnd));
+
+    // Completions are run when the control handles CUSTOMLB_WORKCOMPLETE.
+    m_executor.Start(0, PostWorkComplete, hwnd);
 }
 
 // Destructor.
 //
 CustomListControl::~CustomListControl()
 {
-    // Free the items in the collection.
-    for (int i = static_cast<int>(m_itemCollection.size()) - 1; i >= 0; i--)
+    // Wait for running work, which may refer to the control, and discard the rest.
+    m_executor.Stop();
+    m_jobs.Clear();
+
+    // Release the model, which deletes the items if no other control shows them.
+    m_itemCollection.clear();
+    if (m_pModel != NULL)
     {
-        CustomListControlItem* pItem = m_itemCollection.at(i);
-        delete pItem;
+        m_pModel->RemoveObserver(this);
+        m_pModel->Release();
     }
 
     // Destroy the accessible object.
@@ -45,6 +178,13 @@ CustomListControl::~CustomListControl()
         // Release the reference created in WM_GETOBJECT.
         m_pAccServer->Release(); 
     }   
+
+    if (m_avatarDC != NULL)
+    {
+        SelectObject(m_avatarDC, m_oldAvatarBitmap);
+        DeleteDC(m_avatarDC);
+        DeleteObject(m_avatarBitmap);
+    }
 }
 
 void CustomListControl::SetAccServer(AccServer* pAccServer)
@@ -57,38 +197,27 @@ AccServer* CustomListControl::GetAccServer()
     return m_pAccServer;
 }
 
-// Adds an item to the end of the list.
+// Adds an item to the end of the list. The model adds it to every view whose
+// filter it passes.
 //
 bool CustomListControl::AddItem(ContactStatus status, WCHAR* name)
 {
-    if (GetCount() >= MaxItems)
+    if (m_pModel->GetCount() >= MaxItems)
     {
         return false;
     }
-    CustomListControlItem* newItem = new (std::nothrow) CustomListControlItem(name);
-    if (newItem)
+    // The views select the item when the model adds it, but the add must come
+    // first in the recording, and only if it succeeds. So nothing is recorded
+    // during the add, and the add and the new selection are recorded after it.
+    QueryRecorder::SetPaused(true);
+    bool added = m_pModel->AddItem(status, name) != NULL;
+    QueryRecorder::SetPaused(false);
+    if (added)
     {
-        newItem->SetStatus(status);
-
-        // Add to collection.
-        m_itemCollection.push_back(newItem);  
-
-        // Send WinEvent.
-        NotifyWinEvent(EVENT_OBJECT_CREATE, m_controlHwnd, OBJID_CLIENT, 
-            (LONG)m_itemCollection.size());
-
-        // Initialize selection when first item is added.
-        if (GetSelectedIndex() < 0)
-        {
-            SelectItem(0);
-        }
-        // Force visual refresh.
-        InvalidateRect(m_controlHwnd, NULL, TRUE);
-
-        return true;
+        QueryRecorder::RecordAddItem(this, status, name);
+        QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
     }
-
-    return false;
+    return added;
 }
 
 // Gets the item at the specified index.
@@ -99,149 +228,1963 @@ LISTITERATOR CustomListControl::GetItemAt(int index)
 }
 
 
-// Removes the specified item.
+// Removes the selected items from the model, and so from every view.
 //
 bool CustomListControl::RemoveSelected()
 {
-    int index = GetSelectedIndex();
-    LISTITERATOR itemToDelete = GetItemAt(index);
-    // Don't allow deletion of the last remaining item. This is just to
+    // Don't allow deletion of every remaining item. This is just to
     // simplify the logic of the sample.
-    if (GetCount() == 1)
+    int removeCount = m_selection.GetCount();
+    if ((removeCount == 0) || (removeCount >= GetCount()))
     {
         return FALSE;
     }
-    CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*itemToDelete);
-    // Remove from list.
-    m_itemCollection.erase(itemToDelete);
-    // Delete object.
-    delete pItem;
+    QueryRecorder::RecordRemoveSelected(this);
 
-    // Select at the same index; if we deleted the bottom item, 
-    // the index will be decremented.
-    SelectItem(GetSelectedIndex());   
+    // With the focus rectangle on the first removed item, the item that takes
+    // its place is selected when the view is updated, or the last item if the
+    // bottom items were removed.
+    m_selectedIndex = m_selection.GetFirst();
 
-    // Raise WinEvent.
-    NotifyWinEvent(EVENT_OBJECT_DESTROY, m_controlHwnd, OBJID_CLIENT, static_cast<LONG>(index) + 1);
+    std::vector<CustomListControlItem*> removed;
+    removed.reserve(removeCount);
+    for (int r = 0; r < m_selection.GetRangeCount(); r++)
+    {
+        const SelectionRangeSet::Range& range = m_selection.GetRange(r);
+        for (int i = range.First; i < range.Last; i++)
+        {
+            removed.push_back(m_itemCollection[i]);
+        }
+    }
+    m_pModel->RemoveItems(removed);
     return TRUE;
 }
 
-// Gets the index of the item at a point on the Y coordinate within the list.
+// Moves an item to a new position. The item keeps its selection state, and the
+// focus rectangle stays on the same item.
 //
-int CustomListControl::IndexFromY(int y)
+bool CustomListControl::MoveItem(int index, int newIndex)
 {
-    int index = y / ItemHeight;
-    if ((index < 0) || (GetCount() <= index))
+    if ((index < 0) || (index >= GetCount()) || (newIndex < 0) || (newIndex >= GetCount()))
+    {
+        return false;
+    }
+    if (index == newIndex)
+    {
+        return true;
+    }
+    CustomListControlItem* pItem = m_itemCollection[index];
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_itemCollection.erase(m_itemCollection.begin() + index);
+        m_itemCollection.insert(m_itemCollection.begin() + newIndex, pItem);
+    }
+    m_changeLog.AddMove(pItem->GetId(), index, newIndex);
+    m_itemPositionsValid = false;
+    m_generation++;
+    m_groups.OnItemsMoved();
+    UpdateGroupMembers();
+
+    bool wasSelected = m_selection.Contains(index);
+    m_selection.OnItemsRemoved(index, 1);
+    m_selection.OnItemsInserted(newIndex, 1);
+    if (wasSelected)
+    {
+        m_selection.AddRange(newIndex, newIndex + 1);
+    }
+    if (m_selectedIndex == index)
     {
-        index = -1;
+        m_selectedIndex = newIndex;
     }
-    return index;
+    else if ((index < m_selectedIndex) && (m_selectedIndex <= newIndex))
+    {
+        m_selectedIndex--;
+    }
+    else if ((newIndex <= m_selectedIndex) && (m_selectedIndex < index))
+    {
+        m_selectedIndex++;
+    }
+    m_anchorIndex = m_selectedIndex;
+    QueryRecorder::RecordMoveItem(this, index, newIndex);
+
+    RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+    return true;
 }
 
-// Sets the selected item.
+// Renames an item.
 //
-void CustomListControl::SelectItem(int index)
+bool CustomListControl::SetItemName(int index, WCHAR* name)
 {
-    m_selectedIndex = index;
-    if (m_selectedIndex >= static_cast<int>(m_itemCollection.size()))
+    if ((index < 0) || (index >= GetCount()) || (name == NULL))
     {
-        m_selectedIndex = static_cast<int>(m_itemCollection.size()) - 1;  
+        return false;
     }
-
-    // Raise WinEvents.
-    NotifyWinEvent(EVENT_OBJECT_SELECTION, m_controlHwnd, OBJID_CLIENT, m_selectedIndex + 1);
-    if (GetIsFocused())
+    // A view that filters on names may drop the item, so the selection is
+    // recorded after the change, as for SetItemStatus.
+    QueryRecorder::SetPaused(true);
+    bool renamed = m_pModel->SetItemName(m_itemCollection[index], name);
+    QueryRecorder::SetPaused(false);
+    if (renamed)
     {
-        NotifyWinEvent(EVENT_OBJECT_FOCUS, m_controlHwnd, OBJID_CLIENT, m_selectedIndex + 1);
+        QueryRecorder::RecordItemName(this, index, name);
+        QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
     }
+    return renamed;
+}
 
-    // Force refresh.
-    InvalidateRect(m_controlHwnd, NULL, TRUE);
+// Changes the status of an item. The status shows in the item's help string.
+//
+bool CustomListControl::SetItemStatus(int index, ContactStatus status)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return false;
+    }
+    // A view that filters on status may drop the item and change its
+    // selection, which is recorded after the change, as for AddItem.
+    QueryRecorder::SetPaused(true);
+    m_pModel->SetItemStatus(m_itemCollection[index], status);
+    QueryRecorder::SetPaused(false);
+    QueryRecorder::RecordItemStatus(this, index, status);
+    QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+    return true;
 }
 
-// Gets the index of the selected item.
+// Replaces the contacts in the model with a complete roster, in which each
+// contact is identified by its item ID. Contacts in both keep their items, so
+// the selection and the focus rectangle stay on them in every view. This view
+// takes the roster's order with the fewest moves; other views keep their own
+// order. Returns false, and leaves the model as it was, if the roster has more
+// than MaxItems contacts, repeats an ID, has a contact with ID 0 or no name, or
+// memory runs out.
 //
-int CustomListControl::GetSelectedIndex()
+bool CustomListControl::SyncRoster(const std::vector<RosterEntry>& roster)
 {
-    return m_selectedIndex;
+    TRACE_SPAN("CustomListControl::SyncRoster");
+    if (roster.size() > static_cast<size_t>(MaxItems))
+    {
+        return false;
+    }
+
+    // Check the roster and create the new items before anything changes.
+    std::unordered_set<unsigned int> ids;
+    std::vector<CustomListControlItem*> items(roster.size(), NULL);
+    std::vector<bool> isNew(roster.size(), false);
+    bool failed = false;
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        for (size_t j = 0; (j < roster.size()) && !failed; j++)
+        {
+            if ((roster[j].Id == 0) || (roster[j].Name == NULL) || !ids.insert(roster[j].Id).second)
+            {
+                failed = true;
+                break;
+            }
+            items[j] = m_pModel->FindItem(roster[j].Id);
+            if (items[j] != NULL)
+            {
+                continue;
+            }
+            items[j] = new (std::nothrow) CustomListControlItem(roster[j].Id, roster[j].Name);
+            if ((items[j] == NULL) || (items[j]->GetName() == NULL))
+            {
+                delete items[j];
+                items[j] = NULL;
+                failed = true;
+            }
+            else
+            {
+                items[j]->SetStatus(roster[j].Status);
+                isNew[j] = true;
+            }
+        }
+    }
+    if (failed)
+    {
+        for (size_t j = 0; j < roster.size(); j++)
+        {
+            if (isNew[j])
+            {
+                delete items[j];
+            }
+        }
+        return false;
+    }
+
+    // Make the changes as one commit. If a name cannot be copied, the contact
+    // keeps its old one. The roster, and the selection that results, are
+    // recorded once the commit is done.
+    QueryRecorder::SetPaused(true);
+    m_pModel->BeginUpdate();
+    std::vector<CustomListControlItem*> removed;
+    for (int i = m_pModel->GetCount() - 1; i >= 0; i--)
+    {
+        if (ids.find(m_pModel->GetItem(i)->GetId()) == ids.end())
+        {
+            removed.push_back(m_pModel->GetItem(i));
+        }
+    }
+    m_pModel->RemoveItems(removed);
+    for (size_t j = 0; j < roster.size(); j++)
+    {
+        CustomListControlItem* pItem = items[j];
+        if (isNew[j])
+        {
+            m_pModel->AddItem(pItem);
+            continue;
+        }
+        m_pModel->SetItemStatus(pItem, roster[j].Status);
+        if ((pItem->GetName() == NULL) || (wcscmp(pItem->GetName(), roster[j].Name) != 0))
+        {
+            m_pModel->SetItemName(pItem, roster[j].Name);
+        }
+    }
+    std::vector<CustomListControlItem*> order;
+    for (size_t j = 0; j < roster.size(); j++)
+    {
+        if (PassesFilter(items[j]))
+        {
+            order.push_back(items[j]);
+        }
+    }
+    m_pSyncOrder = &order;
+    m_pModel->EndUpdate();
+
+    // If no contact changed, the commit was empty, but the order may not be.
+    if (m_pSyncOrder != NULL)
+    {
+        m_pSyncOrder = NULL;
+        ApplyItems(order, std::vector<ModelChange>());
+    }
+    QueryRecorder::SetPaused(false);
+    QueryRecorder::RecordSyncRoster(this, roster);
+    QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+    return true;
 }
 
-// Gets the focused state.
+// Updates the view after a commit to the model. Items keep their places; those
+// that are removed, or no longer pass the filter, leave the view, and those
+// that are added, or now pass it, go at the end.
 //
-bool CustomListControl::GetIsFocused()
+void CustomListControl::OnModelChanged(const std::vector<ModelChange>& changes)
 {
-    return m_hasFocus;
+    if (m_pSyncOrder != NULL)
+    {
+        // The commit is this view's SyncRoster, which gives the order.
+        const std::vector<CustomListControlItem*>* pOrder = m_pSyncOrder;
+        m_pSyncOrder = NULL;
+        ApplyItems(*pOrder, changes);
+        return;
+    }
+
+    std::vector<CustomListControlItem*> items;
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        std::unordered_set<CustomListControlItem*> removed;
+        for (size_t c = 0; c < changes.size(); c++)
+        {
+            if (changes[c].Type == ModelChange_Remove)
+            {
+                removed.insert(changes[c].pItem);
+            }
+        }
+        std::unordered_set<CustomListControlItem*> seen(m_itemCollection.begin(), m_itemCollection.end());
+        items.reserve(m_itemCollection.size() + changes.size());
+        for (int i = 0; i < GetCount(); i++)
+        {
+            if ((removed.find(m_itemCollection[i]) == removed.end()) && PassesFilter(m_itemCollection[i]))
+            {
+                items.push_back(m_itemCollection[i]);
+            }
+        }
+        for (size_t c = 0; c < changes.size(); c++)
+        {
+            CustomListControlItem* pItem = changes[c].pItem;
+            if (seen.insert(pItem).second && (removed.find(pItem) == removed.end()) && PassesFilter(pItem))
+            {
+                items.push_back(pItem);
+            }
+        }
+    }
+    ApplyItems(items, changes);
 }
 
-// Sets the focused state.
+// Makes the view show a list of items from the model, in order, with the
+// fewest edits, and logs the renames and status changes in a commit to the
+// items it already showed. Items that stay keep their selection state and the
+// focus rectangle; if that was on an item that has gone, it stays at the same
+// index, and the item there is selected if nothing else is.
 //
-void CustomListControl::SetIsFocused(bool isFocused)
+void CustomListControl::ApplyItems(const std::vector<CustomListControlItem*>& items, const std::vector<ModelChange>& changes)
 {
-    m_hasFocus = isFocused;
+    std::vector<unsigned int> oldIds(m_itemCollection.size());
+    for (size_t i = 0; i < m_itemCollection.size(); i++)
+    {
+        oldIds[i] = m_itemCollection[i]->GetId();
+    }
+    std::vector<unsigned int> newIds(items.size());
+    for (size_t j = 0; j < items.size(); j++)
+    {
+        newIds[j] = items[j]->GetId();
+    }
+    std::vector<RosterEdit> edits;
+    if (!RosterDiff::Compute(oldIds, newIds, &edits))
+    {
+        // IDs are unique within a model.
+        return;
+    }
+
+    // Log the renames and status changes of the items that are shown first, at
+    // their current indexes. The groups count each item under the status it
+    // had when the view last saw it.
+    UpdateItemPositions();
+    std::vector<CustomListControlItem*> renamed;
+    std::vector<CustomListControlItem*> statusChanged;
+    for (size_t c = 0; c < changes.size(); c++)
+    {
+        const ModelChange& change = changes[c];
+        if ((change.Type != ModelChange_Rename) && (change.Type != ModelChange_Status))
+        {
+            continue;
+        }
+        std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(change.pItem->GetId());
+        if ((found == m_itemPositions.end()) || (m_itemCollection[found->second] != change.pItem))
+        {
+            continue;
+        }
+        int index = found->second;
+        if (change.Type == ModelChange_Rename)
+        {
+            m_changeLog.AddRename(change.pItem->GetId(), index, change.pItem->GetName());
+            renamed.push_back(change.pItem);
+        }
+        else
+        {
+            {
+                MEMSTATS_SCOPE(MemoryTag_Items);
+                m_groups.OnMemberRemoved(GroupFromStatus(change.OldStatus), index);
+                m_groups.OnMemberAdded(GroupFromStatus(change.NewStatus), index);
+            }
+            m_changeLog.AddStatus(change.pItem->GetId(), index, change.NewStatus);
+            statusChanged.push_back(change.pItem);
+        }
+    }
+    if (edits.empty() && renamed.empty() && statusChanged.empty())
+    {
+        return;
+    }
+    m_generation++;
+
+    CustomListControlItem* pFocused = ((m_selectedIndex >= 0) && (m_selectedIndex < GetCount()))
+        ? m_itemCollection[m_selectedIndex] : NULL;
+    std::unordered_set<CustomListControlItem*> selected;
+    for (int r = 0; r < m_selection.GetRangeCount(); r++)
+    {
+        const SelectionRangeSet::Range& range = m_selection.GetRange(r);
+        for (int i = range.First; i < range.Last; i++)
+        {
+            selected.insert(m_itemCollection[i]);
+        }
+    }
+    bool selectionChanged = false;
+
+    // Apply the edits in order. The removals come first, at the old indexes.
+    // Unless the only edit adds an item at the end, other items change index,
+    // so the lists of group members are rebuilt afterwards.
+    if (!edits.empty()
+        && ((edits.size() > 1) || (edits[0].Type != RosterEdit_Insert) || (edits[0].Index != GetCount())))
+    {
+        m_groups.OnItemsMoved();
+    }
+    for (size_t e = 0; e < edits.size(); e++)
+    {
+        const RosterEdit& edit = edits[e];
+        if (edit.Type == RosterEdit_Remove)
+        {
+            CustomListControlItem* pItem = m_itemCollection[edit.Index];
+            m_changeLog.AddRemove(edit.Id, edit.Index);
+            m_groups.OnMemberRemoved(GroupFromStatus(pItem->GetStatus()), edit.Index);
+            if ((selected.erase(pItem) != 0) || (pItem == pFocused))
+            {
+                selectionChanged = true;
+            }
+        }
+        else if (edit.Type == RosterEdit_Insert)
+        {
+            CustomListControlItem* pItem = items[edit.Source];
+            m_changeLog.AddInsert(edit.Id, edit.Index, pItem->GetName(), pItem->GetStatus());
+            MEMSTATS_SCOPE(MemoryTag_Items);
+            m_groups.OnMemberAdded(GroupFromStatus(pItem->GetStatus()), edit.Index);
+        }
+        else
+        {
+            m_changeLog.AddMove(edit.Id, edit.Index, edit.NewIndex);
+        }
+    }
+
+    if (!edits.empty())
+    {
+        {
+            MEMSTATS_SCOPE(MemoryTag_Items);
+            m_itemCollection.assign(items.begin(), items.end());
+        }
+        m_itemPositionsValid = false;
+
+        int focusIndex = (std::min)(m_selectedIndex, GetCount() - 1);
+        m_selectedIndex = -1;
+        m_selection.Clear();
+        for (int i = 0; i < GetCount(); i++)
+        {
+            if (selected.find(m_itemCollection[i]) != selected.end())
+            {
+                m_selection.AddRange(i, i + 1);
+            }
+            if (m_itemCollection[i] == pFocused)
+            {
+                m_selectedIndex = i;
+            }
+        }
+        if (m_selectedIndex < 0)
+        {
+            m_selectedIndex = (std::max)(focusIndex, (GetCount() > 0) ? 0 : -1);
+        }
+        if ((m_selection.GetCount() == 0) && (m_selectedIndex >= 0))
+        {
+            m_selection.AddRange(m_selectedIndex, m_selectedIndex + 1);
+            selectionChanged = true;
+        }
+        m_anchorIndex = m_selectedIndex;
+    }
+    UpdateGroupMembers();
+
+    // Raise WinEvents. A single addition or removal is reported as such; after
+    // any other change to the children, a single reorder event tells clients
+    // to read them again, names and statuses included.
+    bool reorder = m_grouped ? (!edits.empty() || !statusChanged.empty())
+        : ((edits.size() > 1) || ((edits.size() == 1) && (edits[0].Type == RosterEdit_Move)));
+    if (reorder)
+    {
+        RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+    }
+    else
+    {
+        if (edits.size() == 1)
+        {
+            RaiseWinEvent((edits[0].Type == RosterEdit_Insert) ? EVENT_OBJECT_CREATE : EVENT_OBJECT_DESTROY,
+                static_cast<LONG>(edits[0].Index) + 1);
+        }
+        // Items that were changed and then removed have no events.
+        UpdateItemPositions();
+        for (size_t n = 0; n < renamed.size(); n++)
+        {
+            std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(renamed[n]->GetId());
+            // An item in a collapsed group is not a child, so there is no event for it.
+            if ((found != m_itemPositions.end()) && (ChildFromItem(found->second) != CHILDID_SELF))
+            {
+                RaiseWinEvent(EVENT_OBJECT_NAMECHANGE, ChildFromItem(found->second));
+            }
+        }
+        for (size_t n = 0; n < statusChanged.size(); n++)
+        {
+            std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(statusChanged[n]->GetId());
+            if ((found != m_itemPositions.end()) && (ChildFromItem(found->second) != CHILDID_SELF))
+            {
+                RaiseWinEvent(EVENT_OBJECT_HELPCHANGE, ChildFromItem(found->second));
+            }
+        }
+    }
+    if (selectionChanged)
+    {
+        bool single = (m_selection.GetCount() == 1) && IsItemSelected(m_selectedIndex);
+        RaiseSelectionEvents(m_selectedIndex, single ? EVENT_OBJECT_SELECTION : EVENT_OBJECT_SELECTIONWITHIN);
+    }
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
 }
 
-// Gets the count of items in the list.
+// Decides whether the view shows an item.
 //
-int CustomListControl::GetCount()
+bool CustomListControl::PassesFilter(CustomListControlItem* pItem)
 {
-    return static_cast<int>(m_itemCollection.size());
+    return (m_filter == NULL) || m_filter(pItem, m_pFilterContext);
 }
 
-// Gets the bounds of the specified item.
+// Shows only the items that pass a filter, or every item if filter is NULL.
+// Items that stay keep their places; those that now pass go at the end, in
+// the model's order.
 //
-bool CustomListControl::GetItemScreenRect(int index, RECT* pRetVal)
+void CustomListControl::SetFilter(ContactFilter filter, void* pContext)
 {
-    if ((pRetVal == NULL) || (index >= static_cast<int>(m_itemCollection.size())) || (index < 0))
+    m_filter = filter;
+    m_pFilterContext = pContext;
+    std::vector<CustomListControlItem*> items;
+    std::unordered_set<CustomListControlItem*> seen(m_itemCollection.begin(), m_itemCollection.end());
+    for (int i = 0; i < GetCount(); i++)
     {
-        return false;
+        if (PassesFilter(m_itemCollection[i]))
+        {
+            items.push_back(m_itemCollection[i]);
+        }
     }
-    // Get the container rectangle.
-    RECT parentRect;
-    GetClientRect(m_controlHwnd, &parentRect);
-    // Align to size of contents.
-    InflateRect(&parentRect, -4, -4);
-
-    // Convert top left corner to screen coordinates.
-    POINT upperLeft;
-    upperLeft.x = parentRect.left;  
-    upperLeft.y = parentRect.top;
-    ClientToScreen(m_controlHwnd, &upperLeft);
-
-    // Get coordinates of list item.
-    pRetVal->left = upperLeft.x;
-    pRetVal->right = pRetVal->left + parentRect.right - parentRect.left;
-    pRetVal->top = upperLeft.y + (ItemHeight * index);
-    pRetVal->bottom = pRetVal->top + ItemHeight;
-    return true;
+    for (int i = 0; i < m_pModel->GetCount(); i++)
+    {
+        CustomListControlItem* pItem = m_pModel->GetItem(i);
+        if ((seen.find(pItem) == seen.end()) && PassesFilter(pItem))
+        {
+            items.push_back(pItem);
+        }
+    }
+    ApplyItems(items, std::vector<ModelChange>());
 }
 
+// Gets the model the control shows.
+//
+ContactModel* CustomListControl::GetModel()
+{
+    return m_pModel;
+}
 
-// Responds to double-click on an item. For simplicity, we simply show the name
-// of the selected contact.
+// Makes the control a view of another model, such as that of another control,
+// so that both show the same contacts without copying them. The filter stays.
+//
+void CustomListControl::SetModel(ContactModel* pModel)
+{
+    if ((pModel == NULL) || (pModel == m_pModel))
+    {
+        return;
+    }
+    // Items in different models may have the same IDs, so the old ones go first.
+    ApplyItems(std::vector<CustomListControlItem*>(), std::vector<ModelChange>());
+    m_pModel->RemoveObserver(this);
+    m_pModel->Release();
+    m_pModel = pModel;
+    m_pModel->AddRef();
+    m_pModel->AddObserver(this);
+
+    std::vector<CustomListControlItem*> items;
+    for (int i = 0; i < m_pModel->GetCount(); i++)
+    {
+        if (PassesFilter(m_pModel->GetItem(i)))
+        {
+            items.push_back(m_pModel->GetItem(i));
+        }
+    }
+    ApplyItems(items, std::vector<ModelChange>());
+}
+
+// Gets the generation of the items, which changes whenever an item is added,
+// removed, moved or changed.
+//
+unsigned int CustomListControl::GetGeneration()
+{
+    return m_generation;
+}
+
+// Replaces the order of the items with a permutation of them, as a single
+// change. Selected items stay selected, and the focus rectangle stays on the
+// same item.
+//
+void CustomListControl::CommitOrder(const std::vector<CustomListControlItem*>& items)
+{
+    CustomListControlItem* pFocused = ((m_selectedIndex >= 0) && (m_selectedIndex < GetCount()))
+        ? m_itemCollection[m_selectedIndex] : NULL;
+    std::unordered_set<CustomListControlItem*> selected;
+    for (int r = 0; r < m_selection.GetRangeCount(); r++)
+    {
+        const SelectionRangeSet::Range& range = m_selection.GetRange(r);
+        for (int i = range.First; i < range.Last; i++)
+        {
+            selected.insert(m_itemCollection[i]);
+        }
+    }
+
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_itemCollection.assign(items.begin(), items.end());
+    }
+    m_itemPositionsValid = false;
+    m_changeLog.Reset();
+    m_generation++;
+    m_groups.OnItemsMoved();
+    UpdateGroupMembers();
+
+    m_selection.Clear();
+    for (int i = 0; i < GetCount(); i++)
+    {
+        if (selected.find(m_itemCollection[i]) != selected.end())
+        {
+            m_selection.AddRange(i, i + 1);
+        }
+        if (m_itemCollection[i] == pFocused)
+        {
+            m_selectedIndex = i;
+        }
+    }
+    m_anchorIndex = m_selectedIndex;
+
+    RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Sorts the items by name, ignoring case. The sort runs in slices between
+// other messages, and the new order appears all at once when it is done.
+//
+void CustomListControl::SortItemsByName()
+{
+    ScheduleJob(new (std::nothrow) SortByNameJob(this));
+}
+
+// Runs a job in slices on the UI thread, after any jobs already scheduled.
+// The control deletes the job when it is done.
+//
+void CustomListControl::ScheduleJob(TimeSlicedJob* pJob)
+{
+    if (pJob != NULL)
+    {
+        m_jobs.Add(pJob);
+        ContinueJobs();
+    }
+}
+
+// Arranges for the next slice of the jobs to run once waiting messages have
+// been handled. Posted messages are retrieved before input, so when input is
+// waiting the slice waits for a timer, which is retrieved after it.
+//
+void CustomListControl::ContinueJobs()
+{
+    if (m_jobsPending)
+    {
+        return;
+    }
+    if (HIWORD(GetQueueStatus(QS_INPUT)) != 0)
+    {
+        m_jobsPending = (SetTimer(m_controlHwnd, JobTimerId, USER_TIMER_MINIMUM, NULL) != 0);
+    }
+    else
+    {
+        m_jobsPending = (PostMessage(m_controlHwnd, CUSTOMLB_RUNJOBS, 0, 0) != FALSE);
+    }
+}
+
+// Runs the next slice of the jobs.
+//
+void CustomListControl::RunJobs()
+{
+    KillTimer(m_controlHwnd, JobTimerId);
+    m_jobsPending = false;
+    if (m_jobs.RunSlice())
+    {
+        ContinueJobs();
+    }
+}
+
+// Runs the jobs to the end, without letting other messages through.
+//
+void CustomListControl::FinishJobs()
+{
+    while (m_jobs.RunSlice())
+    {
+    }
+}
+
+// Gets the log of recent changes to the items.
+//
+const ChangeLog& CustomListControl::GetChangeLog()
+{
+    return m_changeLog;
+}
+
+// Rebuilds the map from item ID to index. Positions are rebuilt only when a
+// query needs them after a removal or move.
+//
+void CustomListControl::UpdateItemPositions()
+{
+    if (!m_itemPositionsValid)
+    {
+        m_itemPositions.clear();
+        for (int i = 0; i < GetCount(); i++)
+        {
+            m_itemPositions[m_itemCollection[i]->GetId()] = i;
+        }
+        m_itemPositionsValid = true;
+    }
+}
+
+// Finds the items that match a name and status, in index order. Use AnyStatus
+// to match any status.
+//
+void CustomListControl::FindItems(const WCHAR* name, NameMatch match, int status, std::vector<int>* pIndexes)
+{
+    pIndexes->clear();
+    std::vector<unsigned int> itemIds;
+    m_pModel->GetContactIndex().Find(name, match, status, &itemIds);
+    if (itemIds.empty())
+    {
+        return;
+    }
+
+    UpdateItemPositions();
+    pIndexes->reserve(itemIds.size());
+    for (size_t i = 0; i < itemIds.size(); i++)
+    {
+        // Items that the filter hides are not found.
+        std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(itemIds[i]);
+        if (found != m_itemPositions.end())
+        {
+            pIndexes->push_back(found->second);
+        }
+    }
+    std::sort(pIndexes->begin(), pIndexes->end());
+}
+
+// Selects the items whose names contain some text, ignoring case, and moves the
+// focus rectangle to the first of them. If no name contains the text, the
+// selection and the focus rectangle stay as they were. Returns the number of
+// items selected.
+//
+int CustomListControl::SelectMatching(const WCHAR* text)
+{
+    std::vector<int> indexes;
+    FindItems(text, Match_Substring, AnyStatus, &indexes);
+    if (indexes.empty())
+    {
+        return 0;
+    }
+    std::vector<SelectionRangeSet::Range> ranges;
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        if (!ranges.empty() && (ranges.back().Last == indexes[i]))
+        {
+            ranges.back().Last++;
+        }
+        else
+        {
+            SelectionRangeSet::Range range = { indexes[i], indexes[i] + 1 };
+            ranges.push_back(range);
+        }
+    }
+    SetSelection(ranges, indexes[0]);
+    return static_cast<int>(indexes.size());
+}
+
+// Adds a typed character to the text that selects matching items, starting the
+// text again if the last character was typed more than TypeAheadTimeout ago.
+// Backspace removes the last character. If no name contains the text, the item
+// whose name comes closest, allowing for a typing mistake, is selected instead.
+// Returns the number of items selected.
+//
+int CustomListControl::TypeAhead(WCHAR character, DWORD time)
+{
+    if (time - m_typedTime > TypeAheadTimeout)
+    {
+        m_typedText.clear();
+    }
+    m_typedTime = time;
+    if (character == L'\b')
+    {
+        if (!m_typedText.empty())
+        {
+            m_typedText.erase(m_typedText.size() - 1);
+        }
+    }
+    else
+    {
+        m_typedText.push_back(character);
+    }
+    if (m_typedText.empty())
+    {
+        return 0;
+    }
+    int selected = SelectMatching(m_typedText.c_str());
+    if ((selected == 0) && (m_typedText.size() >= TypeAheadMinimumApproximate))
+    {
+        std::vector<int> indexes;
+        FindApproximate(m_typedText.c_str(), 1, 1, &indexes);
+        if (!indexes.empty())
+        {
+            SelectItem(indexes[0]);
+            selected = 1;
+        }
+    }
+    return selected;
+}
+
+// Checks whether type-ahead text is being typed, so that a space is part of
+// it rather than a key that selects the focused item.
+//
+bool CustomListControl::IsTypingAhead(DWORD time)
+{
+    return !m_typedText.empty() && (time - m_typedTime <= TypeAheadTimeout);
+}
+
+// Answers substring searches from a trigram index, which is mapped from a file
+// if one was saved for the current names, and saved there when the control is
+// destroyed.
+//
+void CustomListControl::OpenSearchIndex(const char* path)
+{
+    m_pModel->OpenSearchIndex(path);
+}
+
+// Gives the contacts of the model avatars and status messages from a directory
+// of payload files, through a cache of capacityBytes, or the default size if
+// zero. Every view of the model shows them.
+//
+bool CustomListControl::OpenPayloadStore(const char* directory, size_t capacityBytes)
+{
+    PayloadCacheOptions options;
+    PayloadCache::GetDefaultOptions(&options);
+    options.ThumbnailSize = AvatarSize;
+    if (capacityBytes > 0)
+    {
+        options.CapacityBytes = capacityBytes;
+    }
+    FilePayloadStore* pStore = new (std::nothrow) FilePayloadStore(directory);
+    if ((pStore == NULL) || !m_pModel->SetPayloadStore(pStore, options))
+    {
+        return false;
+    }
+    m_generation++;
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+    return true;
+}
+
+// Tells whether the contacts have payloads, and so room is left for avatars.
+//
+bool CustomListControl::HasPayloads()
+{
+    return m_pModel->GetPayloads() != NULL;
+}
+
+// Gets the payload of an item for painting, or NULL if it is not in the cache,
+// in which case it is loaded and the item painted again. Does not allocate.
+//
+ContactPayloadPtr CustomListControl::GetItemPayload(int index)
+{
+    const std::shared_ptr<PayloadCache>& pPayloads = m_pModel->GetPayloads();
+    if (pPayloads == NULL)
+    {
+        return ContactPayloadPtr();
+    }
+    unsigned int id = m_itemCollection[index]->GetId();
+    ContactPayloadPtr pPayload = pPayloads->Find(id);
+    if ((pPayload == NULL) && (m_payloadRequests.size() < m_payloadRequests.capacity())
+        && (std::find(m_payloadRequests.begin(), m_payloadRequests.end(), id) == m_payloadRequests.end()))
+    {
+        // The loads are started after painting, which must not allocate.
+        if (m_payloadRequests.empty())
+        {
+            PostMessage(m_controlHwnd, CUSTOMLB_LOADPAYLOADS, 0, 0);
+        }
+        m_payloadRequests.push_back(id);
+    }
+    return pPayload;
+}
+
+// Draws an avatar, or a placeholder if the payload has not been loaded. A
+// contact with no avatar has neither. The cache has scaled the avatar to
+// AvatarSize, so it is copied to a DIB section that is kept for the purpose
+// and drawn with one AlphaBlend, without stretching.
+//
+void CustomListControl::DrawAvatar(HDC hdc, const ContactPayload* pPayload, int x, int y, HBRUSH placeholderBrush)
+{
+    if (pPayload == NULL)
+    {
+        HGDIOBJ oldBrush = SelectObject(hdc, placeholderBrush);
+        Ellipse(hdc, x, y, x + AvatarSize, y + AvatarSize);
+        SelectObject(hdc, oldBrush);
+        return;
+    }
+    if ((pPayload->AvatarWidth != AvatarSize) || (pPayload->AvatarHeight != AvatarSize))
+    {
+        return;
+    }
+
+    if (m_avatarDC == NULL)
+    {
+        // The pixels are premultiplied, as AlphaBlend needs, and top row first.
+        BITMAPINFO info;
+        ZeroMemory(&info, sizeof(info));
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = AvatarSize;
+        info.bmiHeader.biHeight = -AvatarSize;
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        void* pBits = NULL;
+        HBITMAP bitmap = CreateDIBSection(hdc, &info, DIB_RGB_COLORS, &pBits, NULL, 0);
+        if (bitmap == NULL)
+        {
+            return;
+        }
+        HDC bitmapDC = CreateCompatibleDC(hdc);
+        if (bitmapDC == NULL)
+        {
+            DeleteObject(bitmap);
+            return;
+        }
+        m_avatarDC = bitmapDC;
+        m_avatarBitmap = bitmap;
+        m_oldAvatarBitmap = SelectObject(bitmapDC, bitmap);
+        m_pAvatarBits = static_cast<unsigned int*>(pBits);
+    }
+
+    // GDI may still be reading the bits for the last avatar.
+    GdiFlush();
+    memcpy(m_pAvatarBits, &pPayload->AvatarPixels[0], AvatarSize * AvatarSize * sizeof(unsigned int));
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    AlphaBlend(hdc, x, y, AvatarSize, AvatarSize, m_avatarDC, 0, 0, AvatarSize, AvatarSize, blend);
+}
+
+// Starts loading the payloads that painting found missing.
+//
+void CustomListControl::LoadPayloads()
+{
+    const std::shared_ptr<PayloadCache>& pPayloads = m_pModel->GetPayloads();
+    for (size_t i = 0; (pPayloads != NULL) && (i < m_payloadRequests.size()); i++)
+    {
+        pPayloads->Request(m_payloadRequests[i], m_executor,
+            [this](unsigned int id)
+            {
+                m_pModel->NotifyPayloadLoaded(id);
+            });
+    }
+    m_payloadRequests.clear();
+}
+
+// Paints an item again when its payload has been loaded.
+//
+void CustomListControl::OnPayloadLoaded(unsigned int id)
+{
+    UpdateItemPositions();
+    std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(id);
+    RECT rect;
+    if ((found != m_itemPositions.end()) && GetChildClientRect(ChildFromItem(found->second), &rect))
+    {
+        InvalidateRect(m_controlHwnd, &rect, TRUE);
+    }
+}
+
+// Gets the thread pool for expensive work. Completions run on the UI thread,
+// so they may update the control.
+//
+WorkExecutor& CustomListControl::GetExecutor()
+{
+    return m_executor;
+}
+
+// Finds up to maxResults items whose names contain some text with at most
+// maxErrors typing mistakes, ignoring case, best matches first. The threads of
+// the pool help to search long lists.
+//
+void CustomListControl::FindApproximate(const WCHAR* text, int maxErrors, size_t maxResults, std::vector<int>* pIndexes)
+{
+    pIndexes->clear();
+    std::vector<ApproximateMatch> matches;
+    m_pModel->GetContactIndex().FindApproximate(text, maxErrors, maxResults, &matches, &m_executor);
+    UpdateItemPositions();
+    pIndexes->reserve(matches.size());
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        std::unordered_map<unsigned int, int>::iterator found = m_itemPositions.find(matches[i].ItemId);
+        if (found != m_itemPositions.end())
+        {
+            pIndexes->push_back(found->second);
+        }
+    }
+}
+
+// Gets the index of the item at a point within the list, or -1 if there is
+// none. In the grouped view, this is -1 for a group. Only the tile view looks
+// at the X coordinate.
+//
+int CustomListControl::IndexFromPoint(int x, int y)
+{
+    MEMSTATS_BUDGET("CustomListControl::IndexFromPoint", 0);
+    if (m_grouped || m_tiled)
+    {
+        return ItemFromChild(ChildFromPoint(x, y));
+    }
+    return m_layout.IndexFromY(y, GetCount());
+}
+
+const ItemLayout& CustomListControl::GetLayout() const
+{
+    return m_layout;
+}
+
+const ItemTileLayout& CustomListControl::GetTileLayout() const
+{
+    return m_tiles;
+}
+
+// Gets the number of items that Page Up and Page Down move by: as many as fit
+// in the client area, and at least one. In the tile view, that is as many
+// whole rows as fit.
+//
+int CustomListControl::GetPageSize()
+{
+    RECT clientRect;
+    GetClientRect(m_controlHwnd, &clientRect);
+    InflateRect(&clientRect, -4, -4);
+    int height = m_tiled ? ItemTileLayout::TileHeight : ItemHeight;
+    int pageSize = (clientRect.bottom - clientRect.top) / height;
+    return ((pageSize > 1) ? pageSize : 1) * GetColumnCount();
+}
+
+// Gets the number of items that Up and Down move by: one, or in the tile
+// view, a row.
+//
+int CustomListControl::GetColumnCount()
+{
+    return m_tiled ? m_tiles.GetColumnCount() : 1;
+}
+
+// Gets the name of a WinEvent for the trace.
+//
+static const char* WinEventTraceName(DWORD winEvent)
+{
+    switch (winEvent)
+    {
+    case EVENT_OBJECT_CREATE:           return "NotifyWinEvent(EVENT_OBJECT_CREATE)";
+    case EVENT_OBJECT_DESTROY:          return "NotifyWinEvent(EVENT_OBJECT_DESTROY)";
+    case EVENT_OBJECT_REORDER:          return "NotifyWinEvent(EVENT_OBJECT_REORDER)";
+    case EVENT_OBJECT_NAMECHANGE:       return "NotifyWinEvent(EVENT_OBJECT_NAMECHANGE)";
+    case EVENT_OBJECT_HELPCHANGE:       return "NotifyWinEvent(EVENT_OBJECT_HELPCHANGE)";
+    case EVENT_OBJECT_STATECHANGE:      return "NotifyWinEvent(EVENT_OBJECT_STATECHANGE)";
+    case EVENT_OBJECT_FOCUS:            return "NotifyWinEvent(EVENT_OBJECT_FOCUS)";
+    case EVENT_OBJECT_SELECTION:        return "NotifyWinEvent(EVENT_OBJECT_SELECTION)";
+    case EVENT_OBJECT_SELECTIONADD:     return "NotifyWinEvent(EVENT_OBJECT_SELECTIONADD)";
+    case EVENT_OBJECT_SELECTIONREMOVE:  return "NotifyWinEvent(EVENT_OBJECT_SELECTIONREMOVE)";
+    case EVENT_OBJECT_SELECTIONWITHIN:  return "NotifyWinEvent(EVENT_OBJECT_SELECTIONWITHIN)";
+    }
+    return "NotifyWinEvent";
+}
+
+// Raises a WinEvent for the client area of the control. In-context clients 
+// handle the event before this returns, so the time is traced.
+//
+void CustomListControl::RaiseWinEvent(DWORD winEvent, LONG childId)
+{
+    TRACE_SPAN(WinEventTraceName(winEvent));
+    NotifyWinEvent(winEvent, m_controlHwnd, OBJID_CLIENT, childId);
+    InvalidateSnapshot();
+}
+
+// Raises the selection event for an item, and the focus event if the
+// control has the focus. The focus rectangle is on an item, not a group.
+//
+void CustomListControl::RaiseSelectionEvents(int index, DWORD selectionEvent)
+{
+    QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+    m_focusedGroup = -1;
+    m_stateEpoch++;
+    LONG childId = (selectionEvent == EVENT_OBJECT_SELECTIONWITHIN) ? CHILDID_SELF : ChildFromItem(index);
+    // An item in a collapsed group is not a child, so the change is reported
+    // as being within the list.
+    if (m_grouped && (childId == CHILDID_SELF))
+    {
+        selectionEvent = EVENT_OBJECT_SELECTIONWITHIN;
+    }
+    RaiseWinEvent(selectionEvent, childId);
+    if (GetIsFocused())
+    {
+        RaiseWinEvent(EVENT_OBJECT_FOCUS, GetFocusChild());
+    }
+}
+
+// Sets the selected item, clearing any other selection.
+//
+void CustomListControl::SelectItem(int index)
+{
+    TRACE_SPAN("CustomListControl::SelectItem");
+    MEMSTATS_BUDGET("CustomListControl::SelectItem", 0);
+    m_selectedIndex = index;
+    if (m_selectedIndex >= static_cast<int>(m_itemCollection.size()))
+    {
+        m_selectedIndex = static_cast<int>(m_itemCollection.size()) - 1;  
+    }
+    m_anchorIndex = m_selectedIndex;
+    m_selection.Clear();
+    if (m_selectedIndex >= 0)
+    {
+        m_selection.AddRange(m_selectedIndex, m_selectedIndex + 1);
+    }
+
+    // Raise WinEvents.
+    RaiseSelectionEvents(m_selectedIndex, EVENT_OBJECT_SELECTION);
+
+    // Force refresh.
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Adds an item to the selection and gives it the focus rectangle.
+//
+void CustomListControl::AddToSelection(int index)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return;
+    }
+    m_selection.AddRange(index, index + 1);
+    m_selectedIndex = index;
+    m_anchorIndex = index;
+    RaiseSelectionEvents(index, EVENT_OBJECT_SELECTIONADD);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Removes an item from the selection and gives it the focus rectangle.
+//
+void CustomListControl::RemoveFromSelection(int index)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return;
+    }
+    m_selection.RemoveRange(index, index + 1);
+    m_selectedIndex = index;
+    m_anchorIndex = index;
+    RaiseSelectionEvents(index, EVENT_OBJECT_SELECTIONREMOVE);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Selects or deselects an item, leaving the focus rectangle and the anchor
+// where they are, as accSelect does without SELFLAG_TAKEFOCUS.
+//
+void CustomListControl::SetItemSelected(int index, bool selected)
+{
+    if ((index < 0) || (index >= GetCount()) || (IsItemSelected(index) == selected))
+    {
+        return;
+    }
+    if (selected)
+    {
+        m_selection.AddRange(index, index + 1);
+    }
+    else
+    {
+        m_selection.RemoveRange(index, index + 1);
+    }
+    QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+    m_stateEpoch++;
+    // An item in a collapsed group is not a child, so the change is reported
+    // as being within the list.
+    LONG childId = ChildFromItem(index);
+    DWORD selectionEvent = selected ? EVENT_OBJECT_SELECTIONADD : EVENT_OBJECT_SELECTIONREMOVE;
+    RaiseWinEvent((childId == CHILDID_SELF) ? EVENT_OBJECT_SELECTIONWITHIN : selectionEvent, childId);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Toggles the selection state of an item, as for a ctrl+click.
+//
+void CustomListControl::ToggleSelection(int index)
+{
+    if (IsItemSelected(index))
+    {
+        RemoveFromSelection(index);
+    }
+    else
+    {
+        AddToSelection(index);
+    }
+}
+
+// Changes the selection of the items between the anchor and the specified
+// item, as for a shift+click. The anchor stays where it is. The focus rectangle
+// moves to the item unless moveFocus is false, as for accSelect without
+// SELFLAG_TAKEFOCUS.
+//
+void CustomListControl::ExtendSelection(int index, ExtendMode mode, bool moveFocus)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return;
+    }
+    if ((m_anchorIndex < 0) || (m_anchorIndex >= GetCount()))
+    {
+        m_anchorIndex = index;
+    }
+    int first = (m_anchorIndex < index) ? m_anchorIndex : index;
+    int last = ((m_anchorIndex < index) ? index : m_anchorIndex) + 1;
+
+    if (mode == Extend_MatchAnchor)
+    {
+        mode = IsItemSelected(m_anchorIndex) ? Extend_Add : Extend_Remove;
+    }
+    switch (mode)
+    {
+    case Extend_Replace:
+        m_selection.Clear();
+        m_selection.AddRange(first, last);
+        break;
+    case Extend_Add:
+        m_selection.AddRange(first, last);
+        break;
+    default:
+        m_selection.RemoveRange(first, last);
+        break;
+    }
+    if (moveFocus)
+    {
+        m_selectedIndex = index;
+        RaiseSelectionEvents(index, EVENT_OBJECT_SELECTIONWITHIN);
+    }
+    else
+    {
+        QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+        m_stateEpoch++;
+        RaiseWinEvent(EVENT_OBJECT_SELECTIONWITHIN, CHILDID_SELF);
+    }
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Selects every item. The selection is stored as a single range, so this does not 
+// depend on the number of items.
+//
+void CustomListControl::SelectAll()
+{
+    m_selection.SelectAll(GetCount());
+    RaiseSelectionEvents(m_selectedIndex, EVENT_OBJECT_SELECTIONWITHIN);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Moves the focus rectangle without changing the selection.
+//
+void CustomListControl::SetFocusedItem(int index)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return;
+    }
+    m_selectedIndex = index;
+    m_anchorIndex = index;
+    m_focusedGroup = -1;
+    m_stateEpoch++;
+    QueryRecorder::RecordSelection(this, m_selection, m_selectedIndex);
+    if (GetIsFocused())
+    {
+        RaiseWinEvent(EVENT_OBJECT_FOCUS, GetFocusChild());
+    }
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Replaces the selection and moves the focus rectangle. Ranges outside the 
+// list are ignored.
+//
+void CustomListControl::SetSelection(const std::vector<SelectionRangeSet::Range>& ranges, int focusIndex)
+{
+    m_selection.Clear();
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        int last = (ranges[i].Last < GetCount()) ? ranges[i].Last : GetCount();
+        m_selection.AddRange((ranges[i].First > 0) ? ranges[i].First : 0, last);
+    }
+    m_selectedIndex = ((focusIndex >= 0) && (focusIndex < GetCount())) ? focusIndex : m_selection.GetFirst();
+    m_anchorIndex = m_selectedIndex;
+    RaiseSelectionEvents(m_selectedIndex, EVENT_OBJECT_SELECTIONWITHIN);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Determines whether an item is selected.
+//
+bool CustomListControl::IsItemSelected(int index)
+{
+    return m_selection.Contains(index);
+}
+
+// Gets the selected items.
+//
+const SelectionRangeSet& CustomListControl::GetSelection()
+{
+    return m_selection;
+}
+
+// Gets the index of the item with the focus rectangle. When a single item 
+// is selected, this is the selected item.
+//
+int CustomListControl::GetSelectedIndex()
+{
+    return m_selectedIndex;
+}
+
+// Gets the focused state.
+//
+bool CustomListControl::GetIsFocused()
+{
+    return m_hasFocus;
+}
+
+// Sets the focused state.
+//
+void CustomListControl::SetIsFocused(bool isFocused)
+{
+    m_hasFocus = isFocused;
+    m_stateEpoch++;
+    InvalidateSnapshot();
+}
+
+// Gets the count of items in the list.
+//
+int CustomListControl::GetCount()
+{
+    return static_cast<int>(m_itemCollection.size());
+}
+
+// Gets the bounds of the specified item. Fails for an item in a collapsed group.
+//
+bool CustomListControl::GetItemScreenRect(int index, RECT* pRetVal)
+{
+    return GetChildScreenRect(ChildFromItem(index), pRetVal);
+}
+
+// Gets the bounds of the specified item, relative to the client area.
+//
+bool CustomListControl::GetItemClientRect(int index, RECT* pRetVal)
+{
+    return GetChildClientRect(ChildFromItem(index), pRetVal);
+}
+
+// Gets the accessible state of an item.
+//
+DWORD CustomListControl::GetItemState(int index)
+{
+    DWORD flags = STATE_SYSTEM_SELECTABLE | STATE_SYSTEM_FOCUSABLE;
+    if (IsItemSelected(index))
+    {
+        flags |= STATE_SYSTEM_SELECTED;
+    }
+    if ((index == m_selectedIndex) && (m_focusedGroup < 0) && GetIsFocused())
+    {
+        flags |= STATE_SYSTEM_FOCUSED;
+    }
+    return flags;
+}
+
+// Gets the accessible help string for an item.
+// For simplicity, the string is not localized.
+//
+const WCHAR* CustomListControl::GetItemHelp(int index)
+{
+    CustomListControlItem* pItem = *GetItemAt(index);
+    return (pItem->GetStatus() == Status_Online) ? L"Online contact." : L"Offline contact.";
+}
+
+// Fills in the packed record for an item, as a child of the flat list. The
+// strings are not copied.
+//
+void CustomListControl::GetItemRecord(int index, const RECT& rect, ChildRecords::Record* pRecord)
+{
+    CustomListControlItem* pItem = *GetItemAt(index);
+    const WCHAR* help = GetItemHelp(index);
+    pRecord->ChildId = static_cast<unsigned int>(index + 1);
+    pRecord->Role = ROLE_SYSTEM_LISTITEM;
+    pRecord->State = GetItemState(index);
+    pRecord->Left = rect.left;
+    pRecord->Top = rect.top;
+    pRecord->Width = rect.right - rect.left;
+    pRecord->Height = rect.bottom - rect.top;
+    pRecord->Name = reinterpret_cast<const unsigned short*>(pItem->GetName());
+    pRecord->NameLength = static_cast<unsigned int>(wcslen(pItem->GetName()));
+    pRecord->Help = reinterpret_cast<const unsigned short*>(help);
+    pRecord->HelpLength = static_cast<unsigned int>(wcslen(help));
+    pRecord->ItemId = pItem->GetId();
+}
+
+// Determines whether the items are shown in groups.
+//
+bool CustomListControl::IsGrouped()
+{
+    return m_grouped;
+}
+
+// Shows the items in groups, as an outline, or as a flat list. The focus
+// rectangle stays on the same item.
+//
+void CustomListControl::SetGrouped(bool grouped)
+{
+    if (grouped == m_grouped)
+    {
+        return;
+    }
+    QueryRecorder::RecordGrouped(this, grouped);
+    m_grouped = grouped;
+    m_tiled = false;
+    m_focusedGroup = -1;
+    m_viewEpoch++;
+    UpdateGroupMembers();
+    RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+    if (GetIsFocused())
+    {
+        RaiseWinEvent(EVENT_OBJECT_FOCUS, GetFocusChild());
+    }
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Determines whether the items are shown as tiles.
+//
+bool CustomListControl::IsTiled()
+{
+    return m_tiled;
+}
+
+// Shows the items as tiles, in as many columns as fit the width, or as a
+// list. The tile view shows the items in list order, so the children are the
+// same as in the flat list; only their bounds change.
+//
+void CustomListControl::SetTiled(bool tiled)
+{
+    if (tiled == m_tiled)
+    {
+        return;
+    }
+    if (m_grouped)
+    {
+        SetGrouped(false);
+    }
+    QueryRecorder::RecordTiled(this, tiled);
+    m_tiled = tiled;
+    OnSize();
+    RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Gets the child in the tile view that is a number of columns and rows away
+// from another, or CHILDID_SELF if there is none.
+//
+long CustomListControl::GetTileNeighbor(long childId, int columns, int rows)
+{
+    if (!m_tiled || (childId < 1) || (childId > GetCount()))
+    {
+        return CHILDID_SELF;
+    }
+    return m_tiles.GetNeighbor(static_cast<int>(childId) - 1, columns, rows, GetCount()) + 1;
+}
+
+// Builds the lists of members of the groups that are shown expanded, if they
+// are out of date.
+//
+void CustomListControl::UpdateGroupMembers()
+{
+    if (m_grouped)
+    {
+        MEMSTATS_SCOPE(MemoryTag_Items);
+        m_groups.UpdateMembers(GetCount(), [this](int index)
+        {
+            return GroupFromStatus(m_itemCollection[index]->GetStatus());
+        });
+    }
+}
+
+// Gets the number of children: the items, or in the grouped view, the groups
+// and the members of the expanded groups.
+//
+int CustomListControl::GetChildCount()
+{
+    return m_grouped ? m_groups.GetRowCount() : GetCount();
+}
+
+// Gets the index of the item that a child shows, or -1 if the child is a group.
+//
+int CustomListControl::ItemFromChild(long childId)
+{
+    if ((childId < 1) || (childId > GetChildCount()))
+    {
+        return -1;
+    }
+    if (!m_grouped)
+    {
+        return static_cast<int>(childId) - 1;
+    }
+    RosterGroups::Row row;
+    m_groups.GetRow(static_cast<int>(childId) - 1, &row);
+    return (row.Member == RosterGroups::GroupRow) ? -1 : m_groups.GetMemberIndex(row.Group, row.Member);
+}
+
+// Gets the group that a child shows, or -1 if the child is an item.
+//
+int CustomListControl::GroupFromChild(long childId)
+{
+    RosterGroups::Row row;
+    if (m_grouped && m_groups.GetRow(static_cast<int>(childId) - 1, &row) && (row.Member == RosterGroups::GroupRow))
+    {
+        return row.Group;
+    }
+    return -1;
+}
+
+// Gets the child ID of an item, or CHILDID_SELF if there is no such item, or
+// it is in a collapsed group.
+//
+long CustomListControl::ChildFromItem(int index)
+{
+    if ((index < 0) || (index >= GetCount()))
+    {
+        return CHILDID_SELF;
+    }
+    if (!m_grouped)
+    {
+        return index + 1;
+    }
+    int group = GetItemGroup(index);
+    int member = m_groups.IsExpanded(group) ? m_groups.FindMember(group, index) : -1;
+    return (member >= 0) ? m_groups.GetGroupRow(group) + member + 2 : CHILDID_SELF;
+}
+
+// Gets the child ID of a group in the grouped view.
+//
+long CustomListControl::ChildFromGroup(int group)
+{
+    return m_grouped ? m_groups.GetGroupRow(group) + 1 : CHILDID_SELF;
+}
+
+// Gets the child at a point within the list, or CHILDID_SELF if there is
+// none. Rows of the grouped view all have the fixed item height. Tiles are
+// found from the same origin as GetChildClientRect places them.
+//
+long CustomListControl::ChildFromPoint(int x, int y)
+{
+    if (m_tiled)
+    {
+        return m_tiles.IndexFromPoint(x - 4, y - 4, GetCount()) + 1;
+    }
+    if (!m_grouped)
+    {
+        return m_layout.IndexFromY(y, GetCount()) + 1;
+    }
+    int row = (y >= 0) ? y / ItemHeight : -1;
+    return ((row >= 0) && (row < GetChildCount())) ? row + 1 : CHILDID_SELF;
+}
+
+// Gets the child with the focus rectangle. When the item with it is in a
+// collapsed group, the group has it.
+//
+long CustomListControl::GetFocusChild()
+{
+    if (m_grouped && (m_focusedGroup >= 0))
+    {
+        return ChildFromGroup(m_focusedGroup);
+    }
+    long childId = ChildFromItem(m_selectedIndex);
+    if (m_grouped && (childId == CHILDID_SELF) && (m_selectedIndex >= 0) && (m_selectedIndex < GetCount()))
+    {
+        childId = ChildFromGroup(GetItemGroup(m_selectedIndex));
+    }
+    return childId;
+}
+
+// Gets the bounds of a child. Moving the dialog moves the control without
+// telling it, so the position on the screen is found on every call.
+//
+bool CustomListControl::GetChildScreenRect(long childId, RECT* pRetVal)
+{
+    if (!GetChildClientRect(childId, pRetVal))
+    {
+        return false;
+    }
+    POINT upperLeft = { 0, 0 };
+    ClientToScreen(m_controlHwnd, &upperLeft);
+    OffsetRect(pRetVal, upperLeft.x, upperLeft.y);
+    return true;
+}
+
+// Gets the bounds of a child, relative to the client area. The bounds are
+// cached until the children change or the control is resized.
+//
+bool CustomListControl::GetChildClientRect(long childId, RECT* pRetVal)
+{
+    if ((pRetVal == NULL) || (childId < 1) || (childId > GetChildCount()))
+    {
+        return false;
+    }
+    ChildProperties* pProperties = GetChildProperties(childId);
+    bool hit = (pProperties != NULL) && pProperties->HasRect;
+    ACCSTATS_CACHE(AccCache_Rect, hit);
+    if (hit)
+    {
+        *pRetVal = pProperties->Rect;
+        return true;
+    }
+    int row = static_cast<int>(childId) - 1;
+    GetClientRect(m_controlHwnd, pRetVal);
+    InflateRect(pRetVal, -4, -4);
+    if (m_tiled)
+    {
+        pRetVal->left += m_tiles.GetItemLeft(row);
+        pRetVal->top += m_tiles.GetItemTop(row);
+        pRetVal->right = pRetVal->left + ItemTileLayout::TileWidth;
+        pRetVal->bottom = pRetVal->top + ItemTileLayout::TileHeight;
+    }
+    else
+    {
+        pRetVal->top += m_grouped ? row * ItemHeight : m_layout.GetItemTop(row);
+        pRetVal->bottom = pRetVal->top + (m_grouped ? ItemHeight : m_layout.GetItemHeight(row));
+    }
+    if (pProperties != NULL)
+    {
+        pProperties->Rect = *pRetVal;
+        pProperties->HasRect = true;
+    }
+    return true;
+}
+
+// Gets the state of a child, which is an item or a group. The state is cached
+// until the selection, the focus or the children change.
+//
+DWORD CustomListControl::GetChildState(long childId)
+{
+    ChildProperties* pProperties = GetChildProperties(childId);
+    bool hit = (pProperties != NULL) && pProperties->HasState && (pProperties->StateEpoch == m_stateEpoch);
+    ACCSTATS_CACHE(AccCache_State, hit);
+    if (hit)
+    {
+        return pProperties->State;
+    }
+    int index = ItemFromChild(childId);
+    DWORD state = (index >= 0) ? GetItemState(index) : GetGroupState(GroupFromChild(childId));
+    if (pProperties != NULL)
+    {
+        pProperties->State = state;
+        pProperties->StateEpoch = m_stateEpoch;
+        pProperties->HasState = true;
+    }
+    return state;
+}
+
+// Gets the help string of a child, which is an item or a group. The string is
+// cached until the children change.
+//
+const WCHAR* CustomListControl::GetChildHelp(long childId)
+{
+    ChildProperties* pProperties = GetChildProperties(childId);
+    bool hit = (pProperties != NULL) && pProperties->HasHelp;
+    ACCSTATS_CACHE(AccCache_Help, hit);
+    if (hit)
+    {
+        return pProperties->Help;
+    }
+    int index = ItemFromChild(childId);
+    const WCHAR* help = (index >= 0) ? GetItemHelp(index) : GetGroupHelp(GroupFromChild(childId));
+    if (pProperties != NULL)
+    {
+        pProperties->Help = help;
+        pProperties->HasHelp = true;
+    }
+    return help;
+}
+
+// Gets the cached properties of a child, or NULL if there is no entry for it.
+// The entry is emptied if the items or the children have changed since it was
+// filled; the state is also checked against m_stateEpoch when it is read.
+//
+CustomListControl::ChildProperties* CustomListControl::GetChildProperties(long childId)
+{
+    if ((childId < 1) || (childId > static_cast<long>(m_childProperties.size())))
+    {
+        return NULL;
+    }
+    ChildProperties* pProperties = &m_childProperties[childId - 1];
+    if ((pProperties->Generation != m_generation) || (pProperties->ViewEpoch != m_viewEpoch))
+    {
+        pProperties->Generation = m_generation;
+        pProperties->ViewEpoch = m_viewEpoch;
+        pProperties->HasState = false;
+        pProperties->HasHelp = false;
+        pProperties->HasRect = false;
+    }
+    return pProperties;
+}
+
+// Forgets the bounds of the children after the control is resized, fits the
+// rows of tiles to the new width, and schedules the snapshot to be published
+// with the new bounds.
+//
+void CustomListControl::OnSize()
+{
+    RECT clientRect;
+    GetClientRect(m_controlHwnd, &clientRect);
+    InflateRect(&clientRect, -4, -4);
+    m_tiles.SetWidth(clientRect.right - clientRect.left);
+    m_viewEpoch++;
+    InvalidateSnapshot();
+}
+
+// Gets the selected children, as ranges of 0-based child indexes in order.
+// Selected items in collapsed groups are left out.
+//
+void CustomListControl::GetSelectedChildren(std::vector<SelectionRangeSet::Range>* pRanges)
+{
+    pRanges->clear();
+    if (!m_grouped)
+    {
+        pRanges->assign(m_selection.GetRanges().begin(), m_selection.GetRanges().end());
+        return;
+    }
+    std::vector<int> rows;
+    for (int r = 0; r < m_selection.GetRangeCount(); r++)
+    {
+        const SelectionRangeSet::Range& range = m_selection.GetRange(r);
+        for (int i = range.First; i < range.Last; i++)
+        {
+            long childId = ChildFromItem(i);
+            if (childId != CHILDID_SELF)
+            {
+                rows.push_back(static_cast<int>(childId) - 1);
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (!pRanges->empty() && (pRanges->back().Last == rows[i]))
+        {
+            pRanges->back().Last++;
+        }
+        else
+        {
+            SelectionRangeSet::Range range = { rows[i], rows[i] + 1 };
+            pRanges->push_back(range);
+        }
+    }
+}
+
+// Fills in the packed record for a child. The strings are not copied.
+//
+void CustomListControl::GetChildRecord(long childId, const RECT& rect, ChildRecords::Record* pRecord)
+{
+    int index = ItemFromChild(childId);
+    if (index >= 0)
+    {
+        GetItemRecord(index, rect, pRecord);
+        pRecord->ChildId = static_cast<unsigned int>(childId);
+        pRecord->Role = m_grouped ? ROLE_SYSTEM_OUTLINEITEM : ROLE_SYSTEM_LISTITEM;
+        return;
+    }
+    int group = GroupFromChild(childId);
+    const WCHAR* name = GetGroupName(group);
+    const WCHAR* help = GetGroupHelp(group);
+    pRecord->ChildId = static_cast<unsigned int>(childId);
+    pRecord->Role = ROLE_SYSTEM_OUTLINEITEM;
+    pRecord->State = GetGroupState(group);
+    pRecord->Left = rect.left;
+    pRecord->Top = rect.top;
+    pRecord->Width = rect.right - rect.left;
+    pRecord->Height = rect.bottom - rect.top;
+    pRecord->Name = reinterpret_cast<const unsigned short*>(name);
+    pRecord->NameLength = static_cast<unsigned int>(wcslen(name));
+    pRecord->Help = reinterpret_cast<const unsigned short*>(help);
+    pRecord->HelpLength = static_cast<unsigned int>(wcslen(help));
+    pRecord->ItemId = 0;
+}
+
+// Gets the group that an item is shown in.
+//
+int CustomListControl::GetItemGroup(int index)
+{
+    return GroupFromStatus(m_itemCollection[index]->GetStatus());
+}
+
+// Gets the number of items in a group. The count is kept as items change,
+// so it is known whether or not the group is expanded.
+//
+int CustomListControl::GetGroupMemberCount(int group)
+{
+    return m_groups.GetMemberCount(group);
+}
+
+bool CustomListControl::IsGroupExpanded(int group)
+{
+    return m_groups.IsExpanded(group);
+}
+
+// Expands or collapses a group. Only the first expansion, or the first after
+// items are removed or reordered, builds the list of members.
+//
+void CustomListControl::SetGroupExpanded(int group, bool expanded)
+{
+    if ((group < 0) || (group >= Group_Count) || (m_groups.IsExpanded(group) == expanded))
+    {
+        return;
+    }
+    QueryRecorder::RecordGroupExpanded(this, group, expanded);
+    m_groups.SetExpanded(group, expanded);
+    m_viewEpoch++;
+    UpdateGroupMembers();
+    if (m_grouped)
+    {
+        RaiseWinEvent(EVENT_OBJECT_STATECHANGE, ChildFromGroup(group));
+        RaiseWinEvent(EVENT_OBJECT_REORDER, CHILDID_SELF);
+        // The focus moves to the group if the item with it is now hidden.
+        if (GetIsFocused())
+        {
+            RaiseWinEvent(EVENT_OBJECT_FOCUS, GetFocusChild());
+        }
+        InvalidateRect(m_controlHwnd, NULL, TRUE);
+    }
+}
+
+// Moves the focus rectangle to a group in the grouped view. The selection
+// does not change.
+//
+void CustomListControl::SetFocusedGroup(int group)
+{
+    if (!m_grouped || (group < 0) || (group >= Group_Count))
+    {
+        return;
+    }
+    m_focusedGroup = group;
+    m_stateEpoch++;
+    if (GetIsFocused())
+    {
+        RaiseWinEvent(EVENT_OBJECT_FOCUS, ChildFromGroup(group));
+    }
+    InvalidateRect(m_controlHwnd, NULL, TRUE);
+}
+
+// Gets the name of a group.
+// For simplicity, the strings are not localized.
+//
+const WCHAR* CustomListControl::GetGroupName(int group)
+{
+    return (group == Group_Online) ? L"Online" : L"Offline";
+}
+
+const WCHAR* CustomListControl::GetGroupHelp(int group)
+{
+    return (group == Group_Online) ? L"Group of online contacts." : L"Group of offline contacts.";
+}
+
+// Gets the accessible state of a group.
+//
+DWORD CustomListControl::GetGroupState(int group)
+{
+    DWORD flags = STATE_SYSTEM_FOCUSABLE;
+    flags |= m_groups.IsExpanded(group) ? STATE_SYSTEM_EXPANDED : STATE_SYSTEM_COLLAPSED;
+    if ((m_focusedGroup == group) && GetIsFocused())
+    {
+        flags |= STATE_SYSTEM_FOCUSED;
+    }
+    return flags;
+}
+
+// Schedules the shared-memory snapshot to be published. Changes made while
+// handling one message are published together.
+//
+void CustomListControl::InvalidateSnapshot()
+{
+    if (m_snapshot.IsOpen() && !m_snapshotPending)
+    {
+        m_snapshotPending = (PostMessage(m_controlHwnd, CUSTOMLB_PUBLISHSNAPSHOT, 0, 0) != FALSE);
+    }
+}
+
+// Publishes the children to the shared-memory snapshot.
+//
+void CustomListControl::PublishSnapshot()
+{
+    TRACE_SPAN("CustomListControl::PublishSnapshot");
+    m_snapshotPending = false;
+    if (!m_snapshot.IsOpen())
+    {
+        return;
+    }
+    ChildRecords::Writer writer;
+    for (long childId = 1; childId <= GetChildCount(); childId++)
+    {
+        RECT rect;
+        GetChildClientRect(childId, &rect);
+        ChildRecords::Record record;
+        GetChildRecord(childId, rect, &record);
+        writer.Append(record);
+    }
+    m_snapshot.Publish(writer.GetData(), writer.GetSize());
+}
+
+
+// Responds to double-click on an item. For simplicity, we simply show the name
+// of the selected contact.
 // This method is simply to demonstrate how a default action is invoked by 
 // IAccessible::accDoDefaultAction. 
 //
-void CustomListControl::OnDoubleClick()
+void CustomListControl::OnDoubleClick()
+{
+    LISTITERATOR item = GetItemAt(GetSelectedIndex());
+    CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
+    HWND h = GetParent(m_controlHwnd);
+    WCHAR* name = pItem->GetName();
+    MessageBox(h, name, TEXT("Contact"), MB_OK);
+}
+
+
+// Registers the control class.
+//
+void RegisterListControl(HINSTANCE hInstance)
+{
+    WNDCLASS wc = {};
+    wc.style            = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
+    wc.lpfnWndProc      = ControlWndProc;
+    wc.hInstance        = hInstance;
+    wc.hCursor          = LoadCursor(NULL, IDC_ARROW);
+    wc.lpszClassName    = TEXT("CONTACTLIST");
+    RegisterClass(&wc);
+}
+
+
+// Moves the focus rectangle in response to a navigation key. Shift extends the
+// selection from the anchor; ctrl moves the focus without changing the selection.
+//
+static void MoveSelection(CustomListControl* pCustomList, int index, bool shiftDown, bool controlDown)
+{
+    if (shiftDown)
+    {
+        pCustomList->ExtendSelection(index, controlDown ? Extend_Add : Extend_Replace);
+    }
+    else if (controlDown)
+    {
+        pCustomList->SetFocusedItem(index);
+    }
+    else
+    {
+        pCustomList->SelectItem(index);
+    }
+}
+
+
+// Moves the focus rectangle to a child, which in the grouped view may be a
+// group. The grouped view does not show ranges in list order, so there shift
+// has no effect.
+//
+static void MoveToChild(CustomListControl* pCustomList, long childId, bool shiftDown, bool controlDown)
 {
-    LISTITERATOR item = GetItemAt(GetSelectedIndex());
-    CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
-    HWND h = GetParent(m_controlHwnd);
-    WCHAR* name = pItem->GetName();
-    MessageBox(h, name, TEXT("Contact"), MB_OK);
+    int index = pCustomList->ItemFromChild(childId);
+    if (index >= 0)
+    {
+        MoveSelection(pCustomList, index, shiftDown && !pCustomList->IsGrouped(), controlDown);
+    }
+    else
+    {
+        pCustomList->SetFocusedGroup(pCustomList->GroupFromChild(childId));
+    }
 }
 
 
-// Registers the control class.
+// Gets the number of presses that a key-down message stands for: its repeat
+// count, plus the repeats of the same key queued directly behind it, which are
+// removed. A held key then moves the selection once per turn of the message
+// loop, however far the control has fallen behind the keyboard.
 //
-void RegisterListControl(HINSTANCE hInstance)
+static int TakeKeyRepeats(HWND hwnd, WPARAM key, LPARAM lParam)
 {
-    WNDCLASS wc = {};
-    wc.style            = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
-    wc.lpfnWndProc      = ControlWndProc;
-    wc.hInstance        = hInstance;
-    wc.hCursor          = LoadCursor(NULL, IDC_ARROW);
-    wc.lpszClassName    = TEXT("CONTACTLIST");
-    RegisterClass(&wc);
+    int presses = (LOWORD(lParam) > 0) ? LOWORD(lParam) : 1;
+    MSG msg;
+    // Stop at any other keyboard message, so that a change of shift or ctrl
+    // is seen before the keys that follow it.
+    while (PeekMessage(&msg, hwnd, WM_KEYFIRST, WM_KEYLAST, PM_NOREMOVE)
+        && (msg.message == WM_KEYDOWN) && (msg.wParam == key) && ((msg.lParam & (1 << 30)) != 0))
+    {
+        PeekMessage(&msg, hwnd, WM_KEYDOWN, WM_KEYDOWN, PM_REMOVE);
+        presses += (LOWORD(msg.lParam) > 0) ? LOWORD(msg.lParam) : 1;
+    }
+    return presses;
 }
 
 
@@ -255,10 +2198,24 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
         {
             // Create the control object.
             CustomListControl* pCustomList = new (std::nothrow) CustomListControl(hwnd);
+            if ((pCustomList != NULL) && (pCustomList->GetModel() == NULL))
+            {
+                delete pCustomList;
+                return -1;
+            }
 
             // Save the class instance as window data so that its members 
             // can be accessed from within this function.
             SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)pCustomList);
+
+            // If a recording is open, it follows the first list created.
+            if (pCustomList != NULL)
+            {
+                QueryRecorder::AttachControl(pCustomList);
+            }
+#ifdef ACCSERVER_STATS
+            SetTimer(hwnd, MemoryTimerId, MemoryDumpMilliseconds, NULL);
+#endif
             break;
         }
 
@@ -266,14 +2223,20 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
         {
             // Retrieve the control.
             CustomListControl* pCustomList = GetControl(hwnd);
+            QueryRecorder::DetachControl(pCustomList);
             // Destroy the control.
             delete pCustomList;
 
+            // Report the accessibility call statistics, if they are compiled in.
+            ACCSTATS_DUMP();
+            MEMSTATS_DUMP();
+
             break;
         }
 
     case WM_GETOBJECT:
         {
+            TRACE_SPAN("WM_GETOBJECT");
             // Return the IAccessible object.
             if (static_cast<LONG>(lParam) == OBJID_CLIENT)
             {
@@ -289,6 +2252,7 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
                 }
                 if (pAccServer != NULL)  // NULL if out of memory.
                 {
+                    TRACE_SPAN("LresultFromObject");
                     LRESULT Lresult = LresultFromObject(IID_IAccessible, wParam, 
                         static_cast<IAccessible*>(pAccServer));
                     return Lresult;
@@ -300,6 +2264,8 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
 
     case WM_PAINT:
         {
+            TRACE_SPAN("WM_PAINT");
+            MEMSTATS_BUDGET("WM_PAINT", 0);
             // Retrieve the control.
             CustomListControl* pCustomList = GetControl(hwnd);
 
@@ -329,7 +2295,7 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
             // Set transparency for text.
             SetBkMode(hdc, TRANSPARENT); 
 
-            int itemHeight = pCustomList->ItemHeight;
+            const ItemLayout& layout = pCustomList->GetLayout();
 
             // Create brushes
             HBRUSH unfocusedFillBrush  = GetSysColorBrush(COLOR_BTNFACE);
@@ -337,64 +2303,157 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
 
             HBRUSH onlineFillBrush = CreateSolidBrush(RGB(0, 192, 0));  // Green.
             HBRUSH offlineFillBrush = CreateSolidBrush(RGB(255, 0, 0)); // Red.
-
-            if (pCustomList->GetCount() > 0)
+            HBRUSH placeholderBrush = GetSysColorBrush(COLOR_BTNSHADOW);
+            bool payloads = pCustomList->HasPayloads();
+
+            // In the grouped view, members are indented under their group.
+            bool grouped = pCustomList->IsGrouped();
+            int indent = grouped ? pCustomList->ImageWidth : 0;
+            long focusChild = pCustomList->GetFocusChild();
+            int childCount = pCustomList->GetChildCount();
+
+            // In the tile view, only the rows of tiles that need painting are drawn.
+            bool tiled = pCustomList->IsTiled();
+            long firstChild = 1;
+            long endChild = childCount + 1;
+            if (tiled)
+            {
+                int first;
+                int end;
+                pCustomList->GetTileLayout().GetItemsInBand(paintStruct.rcPaint.top - 4,
+                    paintStruct.rcPaint.bottom - 4, childCount, &first, &end);
+                firstChild = first + 1;
+                endChild = end + 1;
+            }
+            for (long child = firstChild; child < endChild; child++)
             {
-                for (int i = 0; i < pCustomList->GetCount(); i++)              
+                // Get the rectangle for the child. Stop at the bottom of the window.
+                int row = static_cast<int>(child) - 1;
+                RECT itemRect;
+                if (tiled)
+                {
+                    pCustomList->GetChildClientRect(child, &itemRect);
+                }
+                else
                 {
-                    // Get the rectangle for the item.
-                    RECT itemRect;
                     itemRect.left = clientRect.left + 2;
-                    itemRect.top = clientRect.top + 2 + itemHeight * i;
+                    itemRect.top = clientRect.top + 2 + (grouped ? row * pCustomList->ItemHeight : layout.GetItemTop(row));
                     itemRect.right = clientRect.right - 2;
-                    itemRect.bottom = itemRect.top + itemHeight;
+                    itemRect.bottom = itemRect.top + (grouped ? pCustomList->ItemHeight : layout.GetItemHeight(row));
+                }
+                if (itemRect.top >= clientRect.bottom)
+                {
+                    break;
+                }
 
-                    // Set the default text color.
-                    SetTextColor(hdc, GetSysColor(COLOR_WINDOWTEXT));
+                // Set the default text color.
+                SetTextColor(hdc, GetSysColor(COLOR_WINDOWTEXT));
 
-                    // Set up the appearance of the focused item.
-                    // It's different depending on whether the list control has focus.
-                    if (i == pCustomList->GetSelectedIndex())
+                int i = pCustomList->ItemFromChild(child);
+                if (i < 0)
+                {
+                    // Draw a group, with a sign that shows whether it can be expanded,
+                    // and the number of members.
+                    int group = pCustomList->GroupFromChild(child);
+                    WCHAR text[64];
+                    swprintf_s(text, _countof(text), L"%ls %ls (%d)", 
+                        pCustomList->IsGroupExpanded(group) ? L"-" : L"+",
+                        pCustomList->GetGroupName(group), pCustomList->GetGroupMemberCount(group));
+                    TextOut(hdc, itemRect.left + 2, itemRect.top + 2, text, static_cast<int>(wcslen(text)));
+                    if (child == focusChild)
                     {
-                        if (pCustomList->GetIsFocused())
-                        {
-                            SetTextColor(hdc, GetSysColor(COLOR_HIGHLIGHTTEXT));
-                            HGDIOBJ oldBrush = SelectObject(hdc, focusedFillBrush);
-                            Rectangle(hdc, itemRect.left+1, itemRect.top+1, 
-                                itemRect.right, itemRect.bottom);
-                            SelectObject(hdc, oldBrush);
-                        }
-                        else
-                        {
-                            HGDIOBJ oldBrush = SelectObject(hdc, unfocusedFillBrush);
-                            Rectangle(hdc, itemRect.left, itemRect.top, itemRect.right, itemRect.bottom);
-                            SelectObject(hdc, oldBrush);
-                        }
-                        DrawFocusRect(hdc, &itemRect); 
+                        DrawFocusRect(hdc, &itemRect);
+                    }
+                    continue;
+                }
+
+                // Set up the appearance of the focused item.
+                // It's different depending on whether the list control has focus.
+                if (pCustomList->IsItemSelected(i))
+                {
+                    if (pCustomList->GetIsFocused())
+                    {
+                        SetTextColor(hdc, GetSysColor(COLOR_HIGHLIGHTTEXT));
+                        HGDIOBJ oldBrush = SelectObject(hdc, focusedFillBrush);
+                        Rectangle(hdc, itemRect.left+1, itemRect.top+1, 
+                            itemRect.right, itemRect.bottom);
+                        SelectObject(hdc, oldBrush);
+                    }
+                    else
+                    {
+                        HGDIOBJ oldBrush = SelectObject(hdc, unfocusedFillBrush);
+                        Rectangle(hdc, itemRect.left, itemRect.top, itemRect.right, itemRect.bottom);
+                        SelectObject(hdc, oldBrush);
                     }
-                    // Get the item.
-                    LISTITERATOR item = pCustomList->GetItemAt(i);
-                    CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
+                }
+                if (child == focusChild)
+                {
+                    DrawFocusRect(hdc, &itemRect); 
+                }
+                itemRect.left += indent;
+
+                // Get the item.
+                LISTITERATOR item = pCustomList->GetItemAt(i);
+                CustomListControlItem* pItem = static_cast<CustomListControlItem*>(*item);
 
-                    // Draw the text.
-                    TextOut(hdc, itemRect.left + pCustomList->ImageWidth + 5, itemRect.top + 2, 
-                        pItem->GetName(), static_cast<int>(wcslen(pItem->GetName())));
+                // With payloads, the avatar goes between the status icon and the
+                // name, and the status message follows the name.
+                int textLeft = itemRect.left + pCustomList->ImageWidth + 5;
+                ContactPayloadPtr pPayload;
+                if (payloads)
+                {
+                    pPayload = pCustomList->GetItemPayload(i);
+                    pCustomList->DrawAvatar(hdc, pPayload.get(), textLeft, itemRect.top + 2, placeholderBrush);
+                    textLeft += pCustomList->AvatarSize + 3;
+                }
 
-                    // Draw the status icon.
-                    if (pItem->GetStatus() == Status_Online)
+                // Draw the text. Tiles are narrow, so there the text is cut off at
+                // the edge of the tile, and the status message goes below the name.
+                int nameLength = static_cast<int>(wcslen(pItem->GetName()));
+                if (tiled)
+                {
+                    ExtTextOut(hdc, textLeft, itemRect.top + 2, ETO_CLIPPED, &itemRect, pItem->GetName(),
+                        static_cast<UINT>(nameLength), NULL);
+                }
+                else
+                {
+                    TextOut(hdc, textLeft, itemRect.top + 2, pItem->GetName(), nameLength);
+                }
+                SIZE nameSize;
+                if ((pPayload != NULL) && !pPayload->StatusMessage.empty()
+                    && (tiled || GetTextExtentPoint32(hdc, pItem->GetName(), nameLength, &nameSize)))
+                {
+                    if (!pCustomList->IsItemSelected(i) || !pCustomList->GetIsFocused())
+                    {
+                        SetTextColor(hdc, GetSysColor(COLOR_GRAYTEXT));
+                    }
+                    if (tiled)
                     {
-                        SelectObject(hdc, onlineFillBrush);
-                        Rectangle(hdc, itemRect.left + 2, itemRect.top + 3,
-                            itemRect.left + pCustomList->ImageWidth + 2, itemRect.top + 3 + pCustomList->ImageHeight);
+                        ExtTextOut(hdc, textLeft, itemRect.top + 2 + pCustomList->ItemHeight, ETO_CLIPPED,
+                            &itemRect, pPayload->StatusMessage.c_str(),
+                            static_cast<UINT>(pPayload->StatusMessage.size()), NULL);
                     }
                     else
                     {
-                        SelectObject(hdc, offlineFillBrush);
-                        Ellipse(hdc, itemRect.left + 2, itemRect.top + 3,
-                            itemRect.left + pCustomList->ImageWidth + 2, itemRect.top + 3 + pCustomList->ImageHeight);
+                        TextOut(hdc, textLeft + nameSize.cx + 6, itemRect.top + 2, pPayload->StatusMessage.c_str(),
+                            static_cast<int>(pPayload->StatusMessage.size()));
                     }
-                }  // for each item.
-            }
+                }
+
+                // Draw the status icon.
+                if (pItem->GetStatus() == Status_Online)
+                {
+                    SelectObject(hdc, onlineFillBrush);
+                    Rectangle(hdc, itemRect.left + 2, itemRect.top + 3,
+                        itemRect.left + pCustomList->ImageWidth + 2, itemRect.top + 3 + pCustomList->ImageHeight);
+                }
+                else
+                {
+                    SelectObject(hdc, offlineFillBrush);
+                    Ellipse(hdc, itemRect.left + 2, itemRect.top + 3,
+                        itemRect.left + pCustomList->ImageWidth + 2, itemRect.top + 3 + pCustomList->ImageHeight);
+                }
+            }  // for each child.
 
             EndPaint(hwnd, &paintStruct);
             // Restore context.
@@ -452,6 +2511,145 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
             break;
         }
 
+    case CUSTOMLB_RENAMEITEM:
+        // Rename the item with the focus rectangle.
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            pCustomList->SetItemName(pCustomList->GetSelectedIndex(), (WCHAR*)lParam);
+            break;
+        }
+
+    case CUSTOMLB_SYNCROSTER:
+        {
+            // lParam points to the roster, a std::vector<RosterEntry>, so the
+            // message is sent, not posted.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if ((pCustomList == NULL) || (lParam == 0))
+            {
+                return FALSE;
+            }
+            return pCustomList->SyncRoster(*reinterpret_cast<const std::vector<RosterEntry>*>(lParam)) ? TRUE : FALSE;
+        }
+
+    case CUSTOMLB_GETMODEL:
+        {
+            // Returns the ContactModel the list shows, without a reference; the
+            // model lives as long as the list does.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            return (pCustomList != NULL) ? reinterpret_cast<LRESULT>(pCustomList->GetModel()) : 0;
+        }
+
+    case CUSTOMLB_SETMODEL:
+        {
+            // lParam is the ContactModel to show, such as one got from another
+            // list with GetModel.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if ((pCustomList != NULL) && (lParam != 0))
+            {
+                pCustomList->SetModel(reinterpret_cast<ContactModel*>(lParam));
+            }
+            break;
+        }
+
+    case CUSTOMLB_SETFILTER:
+        {
+            // wParam is the ContactFilter, or 0 to show every contact, and
+            // lParam the context passed to it.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->SetFilter(reinterpret_cast<ContactFilter>(wParam), reinterpret_cast<void*>(lParam));
+            }
+            break;
+        }
+
+    case CUSTOMLB_LOADPAYLOADS:
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->LoadPayloads();
+            }
+            break;
+        }
+
+    case CUSTOMLB_OPENPAYLOADS:
+        {
+            // lParam is the directory of payload files, and wParam the capacity
+            // of the cache in kilobytes, or zero for the default.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if ((pCustomList == NULL) || (lParam == 0))
+            {
+                return FALSE;
+            }
+            return pCustomList->OpenPayloadStore(reinterpret_cast<const char*>(lParam), wParam * 1024) ? TRUE : FALSE;
+        }
+
+    case CUSTOMLB_OPENSEARCHINDEX:
+        {
+            // Retrieve the control.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if ((pCustomList != NULL) && (lParam != 0))
+            {
+                pCustomList->OpenSearchIndex(reinterpret_cast<const char*>(lParam));
+            }
+            break;
+        }
+
+    case CUSTOMLB_WORKCOMPLETE:
+        {
+            // Run the completions of background work. One message is posted for
+            // any number of completions.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->GetExecutor().RunCompletions();
+            }
+            break;
+        }
+
+    case WM_TIMER:
+        if (wParam == MemoryTimerId)
+        {
+            MEMSTATS_DUMP();
+            break;
+        }
+        if (wParam != JobTimerId)
+        {
+            break;
+        }
+        // The timer runs the jobs when input was waiting.
+    case CUSTOMLB_RUNJOBS:
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->RunJobs();
+            }
+            break;
+        }
+
+    case WM_SIZE:
+        {
+            // Rectangles change with the size of the control.
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->OnSize();
+            }
+            break;
+        }
+
+    case CUSTOMLB_PUBLISHSNAPSHOT:
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            if (pCustomList != NULL)
+            {
+                pCustomList->PublishSnapshot();
+            }
+            break;
+        }
+
     case WM_GETDLGCODE:
         {
             // Trap arrow keys.
@@ -465,10 +2663,10 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
             // Retrieve the control.
             CustomListControl* pCustomList = GetControl(hwnd);
 
-            // Check that the click was on an item. If CUSTOMLB_DEFERDOUBLECLICK,
-            // lParam is 0. 
-            int itemClicked = pCustomList->IndexFromY(HIWORD(lParam));
-            if (itemClicked >= 0)
+            // Check that the click was on an item. CUSTOMLB_DEFERDOUBLECLICK is
+            // always for the selected item.
+            if ((message == CUSTOMLB_DEFERDOUBLECLICK)
+                || (pCustomList->IndexFromPoint(LOWORD(lParam), HIWORD(lParam)) >= 0))
             {
                 pCustomList->OnDoubleClick();
             }
@@ -481,14 +2679,38 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
             CustomListControl* pCustomList = GetControl(hwnd);
 
             // Get the item under the cursor. This is -1 if the user clicked on a blank space.
+            int x = LOWORD(lParam);
             int y = HIWORD(lParam);
-            int item = pCustomList->IndexFromY(y);
+            int item = pCustomList->IndexFromPoint(x, y);
 
             // Set the focus to the control regardless of whether the selection is valid.
             SetFocus(hwnd);
-            if (item >= 0)
+
+            // Clicking a group expands or collapses it.
+            int group = pCustomList->GroupFromChild(pCustomList->ChildFromPoint(x, y));
+            if (group >= 0)
+            {
+                pCustomList->SetFocusedGroup(group);
+                pCustomList->SetGroupExpanded(group, !pCustomList->IsGroupExpanded(group));
+            }
+            else if (item >= 0)
             {
-                pCustomList->SelectItem(item);
+                // Shift extends the selection from the anchor, ctrl toggles a single item.
+                // The grouped view does not show ranges in list order, so there shift
+                // has no effect.
+                if ((wParam & MK_SHIFT) && !pCustomList->IsGrouped())
+                {
+                    pCustomList->ExtendSelection(item, 
+                        (wParam & MK_CONTROL) ? Extend_MatchAnchor : Extend_Replace);
+                }
+                else if (wParam & MK_CONTROL)
+                {
+                    pCustomList->ToggleSelection(item);
+                }
+                else
+                {
+                    pCustomList->SelectItem(item);
+                }
             }
 
             break;
@@ -496,69 +2718,200 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
 
 
     case WM_KEYDOWN:
-        // Move the selection with up/down arrows.
+        // Move the selection with the arrow, Page Up, Page Down, Home and End keys.
         {
             // Retrieve the control.
             CustomListControl* pCustomList = GetControl(hwnd);
 
+            bool shiftDown = GetKeyState(VK_SHIFT) < 0;
+            bool controlDown = GetKeyState(VK_CONTROL) < 0;
+
             switch (wParam)
             {
             case VK_UP:
-                if (pCustomList->GetSelectedIndex() > 0) 
+            case VK_DOWN:
+            case VK_PRIOR:
+            case VK_NEXT:
+            case VK_HOME:
+            case VK_END:
+                {
+                    // Work out where the keys lead, and move there in one step,
+                    // so that the events are raised for the final child only.
+                    int last = pCustomList->GetChildCount() - 1;
+                    int current = static_cast<int>(pCustomList->GetFocusChild()) - 1;
+                    int target = current;
+                    if ((wParam == VK_HOME) || (wParam == VK_END))
+                    {
+                        target = (wParam == VK_HOME) ? 0 : last;
+                    }
+                    else
+                    {
+                        int presses = TakeKeyRepeats(hwnd, wParam, lParam);
+                        int step = ((wParam == VK_PRIOR) || (wParam == VK_NEXT)) ? pCustomList->GetPageSize()
+                            : pCustomList->GetColumnCount();
+                        if (pCustomList->IsTiled() && ((wParam == VK_UP) || (wParam == VK_DOWN)) && (current >= 0))
+                        {
+                            // In the tile view, Up and Down stay in the column, as
+                            // accNavigate does, so there is no move from the first row
+                            // up, or down from a tile with none below it.
+                            int rows = (wParam == VK_UP) ? current / step : (last - current) / step;
+                            int distance = (std::min)(presses, rows) * step;
+                            target = (wParam == VK_UP) ? current - distance : current + distance;
+                        }
+                        else
+                        {
+                            // Clamp the distance first, so that it cannot overflow.
+                            int distance = (presses > last / step + 1) ? last + 1 : presses * step;
+                            target = ((wParam == VK_UP) || (wParam == VK_PRIOR)) ? current - distance : current + distance;
+                            target = (std::max)(0, (std::min)(target, last));
+                        }
+                    }
+                    if ((last >= 0) && (target != current))
+                    {
+                        MoveToChild(pCustomList, target + 1, shiftDown, controlDown);
+                    }
+                    return 0;
+                }
+
+            case VK_LEFT:
+            case VK_RIGHT:
+                // In the tile view, Left and Right move along the rows, from the end
+                // of one row to the start of the next.
+                if (pCustomList->IsTiled())
                 {
-                    pCustomList->SelectItem(pCustomList->GetSelectedIndex() - 1);
+                    int last = pCustomList->GetChildCount() - 1;
+                    int current = static_cast<int>(pCustomList->GetFocusChild()) - 1;
+                    int presses = TakeKeyRepeats(hwnd, wParam, lParam);
+                    int distance = (presses > last) ? last + 1 : presses;
+                    int target = (wParam == VK_LEFT) ? current - distance : current + distance;
+                    target = (std::max)(0, (std::min)(target, last));
+                    if ((last >= 0) && (target != current))
+                    {
+                        MoveToChild(pCustomList, target + 1, shiftDown, controlDown);
+                    }
+                    return 0;
+                }
+                // In the grouped view, Left collapses a group or moves from an item to
+                // its group, and Right expands a group or moves to its first item.
+                if (pCustomList->IsGrouped())
+                {
+                    long child = pCustomList->GetFocusChild();
+                    int group = pCustomList->GroupFromChild(child);
+                    int index = pCustomList->ItemFromChild(child);
+                    if (group < 0)
+                    {
+                        if ((wParam == VK_LEFT) && (index >= 0))
+                        {
+                            pCustomList->SetFocusedGroup(pCustomList->GetItemGroup(index));
+                        }
+                    }
+                    else if (wParam == VK_LEFT)
+                    {
+                        pCustomList->SetGroupExpanded(group, false);
+                    }
+                    else if (!pCustomList->IsGroupExpanded(group))
+                    {
+                        pCustomList->SetGroupExpanded(group, true);
+                    }
+                    else if (pCustomList->GetGroupMemberCount(group) > 0)
+                    {
+                        MoveToChild(pCustomList, child + 1, false, controlDown);
+                    }
+                    return 0;
                 }
-                return 0;
                 break;
 
-            case VK_DOWN:
-                if (pCustomList->GetSelectedIndex() < pCustomList->GetCount() - 1)          
+            case 'G':
+                // Ctrl+G switches between the flat list and the grouped view.
+                if (controlDown)
                 {
-                    pCustomList->SelectItem(pCustomList->GetSelectedIndex() + 1);  
+                    pCustomList->SetGrouped(!pCustomList->IsGrouped());
+                    return 0;
                 }
-                return 0;
                 break;
-            }
-            break; // WM_KEYDOWN
-        }
-    }  // switch (message)
 
-    return DefWindowProc(hwnd, message, wParam, lParam);
-}
+            case 'S':
+                // Ctrl+S sorts the contacts by name.
+                if (controlDown)
+                {
+                    pCustomList->SortItemsByName();
+                    return 0;
+                }
+                break;
 
+            case 'T':
+                // Ctrl+T switches between the list and the tile view.
+                if (controlDown)
+                {
+                    pCustomList->SetTiled(!pCustomList->IsTiled());
+                    return 0;
+                }
+                break;
 
-// CustomListControlItem class 
-//
-CustomListControlItem::CustomListControlItem(WCHAR* name)
-{
-    // In case of failure, name will be set to NULL, which is acceptable.
-    m_name = _wcsdup(name);
-}
+            case VK_SPACE:
+                // Ctrl+Space toggles the item with the focus rectangle, and Space
+                // selects it alone, as in a list box. While type-ahead text is
+                // being typed, Space is part of the text instead; see WM_CHAR.
+                if (controlDown)
+                {
+                    pCustomList->ToggleSelection(pCustomList->GetSelectedIndex());
+                    return 0;
+                }
+                if (!pCustomList->IsTypingAhead(static_cast<DWORD>(GetMessageTime())))
+                {
+                    if (pCustomList->GetSelectedIndex() >= 0)
+                    {
+                        pCustomList->SelectItem(pCustomList->GetSelectedIndex());
+                    }
+                    return 0;
+                }
+                break;
 
-CustomListControlItem::~CustomListControlItem()
-{
-    free(m_name);
-}
+            case 'A':
+                // Ctrl+A selects everything.
+                if (controlDown)
+                {
+                    pCustomList->SelectAll();
+                    return 0;
+                }
+                break;
+            }
+            break; // WM_KEYDOWN
+        }
 
-// Gets the status (online/offline) of this contact.
-//
-ContactStatus CustomListControlItem::GetStatus()
-{
-    return m_status;
-}
+    case WM_CHAR:
+        // Typing selects the contacts whose names contain the typed text. A
+        // space that does not continue the text was handled as a key.
+        if (((wParam >= L' ') || (wParam == L'\b')) && (GetKeyState(VK_CONTROL) >= 0))
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            DWORD time = static_cast<DWORD>(GetMessageTime());
+            if ((wParam != L' ') || pCustomList->IsTypingAhead(time))
+            {
+                pCustomList->TypeAhead(static_cast<WCHAR>(wParam), time);
+            }
+            return 0;
+        }
+        break;
 
-// Sets the status (online/offline) of this contact.
-//
-void CustomListControlItem::SetStatus(ContactStatus status)
-{
-    m_status = status;
-}
+    case WM_SYSKEYDOWN:
+        // Alt+Up and Alt+Down move the item with the focus rectangle up or down
+        // the list. Groups and tiles keep their own order, so only the list does.
+        // If the item cannot move, the key goes to DefWindowProc as usual.
+        if ((wParam == VK_UP) || (wParam == VK_DOWN))
+        {
+            CustomListControl* pCustomList = GetControl(hwnd);
+            int index = pCustomList->GetSelectedIndex();
+            if (!pCustomList->IsGrouped() && !pCustomList->IsTiled() && (index >= 0)
+                && pCustomList->MoveItem(index, (wParam == VK_UP) ? index - 1 : index + 1))
+            {
+                return 0;
+            }
+        }
+        break;
+    }  // switch (message)
 
-// Gets the name of the contact.
-//
-WCHAR* CustomListControlItem::GetName()
-{
-    return m_name;
+    return DefWindowProc(hwnd, message, wParam, lParam);
 }
 
 
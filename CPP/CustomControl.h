@@ -24,26 +24,81 @@
 #include <stdlib.h>
 #include <oleacc.h>
 #include "resource.h"
+#include "SelectionRanges.h"
+#include "ChildRecords.h"
+#include "ChangeLog.h"
+#include "ContactIndex.h"
+#include "ContactModel.h"
+#include <string>
+#include <unordered_map>
+#include "SharedSnapshot.h"
+#include "WorkExecutor.h"
+#include "JobScheduler.h"
+#include "ListLayout.h"
+#include "RosterGroups.h"
+#include "RosterDiff.h"
 #include <deque>
 using namespace std;
-#define LISTITERATOR std::deque<CustomListControlItem*>::iterator
+#define LISTITERATOR ItemStorage::iterator
 
 // Forward declarations.
-class CustomListControlItem;
 class AccServer;
 
+// Container for the items. Named here so that the iterator type follows it.
+typedef std::deque<CustomListControlItem*> ItemStorage;
 
-// Values for status of contacts.
-enum ContactStatus 
+// Maps between item indexes and positions. Every item is the same height.
+typedef FixedHeightLayout<15> ItemLayout;
+
+// Maps between item indexes and tiles in the tile view. Tiles have room for
+// a line with the name and a line with the status message.
+typedef TileLayout<120, 32> ItemTileLayout;
+
+// Decides whether a view shows a contact.
+typedef bool (*ContactFilter)(CustomListControlItem* pItem, void* pContext);
+
+
+// Groups of the grouped view, in the order they are shown.
+enum ContactGroup
 {
-    Status_Offline,
-    Status_Online
+    Group_Online,
+    Group_Offline,
+    Group_Count
+};
+
+// How ExtendSelection treats the items between the anchor and the new item.
+enum ExtendMode
+{
+    Extend_Replace,         // Select only the items in the range.
+    Extend_Add,             // Add the range to the selection.
+    Extend_Remove,          // Remove the range from the selection.
+    Extend_MatchAnchor      // Give the range the selection state of the anchor item.
+};
+
+// A contact in a complete roster, for SyncRoster. The ID is the item ID, and
+// identifies the contact from one roster to the next. Item IDs start at 1.
+struct RosterEntry
+{
+    unsigned int Id;
+    ContactStatus Status;
+    WCHAR* Name;
 };
 
 // Custom message types.
 #define CUSTOMLB_ADDITEM            (WM_USER + 1)
 #define CUSTOMLB_DEFERDOUBLECLICK   (WM_USER + 2)
 #define CUSTOMLB_DELETEITEM         (WM_USER + 3)
+#define CUSTOMLB_PUBLISHSNAPSHOT    (WM_USER + 4)
+#define CUSTOMLB_OPENSEARCHINDEX    (WM_USER + 5)
+#define CUSTOMLB_WORKCOMPLETE       (WM_USER + 6)
+#define CUSTOMLB_RUNJOBS            (WM_USER + 7)
+#define CUSTOMLB_SYNCROSTER         (WM_USER + 8)
+#define CUSTOMLB_SETMODEL           (WM_USER + 9)
+#define CUSTOMLB_LOADPAYLOADS       (WM_USER + 10)
+#define CUSTOMLB_OPENPAYLOADS       (WM_USER + 11)
+#define CUSTOMLB_RENAMEITEM         (WM_USER + 12)
+#define CUSTOMLB_GETMODEL           (WM_USER + 13)
+#define CUSTOMLB_SETFILTER          (WM_USER + 14)
 
 
 void RegisterListControl(HINSTANCE hInstance);
@@ -51,58 +106,184 @@ LRESULT CALLBACK ControlWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM l
 HFONT GetFont(LONG height);
 
 
-// CustomList control class -- the list box itself.
+// CustomList control class -- the list box itself, which is a view of a
+// contact model.
 //
-class CustomListControl
+class CustomListControl : public ContactModelObserver
 {
 private:
     bool   m_hasFocus;
-    int    m_selectedIndex; 
+    int    m_selectedIndex;     // The item with the focus rectangle.
+    int    m_anchorIndex;       // Fixed end of a range selection.
     HWND   m_controlHwnd;
-    std::deque<CustomListControlItem*> m_itemCollection;
+    ItemStorage m_itemCollection;
+    SelectionRangeSet m_selection;
     AccServer* m_pAccServer;
+    SnapshotPublisher m_snapshot;   // Children published in shared memory.
+    bool   m_snapshotPending;       // CUSTOMLB_PUBLISHSNAPSHOT has been posted.
+    ChangeLog m_changeLog;          // Recent changes, for clients that mirror the list.
+    ContactModel* m_pModel;         // The contacts, which other controls may also show.
+    ContactFilter m_filter;         // Decides which contacts are shown, or NULL for all.
+    void*  m_pFilterContext;
+    const std::vector<CustomListControlItem*>* m_pSyncOrder;   // Order for the commit SyncRoster makes.
+    std::unordered_map<unsigned int, int> m_itemPositions; // Item ID to index.
+    bool   m_itemPositionsValid;    // False after items are removed or moved.
+    WorkExecutor m_executor;        // Runs expensive work off the UI thread.
+    JobScheduler m_jobs;            // Long operations that run on the UI thread in slices.
+    bool   m_jobsPending;           // The next slice of m_jobs has been scheduled.
+    std::vector<unsigned int> m_payloadRequests;    // Payloads found missing while painting.
+    unsigned int m_generation;      // Changes whenever the items change.
+    ItemLayout m_layout;            // Positions of the items.
+    ItemTileLayout m_tiles;         // Positions of the items in the tile view.
+    RosterGroups m_groups;          // Member counts and expanded state of the groups.
+    bool   m_grouped;               // The items are shown in groups, as an outline.
+    bool   m_tiled;                 // The items are shown as tiles, in rows.
+    int    m_focusedGroup;          // Group with the focus rectangle, or -1 for an item.
+    unsigned int m_viewEpoch;       // Changes when the children change but the items do not.
+    unsigned int m_stateEpoch;      // Changes with the selection, the focus rectangle and the focus.
+    std::wstring m_typedText;       // Characters typed to select matching items.
+    DWORD  m_typedTime;             // Message time of the last of them.
+    HDC    m_avatarDC;              // Memory DC with a DIB section of AvatarSize, kept for painting.
+    HBITMAP m_avatarBitmap;
+    HGDIOBJ m_oldAvatarBitmap;
+    unsigned int* m_pAvatarBits;
+
+    // Properties of a child, kept until a counter they depend on changes.
+    struct ChildProperties
+    {
+        unsigned int Generation;    // m_generation and m_viewEpoch, for every property.
+        unsigned int ViewEpoch;
+        unsigned int StateEpoch;    // m_stateEpoch, for State.
+        bool HasState;
+        bool HasHelp;
+        bool HasRect;
+        DWORD State;
+        const WCHAR* Help;
+        RECT Rect;                  // Client coordinates.
+    };
+    std::vector<ChildProperties> m_childProperties; // Indexed by child ID - 1.
+
+    void RaiseWinEvent(DWORD winEvent, LONG childId);
+    void RaiseSelectionEvents(int index, DWORD selectionEvent);
+    void InvalidateSnapshot();
+    void UpdateItemPositions();
+    void ContinueJobs();
+    void CommitOrder(const std::vector<CustomListControlItem*>& items);
+    void ApplyItems(const std::vector<CustomListControlItem*>& items, const std::vector<ModelChange>& changes);
+    bool PassesFilter(CustomListControlItem* pItem);
+    void UpdateGroupMembers();
+    ChildProperties* GetChildProperties(long childId);
+
+    friend class SortByNameJob;
 
 public:
     // For simplicity, declare some properties as constants.
     static const int MaxItems = 10;
     // Height of list item.
-    static const int ItemHeight = 15;
+    static const int ItemHeight = ItemLayout::ItemHeight;
     // Dimensions of image that signifies item status.
     static const int ImageWidth = 10;
     static const int ImageHeight = 10;
+    // Size of avatars, when the contacts have payloads.
+    static const int AvatarSize = 12;
+    // Pause, in milliseconds, after which typing starts a new search.
+    static const DWORD TypeAheadTimeout = 1000;
+    // Typed characters needed before a mistake is allowed for.
+    static const size_t TypeAheadMinimumApproximate = 3;
 
     CustomListControl(HWND hwnd);
-    virtual ~CustomListControl();
+    ~CustomListControl();
     AccServer* GetAccServer();
     void SetAccServer(AccServer* pAccServer);
+    ContactModel* GetModel();
+    void SetModel(ContactModel* pModel);
+    void SetFilter(ContactFilter filter, void* pContext);
+    virtual void OnModelChanged(const std::vector<ModelChange>& changes);
+    virtual void OnPayloadLoaded(unsigned int id);
 
-    int IndexFromY(int y);
+    int IndexFromPoint(int x, int y);
+    const ItemLayout& GetLayout() const;
+    const ItemTileLayout& GetTileLayout() const;
+    int GetPageSize();
+    int GetColumnCount();
     void SelectItem(int index);
+    void AddToSelection(int index);
+    void RemoveFromSelection(int index);
+    void SetItemSelected(int index, bool selected);
+    void ExtendSelection(int index, ExtendMode mode, bool moveFocus = true);
+    void ToggleSelection(int index);
+    void SelectAll();
+    void SetFocusedItem(int index);
+    void SetSelection(const std::vector<SelectionRangeSet::Range>& ranges, int focusIndex);
+    bool IsItemSelected(int index);
+    const SelectionRangeSet& GetSelection();
     int GetSelectedIndex(); 
     bool GetIsFocused();
     void SetIsFocused(bool isFocused);
     bool AddItem(ContactStatus status, WCHAR* name);
     LISTITERATOR GetItemAt(int index);
     bool RemoveSelected();
+    bool MoveItem(int index, int newIndex);
+    bool SetItemName(int index, WCHAR* name);
+    bool SetItemStatus(int index, ContactStatus status);
+    bool SyncRoster(const std::vector<RosterEntry>& roster);
+    const ChangeLog& GetChangeLog();
+    void FindItems(const WCHAR* name, NameMatch match, int status, std::vector<int>* pIndexes);
+    int SelectMatching(const WCHAR* text);
+    int TypeAhead(WCHAR character, DWORD time);
+    bool IsTypingAhead(DWORD time);
+    void OpenSearchIndex(const char* path);
+    bool OpenPayloadStore(const char* directory, size_t capacityBytes);
+    bool HasPayloads();
+    ContactPayloadPtr GetItemPayload(int index);
+    void DrawAvatar(HDC hdc, const ContactPayload* pPayload, int x, int y, HBRUSH placeholderBrush);
+    void LoadPayloads();
+    WorkExecutor& GetExecutor();
+    unsigned int GetGeneration();
+    void SortItemsByName();
+    void ScheduleJob(TimeSlicedJob* pJob);
+    void RunJobs();
+    void FinishJobs();
+    void FindApproximate(const WCHAR* text, int maxErrors, size_t maxResults, std::vector<int>* pIndexes);
     int GetCount();
     bool GetItemScreenRect(int index, RECT* pRetVal);
-    void OnDoubleClick();
-};
+    bool GetItemClientRect(int index, RECT* pRetVal);
+    DWORD GetItemState(int index);
+    const WCHAR* GetItemHelp(int index);
+    void GetItemRecord(int index, const RECT& rect, ChildRecords::Record* pRecord);
 
-// CustomListItem control class -- an item in the list.
-//
-class CustomListControlItem
-{
-private:
-    WCHAR* m_name;
-    ContactStatus m_status;
+    // Children, which are the items, or in the grouped view, the rows.
+    bool IsGrouped();
+    void SetGrouped(bool grouped);
+    int GetChildCount();
+    int ItemFromChild(long childId);
+    int GroupFromChild(long childId);
+    long ChildFromItem(int index);
+    long ChildFromGroup(int group);
+    long ChildFromPoint(int x, int y);
+    long GetFocusChild();
+    bool GetChildScreenRect(long childId, RECT* pRetVal);
+    bool GetChildClientRect(long childId, RECT* pRetVal);
+    void GetSelectedChildren(std::vector<SelectionRangeSet::Range>* pRanges);
+    DWORD GetChildState(long childId);
+    const WCHAR* GetChildHelp(long childId);
+    void GetChildRecord(long childId, const RECT& rect, ChildRecords::Record* pRecord);
 
-public:
-    CustomListControlItem(WCHAR* name);
-    virtual ~CustomListControlItem();
-    ContactStatus GetStatus();
-    void SetStatus(ContactStatus status);
-    WCHAR* GetName();
+    bool IsTiled();
+    void SetTiled(bool tiled);
+    long GetTileNeighbor(long childId, int columns, int rows);
+
+    int GetItemGroup(int index);
+    int GetGroupMemberCount(int group);
+    bool IsGroupExpanded(int group);
+    void SetGroupExpanded(int group, bool expanded);
+    void SetFocusedGroup(int group);
+    const WCHAR* GetGroupName(int group);
+    const WCHAR* GetGroupHelp(int group);
+    DWORD GetGroupState(int group);
+    void OnSize();
+    void PublishSnapshot();
+    void OnDoubleClick();
 };
 
 // Helper function.
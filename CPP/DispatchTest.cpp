@@ -0,0 +1,351 @@
+/*************************************************************************************************
+* Description: Implementation of the dispatch test.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "DispatchTest.h"
+#include "AccServer.h"
+#include "MemoryStats.h"
+#include <stdio.h>
+#include <new>
+
+enum DispatchCallKind
+{
+    Call_Name,
+    Call_State,
+    Call_Role,
+    Call_ChildCount,
+    Call_Location,
+    Call_HitTest,
+    Call_KindCount
+};
+
+static const OLECHAR* const CallNames[Call_KindCount] =
+{
+    L"accName",
+    L"accState",
+    L"accRole",
+    L"accChildCount",
+    L"accLocation",
+    L"accHitTest",
+};
+
+// Names that the lookup phase cycles through: every member, in a different
+// case now and then, as scripts write them.
+static const OLECHAR* const LookupNames[] =
+{
+    L"accParent", L"accChildCount", L"accChild", L"accName", L"accValue", L"accDescription",
+    L"accRole", L"accState", L"accHelp", L"accHelpTopic", L"accKeyboardShortcut", L"accFocus",
+    L"accSelection", L"accDefaultAction", L"accSelect", L"accLocation", L"accNavigate",
+    L"accHitTest", L"accDoDefaultAction", L"ACCNAME", L"accrole", L"AccState",
+};
+
+// The arguments of a call, kept together so that the method can write to the
+// ones passed by reference.
+struct DispatchCall
+{
+    VARIANT Args[5];        // Last argument first, as DISPPARAMS holds them.
+    long Location[4];
+    DISPPARAMS Params;
+    WORD Flags;
+};
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG DispatchClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Fills in the arguments of a call of the given kind.
+//
+static void PrepareCall(int kind, long childId, const POINT& point, DispatchCall* pCall)
+{
+    pCall->Params.rgvarg = pCall->Args;
+    pCall->Params.rgdispidNamedArgs = NULL;
+    pCall->Params.cNamedArgs = 0;
+    pCall->Params.cArgs = 0;
+    pCall->Flags = DISPATCH_PROPERTYGET;
+    switch (kind)
+    {
+    case Call_Name:
+    case Call_State:
+    case Call_Role:
+        pCall->Args[0].vt = VT_I4;
+        pCall->Args[0].lVal = childId;
+        pCall->Params.cArgs = 1;
+        break;
+    case Call_Location:
+        for (int i = 0; i < 4; i++)
+        {
+            pCall->Location[i] = 0;
+            pCall->Args[4 - i].vt = VT_BYREF | VT_I4;
+            pCall->Args[4 - i].plVal = &pCall->Location[i];
+        }
+        pCall->Args[0].vt = VT_I4;
+        pCall->Args[0].lVal = childId;
+        pCall->Params.cArgs = 5;
+        pCall->Flags = DISPATCH_METHOD;
+        break;
+    case Call_HitTest:
+        pCall->Args[1].vt = VT_I4;
+        pCall->Args[1].lVal = point.x;
+        pCall->Args[0].vt = VT_I4;
+        pCall->Args[0].lVal = point.y;
+        pCall->Params.cArgs = 2;
+        pCall->Flags = DISPATCH_METHOD;
+        break;
+    }
+}
+
+// Makes a call through the server's IDispatch, or through the type library if
+// pTypeInfo is not NULL.
+//
+static HRESULT InvokeCall(AccServer* pAcc, ITypeInfo* pTypeInfo, DISPID dispid, DispatchCall* pCall,
+    VARIANT* pResult)
+{
+    EXCEPINFO excepInfo;
+    ZeroMemory(&excepInfo, sizeof(EXCEPINFO));
+    UINT argErr = 0;
+    HRESULT hr = (pTypeInfo != NULL)
+        ? pTypeInfo->Invoke(static_cast<IAccessible*>(pAcc), dispid, pCall->Flags, &pCall->Params, pResult,
+            &excepInfo, &argErr)
+        : pAcc->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT, pCall->Flags, &pCall->Params, pResult,
+            &excepInfo, &argErr);
+    if (hr == DISP_E_EXCEPTION)
+    {
+        SysFreeString(excepInfo.bstrSource);
+        SysFreeString(excepInfo.bstrDescription);
+        SysFreeString(excepInfo.bstrHelpFile);
+        hr = excepInfo.scode;
+    }
+    return hr;
+}
+
+static bool SameResult(const VARIANT& a, const VARIANT& b)
+{
+    if (a.vt != b.vt)
+    {
+        return false;
+    }
+    switch (a.vt)
+    {
+    case VT_EMPTY:
+        return true;
+    case VT_I4:
+        return a.lVal == b.lVal;
+    case VT_BSTR:
+        return ((a.bstrVal == NULL) || (b.bstrVal == NULL)) ? (a.bstrVal == b.bstrVal)
+            : (wcscmp(a.bstrVal, b.bstrVal) == 0);
+    case VT_DISPATCH:
+        return a.pdispVal == b.pdispVal;
+    default:
+        return false;
+    }
+}
+
+// Makes every kind of call for every child, and at points down the control,
+// on both paths, and counts the calls whose results differ.
+//
+static void CompareCalls(AccServer* pAcc, ITypeInfo* pTypeInfo, const DISPID* pDispIds, long count,
+    const RECT& bounds, DispatchTestReport* pReport)
+{
+    for (int kind = 0; kind < Call_KindCount; kind++)
+    {
+        for (long i = 0; i <= count; i++)
+        {
+            POINT point;
+            point.x = bounds.left + 20;
+            point.y = bounds.top + i * CustomListControl::ItemHeight + 2;
+            DispatchCall staticCall;
+            DispatchCall typeLibCall;
+            PrepareCall(kind, i, point, &staticCall);
+            PrepareCall(kind, i, point, &typeLibCall);
+            VARIANT staticResult;
+            VARIANT typeLibResult;
+            VariantInit(&staticResult);
+            VariantInit(&typeLibResult);
+            HRESULT staticHr = InvokeCall(pAcc, NULL, pDispIds[kind], &staticCall, &staticResult);
+            HRESULT typeLibHr = InvokeCall(pAcc, pTypeInfo, pDispIds[kind], &typeLibCall, &typeLibResult);
+            bool same = (staticHr == typeLibHr) && SameResult(staticResult, typeLibResult);
+            for (int j = 0; (j < 4) && same && (kind == Call_Location); j++)
+            {
+                same = staticCall.Location[j] == typeLibCall.Location[j];
+            }
+            pReport->Compared++;
+            pReport->Mismatches += same ? 0 : 1;
+            VariantClear(&staticResult);
+            VariantClear(&typeLibResult);
+        }
+    }
+}
+
+// Makes the mix of calls on one path, and returns the time they took.
+//
+static ULONGLONG TimeCalls(AccServer* pAcc, ITypeInfo* pTypeInfo, const DISPID* pDispIds, ULONG calls,
+    long count, const RECT& bounds)
+{
+    DispatchCall call;
+    VARIANT result;
+    VariantInit(&result);
+    ULONGLONG start = DispatchClock();
+    for (ULONG i = 0; i < calls; i++)
+    {
+        int kind = i % Call_KindCount;
+        POINT point;
+        point.x = bounds.left + 20;
+        point.y = bounds.top + static_cast<long>((i * 7) % (bounds.bottom - bounds.top));
+        PrepareCall(kind, 1 + static_cast<long>(i / Call_KindCount) % count, point, &call);
+        InvokeCall(pAcc, pTypeInfo, pDispIds[kind], &call, &result);
+        VariantClear(&result);
+    }
+    return DispatchClock() - start;
+}
+
+// Runs the test against a hidden list control. Returns false if the control
+// cannot be created or the type library cannot be loaded.
+//
+bool DispatchTest::Run(ULONG calls, HINSTANCE hInstance, DispatchTestReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(DispatchTestReport));
+    pReport->Calls = calls;
+    pReport->Lookups = calls;
+
+    ITypeLib* pTypeLib = NULL;
+    ITypeInfo* pTypeInfo = NULL;
+    HRESULT hr = LoadRegTypeLib(LIBID_Accessibility, 1, 1, 0, &pTypeLib);
+    if (SUCCEEDED(hr))
+    {
+        hr = pTypeLib->GetTypeInfoOfGuid(IID_IAccessible, &pTypeInfo);
+        pTypeLib->Release();
+    }
+    if (FAILED(hr))
+    {
+        return false;
+    }
+
+    HWND hwnd = CreateWindowEx(0, TEXT("CONTACTLIST"), TEXT("Dispatch test"), WS_POPUP,
+        0, 0, 200, 200, NULL, NULL, hInstance, NULL);
+    CustomListControl* pControl = (hwnd != NULL) ? GetControl(hwnd) : NULL;
+    AccServer* pAcc = (pControl != NULL) ? new (std::nothrow) AccServer(hwnd, pControl) : NULL;
+    if (pAcc == NULL)
+    {
+        if (hwnd != NULL)
+        {
+            DestroyWindow(hwnd);
+        }
+        pTypeInfo->Release();
+        return false;
+    }
+    // The control releases this reference when it is destroyed.
+    pControl->SetAccServer(pAcc);
+    for (int i = 0; i < CustomListControl::MaxItems; i++)
+    {
+        WCHAR name[32];
+        swprintf_s(name, _countof(name), L"Contact %d", i + 1);
+        pControl->AddItem(((i % 3) == 0) ? Status_Offline : Status_Online, name);
+    }
+    long count = pControl->GetCount();
+    RECT bounds;
+    if ((count == 0) || !GetWindowRect(hwnd, &bounds) || (bounds.bottom <= bounds.top))
+    {
+        pTypeInfo->Release();
+        DestroyWindow(hwnd);
+        return false;
+    }
+
+    // Both paths must agree on the DISPIDs before their calls can be compared.
+    DISPID dispIds[Call_KindCount];
+    for (int kind = 0; kind < Call_KindCount; kind++)
+    {
+        OLECHAR* name = const_cast<OLECHAR*>(CallNames[kind]);
+        DISPID typeLibDispId = DISPID_UNKNOWN;
+        pAcc->GetIDsOfNames(IID_NULL, &name, 1, LOCALE_USER_DEFAULT, &dispIds[kind]);
+        pTypeInfo->GetIDsOfNames(&name, 1, &typeLibDispId);
+        pReport->Compared++;
+        pReport->Mismatches += (dispIds[kind] == typeLibDispId) ? 0 : 1;
+    }
+
+    // So must every other name, in any case, and a name that is not a member.
+    const ULONG nameCount = _countof(LookupNames);
+    for (ULONG i = 0; i <= nameCount; i++)
+    {
+        OLECHAR* name = const_cast<OLECHAR*>((i < nameCount) ? LookupNames[i] : L"accNothing");
+        DISPID staticDispId = DISPID_UNKNOWN;
+        DISPID typeLibDispId = DISPID_UNKNOWN;
+        bool staticFound = SUCCEEDED(pAcc->GetIDsOfNames(IID_NULL, &name, 1, LOCALE_USER_DEFAULT, &staticDispId));
+        bool typeLibFound = SUCCEEDED(pTypeInfo->GetIDsOfNames(&name, 1, &typeLibDispId));
+        pReport->Compared++;
+        pReport->Mismatches += ((staticFound == typeLibFound) && (!staticFound || (staticDispId == typeLibDispId))) ? 0 : 1;
+    }
+    CompareCalls(pAcc, pTypeInfo, dispIds, count, bounds, pReport);
+
+    pReport->StaticNanoseconds = TimeCalls(pAcc, NULL, dispIds, calls, count, bounds);
+    pReport->TypeLibNanoseconds = TimeCalls(pAcc, pTypeInfo, dispIds, calls, count, bounds);
+
+    DISPID dispId;
+    ULONGLONG start = DispatchClock();
+    for (ULONG i = 0; i < pReport->Lookups; i++)
+    {
+        OLECHAR* name = const_cast<OLECHAR*>(LookupNames[i % nameCount]);
+        pAcc->GetIDsOfNames(IID_NULL, &name, 1, LOCALE_USER_DEFAULT, &dispId);
+    }
+    pReport->StaticLookupNanoseconds = DispatchClock() - start;
+    start = DispatchClock();
+    for (ULONG i = 0; i < pReport->Lookups; i++)
+    {
+        OLECHAR* name = const_cast<OLECHAR*>(LookupNames[i % nameCount]);
+        pTypeInfo->GetIDsOfNames(&name, 1, &dispId);
+    }
+    pReport->TypeLibLookupNanoseconds = DispatchClock() - start;
+
+    pTypeInfo->Release();
+    DestroyWindow(hwnd);
+    return true;
+}
+
+bool DispatchTest::WriteReport(const DispatchTestReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    double calls = (report.Calls > 0) ? report.Calls : 1.0;
+    double lookups = (report.Lookups > 0) ? report.Lookups : 1.0;
+    double staticCall = report.StaticNanoseconds / calls;
+    double typeLibCall = report.TypeLibNanoseconds / calls;
+    fprintf(pFile, "invoke: %lu calls on each path; static %.0f ns/call, type library %.0f ns/call (%.1fx)\n",
+        report.Calls, staticCall, typeLibCall, (staticCall > 0) ? typeLibCall / staticCall : 0.0);
+    fprintf(pFile, "names: %lu lookups on each path; static %.0f ns/name, type library %.0f ns/name\n",
+        report.Lookups, report.StaticLookupNanoseconds / lookups, report.TypeLibLookupNanoseconds / lookups);
+    fprintf(pFile, "results: %lu calls compared, %lu mismatches\n", report.Compared, report.Mismatches);
+#ifdef ACCSERVER_STATS
+    fputs(MemoryStats::FormatReport().c_str(), pFile);
+#endif
+    fclose(pFile);
+    return true;
+}
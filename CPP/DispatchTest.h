@@ -0,0 +1,44 @@
+/*************************************************************************************************
+* Description: Declarations for the dispatch test, which compares the server's IDispatch with
+* dispatch through the oleacc type library.
+*
+* A hidden control is filled with contacts, and the same mix of calls -- names, states and
+* roles of children, the child count, locations and hit tests -- is made by name through
+* both paths: the server's own GetIDsOfNames and Invoke, and ITypeInfo for IAccessible from
+* the registered type library, invoked on the same object. Every call is first made both
+* ways and the results compared, so the report gives the number of calls whose results
+* differ as well as the time per call and per name lookup on each path.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+
+struct DispatchTestReport
+{
+    ULONG Calls;                        // On each path.
+    ULONG Lookups;                      // Of names, on each path.
+    ULONGLONG StaticNanoseconds;
+    ULONGLONG TypeLibNanoseconds;
+    ULONGLONG StaticLookupNanoseconds;
+    ULONGLONG TypeLibLookupNanoseconds;
+    ULONG Compared;                     // Calls made on both paths and compared.
+    ULONG Mismatches;
+};
+
+namespace DispatchTest
+{
+    bool Run(ULONG calls, HINSTANCE hInstance, DispatchTestReport* pReport);
+    bool WriteReport(const DispatchTestReport& report, const WCHAR* reportPath);
+}
@@ -28,25 +28,225 @@
 #include <ole2.h>
 #include "resource.h"
 #include "CustomControl.h"
+#include "TraceLog.h"
+#include "QueryRecorder.h"
+#include "PayloadTest.h"
+#include "DispatchTest.h"
+#include "CrossProcessTest.h"
+#include "ComponentTest.h"
+#include "SortTest.h"
+#include "AccServer.h"
+#include "MemoryStats.h"
+#include <new>
 
 #define MAXNAMELENGTH 15
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
 INT_PTR CALLBACK    DlgProc(HWND, UINT, WPARAM, LPARAM);
 
+// Checks that no call has allocated more than its budget. Only statistics
+// builds keep budgets, so other builds always pass.
+//
+static bool WithinAllocationBudgets()
+{
+#ifdef ACCSERVER_STATS
+    return MemoryStats::GetBudgetViolations() == 0;
+#else
+    return true;
+#endif
+}
+
 // Entry point.
 int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR /*lpCmdLine*/, int /*nCmdShow*/)
 {
     // Register the window class for the CustomList control.
     RegisterListControl(hInstance);
 
+    // "/replay <recording> <report>" replays a recording made with ACCSERVER_RECORD
+    // against a hidden control, writes the timings to the report, and exits.
+    if ((__argc == 4) && (_wcsicmp(__wargv[1], L"/replay") == 0))
+    {
+        CoInitialize(NULL);
+        ReplayReport report;
+        bool replayed = QueryReplay::Replay(__wargv[2], hInstance, &report)
+            && QueryReplay::WriteReport(report, __wargv[3]);
+        CoUninitialize();
+        return (replayed && WithinAllocationBudgets()) ? 0 : 1;
+    }
+
+    // "/payloads <report> [contacts [cache KB [seconds [threads]]]]" measures
+    // decoding and the payload cache while a simulated view scrolls, writes the
+    // results to the report, and exits.
+    if ((__argc >= 3) && (__argc <= 7) && (_wcsicmp(__wargv[1], L"/payloads") == 0))
+    {
+        PayloadTestOptions options;
+        PayloadTest::GetDefaultOptions(&options);
+        if (__argc > 3)
+        {
+            options.Contacts = wcstoul(__wargv[3], NULL, 10);
+        }
+        if (__argc > 4)
+        {
+            options.CapacityKB = wcstoul(__wargv[4], NULL, 10);
+        }
+        if (__argc > 5)
+        {
+            options.Seconds = wcstoul(__wargv[5], NULL, 10);
+        }
+        if (__argc > 6)
+        {
+            options.Threads = wcstoul(__wargv[6], NULL, 10);
+        }
+        if (options.Contacts == 0)
+        {
+            return 1;
+        }
+        PayloadTestReport report;
+        bool measured = PayloadTest::Run(options, &report) && PayloadTest::WriteReport(report, __wargv[2]);
+        return (measured && WithinAllocationBudgets()) ? 0 : 1;
+    }
+
+    // "/dispatch <report> [calls]" makes the same calls by name through the
+    // server's IDispatch and through the oleacc type library, writes the time
+    // each path takes and any difference in their results to the report, and exits.
+    if ((__argc >= 3) && (__argc <= 4) && (_wcsicmp(__wargv[1], L"/dispatch") == 0))
+    {
+        ULONG calls = (__argc > 3) ? wcstoul(__wargv[3], NULL, 10) : 1000000;
+        if (calls == 0)
+        {
+            return 1;
+        }
+        CoInitialize(NULL);
+        DispatchTestReport report;
+        bool measured = DispatchTest::Run(calls, hInstance, &report)
+            && DispatchTest::WriteReport(report, __wargv[2]);
+        CoUninitialize();
+        return (measured && (report.Mismatches == 0) && WithinAllocationBudgets()) ? 0 : 1;
+    }
+
+    // "/crossprocess <report>" starts a second copy of the sample as a client of
+    // a hidden control, which checks the extension interfaces from its process
+    // against IAccessible, times both, writes the report, and exits.
+    if ((__argc == 3) && (_wcsicmp(__wargv[1], L"/crossprocess") == 0))
+    {
+        if (FAILED(RegisterExtensionTypeLib(hInstance)))
+        {
+            return 1;
+        }
+        CoInitialize(NULL);
+        bool passed = CrossProcessTest::Serve(hInstance, __wargv[2]);
+        CoUninitialize();
+        return passed ? 0 : 1;
+    }
+
+    // "/client <window> <report>" is the client that /crossprocess starts.
+    if ((__argc == 4) && (_wcsicmp(__wargv[1], L"/client") == 0))
+    {
+        HWND hwnd = reinterpret_cast<HWND>(static_cast<UINT_PTR>(_wcstoui64(__wargv[2], NULL, 10)));
+        CoInitialize(NULL);
+        CrossProcessReport report;
+        bool passed = CrossProcessTest::RunClient(hwnd, 1000, &report);
+
+        // The report says how far the client got, so it is written even if it failed.
+        passed = CrossProcessTest::WriteReport(report, __wargv[3]) && passed;
+        CoUninitialize();
+        return (passed && (report.Mismatches == 0)) ? 0 : 1;
+    }
+
+    // "/components <report> [seconds [threads [names]]]" checks and measures
+    // the building blocks of the sample on their own, writes the results to
+    // the report, and exits.
+    if ((__argc >= 3) && (__argc <= 6) && (_wcsicmp(__wargv[1], L"/components") == 0))
+    {
+        ComponentTestOptions options;
+        ComponentTest::GetDefaultOptions(&options);
+        if (__argc > 3)
+        {
+            options.Seconds = wcstoul(__wargv[3], NULL, 10);
+        }
+        if (__argc > 4)
+        {
+            options.Threads = wcstoul(__wargv[4], NULL, 10);
+        }
+        if (__argc > 5)
+        {
+            options.Names = wcstoul(__wargv[5], NULL, 10);
+        }
+        ComponentTestReport report;
+        bool measured = ComponentTest::Run(options, &report) && ComponentTest::WriteReport(report, __wargv[2]);
+        return (measured && (report.Failures == 0) && WithinAllocationBudgets()) ? 0 : 1;
+    }
+
+    // "/sort <report> [names [budget in microseconds]]" sorts names in one call
+    // and then in slices on a hidden window, writes how long messages waited
+    // for the slices to the report, and exits.
+    if ((__argc >= 3) && (__argc <= 5) && (_wcsicmp(__wargv[1], L"/sort") == 0))
+    {
+        SortTestOptions options;
+        SortTest::GetDefaultOptions(&options);
+        if (__argc > 3)
+        {
+            options.Names = wcstoul(__wargv[3], NULL, 10);
+        }
+        if (__argc > 4)
+        {
+            options.BudgetMicroseconds = wcstoul(__wargv[4], NULL, 10);
+        }
+        SortTestReport report;
+        bool measured = SortTest::Run(options, hInstance, &report) && SortTest::WriteReport(report, __wargv[2]);
+        return (measured && report.Agreed && WithinAllocationBudgets()) ? 0 : 1;
+    }
+
+    // If ACCSERVER_TRACE names a file, trace the session and write it there
+    // as a Chrome trace that can be opened in Perfetto.
+    WCHAR tracePath[MAX_PATH];
+    DWORD tracePathLength = GetEnvironmentVariable(L"ACCSERVER_TRACE", tracePath, MAX_PATH);
+    bool tracing = (tracePathLength > 0) && (tracePathLength < MAX_PATH);
+    if (tracing)
+    {
+        TraceLog::SetThreadName("UI thread");
+        TraceLog::SetEnabled(true);
+    }
+
+    // If ACCSERVER_RECORD names a file, record the calls that clients make
+    // on the list so that they can be replayed with /replay.
+    WCHAR recordPath[MAX_PATH];
+    DWORD recordPathLength = GetEnvironmentVariable(L"ACCSERVER_RECORD", recordPath, MAX_PATH);
+    if ((recordPathLength > 0) && (recordPathLength < MAX_PATH))
+    {
+        QueryRecorder::Open(recordPath);
+    }
+
+    // Let clients in other processes use the extension interfaces. If this
+    // fails, they can still use IAccessible.
+    RegisterExtensionTypeLib(hInstance);
+
     // Show the dialog.
     CoInitialize(NULL);
     DialogBox(hInstance, MAKEINTRESOURCE(IDD_MAINDLG), NULL, DlgProc);
     CoUninitialize();
+    QueryRecorder::Close();
+
+    if (tracing)
+    {
+        TraceLog::SetEnabled(false);
+        FILE* pTraceFile = NULL;
+        if ((_wfopen_s(&pTraceFile, tracePath, L"w") == 0) && (pTraceFile != NULL))
+        {
+            TraceLog::WriteChromeTrace(pTraceFile);
+            fclose(pTraceFile);
+        }
+    }
     return 0;
 }
 
+// Filter for the list of online contacts.
+//
+static bool IsOnline(CustomListControlItem* pItem, void* /*pContext*/)
+{
+    return pItem->GetStatus() == Status_Online;
+}
+
 // Message handler for application dialog.
 INT_PTR CALLBACK DlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM /*lParam*/)
 {
@@ -65,6 +265,38 @@ INT_PTR CALLBACK DlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM /*lParam
         SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_ADDITEM, Status_Offline, (LPARAM)L"Kim");
         SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_ADDITEM, Status_Offline, (LPARAM)L"Prakesh");
         SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_ADDITEM, Status_Online, (LPARAM)L"Silvio");
+
+        // The second list shows the online contacts of the same model, so it
+        // follows every change made through the first without a copy of them.
+        SendDlgItemMessage(hDlg, IDC_ONLINELISTBOX, CUSTOMLB_SETFILTER, (WPARAM)IsOnline, 0);
+        SendDlgItemMessage(hDlg, IDC_ONLINELISTBOX, CUSTOMLB_SETMODEL, 0,
+            SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_GETMODEL, 0, 0));
+
+        // If ACCSERVER_INDEX names a file, search the names with a trigram index
+        // that is kept in that file between runs.
+        {
+            char indexPath[MAX_PATH];
+            DWORD indexPathLength = GetEnvironmentVariableA("ACCSERVER_INDEX", indexPath, MAX_PATH);
+            if ((indexPathLength > 0) && (indexPathLength < MAX_PATH))
+            {
+                SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_OPENSEARCHINDEX, 0, (LPARAM)indexPath);
+            }
+        }
+
+        // If ACCSERVER_PAYLOADS names a directory of payload files, show avatars
+        // and status messages, through a cache of ACCSERVER_PAYLOAD_KB kilobytes.
+        {
+            char payloadPath[MAX_PATH];
+            DWORD payloadPathLength = GetEnvironmentVariableA("ACCSERVER_PAYLOADS", payloadPath, MAX_PATH);
+            if ((payloadPathLength > 0) && (payloadPathLength < MAX_PATH))
+            {
+                char capacity[16];
+                DWORD capacityLength = GetEnvironmentVariableA("ACCSERVER_PAYLOAD_KB", capacity, _countof(capacity));
+                ULONG capacityKB = ((capacityLength > 0) && (capacityLength < _countof(capacity)))
+                    ? strtoul(capacity, NULL, 10) : 0;
+                SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_OPENPAYLOADS, capacityKB, (LPARAM)payloadPath);
+            }
+        }
         break;
 
     case WM_COMMAND:
@@ -79,8 +311,8 @@ INT_PTR CALLBACK DlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM /*lParam
         {
             SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_DELETEITEM, 0, 0);
         }
-        // "Add" button clicked.
-        else if (LOWORD(wParam) == IDC_ADD)
+        // "Add" or "Rename" button clicked.
+        else if ((LOWORD(wParam) == IDC_ADD) || (LOWORD(wParam) == IDC_RENAME))
         {
             WCHAR name[MAXNAMELENGTH+1];
             // EM_GETLINE doesn't get a null terminator, so fill buffer with nulls.
@@ -95,6 +327,12 @@ INT_PTR CALLBACK DlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM /*lParam
             {
                 break;
             }
+            // Rename the contact with the focus rectangle.
+            if (LOWORD(wParam) == IDC_RENAME)
+            {
+                SendDlgItemMessage(hDlg, IDC_CUSTOMLISTBOX, CUSTOMLB_RENAMEITEM, 0, (LPARAM)name);
+                break;
+            }
             // Get the status
             ContactStatus status; 
             if (BST_CHECKED == SendDlgItemMessage(hDlg, IDC_ONLINE, BM_GETCHECK, 0, 0))
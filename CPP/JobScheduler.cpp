@@ -0,0 +1,124 @@
+/*************************************************************************************************
+* Description: Implementation of long operations that run on the UI thread in short slices.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "JobScheduler.h"
+#include "TraceLog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Gets a monotonic timestamp in nanoseconds.
+//
+static unsigned long long JobClock()
+{
+#ifdef _WIN32
+    static unsigned long long perSecond = 0;
+    if (perSecond == 0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        perSecond = static_cast<unsigned long long>(frequency.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    unsigned long long ticks = static_cast<unsigned long long>(now.QuadPart);
+    return (ticks / perSecond) * 1000000000ULL + ((ticks % perSecond) * 1000000000ULL) / perSecond;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<unsigned long long>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+JobScheduler::JobScheduler() : m_budget(DefaultBudgetMicroseconds * 1000ULL), m_longestSlice(0)
+{
+}
+
+JobScheduler::~JobScheduler()
+{
+    Clear();
+}
+
+// Adds a job to run after the others. The scheduler deletes the job when it
+// has been committed or cleared.
+//
+void JobScheduler::Add(TimeSlicedJob* pJob)
+{
+    if (pJob != NULL)
+    {
+        m_jobs.push_back(pJob);
+    }
+}
+
+// Deletes the jobs without committing them.
+//
+void JobScheduler::Clear()
+{
+    for (size_t i = 0; i < m_jobs.size(); i++)
+    {
+        delete m_jobs[i];
+    }
+    m_jobs.clear();
+}
+
+bool JobScheduler::HasJobs() const
+{
+    return !m_jobs.empty();
+}
+
+// Runs steps until the budget is used up or there are no jobs left. At least
+// one step is run. Returns true if there is more to do.
+//
+bool JobScheduler::RunSlice()
+{
+    TRACE_SPAN("JobScheduler::RunSlice");
+    unsigned long long start = JobClock();
+    unsigned long long now = start;
+    while (!m_jobs.empty() && ((now == start) || (now - start < m_budget)))
+    {
+        TimeSlicedJob* pJob = m_jobs.front();
+        if (pJob->Step())
+        {
+            m_jobs.pop_front();
+            pJob->Commit();
+            delete pJob;
+        }
+        now = JobClock();
+    }
+    if (now - start > m_longestSlice)
+    {
+        m_longestSlice = now - start;
+    }
+    return !m_jobs.empty();
+}
+
+void JobScheduler::SetBudget(unsigned int microseconds)
+{
+    m_budget = microseconds * 1000ULL;
+}
+
+// Gets the longest time, in nanoseconds, that a slice has kept other messages
+// waiting.
+//
+unsigned long long JobScheduler::GetLongestSlice() const
+{
+    return m_longestSlice;
+}
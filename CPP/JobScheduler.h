@@ -0,0 +1,157 @@
+/*************************************************************************************************
+* Description: Declarations for long operations that run on the UI thread in short slices.
+*
+* Some operations must change the list on the UI thread, but take too long to run inside
+* one message handler: input and accessibility clients would wait until they finished.
+* Such an operation is written as a job whose Step method does a little of the work and
+* returns, keeping its place in member variables. The scheduler runs steps until a time
+* budget is used up, and the control then lets other messages through before it runs the
+* next slice.
+*
+* A job works on its own copy of what it needs, and changes the list only in Commit, which
+* is called once, after its last step. So the list is never seen half-changed.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+// A long operation split into steps.
+//
+class TimeSlicedJob
+{
+public:
+    virtual ~TimeSlicedJob()
+    {
+    }
+
+    // Does a little of the work. Returns true when there is no more to do.
+    virtual bool Step() = 0;
+
+    // Applies the result. Called once, directly after the last step.
+    virtual void Commit() = 0;
+};
+
+// A stable bottom-up merge sort that keeps its place between steps, for jobs
+// that sort. Less compares two items, as for std::stable_sort.
+//
+template <typename T, typename Less>
+class SlicedMergeSort
+{
+private:
+    std::vector<T> m_items;
+    std::vector<T> m_merged;
+    Less m_less;
+    size_t m_width;                 // Length of the runs being merged.
+    size_t m_runStart;              // Start of the pair of runs being merged.
+    size_t m_left;                  // Next item in the first run.
+    size_t m_right;                 // Next item in the second run.
+    size_t m_output;                // Next position in m_merged.
+
+    void StartRun(size_t runStart)
+    {
+        m_runStart = runStart;
+        m_left = runStart;
+        m_right = (runStart + m_width < m_items.size()) ? runStart + m_width : m_items.size();
+        m_output = runStart;
+    }
+
+public:
+    SlicedMergeSort() : m_width(1), m_runStart(0), m_left(0), m_right(0), m_output(0)
+    {
+    }
+
+    // Starts sorting a copy of some items.
+    void Reset(const std::vector<T>& items)
+    {
+        m_items = items;
+        m_merged.resize(m_items.size());
+        m_width = 1;
+        StartRun(0);
+    }
+
+    // Merges up to count items. Returns true when the items are sorted.
+    bool Step(size_t count)
+    {
+        size_t itemCount = m_items.size();
+        for (size_t done = 0; (done < count) && (m_width < itemCount); done++)
+        {
+            size_t middle = (m_runStart + m_width < itemCount) ? m_runStart + m_width : itemCount;
+            size_t end = (m_runStart + 2 * m_width < itemCount) ? m_runStart + 2 * m_width : itemCount;
+            if (m_output == end)
+            {
+                // This pair is merged; go on to the next, or to longer runs.
+                if (end == itemCount)
+                {
+                    m_items.swap(m_merged);
+                    m_width *= 2;
+                    StartRun(0);
+                }
+                else
+                {
+                    StartRun(end);
+                }
+                continue;
+            }
+            // Take from the first run on ties, so that the sort is stable.
+            if ((m_left < middle) && ((m_right == end) || !m_less(m_items[m_right], m_items[m_left])))
+            {
+                m_merged[m_output++] = m_items[m_left++];
+            }
+            else
+            {
+                m_merged[m_output++] = m_items[m_right++];
+            }
+        }
+        return m_width >= itemCount;
+    }
+
+    // Gets the items, which are sorted once Step has returned true.
+    std::vector<T>& GetItems()
+    {
+        return m_items;
+    }
+};
+
+// Runs jobs, one at a time and in the order they were added.
+//
+class JobScheduler
+{
+private:
+    std::deque<TimeSlicedJob*> m_jobs;
+    unsigned long long m_budget;            // Nanoseconds per slice.
+    unsigned long long m_longestSlice;      // Nanoseconds.
+
+    JobScheduler(const JobScheduler&);
+    JobScheduler& operator=(const JobScheduler&);
+
+public:
+    // Time to spend in each slice. Input waits at most this long, plus one step.
+    static const unsigned int DefaultBudgetMicroseconds = 4000;
+
+    JobScheduler();
+    ~JobScheduler();
+
+    void Add(TimeSlicedJob* pJob);
+    void Clear();
+    bool HasJobs() const;
+    bool RunSlice();
+    void SetBudget(unsigned int microseconds);
+    unsigned long long GetLongestSlice() const;
+};
@@ -0,0 +1,153 @@
+/*************************************************************************************************
+* Description: Layout policies that map between item indexes and positions in the list.
+*
+* The control does not ask a virtual object where its items are. It names a layout class
+* in a typedef, and calls it directly, so the compiler sees the whole calculation. With
+* FixedHeightLayout the height is a template argument, and IndexFromY and GetItemTop fold
+* to a division and a multiplication by a constant.
+*
+* TileLayout is for the tile view, where items flow left to right into rows of tiles of one
+* size. Its only state is the number of columns, so every mapping between an index, a row
+* and column, and a position is arithmetic, and a resize is one division.
+*
+* Positions are relative to the top of the first item, or the top left of the first tile.
+*
+* Layout is the only policy. Every item in the sample is one height, so there is no
+* variable-height layout for a control to choose. The items live in the shared ContactModel,
+* so storage is a typedef, ItemStorage, rather than a parameter. Clients can select
+* several items, and the accessible object and recorder are written against
+* SelectionRangeSet, so selection stays as it is. Statistics are compiled in or out with
+* ACCSERVER_STATS, and cost nothing when they are out.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <algorithm>
+
+// Layout in which every item has the same height, known at compile time.
+//
+template <int Height>
+class FixedHeightLayout
+{
+public:
+    static const int ItemHeight = Height;
+
+    // Gets the index of the item at y, or -1 if there is none.
+    int IndexFromY(int y, int count) const
+    {
+        int index = y / Height;
+        if ((index < 0) || (count <= index))
+        {
+            index = -1;
+        }
+        return index;
+    }
+
+    int GetItemTop(int index) const
+    {
+        return index * Height;
+    }
+
+    int GetItemHeight(int /*index*/) const
+    {
+        return Height;
+    }
+};
+
+// Layout that flows items into rows of tiles, as many to a row as fit the
+// width, and at least one. The tile size is known at compile time.
+//
+template <int Width, int Height>
+class TileLayout
+{
+private:
+    int m_columns;
+
+public:
+    static const int TileWidth = Width;
+    static const int TileHeight = Height;
+
+    TileLayout() : m_columns(1)
+    {
+    }
+
+    // Sets the width that the rows fill, which gives the number of columns.
+    void SetWidth(int width)
+    {
+        m_columns = (std::max)(1, width / Width);
+    }
+
+    int GetColumnCount() const
+    {
+        return m_columns;
+    }
+
+    int GetRowCount(int count) const
+    {
+        return (count + m_columns - 1) / m_columns;
+    }
+
+    // Gets the index of the tile at a point, or -1 if there is none. The
+    // space to the right of the last column holds no tile.
+    int IndexFromPoint(int x, int y, int count) const
+    {
+        if ((x < 0) || (y < 0))
+        {
+            return -1;
+        }
+        int column = x / Width;
+        int index = (y / Height) * m_columns + column;
+        if ((column >= m_columns) || (index >= count))
+        {
+            index = -1;
+        }
+        return index;
+    }
+
+    int GetItemLeft(int index) const
+    {
+        return (index % m_columns) * Width;
+    }
+
+    int GetItemTop(int index) const
+    {
+        return (index / m_columns) * Height;
+    }
+
+    // Gets the tile that is a number of columns and rows away from another,
+    // or -1 if that is off the grid or past the last tile.
+    int GetNeighbor(int index, int columns, int rows, int count) const
+    {
+        int column = index % m_columns + columns;
+        int neighbor = index + rows * m_columns + columns;
+        if ((column < 0) || (column >= m_columns) || (neighbor < 0) || (neighbor >= count))
+        {
+            neighbor = -1;
+        }
+        return neighbor;
+    }
+
+    // Gets the range of tiles, from first up to end, in the rows that a band
+    // from top to bottom crosses.
+    void GetItemsInBand(int top, int bottom, int count, int* pFirst, int* pEnd) const
+    {
+        int firstRow = (std::max)(top, 0) / Height;
+        int endRow = (bottom > 0) ? (bottom - 1) / Height + 1 : 0;
+        *pFirst = (std::min)(firstRow * m_columns, count);
+        *pEnd = (std::max)(*pFirst, (std::min)(endRow * m_columns, count));
+    }
+};
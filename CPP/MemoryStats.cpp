@@ -0,0 +1,309 @@
+/*************************************************************************************************
+* Description: Implementation of memory accounting by subsystem.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "MemoryStats.h"
+
+// Names of the tags, in the order of the MemoryTag enumeration.
+static const char* const TagNames[MemoryTag_Count] =
+{
+    "other",
+    "items",
+    "names",
+    "indexes",
+    "enumerators",
+    "accessible strings",
+    "payloads",
+    "diagnostics",
+};
+
+// Gets the name of a tag, for reports.
+//
+const char* GetMemoryTagName(MemoryTag tag)
+{
+    return ((tag >= 0) && (tag < MemoryTag_Count)) ? TagNames[tag] : "unknown";
+}
+
+#ifdef ACCSERVER_STATS
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// Counters, one set per tag and one for all tags together. They are in static
+// storage, so they are zero before any constructor runs, and operator new can
+// use them from the start.
+struct MemoryCounters
+{
+    std::atomic<unsigned long long> LiveBytes;
+    std::atomic<unsigned long long> PeakBytes;
+    std::atomic<unsigned long long> TotalBytes;
+    std::atomic<unsigned long long> Allocations;
+    std::atomic<unsigned long long> LiveAllocations;
+};
+
+static MemoryCounters s_counters[MemoryTag_Count];
+static MemoryCounters s_allTags;
+
+// Tag for allocations on the current thread.
+static __declspec(thread) int t_tag = MemoryTag_Other;
+
+// Blocks allocated on the current thread, other than for diagnostics.
+static __declspec(thread) unsigned long long t_allocations = 0;
+
+// Calls that went over their budget. The first few are kept for the report.
+struct BudgetViolation
+{
+    const char* Site;
+    unsigned int Budget;
+    unsigned long long Used;
+};
+
+static const unsigned int KeptViolationCount = 8;
+static BudgetViolation s_keptViolations[KeptViolationCount];
+static std::atomic<unsigned long long> s_budgetViolations;
+
+// Bytes in front of each block from operator new: the size, then the tag.
+// Sixteen keeps the block aligned as malloc aligned it.
+static const size_t HeaderSize = 16;
+
+static void AddAllocation(MemoryCounters* pCounters, size_t bytes)
+{
+    unsigned long long live = pCounters->LiveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    pCounters->TotalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    pCounters->Allocations.fetch_add(1, std::memory_order_relaxed);
+    pCounters->LiveAllocations.fetch_add(1, std::memory_order_relaxed);
+    unsigned long long peak = pCounters->PeakBytes.load(std::memory_order_relaxed);
+    while ((live > peak) && !pCounters->PeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+static void RemoveAllocation(MemoryCounters* pCounters, size_t bytes)
+{
+    pCounters->LiveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    pCounters->LiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Sets the tag for allocations on this thread, and returns the one it replaces.
+//
+MemoryTag MemoryStats::SetThreadTag(MemoryTag tag)
+{
+    MemoryTag previous = static_cast<MemoryTag>(t_tag);
+    t_tag = tag;
+    return previous;
+}
+
+void MemoryStats::Allocate(MemoryTag tag, size_t bytes)
+{
+    if (tag != MemoryTag_Diagnostics)
+    {
+        t_allocations++;
+    }
+    AddAllocation(&s_counters[tag], bytes);
+    AddAllocation(&s_allTags, bytes);
+}
+
+void MemoryStats::Free(MemoryTag tag, size_t bytes)
+{
+    RemoveAllocation(&s_counters[tag], bytes);
+    RemoveAllocation(&s_allTags, bytes);
+}
+
+// Counts memory that is freed by someone else, such as a BSTR returned to a
+// client. It adds to the totals, but not to the live or peak bytes.
+//
+void MemoryStats::Handoff(MemoryTag tag, size_t bytes)
+{
+    t_allocations++;
+    s_counters[tag].TotalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    s_counters[tag].Allocations.fetch_add(1, std::memory_order_relaxed);
+    s_allTags.TotalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    s_allTags.Allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Copies the counters for each tag, followed by the totals for all tags, into
+// an array of MemoryTag_Count + 1 entries.
+//
+void MemoryStats::Collect(MemoryTagStats* pStats)
+{
+    for (int t = 0; t <= MemoryTag_Count; t++)
+    {
+        const MemoryCounters& counters = (t < MemoryTag_Count) ? s_counters[t] : s_allTags;
+        pStats[t].LiveBytes = counters.LiveBytes.load(std::memory_order_relaxed);
+        pStats[t].PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+        pStats[t].TotalBytes = counters.TotalBytes.load(std::memory_order_relaxed);
+        pStats[t].Allocations = counters.Allocations.load(std::memory_order_relaxed);
+        pStats[t].LiveAllocations = counters.LiveAllocations.load(std::memory_order_relaxed);
+    }
+}
+
+// Formats the counters as text, one line per tag.
+//
+std::string MemoryStats::FormatReport()
+{
+    MemoryTagStats stats[MemoryTag_Count + 1];
+    Collect(stats);
+    std::string report("AccServer memory by subsystem\n");
+    char line[160];
+    _snprintf_s(line, _countof(line), _TRUNCATE, "%-20s %14s %14s %16s %12s %12s\n",
+        "subsystem", "live bytes", "peak bytes", "total bytes", "allocations", "live blocks");
+    report += line;
+    for (int t = 0; t <= MemoryTag_Count; t++)
+    {
+        _snprintf_s(line, _countof(line), _TRUNCATE, "%-20s %14I64u %14I64u %16I64u %12I64u %12I64u\n",
+            (t < MemoryTag_Count) ? GetMemoryTagName(static_cast<MemoryTag>(t)) : "all",
+            stats[t].LiveBytes, stats[t].PeakBytes, stats[t].TotalBytes,
+            stats[t].Allocations, stats[t].LiveAllocations);
+        report += line;
+    }
+
+    unsigned long long violations = GetBudgetViolations();
+    if (violations > 0)
+    {
+        _snprintf_s(line, _countof(line), _TRUNCATE, "%I64u calls went over their allocation budget, including:\n",
+            violations);
+        report += line;
+        for (unsigned long long i = 0; (i < violations) && (i < KeptViolationCount); i++)
+        {
+            _snprintf_s(line, _countof(line), _TRUNCATE, "    %s: %I64u blocks, budget %u\n",
+                s_keptViolations[i].Site, s_keptViolations[i].Used, s_keptViolations[i].Budget);
+            report += line;
+        }
+    }
+    return report;
+}
+
+// Writes the counters to the debugger output window.
+//
+void MemoryStats::DumpToDebugger()
+{
+    OutputDebugStringA(FormatReport().c_str());
+}
+
+// Gets the number of blocks allocated on this thread, other than for
+// diagnostics, including strings handed off to clients.
+//
+unsigned long long MemoryStats::GetThreadAllocations()
+{
+    return t_allocations;
+}
+
+// Counts a call that allocated more blocks than its budget, and says so in
+// the debugger output.
+//
+void MemoryStats::ReportBudgetExceeded(const char* site, unsigned int budget, unsigned long long used)
+{
+    unsigned long long index = s_budgetViolations.fetch_add(1, std::memory_order_relaxed);
+    if (index < KeptViolationCount)
+    {
+        s_keptViolations[index].Site = site;
+        s_keptViolations[index].Budget = budget;
+        s_keptViolations[index].Used = used;
+    }
+    char line[160];
+    _snprintf_s(line, _countof(line), _TRUNCATE, "Allocation budget exceeded in %s: %I64u blocks, budget %u\n",
+        site, used, budget);
+    OutputDebugStringA(line);
+}
+
+unsigned long long MemoryStats::GetBudgetViolations()
+{
+    return s_budgetViolations.load(std::memory_order_relaxed);
+}
+
+// Allocates a block with a header that records its size and tag.
+//
+static void* TaggedAllocate(size_t size)
+{
+    if (size > static_cast<size_t>(-1) - HeaderSize)
+    {
+        return NULL;
+    }
+    unsigned char* pBlock = static_cast<unsigned char*>(malloc(size + HeaderSize));
+    if (pBlock == NULL)
+    {
+        return NULL;
+    }
+    MemoryTag tag = static_cast<MemoryTag>(t_tag);
+    *reinterpret_cast<size_t*>(pBlock) = size;
+    *reinterpret_cast<int*>(pBlock + sizeof(size_t)) = tag;
+    MemoryStats::Allocate(tag, size);
+    return pBlock + HeaderSize;
+}
+
+static void TaggedFree(void* p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+    unsigned char* pBlock = static_cast<unsigned char*>(p) - HeaderSize;
+    size_t size = *reinterpret_cast<size_t*>(pBlock);
+    MemoryTag tag = static_cast<MemoryTag>(*reinterpret_cast<int*>(pBlock + sizeof(size_t)));
+    MemoryStats::Free(tag, size);
+    free(pBlock);
+}
+
+void* operator new(size_t size)
+{
+    void* p = TaggedAllocate((size > 0) ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+    return TaggedAllocate((size > 0) ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+    return TaggedAllocate((size > 0) ? size : 1);
+}
+
+void operator delete(void* p) throw()
+{
+    TaggedFree(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    TaggedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+    TaggedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+    TaggedFree(p);
+}
+
+#endif // ACCSERVER_STATS
@@ -0,0 +1,149 @@
+/*************************************************************************************************
+* Description: Declarations for memory accounting by subsystem.
+*
+* In builds with ACCSERVER_STATS defined, operator new is replaced by one that puts the size
+* and a tag in front of each block, so that the block is counted against the subsystem that
+* allocated it, and taken off the same one when it is deleted, wherever that happens. The
+* tag is the one set by the innermost MEMSTATS_SCOPE on the allocating thread; blocks
+* allocated outside any scope are counted as "other".
+*
+* Memory that does not come from operator new is counted by hand: names copied with
+* _wcsdup, with MEMSTATS_ALLOC and MEMSTATS_FREE, and strings handed to clients, which free
+* them, with MEMSTATS_HANDOFF. Handed-off memory is counted as allocated but never as live.
+*
+* Each thread also counts the blocks it allocates, other than for diagnostics. A method that
+* should not allocate, or should allocate only the string it returns, declares that with
+* MEMSTATS_BUDGET, and any call that allocates more is reported to the debugger and counted.
+* Replaying a recording then checks every method that the recording calls.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+
+// Subsystems that memory is counted against.
+enum MemoryTag
+{
+    MemoryTag_Other,
+    MemoryTag_Items,            // List items and the container that holds them.
+    MemoryTag_Names,            // Item names.
+    MemoryTag_Indexes,          // ContactIndex and the search indexes in it.
+    MemoryTag_Enumerators,      // Accessible objects made by Clone and get_accSelection.
+    MemoryTag_AccStrings,       // BSTRs returned to clients.
+    MemoryTag_Payloads,         // Cached avatars and status messages.
+    MemoryTag_Diagnostics,      // Trace buffers. Not counted against budgets.
+    MemoryTag_Count
+};
+
+const char* GetMemoryTagName(MemoryTag tag);
+
+#ifdef ACCSERVER_STATS
+
+#include <string>
+
+// Counters for one tag.
+struct MemoryTagStats
+{
+    unsigned long long LiveBytes;
+    unsigned long long PeakBytes;
+    unsigned long long TotalBytes;          // Allocated since the start, including freed.
+    unsigned long long Allocations;
+    unsigned long long LiveAllocations;
+};
+
+namespace MemoryStats
+{
+    MemoryTag SetThreadTag(MemoryTag tag);
+    void Allocate(MemoryTag tag, size_t bytes);
+    void Free(MemoryTag tag, size_t bytes);
+    void Handoff(MemoryTag tag, size_t bytes);
+    void Collect(MemoryTagStats* pStats);
+    std::string FormatReport();
+    void DumpToDebugger();
+
+    unsigned long long GetThreadAllocations();
+    void ReportBudgetExceeded(const char* site, unsigned int budget, unsigned long long used);
+    unsigned long long GetBudgetViolations();
+}
+
+// Tags the allocations made on this thread until the end of the enclosing block.
+//
+class MemoryTagScope
+{
+private:
+    MemoryTag m_previous;
+
+    MemoryTagScope(const MemoryTagScope&);
+    MemoryTagScope& operator=(const MemoryTagScope&);
+
+public:
+    MemoryTagScope(MemoryTag tag) : m_previous(MemoryStats::SetThreadTag(tag))
+    {
+    }
+
+    ~MemoryTagScope()
+    {
+        MemoryStats::SetThreadTag(m_previous);
+    }
+};
+
+// Reports the enclosing block if it allocates more than the given number of
+// blocks on this thread.
+//
+class AllocationBudget
+{
+private:
+    const char* m_site;
+    unsigned int m_budget;
+    unsigned long long m_start;
+
+    AllocationBudget(const AllocationBudget&);
+    AllocationBudget& operator=(const AllocationBudget&);
+
+public:
+    AllocationBudget(const char* site, unsigned int budget) :
+        m_site(site), m_budget(budget), m_start(MemoryStats::GetThreadAllocations())
+    {
+    }
+
+    ~AllocationBudget()
+    {
+        unsigned long long used = MemoryStats::GetThreadAllocations() - m_start;
+        if (used > m_budget)
+        {
+            MemoryStats::ReportBudgetExceeded(m_site, m_budget, used);
+        }
+    }
+};
+
+#define MEMSTATS_SCOPE(tag)             MemoryTagScope memoryTagScope(tag)
+#define MEMSTATS_BUDGET(site, blocks)   AllocationBudget allocationBudget(site, blocks)
+#define MEMSTATS_ALLOC(tag, bytes)      MemoryStats::Allocate(tag, bytes)
+#define MEMSTATS_FREE(tag, bytes)       MemoryStats::Free(tag, bytes)
+#define MEMSTATS_HANDOFF(tag, bytes)    MemoryStats::Handoff(tag, bytes)
+#define MEMSTATS_DUMP()                 MemoryStats::DumpToDebugger()
+
+#else
+
+#define MEMSTATS_SCOPE(tag)
+#define MEMSTATS_BUDGET(site, blocks)
+#define MEMSTATS_ALLOC(tag, bytes)
+#define MEMSTATS_FREE(tag, bytes)
+#define MEMSTATS_HANDOFF(tag, bytes)
+#define MEMSTATS_DUMP()
+
+#endif // ACCSERVER_STATS
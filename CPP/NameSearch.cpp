@@ -0,0 +1,504 @@
+/*************************************************************************************************
+* Description: Implementation of substring search over contact names.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "NameSearch.h"
+#include "WorkExecutor.h"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string.h>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NAMESEARCH_AVX2
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NAMESEARCH_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Gets the position of the lowest set bit. mask must not be zero.
+//
+static unsigned int LowestSetBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// Names in each chunk of an approximate search, at least. Smaller lists are split
+// into fewer chunks, since handing a chunk to the pool costs more than searching
+// a few thousand names.
+static const size_t SlotsPerChunk = 16384;
+
+// How often, in names, an approximate search checks whether it has been cancelled.
+static const size_t CancelCheckInterval = 1024;
+
+NameSearch::NameSearch() : m_removedUnits(0)
+{
+}
+
+void NameSearch::Clear()
+{
+    m_text.clear();
+    m_starts.clear();
+    m_itemIds.clear();
+    m_slots.clear();
+    m_removedUnits = 0;
+}
+
+// Adds a name, which must already be folded. Replaces any name with the same ID.
+// Item IDs start at 1, since 0 marks a removed name, so a name with ID 0 is not
+// added.
+//
+void NameSearch::Add(unsigned int itemId, const wchar_t* foldedName)
+{
+    if (itemId == 0)
+    {
+        return;
+    }
+    Remove(itemId);
+    m_slots[itemId] = m_starts.size();
+    m_starts.push_back(static_cast<unsigned int>(m_text.size()));
+    m_itemIds.push_back(itemId);
+    for (const wchar_t* p = foldedName; (p != NULL) && (*p != L'\0'); p++)
+    {
+        m_text.push_back(static_cast<unsigned short>(*p));
+    }
+    m_text.push_back(0);
+}
+
+// Removes a name. Its space is reclaimed once removed names take up half the buffer.
+//
+void NameSearch::Remove(unsigned int itemId)
+{
+    std::unordered_map<unsigned int, size_t>::iterator it = m_slots.find(itemId);
+    if (it == m_slots.end())
+    {
+        return;
+    }
+    size_t slot = it->second;
+    size_t end = (slot + 1 < m_starts.size()) ? m_starts[slot + 1] : m_text.size();
+    m_removedUnits += end - m_starts[slot];
+    m_itemIds[slot] = 0;
+    m_slots.erase(it);
+
+    if (m_removedUnits * 2 > m_text.size())
+    {
+        Compact();
+    }
+}
+
+// Rebuilds the buffer without the removed names.
+//
+void NameSearch::Compact()
+{
+    std::vector<unsigned short> text;
+    std::vector<unsigned int> starts;
+    std::vector<unsigned int> itemIds;
+    text.reserve(m_text.size() - m_removedUnits);
+    starts.reserve(m_slots.size());
+    itemIds.reserve(m_slots.size());
+    for (size_t slot = 0; slot < m_starts.size(); slot++)
+    {
+        if (m_itemIds[slot] == 0)
+        {
+            continue;
+        }
+        size_t end = (slot + 1 < m_starts.size()) ? m_starts[slot + 1] : m_text.size();
+        m_slots[m_itemIds[slot]] = starts.size();
+        starts.push_back(static_cast<unsigned int>(text.size()));
+        itemIds.push_back(m_itemIds[slot]);
+        text.insert(text.end(), m_text.begin() + m_starts[slot], m_text.begin() + end);
+    }
+    m_text.swap(text);
+    m_starts.swap(starts);
+    m_itemIds.swap(itemIds);
+    m_removedUnits = 0;
+}
+
+// Gets the number of code units in the buffer, including separators and
+// removed names.
+//
+size_t NameSearch::GetTextSize() const
+{
+    return m_text.size();
+}
+
+// Gets the name that contains a position in the buffer.
+//
+size_t NameSearch::SlotFromOffset(size_t offset) const
+{
+    return (std::upper_bound(m_starts.begin(), m_starts.end(), static_cast<unsigned int>(offset))
+        - m_starts.begin()) - 1;
+}
+
+// Finds the names that contain a folded string. Each item is reported once,
+// in the order the names were added.
+//
+void NameSearch::Find(const wchar_t* foldedText, std::vector<unsigned int>* pItemIds) const
+{
+    pItemIds->clear();
+    std::vector<unsigned short> query;
+    for (const wchar_t* p = foldedText; (p != NULL) && (*p != L'\0'); p++)
+    {
+        query.push_back(static_cast<unsigned short>(*p));
+    }
+    if (query.empty())
+    {
+        for (size_t slot = 0; slot < m_itemIds.size(); slot++)
+        {
+            if (m_itemIds[slot] != 0)
+            {
+                pItemIds->push_back(m_itemIds[slot]);
+            }
+        }
+        return;
+    }
+    size_t length = query.size();
+    if (m_text.size() < length)
+    {
+        return;
+    }
+
+    // A match never spans two names, because names are separated by a zero
+    // and the query has none.
+    const unsigned short* text = &m_text[0];
+    const unsigned short* pattern = &query[0];
+    size_t positions = m_text.size() - length + 1;
+    size_t lastSlot = static_cast<size_t>(-1);
+    auto verify = [&](size_t position)
+    {
+        if (memcmp(text + position, pattern, length * sizeof(unsigned short)) != 0)
+        {
+            return;
+        }
+        size_t slot = SlotFromOffset(position);
+        if ((slot != lastSlot) && (m_itemIds[slot] != 0))
+        {
+            pItemIds->push_back(m_itemIds[slot]);
+        }
+        lastSlot = slot;
+    };
+
+    size_t position = 0;
+#if defined(NAMESEARCH_AVX2)
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(pattern[0]));
+    const __m256i last = _mm256_set1_epi16(static_cast<short>(pattern[length - 1]));
+    for (; position + 16 <= positions; position += 16)
+    {
+        __m256i firstBlock = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + position));
+        __m256i lastBlock = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + position + length - 1));
+        // Two mask bits per 16-bit lane.
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi16(firstBlock, first), _mm256_cmpeq_epi16(lastBlock, last))));
+        while (mask != 0)
+        {
+            unsigned int bit = LowestSetBit(mask);
+            verify(position + bit / 2);
+            mask &= ~(3u << bit);
+        }
+    }
+#elif defined(NAMESEARCH_SSE2)
+    const __m128i first = _mm_set1_epi16(static_cast<short>(pattern[0]));
+    const __m128i last = _mm_set1_epi16(static_cast<short>(pattern[length - 1]));
+    for (; position + 8 <= positions; position += 8)
+    {
+        __m128i firstBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + position));
+        __m128i lastBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + position + length - 1));
+        // Two mask bits per 16-bit lane.
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi16(firstBlock, first), _mm_cmpeq_epi16(lastBlock, last))));
+        while (mask != 0)
+        {
+            unsigned int bit = LowestSetBit(mask);
+            verify(position + bit / 2);
+            mask &= ~(3u << bit);
+        }
+    }
+#endif
+    for (; position < positions; position++)
+    {
+        if ((text[position] == pattern[0]) && (text[position + length - 1] == pattern[length - 1]))
+        {
+            verify(position);
+        }
+    }
+}
+
+// Searches some of the names for approximate matches, and returns the best of them
+// in ranked order.
+//
+void NameSearch::FindApproximateInSlots(const unsigned short* query, size_t length, int maxErrors,
+    size_t maxResults, size_t firstSlot, size_t lastSlot, const SearchCancellation* pCancel,
+    unsigned int generation, std::vector<ApproximateMatch>* pMatches) const
+{
+    pMatches->clear();
+
+    // Bit i of the mask for a character is set where query[i] is that character.
+    unsigned long long lowMasks[256] = {};
+    std::vector<std::pair<unsigned short, unsigned long long> > highMasks;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (query[i] < 256)
+        {
+            lowMasks[query[i]] |= 1ULL << i;
+        }
+        else
+        {
+            highMasks.push_back(std::make_pair(query[i], 1ULL << i));
+        }
+    }
+    const unsigned long long lastBit = 1ULL << (length - 1);
+
+    // The worst of the best matches so far is on top, keyed by errors and then by
+    // position, so that ties go to the names added first.
+    std::priority_queue<std::pair<int, size_t> > best;
+    int errorLimit = maxErrors;
+    for (size_t slot = firstSlot; slot < lastSlot; slot++)
+    {
+        if ((pCancel != NULL) && ((slot - firstSlot) % CancelCheckInterval == 0) && pCancel->IsCancelled(generation))
+        {
+            return;
+        }
+        if (m_itemIds[slot] == 0)
+        {
+            continue;
+        }
+
+        // Each bit of pv and mv is the vertical difference (+1 or -1) between
+        // adjacent cells in the current column of the edit distance matrix.
+        // Horizontal differences are not carried into the first row, since a
+        // match may start anywhere in the name.
+        unsigned long long pv = ~0ULL;
+        unsigned long long mv = 0;
+        int score = static_cast<int>(length);
+        int lowest = score;
+        for (const unsigned short* p = &m_text[m_starts[slot]]; *p != 0; p++)
+        {
+            unsigned long long eq = 0;
+            if (*p < 256)
+            {
+                eq = lowMasks[*p];
+            }
+            else
+            {
+                for (size_t i = 0; i < highMasks.size(); i++)
+                {
+                    if (highMasks[i].first == *p)
+                    {
+                        eq |= highMasks[i].second;
+                    }
+                }
+            }
+            unsigned long long xv = eq | mv;
+            unsigned long long xh = (((eq & pv) + pv) ^ pv) | eq;
+            unsigned long long ph = mv | ~(xh | pv);
+            unsigned long long mh = pv & xh;
+            if (ph & lastBit)
+            {
+                score++;
+            }
+            else if (mh & lastBit)
+            {
+                score--;
+            }
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            if (score < lowest)
+            {
+                lowest = score;
+                if (lowest == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (lowest <= errorLimit)
+        {
+            best.push(std::make_pair(lowest, slot));
+            if (best.size() > maxResults)
+            {
+                best.pop();
+            }
+            if (best.size() == maxResults)
+            {
+                // Later names must do better than the worst kept match.
+                errorLimit = best.top().first - 1;
+                if (errorLimit < 0)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    pMatches->resize(best.size());
+    for (size_t i = best.size(); i > 0; i--)
+    {
+        ApproximateMatch match = { m_itemIds[best.top().second], best.top().first };
+        (*pMatches)[i - 1] = match;
+        best.pop();
+    }
+}
+
+static bool CompareErrors(const ApproximateMatch& a, const ApproximateMatch& b)
+{
+    return a.Errors < b.Errors;
+}
+
+// Chunks of an approximate search, which the calling thread and the pool's
+// threads take in turn. The pool's work items share it, since some may start
+// only after the search has returned; they then find no chunk left.
+struct ApproximateChunks
+{
+    std::atomic<size_t> NextChunk;
+    size_t ChunkCount;
+    std::mutex Lock;
+    std::condition_variable Finished;
+    size_t Searching;                   // Pool threads searching a chunk.
+    std::vector<std::vector<ApproximateMatch> > Matches;
+};
+
+// Finds up to maxResults names that contain a folded string with at most
+// maxErrors edits, best matches first. Only the first MaxApproximateLength units
+// of the string are used. If pExecutor is given, its threads help with long
+// lists. Returns false, with no matches, if the search was cancelled through
+// pCancel.
+//
+bool NameSearch::FindApproximate(const wchar_t* foldedText, int maxErrors, size_t maxResults,
+    std::vector<ApproximateMatch>* pMatches, WorkExecutor* pExecutor, const SearchCancellation* pCancel,
+    unsigned int generation) const
+{
+    pMatches->clear();
+    std::vector<unsigned short> query;
+    for (const wchar_t* p = foldedText; (p != NULL) && (*p != L'\0') && (query.size() < MaxApproximateLength); p++)
+    {
+        query.push_back(static_cast<unsigned short>(*p));
+    }
+    if ((maxResults == 0) || (maxErrors < 0))
+    {
+        return true;
+    }
+    if (query.empty())
+    {
+        for (size_t slot = 0; (slot < m_itemIds.size()) && (pMatches->size() < maxResults); slot++)
+        {
+            if (m_itemIds[slot] != 0)
+            {
+                ApproximateMatch match = { m_itemIds[slot], 0 };
+                pMatches->push_back(match);
+            }
+        }
+        return true;
+    }
+    // Allowing as many errors as the query is long would match every name.
+    if (maxErrors >= static_cast<int>(query.size()))
+    {
+        maxErrors = static_cast<int>(query.size()) - 1;
+    }
+
+    // Each chunk is at least SlotsPerChunk names, and there are no more chunks
+    // than threads to search them.
+    size_t slotCount = m_starts.size();
+    size_t chunkCount = (pExecutor != NULL) ? pExecutor->GetThreadCount() + 1 : 1;
+    if (chunkCount > slotCount / SlotsPerChunk)
+    {
+        chunkCount = slotCount / SlotsPerChunk;
+    }
+    if (chunkCount == 0)
+    {
+        chunkCount = 1;
+    }
+    std::shared_ptr<ApproximateChunks> pChunks = std::make_shared<ApproximateChunks>();
+    pChunks->NextChunk = 0;
+    pChunks->ChunkCount = chunkCount;
+    pChunks->Searching = 0;
+    pChunks->Matches.resize(chunkCount);
+
+    // Takes chunks until there are none left.
+    const unsigned short* pattern = &query[0];
+    size_t length = query.size();
+    auto searchChunks = [=](ApproximateChunks* pShared)
+    {
+        for (size_t chunk = pShared->NextChunk++; chunk < pShared->ChunkCount; chunk = pShared->NextChunk++)
+        {
+            FindApproximateInSlots(pattern, length, maxErrors, maxResults, slotCount * chunk / chunkCount,
+                slotCount * (chunk + 1) / chunkCount, pCancel, generation, &pShared->Matches[chunk]);
+        }
+    };
+
+    // A pool thread counts itself as searching before it takes a chunk, so that
+    // once the calling thread has taken the last chunk, it need only wait for
+    // the pool threads already counted.
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        pExecutor->Submit(
+            [pChunks, searchChunks](const CancellationToken& /*token*/)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(pChunks->Lock);
+                    pChunks->Searching++;
+                }
+                searchChunks(pChunks.get());
+                std::lock_guard<std::mutex> lock(pChunks->Lock);
+                if (--pChunks->Searching == 0)
+                {
+                    pChunks->Finished.notify_all();
+                }
+            },
+            WorkExecutor::CompletionFunction(), CancellationToken(), WorkPriority_High);
+    }
+    searchChunks(pChunks.get());
+    {
+        std::unique_lock<std::mutex> lock(pChunks->Lock);
+        while (pChunks->Searching > 0)
+        {
+            pChunks->Finished.wait(lock);
+        }
+    }
+    if ((pCancel != NULL) && pCancel->IsCancelled(generation))
+    {
+        return false;
+    }
+
+    // Chunks are in name order, so a stable sort keeps ties in name order.
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        pMatches->insert(pMatches->end(), pChunks->Matches[chunk].begin(), pChunks->Matches[chunk].end());
+    }
+    std::stable_sort(pMatches->begin(), pMatches->end(), CompareErrors);
+    if (pMatches->size() > maxResults)
+    {
+        pMatches->resize(maxResults);
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+/*************************************************************************************************
+* Description: Declarations for substring search over contact names.
+*
+* The names are kept, already case-folded, in one contiguous buffer of UTF-16 code
+* units, each followed by a zero. A search scans the whole buffer for positions where
+* both the first and the last unit of the query match, several positions at a time
+* with SSE2 (or AVX2, when the compiler targets it), and then compares the rest of
+* the query only at those positions.
+*
+* An approximate search finds names that contain the query with up to a given number
+* of edits (insertions, deletions or substitutions), using the bit-parallel algorithm
+* of Myers as described by Hyyro. Each name costs one pass of a few word operations
+* per code unit, for queries of up to 64 units. The names are split into chunks, each
+* searched keeping its best matches in a bounded heap. Given a thread pool, the pool's
+* threads search chunks alongside the calling thread, which waits for them.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+class WorkExecutor;
+
+// Stops approximate searches that are no longer wanted. Each search is started
+// with the generation returned by Begin, and stops early once Begin or Cancel
+// has been called again, for example because the user typed another character.
+class SearchCancellation
+{
+private:
+    std::atomic<unsigned int> m_generation;
+
+public:
+    SearchCancellation() : m_generation(0)
+    {
+    }
+    unsigned int Begin()
+    {
+        return ++m_generation;
+    }
+    void Cancel()
+    {
+        ++m_generation;
+    }
+    bool IsCancelled(unsigned int generation) const
+    {
+        return m_generation.load(std::memory_order_relaxed) != generation;
+    }
+};
+
+// A name found by an approximate search.
+struct ApproximateMatch
+{
+    unsigned int ItemId;
+    int Errors;                     // Edits needed for the query to appear in the name.
+};
+
+class NameSearch
+{
+private:
+    std::vector<unsigned short> m_text;     // Folded names, each followed by a zero.
+    std::vector<unsigned int> m_starts;     // Offset of each name in m_text.
+    std::vector<unsigned int> m_itemIds;    // Item ID of each name, or 0 if removed.
+    std::unordered_map<unsigned int, size_t> m_slots;   // Item ID to index in m_starts.
+    size_t m_removedUnits;                  // Units in m_text that belong to removed names.
+
+    void Compact();
+    size_t SlotFromOffset(size_t offset) const;
+    void FindApproximateInSlots(const unsigned short* query, size_t length, int maxErrors, size_t maxResults,
+        size_t firstSlot, size_t lastSlot, const SearchCancellation* pCancel, unsigned int generation,
+        std::vector<ApproximateMatch>* pMatches) const;
+
+public:
+    static const size_t MaxApproximateLength = 64;
+
+    NameSearch();
+
+    void Clear();
+    void Add(unsigned int itemId, const wchar_t* foldedName);
+    void Remove(unsigned int itemId);
+    size_t GetTextSize() const;
+    void Find(const wchar_t* foldedText, std::vector<unsigned int>* pItemIds) const;
+    bool FindApproximate(const wchar_t* foldedText, int maxErrors, size_t maxResults,
+        std::vector<ApproximateMatch>* pMatches, WorkExecutor* pExecutor = NULL,
+        const SearchCancellation* pCancel = NULL, unsigned int generation = 0) const;
+};
@@ -0,0 +1,579 @@
+/*************************************************************************************************
+* Description: Implementation of contact payloads and the cache that holds them.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "PayloadCache.h"
+#include "MemoryStats.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// Encoded payload:
+//
+//   char Magic[4]                      "CPAY"
+//   unsigned short Width, Height       Of the avatar; zero if there is none.
+//   unsigned int MessageLength         In UTF-16 code units.
+//   unsigned short Message[MessageLength]
+//   Runs until Width * Height pixels:
+//     unsigned char Count              1 to 255.
+//     unsigned int Pixel               Straight-alpha 0xAARRGGBB.
+//
+// Numbers are little-endian.
+//
+static const unsigned char PayloadMagic[4] = { 'C', 'P', 'A', 'Y' };
+static const size_t PayloadHeaderSize = 12;
+static const size_t PayloadRunSize = 5;
+
+// Bytes that each cached payload costs beyond its own, for the list and index
+// nodes.
+static const size_t EntryOverhead = 64;
+
+// Smallest share of the capacity for a shard, so that a small cache does not
+// evict the payloads of the items being painted.
+static const size_t MinShardCapacity = 64 * 1024;
+
+static void WriteUInt16(unsigned char* p, unsigned int value)
+{
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+static void WriteUInt32(unsigned char* p, unsigned int value)
+{
+    WriteUInt16(p, value & 0xFFFF);
+    WriteUInt16(p + 2, value >> 16);
+}
+
+static unsigned int ReadUInt16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int ReadUInt32(const unsigned char* p)
+{
+    return ReadUInt16(p) | (ReadUInt16(p + 2) << 16);
+}
+
+// Gets the number of pixels, up to 255, in the run that starts at a pixel.
+//
+static size_t GetRunLength(const unsigned int* pPixels, size_t start, size_t pixelCount)
+{
+    size_t count = 1;
+    while ((start + count < pixelCount) && (count < 255) && (pPixels[start + count] == pPixels[start]))
+    {
+        count++;
+    }
+    return count;
+}
+
+// Multiplies a color channel by alpha, rounding, without dividing.
+//
+static unsigned int Premultiply(unsigned int channel, unsigned int alpha)
+{
+    unsigned int product = channel * alpha + 128;
+    return (product + (product >> 8)) >> 8;
+}
+
+// ContactPayload struct.
+//
+// Gets the memory that the payload holds, for the cache's capacity.
+//
+size_t ContactPayload::GetSize() const
+{
+    return sizeof(ContactPayload) + StatusMessage.capacity() * sizeof(wchar_t)
+        + AvatarPixels.capacity() * sizeof(unsigned int);
+}
+
+
+// PayloadCodec namespace.
+//
+void PayloadCodec::Encode(const std::wstring& statusMessage, int width, int height, const unsigned int* pPixels,
+    std::vector<unsigned char>* pData)
+{
+    // The runs are counted first, so that the data is sized once and written
+    // in place.
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    size_t runCount = 0;
+    for (size_t i = 0; i < pixelCount; i += GetRunLength(pPixels, i, pixelCount))
+    {
+        runCount++;
+    }
+    pData->assign(PayloadHeaderSize + statusMessage.size() * 2 + runCount * PayloadRunSize, 0);
+
+    unsigned char* p = &(*pData)[0];
+    memcpy(p, PayloadMagic, sizeof(PayloadMagic));
+    WriteUInt16(p + 4, width);
+    WriteUInt16(p + 6, height);
+    WriteUInt32(p + 8, static_cast<unsigned int>(statusMessage.size()));
+    p += PayloadHeaderSize;
+    for (size_t i = 0; i < statusMessage.size(); i++, p += 2)
+    {
+        WriteUInt16(p, statusMessage[i] & 0xFFFF);
+    }
+    for (size_t i = 0; i < pixelCount; p += PayloadRunSize)
+    {
+        size_t count = GetRunLength(pPixels, i, pixelCount);
+        p[0] = static_cast<unsigned char>(count);
+        WriteUInt32(p + 1, pPixels[i]);
+        i += count;
+    }
+}
+
+// Decodes a payload, premultiplying the avatar. Returns false if the data is
+// not a payload, is cut short or has an avatar larger than MaxAvatarSize.
+//
+bool PayloadCodec::Decode(const unsigned char* pData, size_t size, ContactPayload* pPayload)
+{
+    if ((size < PayloadHeaderSize) || (memcmp(pData, PayloadMagic, sizeof(PayloadMagic)) != 0))
+    {
+        return false;
+    }
+    int width = ReadUInt16(pData + 4);
+    int height = ReadUInt16(pData + 6);
+    size_t messageLength = ReadUInt32(pData + 8);
+    if ((width > MaxAvatarSize) || (height > MaxAvatarSize) || ((width == 0) != (height == 0))
+        || (messageLength > (size - PayloadHeaderSize) / 2))
+    {
+        return false;
+    }
+    const unsigned char* p = pData + PayloadHeaderSize;
+    const unsigned char* pEnd = pData + size;
+    pPayload->StatusMessage.resize(messageLength);
+    for (size_t i = 0; i < messageLength; i++, p += 2)
+    {
+        pPayload->StatusMessage[i] = static_cast<wchar_t>(ReadUInt16(p));
+    }
+
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    pPayload->AvatarWidth = width;
+    pPayload->AvatarHeight = height;
+    pPayload->AvatarPixels.resize(pixelCount);
+    unsigned int* pPixel = pixelCount ? &pPayload->AvatarPixels[0] : NULL;
+    for (size_t i = 0; i < pixelCount;)
+    {
+        if (static_cast<size_t>(pEnd - p) < PayloadRunSize)
+        {
+            return false;
+        }
+        size_t count = p[0];
+        unsigned int pixel = ReadUInt32(p + 1);
+        p += PayloadRunSize;
+        if ((count == 0) || (count > pixelCount - i))
+        {
+            return false;
+        }
+        unsigned int alpha = pixel >> 24;
+        unsigned int premultiplied = (alpha << 24) | (Premultiply((pixel >> 16) & 0xFF, alpha) << 16)
+            | (Premultiply((pixel >> 8) & 0xFF, alpha) << 8) | Premultiply(pixel & 0xFF, alpha);
+        for (size_t n = 0; n < count; n++)
+        {
+            pPixel[i + n] = premultiplied;
+        }
+        i += count;
+    }
+    return true;
+}
+
+// Scales a decoded avatar to size pixels on each side. Each pixel is the
+// average of those it covers, which is right for premultiplied pixels; an
+// avatar smaller than size has its pixels repeated.
+//
+void PayloadCodec::ScaleAvatar(ContactPayload* pPayload, int size)
+{
+    int width = pPayload->AvatarWidth;
+    int height = pPayload->AvatarHeight;
+    if ((width == 0) || (size <= 0) || ((width == size) && (height == size)))
+    {
+        return;
+    }
+    std::vector<unsigned int> pixels(static_cast<size_t>(size) * size);
+    for (int y = 0; y < size; y++)
+    {
+        int top = y * height / size;
+        int bottom = (std::max)((y + 1) * height / size, top + 1);
+        for (int x = 0; x < size; x++)
+        {
+            int left = x * width / size;
+            int right = (std::max)((x + 1) * width / size, left + 1);
+            unsigned int sums[4] = { 0, 0, 0, 0 };
+            for (int sourceY = top; sourceY < bottom; sourceY++)
+            {
+                const unsigned int* pSource = &pPayload->AvatarPixels[static_cast<size_t>(sourceY) * width];
+                for (int sourceX = left; sourceX < right; sourceX++)
+                {
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        sums[channel] += (pSource[sourceX] >> (channel * 8)) & 0xFF;
+                    }
+                }
+            }
+            unsigned int count = static_cast<unsigned int>((bottom - top) * (right - left));
+            unsigned int pixel = 0;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                pixel |= ((sums[channel] + count / 2) / count) << (channel * 8);
+            }
+            pixels[static_cast<size_t>(y) * size + x] = pixel;
+        }
+    }
+    pPayload->AvatarWidth = size;
+    pPayload->AvatarHeight = size;
+    pPayload->AvatarPixels.swap(pixels);
+}
+
+
+// FilePayloadStore class.
+//
+FilePayloadStore::FilePayloadStore(const char* directory) :
+    m_directory(directory)
+{
+}
+
+std::string FilePayloadStore::GetPath(unsigned int id) const
+{
+    static const char Digits[] = "0123456789abcdef";
+    std::string path(m_directory);
+    if (!path.empty() && (path[path.size() - 1] != '/') && (path[path.size() - 1] != '\\'))
+    {
+        path += '/';
+    }
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+        path += Digits[(id >> shift) & 0xF];
+    }
+    path += ".payload";
+    return path;
+}
+
+static FILE* OpenFile(const std::string& path, const char* mode)
+{
+    FILE* pFile = NULL;
+#ifdef _WIN32
+    if (fopen_s(&pFile, path.c_str(), mode) != 0)
+    {
+        pFile = NULL;
+    }
+#else
+    pFile = fopen(path.c_str(), mode);
+#endif
+    return pFile;
+}
+
+bool FilePayloadStore::Read(unsigned int id, std::vector<unsigned char>* pData)
+{
+    FILE* pFile = OpenFile(GetPath(id), "rb");
+    if (pFile == NULL)
+    {
+        return false;
+    }
+    pData->clear();
+    unsigned char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+    {
+        pData->insert(pData->end(), buffer, buffer + read);
+    }
+    bool failed = (ferror(pFile) != 0);
+    fclose(pFile);
+    return !failed;
+}
+
+// Saves an encoded payload, for tools that fill the store.
+//
+bool FilePayloadStore::Write(unsigned int id, const std::vector<unsigned char>& data)
+{
+    FILE* pFile = OpenFile(GetPath(id), "wb");
+    if (pFile == NULL)
+    {
+        return false;
+    }
+    bool written = data.empty() || (fwrite(&data[0], 1, data.size(), pFile) == data.size());
+    return (fclose(pFile) == 0) && written;
+}
+
+
+// SyntheticPayloadStore class.
+//
+SyntheticPayloadStore::SyntheticPayloadStore(int avatarSize) :
+    m_avatarSize(avatarSize)
+{
+}
+
+// Makes an avatar of a disc in a color that depends on the ID, with a soft
+// edge, on a transparent background, and one of a few status messages.
+//
+bool SyntheticPayloadStore::Read(unsigned int id, std::vector<unsigned char>* pData)
+{
+    static const wchar_t* const Messages[] =
+    {
+        L"",
+        L"In a meeting",
+        L"Working from home today",
+        L"Back on Monday",
+    };
+    unsigned int hash = id * 2654435761u;
+    unsigned int color = (hash >> 8) & 0xFFFFFF;
+    int size = m_avatarSize;
+    std::vector<unsigned int> pixels(static_cast<size_t>(size) * size);
+    int radius = size / 2;
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            int dx = 2 * x + 1 - size;
+            int dy = 2 * y + 1 - size;
+            int distance = dx * dx + dy * dy;
+            int edge = 4 * radius * radius;
+            unsigned int alpha = (distance <= edge - 4 * radius) ? 255 : ((distance <= edge) ? 128 : 0);
+            pixels[y * size + x] = alpha ? ((alpha << 24) | color) : 0;
+        }
+    }
+    std::wstring message(Messages[hash >> 30]);
+    PayloadCodec::Encode(message, size, size, pixels.empty() ? NULL : &pixels[0], pData);
+    return true;
+}
+
+
+// PayloadCache class.
+//
+// Creates a cache that loads payloads from a store, which it then owns.
+//
+PayloadCache::PayloadCache(PayloadStore* pStore) :
+    m_pStore(pStore), m_shardCapacity(0), m_thumbnailSize(0), m_bytes(0), m_peakBytes(0), m_hits(0), m_misses(0), m_loads(0),
+    m_loadFailures(0), m_decodedPixels(0), m_evictions(0)
+{
+}
+
+// Creates the shards. Returns false if memory runs out.
+//
+bool PayloadCache::Initialize(const PayloadCacheOptions& options)
+{
+    size_t shardCount = 1;
+    while (shardCount < options.ShardCount)
+    {
+        shardCount *= 2;
+    }
+    m_shardCapacity = (std::max)(options.CapacityBytes / shardCount, MinShardCapacity);
+    m_thumbnailSize = (std::min)(options.ThumbnailSize, MaxAvatarSize);
+    for (size_t i = 0; i < shardCount; i++)
+    {
+        Shard* pShard = new (std::nothrow) Shard();
+        if (pShard == NULL)
+        {
+            return false;
+        }
+        pShard->Bytes = 0;
+        m_shards.push_back(pShard);
+    }
+    return true;
+}
+
+PayloadCache::~PayloadCache()
+{
+    Clear();
+    for (size_t i = 0; i < m_shards.size(); i++)
+    {
+        delete m_shards[i];
+    }
+}
+
+void PayloadCache::GetDefaultOptions(PayloadCacheOptions* pOptions)
+{
+    pOptions->CapacityBytes = 4 * 1024 * 1024;
+    pOptions->ShardCount = 16;
+    pOptions->ThumbnailSize = 0;
+}
+
+// Gets the shard for an ID. The IDs are hashed, as consecutive IDs are usually
+// shown together.
+//
+PayloadCache::Shard& PayloadCache::GetShard(unsigned int id)
+{
+    unsigned int hash = id * 2654435761u;
+    return *m_shards[(hash >> 16) & (m_shards.size() - 1)];
+}
+
+// Gets a payload and marks it as the most recently used, or returns NULL if it
+// is not cached. Does not allocate, so it may be called while painting.
+//
+ContactPayloadPtr PayloadCache::Find(unsigned int id)
+{
+    Shard& shard = GetShard(id);
+    std::lock_guard<std::mutex> lock(shard.Lock);
+    std::unordered_map<unsigned int, std::list<Entry>::iterator>::iterator found = shard.Index.find(id);
+    if (found == shard.Index.end())
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return ContactPayloadPtr();
+    }
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    shard.Entries.splice(shard.Entries.begin(), shard.Entries, found->second);
+    return found->second->Payload;
+}
+
+// Starts loading a payload that Find did not find, unless it is already being
+// loaded. loaded is called when it is in the cache. Returns false if no load
+// was started.
+//
+bool PayloadCache::Request(unsigned int id, WorkExecutor& executor, const LoadedFunction& loaded)
+{
+    {
+        Shard& shard = GetShard(id);
+        std::lock_guard<std::mutex> lock(shard.Lock);
+        if ((shard.Index.find(id) != shard.Index.end()) || !shard.Pending.insert(id).second)
+        {
+            return false;
+        }
+    }
+    std::shared_ptr<PendingLoad> pPending(new (std::nothrow) PendingLoad());
+    if (pPending == NULL)
+    {
+        Shard& shard = GetShard(id);
+        std::lock_guard<std::mutex> lock(shard.Lock);
+        shard.Pending.erase(id);
+        return false;
+    }
+    pPending->Cache = shared_from_this();
+    pPending->Id = id;
+    executor.Submit(
+        [pPending](const CancellationToken&)
+        {
+            pPending->Cache->Load(pPending->Id);
+        },
+        [pPending, loaded](bool cancelled)
+        {
+            if (!cancelled)
+            {
+                loaded(pPending->Id);
+            }
+        },
+        CancellationToken(), WorkPriority_High);
+    return true;
+}
+
+PayloadCache::PendingLoad::~PendingLoad()
+{
+    Shard& shard = Cache->GetShard(Id);
+    std::lock_guard<std::mutex> lock(shard.Lock);
+    shard.Pending.erase(Id);
+}
+
+// Reads and decodes a payload, scales its avatar to the thumbnail size if there
+// is one, and adds it to the cache. Called on a worker.
+//
+void PayloadCache::Load(unsigned int id)
+{
+    MEMSTATS_SCOPE(MemoryTag_Payloads);
+    std::vector<unsigned char> data;
+    std::shared_ptr<ContactPayload> pPayload(new (std::nothrow) ContactPayload());
+    if (pPayload == NULL)
+    {
+        return;
+    }
+    pPayload->AvatarWidth = 0;
+    pPayload->AvatarHeight = 0;
+    if (!m_pStore->Read(id, &data) || data.empty() || !PayloadCodec::Decode(&data[0], data.size(), pPayload.get()))
+    {
+        // Cache an empty payload, so that the store is not read again.
+        pPayload->StatusMessage.clear();
+        pPayload->AvatarWidth = 0;
+        pPayload->AvatarHeight = 0;
+        std::vector<unsigned int>().swap(pPayload->AvatarPixels);
+        m_loadFailures.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_decodedPixels.fetch_add(pPayload->AvatarPixels.size(), std::memory_order_relaxed);
+        PayloadCodec::ScaleAvatar(pPayload.get(), m_thumbnailSize);
+    }
+    m_loads.fetch_add(1, std::memory_order_relaxed);
+    Insert(id, pPayload);
+}
+
+// Adds a payload as the most recently used in its shard, then evicts the least
+// recently used until the shard is within its capacity. The payload just added
+// is kept even if it alone is larger.
+//
+void PayloadCache::Insert(unsigned int id, const ContactPayloadPtr& pPayload)
+{
+    Entry entry = { id, pPayload, pPayload->GetSize() + EntryOverhead };
+    std::vector<ContactPayloadPtr> evicted;
+    Shard& shard = GetShard(id);
+    {
+        std::lock_guard<std::mutex> lock(shard.Lock);
+        if (shard.Index.find(id) != shard.Index.end())
+        {
+            return;
+        }
+        shard.Entries.push_front(entry);
+        shard.Index[id] = shard.Entries.begin();
+        shard.Bytes += entry.Size;
+        m_bytes.fetch_add(entry.Size, std::memory_order_relaxed);
+        while ((shard.Bytes > m_shardCapacity) && (shard.Entries.size() > 1))
+        {
+            // Payloads are freed after the lock is released; a view may still
+            // hold one.
+            Entry& last = shard.Entries.back();
+            evicted.push_back(last.Payload);
+            shard.Bytes -= last.Size;
+            m_bytes.fetch_sub(last.Size, std::memory_order_relaxed);
+            shard.Index.erase(last.Id);
+            shard.Entries.pop_back();
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    size_t bytes = m_bytes.load(std::memory_order_relaxed);
+    size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+    while ((bytes > peak) && !m_peakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+// Empties the cache. Loads that are running still add their payloads.
+//
+void PayloadCache::Clear()
+{
+    for (size_t i = 0; i < m_shards.size(); i++)
+    {
+        std::list<Entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_shards[i]->Lock);
+            entries.swap(m_shards[i]->Entries);
+            m_shards[i]->Index.clear();
+            m_bytes.fetch_sub(m_shards[i]->Bytes, std::memory_order_relaxed);
+            m_shards[i]->Bytes = 0;
+        }
+    }
+}
+
+void PayloadCache::GetStats(PayloadCacheStats* pStats)
+{
+    pStats->Hits = m_hits.load(std::memory_order_relaxed);
+    pStats->Misses = m_misses.load(std::memory_order_relaxed);
+    pStats->Loads = m_loads.load(std::memory_order_relaxed);
+    pStats->LoadFailures = m_loadFailures.load(std::memory_order_relaxed);
+    pStats->DecodedPixels = m_decodedPixels.load(std::memory_order_relaxed);
+    pStats->Evictions = m_evictions.load(std::memory_order_relaxed);
+    pStats->Bytes = m_bytes.load(std::memory_order_relaxed);
+    pStats->PeakBytes = m_peakBytes.load(std::memory_order_relaxed);
+    pStats->Entries = 0;
+    for (size_t i = 0; i < m_shards.size(); i++)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i]->Lock);
+        pStats->Entries += m_shards[i]->Entries.size();
+    }
+}
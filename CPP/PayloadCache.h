@@ -0,0 +1,199 @@
+/*************************************************************************************************
+* Description: Declarations for contact payloads, such as avatars and status messages, and the
+* cache that holds the ones in use.
+*
+* Payloads are too large to keep for every contact, so they are read from a store when a view
+* needs them and kept in a cache of bounded size. The contact ID is the payload's handle. The
+* cache is split into shards, each with its own lock, its own share of the capacity and its
+* own least-recently-used list, so lookups from the UI thread rarely wait for a load that is
+* being added on a worker. A miss starts a load on a WorkExecutor, which reads the payload and
+* decodes the avatar to premultiplied pixels off the UI thread; until it finishes, views paint
+* a placeholder. A payload that is missing or cannot be decoded is cached as an empty one, so
+* it is not read again. Views that draw avatars at one size have the cache scale them to it on
+* the worker, so that painting copies pixels without stretching them, and the cache holds no
+* more pixels than are drawn.
+*
+* Avatars are stored run-length encoded, with straight alpha, and decoded to premultiplied
+* 0xAARRGGBB pixels, top row first, which is what AlphaBlend expects of a 32-bit DIB.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "WorkExecutor.h"
+
+// Largest avatar that is decoded, in pixels on each side.
+const int MaxAvatarSize = 256;
+
+struct ContactPayload
+{
+    std::wstring StatusMessage;
+    int AvatarWidth;                        // Zero if the contact has no avatar.
+    int AvatarHeight;
+    std::vector<unsigned int> AvatarPixels; // Premultiplied 0xAARRGGBB, top row first.
+
+    size_t GetSize() const;
+};
+
+typedef std::shared_ptr<const ContactPayload> ContactPayloadPtr;
+
+// Encoding of payloads in a store.
+//
+namespace PayloadCodec
+{
+    // pPixels are straight-alpha 0xAARRGGBB, top row first.
+    void Encode(const std::wstring& statusMessage, int width, int height, const unsigned int* pPixels,
+        std::vector<unsigned char>* pData);
+    bool Decode(const unsigned char* pData, size_t size, ContactPayload* pPayload);
+    void ScaleAvatar(ContactPayload* pPayload, int size);
+}
+
+// Source of encoded payloads. Read is called on worker threads, possibly
+// several at once.
+//
+class PayloadStore
+{
+public:
+    virtual ~PayloadStore() {}
+    virtual bool Read(unsigned int id, std::vector<unsigned char>* pData) = 0;
+};
+
+// Store with a file for each contact in a directory, named by the contact ID
+// in hexadecimal with the extension .payload.
+//
+class FilePayloadStore : public PayloadStore
+{
+private:
+    std::string m_directory;
+
+    std::string GetPath(unsigned int id) const;
+
+public:
+    FilePayloadStore(const char* directory);
+    virtual bool Read(unsigned int id, std::vector<unsigned char>* pData);
+    bool Write(unsigned int id, const std::vector<unsigned char>& data);
+};
+
+// Store that makes up a payload for any ID, for measuring the cache without
+// files.
+//
+class SyntheticPayloadStore : public PayloadStore
+{
+private:
+    int m_avatarSize;
+
+public:
+    SyntheticPayloadStore(int avatarSize);
+    virtual bool Read(unsigned int id, std::vector<unsigned char>* pData);
+};
+
+struct PayloadCacheOptions
+{
+    size_t CapacityBytes;       // For all the shards together.
+    size_t ShardCount;          // Rounded up to a power of two.
+    int ThumbnailSize;          // Avatars are scaled to this square as they are loaded, or kept
+                                // at their stored size if zero.
+};
+
+struct PayloadCacheStats
+{
+    unsigned long long Hits;
+    unsigned long long Misses;
+    unsigned long long Loads;           // Payloads read and decoded.
+    unsigned long long LoadFailures;    // Missing or corrupt; cached as empty.
+    unsigned long long DecodedPixels;
+    unsigned long long Evictions;
+    size_t Entries;
+    size_t Bytes;
+    size_t PeakBytes;
+};
+
+// Sharded LRU cache of payloads. Find and Request are called on the UI thread;
+// loads run on the executor's workers.
+//
+class PayloadCache : public std::enable_shared_from_this<PayloadCache>
+{
+public:
+    // Called on the thread that runs the executor's completions.
+    typedef std::function<void(unsigned int id)> LoadedFunction;
+
+private:
+    struct Entry
+    {
+        unsigned int Id;
+        ContactPayloadPtr Payload;
+        size_t Size;
+    };
+
+    struct Shard
+    {
+        std::mutex Lock;
+        std::list<Entry> Entries;       // Most recently used first.
+        std::unordered_map<unsigned int, std::list<Entry>::iterator> Index;
+        std::unordered_set<unsigned int> Pending;
+        size_t Bytes;
+    };
+
+    // Clears the pending mark of a load when its work is deleted, whether it
+    // ran or was discarded, so that a later miss can load it again.
+    struct PendingLoad
+    {
+        std::shared_ptr<PayloadCache> Cache;
+        unsigned int Id;
+
+        ~PendingLoad();
+    };
+
+    std::unique_ptr<PayloadStore> m_pStore;
+    std::vector<Shard*> m_shards;
+    size_t m_shardCapacity;
+    int m_thumbnailSize;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_peakBytes;
+    std::atomic<unsigned long long> m_hits;
+    std::atomic<unsigned long long> m_misses;
+    std::atomic<unsigned long long> m_loads;
+    std::atomic<unsigned long long> m_loadFailures;
+    std::atomic<unsigned long long> m_decodedPixels;
+    std::atomic<unsigned long long> m_evictions;
+
+    PayloadCache(const PayloadCache&);
+    PayloadCache& operator=(const PayloadCache&);
+
+    Shard& GetShard(unsigned int id);
+    void Insert(unsigned int id, const ContactPayloadPtr& pPayload);
+
+public:
+    PayloadCache(PayloadStore* pStore);
+    ~PayloadCache();
+    bool Initialize(const PayloadCacheOptions& options);
+    static void GetDefaultOptions(PayloadCacheOptions* pOptions);
+
+    ContactPayloadPtr Find(unsigned int id);
+    bool Request(unsigned int id, WorkExecutor& executor, const LoadedFunction& loaded);
+    void Load(unsigned int id);
+    void Clear();
+    void GetStats(PayloadCacheStats* pStats);
+};
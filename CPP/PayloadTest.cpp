@@ -0,0 +1,210 @@
+/*************************************************************************************************
+* Description: Implementation of the payload test.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "PayloadTest.h"
+#include "MemoryStats.h"
+#include <stdio.h>
+#include <new>
+#include <vector>
+
+// Distinct payloads that the decode phase cycles through.
+static const ULONG DecodeSampleCount = 256;
+
+static const ULONGLONG FrameNanoseconds = 1000000000ULL / 60;
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG PayloadClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Gets the next value from a xorshift generator. The state must not be zero.
+//
+static ULONG NextRandom(ULONG* pState)
+{
+    ULONG x = *pState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *pState = x;
+    return x;
+}
+
+void PayloadTest::GetDefaultOptions(PayloadTestOptions* pOptions)
+{
+    PayloadCacheOptions cacheOptions;
+    PayloadCache::GetDefaultOptions(&cacheOptions);
+    pOptions->Contacts = 500000;
+    pOptions->CapacityKB = static_cast<ULONG>(cacheOptions.CapacityBytes / 1024);
+    pOptions->Seconds = 5;
+    pOptions->Threads = 0;
+    pOptions->VisibleRows = 40;
+    pOptions->AvatarSize = 32;
+}
+
+// Decodes payloads on this thread for a second.
+//
+static void MeasureDecode(ULONG avatarSize, PayloadTestReport* pReport)
+{
+    SyntheticPayloadStore store(static_cast<int>(avatarSize));
+    std::vector<std::vector<unsigned char> > samples(DecodeSampleCount);
+    for (ULONG i = 0; i < DecodeSampleCount; i++)
+    {
+        store.Read(i + 1, &samples[i]);
+    }
+    ContactPayload payload;
+    ULONGLONG start = PayloadClock();
+    ULONGLONG now = start;
+    while (now - start < 1000000000ULL)
+    {
+        for (ULONG i = 0; i < DecodeSampleCount; i++)
+        {
+            if (PayloadCodec::Decode(&samples[i][0], samples[i].size(), &payload))
+            {
+                pReport->DecodedPayloads++;
+                pReport->DecodedPixels += payload.AvatarPixels.size();
+            }
+        }
+        now = PayloadClock();
+    }
+    pReport->DecodeNanoseconds = now - start;
+}
+
+// Runs the test. Returns false if the cache cannot be created.
+//
+bool PayloadTest::Run(const PayloadTestOptions& options, PayloadTestReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(PayloadTestReport));
+    pReport->Options = options;
+    ULONG avatarSize = (options.AvatarSize < MaxAvatarSize) ? options.AvatarSize : MaxAvatarSize;
+    ULONG rows = (options.VisibleRows < options.Contacts) ? options.VisibleRows : options.Contacts;
+    MeasureDecode(avatarSize, pReport);
+
+    PayloadCacheOptions cacheOptions;
+    PayloadCache::GetDefaultOptions(&cacheOptions);
+    cacheOptions.CapacityBytes = static_cast<size_t>(options.CapacityKB) * 1024;
+    SyntheticPayloadStore* pStore = new (std::nothrow) SyntheticPayloadStore(static_cast<int>(avatarSize));
+    PayloadCache* pCache = (pStore != NULL) ? new (std::nothrow) PayloadCache(pStore) : NULL;
+    if (pCache == NULL)
+    {
+        delete pStore;
+        return false;
+    }
+    std::shared_ptr<PayloadCache> pPayloads(pCache);
+    WorkExecutor executor;
+    if (!pPayloads->Initialize(cacheOptions) || !executor.Start(options.Threads, NULL, NULL))
+    {
+        return false;
+    }
+
+    // Scroll mostly a row or two a frame, sometimes a page, sometimes back, and
+    // now and then jump, as a user looking for someone would.
+    ULONG random = 2463534242UL;
+    ULONG top = 0;
+    ULONG lastTop = options.Contacts - rows;
+    bool down = true;
+    PayloadCache::LoadedFunction loaded = [](unsigned int) {};
+    ULONGLONG start = PayloadClock();
+    ULONGLONG end = start + options.Seconds * 1000000000ULL;
+    ULONGLONG nextFrame = start;
+    ULONGLONG now = start;
+    while (now < end)
+    {
+        ULONG choice = NextRandom(&random) % 100;
+        ULONG step = (choice < 85) ? NextRandom(&random) % 3 : ((choice < 97) ? rows : 0);
+        if (choice >= 97)
+        {
+            top = NextRandom(&random) % (lastTop + 1);
+        }
+        else if ((choice < 5) || (down ? (top + step > lastTop) : (top < step)))
+        {
+            down = !down;
+        }
+        else
+        {
+            top = down ? top + step : top - step;
+        }
+
+        bool placeholder = false;
+        for (ULONG r = 0; r < rows; r++)
+        {
+            unsigned int id = top + r + 1;
+            if (pPayloads->Find(id) == NULL)
+            {
+                pPayloads->Request(id, executor, loaded);
+                placeholder = true;
+            }
+        }
+        pReport->Frames++;
+        pReport->PlaceholderFrames += placeholder ? 1 : 0;
+        executor.RunCompletions();
+
+        nextFrame += FrameNanoseconds;
+        while ((now = PayloadClock()) < nextFrame)
+        {
+            Sleep(static_cast<DWORD>((nextFrame - now) / 1000000));
+        }
+    }
+    pReport->ScrollNanoseconds = now - start;
+
+    // The loads refer to the cache, so they finish first.
+    executor.Stop();
+    pPayloads->GetStats(&pReport->Cache);
+    return true;
+}
+
+bool PayloadTest::WriteReport(const PayloadTestReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    const PayloadTestOptions& options = report.Options;
+    double decodeSeconds = (report.DecodeNanoseconds > 0) ? report.DecodeNanoseconds / 1e9 : 1.0;
+    double scrollSeconds = (report.ScrollNanoseconds > 0) ? report.ScrollNanoseconds / 1e9 : 1.0;
+    const PayloadCacheStats& cache = report.Cache;
+    ULONGLONG lookups = cache.Hits + cache.Misses;
+    fprintf(pFile, "decode: %I64u payloads of %lu x %lu pixels in %.2f s; %.0f payloads/s, %.1f Mpixels/s\n",
+        report.DecodedPayloads, options.AvatarSize, options.AvatarSize, decodeSeconds,
+        report.DecodedPayloads / decodeSeconds, report.DecodedPixels / decodeSeconds / 1e6);
+    fprintf(pFile, "scroll: %lu contacts, %lu rows; %I64u frames in %.1f s, %.1f%% with placeholders\n",
+        options.Contacts, options.VisibleRows, report.Frames, scrollSeconds,
+        (report.Frames > 0) ? 100.0 * report.PlaceholderFrames / report.Frames : 0.0);
+    fprintf(pFile, "cache: %I64u lookups, %.1f%% hits; %I64u loads (%I64u failed), %.0f/s; %I64u evictions\n",
+        lookups, (lookups > 0) ? 100.0 * cache.Hits / lookups : 0.0, cache.Loads, cache.LoadFailures,
+        cache.Loads / scrollSeconds, cache.Evictions);
+    fprintf(pFile, "memory: %Iu payloads in %Iu KB, peak %Iu KB, capacity %lu KB\n",
+        cache.Entries, cache.Bytes / 1024, cache.PeakBytes / 1024, options.CapacityKB);
+#ifdef ACCSERVER_STATS
+    fputs(MemoryStats::FormatReport().c_str(), pFile);
+#endif
+    fclose(pFile);
+    return true;
+}
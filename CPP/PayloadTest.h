@@ -0,0 +1,55 @@
+/*************************************************************************************************
+* Description: Declarations for the payload test, which measures the payload cache without a
+* window.
+*
+* The test first decodes payloads on one thread for a second, to give the decode throughput.
+* It then scrolls a simulated view through a large roster at sixty frames a second, looking
+* up the payloads of the visible rows in a cache that loads misses on a thread pool from a
+* synthetic store. The report gives the hit rate, the share of frames that painted a
+* placeholder, the load rate, and the memory the cache used against its capacity.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+#include "PayloadCache.h"
+
+struct PayloadTestOptions
+{
+    ULONG Contacts;
+    ULONG CapacityKB;
+    ULONG Seconds;          // Of scrolling.
+    ULONG Threads;          // That load payloads, or zero for one fewer than the processors.
+    ULONG VisibleRows;
+    ULONG AvatarSize;       // In pixels on each side.
+};
+
+struct PayloadTestReport
+{
+    PayloadTestOptions Options;
+    ULONGLONG DecodeNanoseconds;
+    ULONGLONG DecodedPayloads;
+    ULONGLONG DecodedPixels;
+    ULONGLONG ScrollNanoseconds;
+    ULONGLONG Frames;
+    ULONGLONG PlaceholderFrames;    // Frames in which a visible payload was missing.
+    PayloadCacheStats Cache;
+};
+
+namespace PayloadTest
+{
+    void GetDefaultOptions(PayloadTestOptions* pOptions);
+    bool Run(const PayloadTestOptions& options, PayloadTestReport* pReport);
+    bool WriteReport(const PayloadTestReport& report, const WCHAR* reportPath);
+}
@@ -0,0 +1,835 @@
+/*************************************************************************************************
+* Description: Implementation of recording and replaying the calls that clients make on the
+* accessible object.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "QueryRecorder.h"
+#include "AccServer.h"
+#include "MemoryStats.h"
+#include <string>
+#include <vector>
+
+// File layout: the signature, a version byte, then records until QueryRecord_End.
+// Each record is a type byte followed by zigzag-encoded variable-length integers.
+// A call record always has three integers; unused arguments are zero, which
+// encodes as one byte. Version 2 added the records that change the view, and
+// version 3 those that move, rename and sort items; older recordings have none,
+// and are replayed as before. Version 4 follows a FindChildren call with the
+// name it looked for, and records the whole sequence number of a GetChanges
+// call as its low and high halves; older recordings have status-only queries
+// and sequence numbers cut to 32 bits.
+static const char TraceSignature[4] = { 'A', 'Q', 'T', 'R' };
+static const unsigned char TraceVersion = 4;
+
+// Value recorded in place of lVal when a VARIANT is not VT_I4.
+static const LONG NotAChildId = 0x7fffffff;
+
+// Recorder state. Calls arrive on the UI thread, so no locking is needed.
+static FILE* s_pRecordFile = NULL;
+static CustomListControl* s_pRecordedControl = NULL;
+static bool s_paused = false;
+
+// Writes an unsigned integer, seven bits per byte, low bits first.
+//
+static void WriteUnsigned(FILE* pFile, ULONG value)
+{
+    while (value >= 0x80)
+    {
+        fputc(static_cast<int>((value & 0x7f) | 0x80), pFile);
+        value >>= 7;
+    }
+    fputc(static_cast<int>(value), pFile);
+}
+
+// Writes a signed integer so that small negative values are also short.
+//
+static void WriteSigned(FILE* pFile, LONG value)
+{
+    WriteUnsigned(pFile, (static_cast<ULONG>(value) << 1) ^ static_cast<ULONG>(value >> 31));
+}
+
+// Writes a name as its length and then its UTF-16 code units.
+//
+static void WriteName(FILE* pFile, const WCHAR* name)
+{
+    size_t length = (name != NULL) ? wcslen(name) : 0;
+    WriteUnsigned(pFile, static_cast<ULONG>(length));
+    for (size_t i = 0; i < length; i++)
+    {
+        WriteUnsigned(pFile, static_cast<ULONG>(name[i]));
+    }
+}
+
+// Opens a file for recording. Nothing is written until a control is attached.
+//
+bool QueryRecorder::Open(const WCHAR* path)
+{
+    Close();
+    if ((_wfopen_s(&s_pRecordFile, path, L"wb") != 0) || (s_pRecordFile == NULL))
+    {
+        s_pRecordFile = NULL;
+        return false;
+    }
+    fwrite(TraceSignature, 1, sizeof(TraceSignature), s_pRecordFile);
+    fputc(TraceVersion, s_pRecordFile);
+    return true;
+}
+
+// Ends the recording and closes the file.
+//
+void QueryRecorder::Close()
+{
+    if (s_pRecordFile != NULL)
+    {
+        fputc(QueryRecord_End, s_pRecordFile);
+        fclose(s_pRecordFile);
+        s_pRecordFile = NULL;
+    }
+    s_pRecordedControl = NULL;
+}
+
+// Whether calls on a control are being recorded. Other lists may share the
+// recorded control's contacts, but only its own calls and changes are recorded.
+//
+bool QueryRecorder::IsRecording(const CustomListControl* pControl)
+{
+    return (s_pRecordedControl != NULL) && (pControl == s_pRecordedControl) && !s_paused;
+}
+
+// Stops recording for the length of a change whose records are written once
+// it is known to have succeeded.
+//
+void QueryRecorder::SetPaused(bool paused)
+{
+    s_paused = paused;
+}
+
+// Starts recording a control: writes a snapshot of its items and selection.
+// Only one control is recorded; later calls are ignored.
+//
+void QueryRecorder::AttachControl(CustomListControl* pControl)
+{
+    if ((s_pRecordFile == NULL) || (s_pRecordedControl != NULL))
+    {
+        return;
+    }
+    s_pRecordedControl = pControl;
+    for (int i = 0; i < pControl->GetCount(); i++)
+    {
+        CustomListControlItem* pItem = *pControl->GetItemAt(i);
+        RecordAddItem(pControl, pItem->GetStatus(), pItem->GetName());
+    }
+    RecordSelection(pControl, pControl->GetSelection(), pControl->GetSelectedIndex());
+}
+
+// Ends the recording when the recorded control is destroyed, so that a control
+// created later at the same address is not taken for it.
+//
+void QueryRecorder::DetachControl(const CustomListControl* pControl)
+{
+    if ((pControl != NULL) && (pControl == s_pRecordedControl))
+    {
+        Close();
+    }
+}
+
+void QueryRecorder::RecordCall(const CustomListControl* pControl, AccMethod method, LONG arg1, LONG arg2, LONG arg3)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(method, s_pRecordFile);
+    WriteSigned(s_pRecordFile, arg1);
+    WriteSigned(s_pRecordFile, arg2);
+    WriteSigned(s_pRecordFile, arg3);
+}
+
+// Records a call that takes a child VARIANT, plus one optional argument.
+//
+void QueryRecorder::RecordChildCall(const CustomListControl* pControl, AccMethod method, const VARIANT& varChild, LONG arg)
+{
+    RecordCall(pControl, method, (varChild.vt == VT_I4) ? varChild.lVal : NotAChildId, varChild.vt, arg);
+}
+
+// Records a hit test relative to the control's window, so that it can be
+// replayed wherever the replay window happens to be.
+//
+void QueryRecorder::RecordHitTest(const CustomListControl* pControl, HWND hwnd, long xLeft, long yTop)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    RECT windowRect;
+    GetWindowRect(hwnd, &windowRect);
+    RecordCall(pControl, AccMethod_accHitTest, xLeft - windowRect.left, yTop - windowRect.top);
+}
+
+void QueryRecorder::RecordAddItem(const CustomListControl* pControl, ContactStatus status, const WCHAR* name)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_AddItem, s_pRecordFile);
+    WriteUnsigned(s_pRecordFile, static_cast<ULONG>(status));
+    WriteName(s_pRecordFile, name);
+}
+
+void QueryRecorder::RecordRemoveSelected(const CustomListControl* pControl)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_RemoveSelected, s_pRecordFile);
+}
+
+// Records the whole selection. Replaying the record restores the state, so it
+// does not matter whether the change came from a client or from the user.
+//
+void QueryRecorder::RecordSelection(const CustomListControl* pControl, const SelectionRangeSet& selection, int focusIndex)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_Selection, s_pRecordFile);
+    WriteSigned(s_pRecordFile, focusIndex);
+    WriteUnsigned(s_pRecordFile, static_cast<ULONG>(selection.GetRangeCount()));
+    for (int i = 0; i < selection.GetRangeCount(); i++)
+    {
+        const SelectionRangeSet::Range& range = selection.GetRange(i);
+        WriteUnsigned(s_pRecordFile, static_cast<ULONG>(range.First));
+        WriteUnsigned(s_pRecordFile, static_cast<ULONG>(range.Last - range.First));
+    }
+}
+
+// Records a switch between the grouped view and the flat list.
+//
+void QueryRecorder::RecordGrouped(const CustomListControl* pControl, bool grouped)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_Grouped, s_pRecordFile);
+    WriteSigned(s_pRecordFile, grouped ? 1 : 0);
+}
+
+void QueryRecorder::RecordGroupExpanded(const CustomListControl* pControl, int group, bool expanded)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_GroupExpanded, s_pRecordFile);
+    WriteSigned(s_pRecordFile, group);
+    WriteSigned(s_pRecordFile, expanded ? 1 : 0);
+}
+
+// Records a roster applied with SyncRoster. The IDs are recorded as they are:
+// the recording starts with the list empty, so the replay's model hands out
+// the same IDs to the items it adds.
+//
+void QueryRecorder::RecordSyncRoster(const CustomListControl* pControl, const std::vector<RosterEntry>& roster)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_SyncRoster, s_pRecordFile);
+    WriteUnsigned(s_pRecordFile, static_cast<ULONG>(roster.size()));
+    for (size_t i = 0; i < roster.size(); i++)
+    {
+        WriteUnsigned(s_pRecordFile, roster[i].Id);
+        WriteUnsigned(s_pRecordFile, static_cast<ULONG>(roster[i].Status));
+        WriteName(s_pRecordFile, roster[i].Name);
+    }
+}
+
+void QueryRecorder::RecordItemStatus(const CustomListControl* pControl, int index, ContactStatus status)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_ItemStatus, s_pRecordFile);
+    WriteSigned(s_pRecordFile, index);
+    WriteUnsigned(s_pRecordFile, static_cast<ULONG>(status));
+}
+
+// Records a switch between the tile view and the list. The replay window has
+// its own width, so it may show a different number of columns.
+//
+void QueryRecorder::RecordTiled(const CustomListControl* pControl, bool tiled)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_Tiled, s_pRecordFile);
+    WriteSigned(s_pRecordFile, tiled ? 1 : 0);
+}
+
+void QueryRecorder::RecordMoveItem(const CustomListControl* pControl, int index, int newIndex)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_MoveItem, s_pRecordFile);
+    WriteSigned(s_pRecordFile, index);
+    WriteSigned(s_pRecordFile, newIndex);
+}
+
+void QueryRecorder::RecordItemName(const CustomListControl* pControl, int index, const WCHAR* name)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_ItemName, s_pRecordFile);
+    WriteSigned(s_pRecordFile, index);
+    WriteName(s_pRecordFile, name);
+}
+
+// Records a query with the name it looked for, which a call record has no room
+// for, so that the replay makes the same query.
+//
+void QueryRecorder::RecordFindChildren(const CustomListControl* pControl, const WCHAR* name, LONG match, LONG status)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    RecordCall(pControl, AccMethod_FindChildren, match, status);
+    WriteName(s_pRecordFile, name);
+}
+
+// Records a sort when it is committed. The replay sorts the list it has at that
+// point, which is the list that was sorted.
+//
+void QueryRecorder::RecordSortByName(const CustomListControl* pControl)
+{
+    if (!IsRecording(pControl))
+    {
+        return;
+    }
+    fputc(QueryRecord_SortByName, s_pRecordFile);
+}
+
+
+// Replay.
+//
+
+// A contact in a recorded roster.
+struct ReplayRosterEntry
+{
+    unsigned int Id;
+    ContactStatus Status;
+    std::wstring Name;
+};
+
+// A decoded record.
+struct ReplayRecord
+{
+    int Type;                   // AccMethod or QueryRecordType.
+    LONG Args[3];
+    std::wstring Name;          // For QueryRecord_AddItem, QueryRecord_ItemName and FindChildren.
+    bool HasName;               // FindChildren was recorded with its name.
+    std::vector<SelectionRangeSet::Range> Ranges; // For QueryRecord_Selection.
+    std::vector<ReplayRosterEntry> Roster;  // For QueryRecord_SyncRoster.
+};
+
+// Reads an unsigned integer written by WriteUnsigned.
+//
+static bool ReadUnsigned(FILE* pFile, ULONG* pValue)
+{
+    ULONG value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        int c = fgetc(pFile);
+        if (c == EOF)
+        {
+            return false;
+        }
+        value |= static_cast<ULONG>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+        {
+            *pValue = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ReadSigned(FILE* pFile, LONG* pValue)
+{
+    ULONG value;
+    if (!ReadUnsigned(pFile, &value))
+    {
+        return false;
+    }
+    *pValue = static_cast<LONG>(value >> 1) ^ -static_cast<LONG>(value & 1);
+    return true;
+}
+
+// Reads a name written by WriteName.
+//
+static bool ReadName(FILE* pFile, std::wstring* pName)
+{
+    ULONG length = 0;
+    bool valid = ReadUnsigned(pFile, &length);
+    for (ULONG i = 0; valid && (i < length); i++)
+    {
+        ULONG value = 0;
+        valid = ReadUnsigned(pFile, &value);
+        pName->push_back(static_cast<WCHAR>(value));
+    }
+    return valid;
+}
+
+// Reads the whole recording into memory, so that file access is not timed.
+//
+static bool LoadRecords(const WCHAR* path, std::vector<ReplayRecord>* pRecords)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, path, L"rb") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    char signature[sizeof(TraceSignature)];
+    bool valid = (fread(signature, 1, sizeof(signature), pFile) == sizeof(signature))
+        && (memcmp(signature, TraceSignature, sizeof(signature)) == 0);
+    int version = valid ? fgetc(pFile) : EOF;
+    valid = valid && (version >= 1) && (version <= TraceVersion);
+
+    while (valid)
+    {
+        int type = fgetc(pFile);
+        if ((type == EOF) || (type == QueryRecord_End))
+        {
+            // A recording that was not closed cleanly is still usable.
+            break;
+        }
+        ReplayRecord record;
+        record.Type = type;
+        record.Args[0] = record.Args[1] = record.Args[2] = 0;
+        record.HasName = false;
+        ULONG value = 0;
+        if (type < AccMethod_Count)
+        {
+            valid = ReadSigned(pFile, &record.Args[0]) && ReadSigned(pFile, &record.Args[1])
+                && ReadSigned(pFile, &record.Args[2]);
+            if (valid && (type == AccMethod_FindChildren) && (version >= 4))
+            {
+                valid = ReadName(pFile, &record.Name);
+                record.HasName = true;
+            }
+            if ((type == AccMethod_GetChanges) && (version < 4))
+            {
+                // Only the low half was recorded, as a signed value.
+                record.Args[1] = (record.Args[0] < 0) ? -1 : 0;
+            }
+        }
+        else if (type == QueryRecord_AddItem)
+        {
+            valid = ReadUnsigned(pFile, &value) && ReadName(pFile, &record.Name);
+            record.Args[0] = static_cast<LONG>(value);
+        }
+        else if (type == QueryRecord_Selection)
+        {
+            ULONG rangeCount = 0;
+            valid = ReadSigned(pFile, &record.Args[0]) && ReadUnsigned(pFile, &rangeCount);
+            for (ULONG i = 0; valid && (i < rangeCount); i++)
+            {
+                ULONG first = 0;
+                ULONG length = 0;
+                valid = ReadUnsigned(pFile, &first) && ReadUnsigned(pFile, &length);
+                SelectionRangeSet::Range range = { static_cast<int>(first), static_cast<int>(first + length) };
+                record.Ranges.push_back(range);
+            }
+        }
+        else if ((type == QueryRecord_Grouped) || (type == QueryRecord_Tiled))
+        {
+            valid = ReadSigned(pFile, &record.Args[0]);
+        }
+        else if ((type == QueryRecord_GroupExpanded) || (type == QueryRecord_MoveItem))
+        {
+            valid = ReadSigned(pFile, &record.Args[0]) && ReadSigned(pFile, &record.Args[1]);
+        }
+        else if (type == QueryRecord_SyncRoster)
+        {
+            ULONG entryCount = 0;
+            valid = ReadUnsigned(pFile, &entryCount) && (entryCount <= static_cast<ULONG>(CustomListControl::MaxItems));
+            for (ULONG i = 0; valid && (i < entryCount); i++)
+            {
+                ReplayRosterEntry entry;
+                ULONG id = 0;
+                valid = ReadUnsigned(pFile, &id) && ReadUnsigned(pFile, &value) && ReadName(pFile, &entry.Name);
+                entry.Id = id;
+                entry.Status = static_cast<ContactStatus>(value);
+                record.Roster.push_back(entry);
+            }
+        }
+        else if (type == QueryRecord_ItemStatus)
+        {
+            valid = ReadSigned(pFile, &record.Args[0]) && ReadUnsigned(pFile, &value);
+            record.Args[1] = static_cast<LONG>(value);
+        }
+        else if (type == QueryRecord_ItemName)
+        {
+            valid = ReadSigned(pFile, &record.Args[0]) && ReadName(pFile, &record.Name);
+        }
+        else if ((type != QueryRecord_RemoveSelected) && (type != QueryRecord_SortByName))
+        {
+            valid = false;
+        }
+        if (valid)
+        {
+            pRecords->push_back(record);
+        }
+    }
+    fclose(pFile);
+    return valid;
+}
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG ReplayClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Reissues one recorded call and frees whatever it returned.
+// pSelectionEnum is the enumerator from the latest get_accSelection, if any.
+//
+static HRESULT ReplayCall(AccServer* pAcc, HWND hwnd, const ReplayRecord& record,
+                          IEnumVARIANT** ppSelectionEnum)
+{
+    VARIANT varChild;
+    varChild.vt = static_cast<VARTYPE>(record.Args[1]);
+    varChild.lVal = record.Args[0];
+    BSTR text = NULL;
+    VARIANT result;
+    VariantInit(&result);
+    HRESULT hr = S_OK;
+
+    switch (record.Type)
+    {
+    case AccMethod_get_accParent:
+    case AccMethod_get_accChild:
+        {
+            IDispatch* pDispatch = NULL;
+            hr = (record.Type == AccMethod_get_accParent)
+                ? pAcc->get_accParent(&pDispatch) : pAcc->get_accChild(varChild, &pDispatch);
+            if (pDispatch != NULL)
+            {
+                pDispatch->Release();
+            }
+            break;
+        }
+    case AccMethod_get_accChildCount:
+        {
+            long count;
+            hr = pAcc->get_accChildCount(&count);
+            break;
+        }
+    case AccMethod_get_accName:             hr = pAcc->get_accName(varChild, &text); break;
+    case AccMethod_get_accValue:            hr = pAcc->get_accValue(varChild, &text); break;
+    case AccMethod_get_accDescription:      hr = pAcc->get_accDescription(varChild, &text); break;
+    case AccMethod_get_accHelp:             hr = pAcc->get_accHelp(varChild, &text); break;
+    case AccMethod_get_accKeyboardShortcut: hr = pAcc->get_accKeyboardShortcut(varChild, &text); break;
+    case AccMethod_get_accDefaultAction:    hr = pAcc->get_accDefaultAction(varChild, &text); break;
+    case AccMethod_get_accRole:             hr = pAcc->get_accRole(varChild, &result); break;
+    case AccMethod_get_accState:            hr = pAcc->get_accState(varChild, &result); break;
+    case AccMethod_get_accFocus:            hr = pAcc->get_accFocus(&result); break;
+    case AccMethod_get_accHelpTopic:
+        {
+            long topic;
+            hr = pAcc->get_accHelpTopic(&text, varChild, &topic);
+            break;
+        }
+    case AccMethod_get_accSelection:
+        hr = pAcc->get_accSelection(&result);
+        if (result.vt == VT_UNKNOWN)
+        {
+            if (*ppSelectionEnum != NULL)
+            {
+                (*ppSelectionEnum)->Release();
+                *ppSelectionEnum = NULL;
+            }
+            result.punkVal->QueryInterface(IID_IEnumVARIANT, reinterpret_cast<void**>(ppSelectionEnum));
+        }
+        break;
+    case AccMethod_accSelect:               hr = pAcc->accSelect(record.Args[2], varChild); break;
+    case AccMethod_accLocation:
+        {
+            long x, y, width, height;
+            hr = pAcc->accLocation(&x, &y, &width, &height, varChild);
+            break;
+        }
+    case AccMethod_accNavigate:             hr = pAcc->accNavigate(record.Args[2], varChild, &result); break;
+    case AccMethod_accHitTest:
+        {
+            RECT windowRect;
+            GetWindowRect(hwnd, &windowRect);
+            hr = pAcc->accHitTest(windowRect.left + record.Args[0], windowRect.top + record.Args[1], &result);
+            break;
+        }
+    case AccMethod_accDoDefaultAction:      hr = pAcc->accDoDefaultAction(varChild); break;
+    case AccMethod_put_accName:             hr = pAcc->put_accName(varChild, NULL); break;
+    case AccMethod_put_accValue:            hr = pAcc->put_accValue(varChild, NULL); break;
+    case AccMethod_Next:
+    case AccMethod_SelectionNext:
+        {
+            IEnumVARIANT* pEnum = (record.Type == AccMethod_Next) ? pAcc : *ppSelectionEnum;
+            ULONG requested = static_cast<ULONG>(record.Args[0]);
+            if ((pEnum == NULL) || (requested > 4096))
+            {
+                hr = E_INVALIDARG;
+                break;
+            }
+            std::vector<VARIANT> items(requested > 0 ? requested : 1);
+            ULONG fetched = 0;
+            hr = pEnum->Next(requested, &items[0], &fetched);
+            for (ULONG i = 0; i < fetched; i++)
+            {
+                VariantClear(&items[i]);
+            }
+            break;
+        }
+    case AccMethod_Skip:
+        hr = pAcc->Skip(static_cast<ULONG>(record.Args[0]));
+        break;
+    case AccMethod_SelectionSkip:
+        hr = (*ppSelectionEnum != NULL) ? (*ppSelectionEnum)->Skip(static_cast<ULONG>(record.Args[0])) : E_INVALIDARG;
+        break;
+    case AccMethod_Reset:
+        hr = pAcc->Reset();
+        break;
+    case AccMethod_SelectionReset:
+        hr = (*ppSelectionEnum != NULL) ? (*ppSelectionEnum)->Reset() : E_INVALIDARG;
+        break;
+    case AccMethod_GetChildRecords:
+        {
+            long count;
+            hr = pAcc->GetChildRecords(record.Args[0], record.Args[1], &count, &text);
+            break;
+        }
+    case AccMethod_GetSnapshot:
+        {
+            LONGLONG sequence;
+            hr = pAcc->GetSnapshot(&sequence, &text);
+            break;
+        }
+    case AccMethod_GetChanges:
+        {
+            LONGLONG sequence;
+            LONGLONG since = static_cast<LONGLONG>(
+                (static_cast<ULONGLONG>(static_cast<ULONG>(record.Args[1])) << 32) | static_cast<ULONG>(record.Args[0]));
+            hr = pAcc->GetChanges(since, &sequence, &text);
+            break;
+        }
+    case AccMethod_FindChildren:
+        if (record.HasName)
+        {
+            BSTR name = SysAllocStringLen(record.Name.c_str(), static_cast<UINT>(record.Name.size()));
+            hr = (name != NULL) ? pAcc->FindChildren(name, record.Args[0], record.Args[1], &result) : E_OUTOFMEMORY;
+            SysFreeString(name);
+        }
+        else
+        {
+            // Older recordings have no names, so the query is replayed as a
+            // status-only one.
+            hr = pAcc->FindChildren(NULL, Match_AnyName, record.Args[1], &result);
+        }
+        break;
+    case AccMethod_Clone:
+    case AccMethod_SelectionClone:
+        {
+            // Calls on clones are recorded as calls on the original.
+            IEnumVARIANT* pEnum = (record.Type == AccMethod_Clone) ? pAcc : *ppSelectionEnum;
+            IEnumVARIANT* pClone = NULL;
+            hr = (pEnum != NULL) ? pEnum->Clone(&pClone) : E_INVALIDARG;
+            if (pClone != NULL)
+            {
+                pClone->Release();
+            }
+            break;
+        }
+    }
+
+    SysFreeString(text);
+    VariantClear(&result);
+    return hr;
+}
+
+// Replays a recording against a hidden list control. Returns false if the
+// recording cannot be read.
+//
+bool QueryReplay::Replay(const WCHAR* tracePath, HINSTANCE hInstance, ReplayReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(ReplayReport));
+    std::vector<ReplayRecord> records;
+    if (!LoadRecords(tracePath, &records))
+    {
+        return false;
+    }
+
+    // The window is never shown, but it gives the control and the standard
+    // accessible object a real HWND to work with.
+    HWND hwnd = CreateWindowEx(0, TEXT("CONTACTLIST"), TEXT("Replay"), WS_POPUP,
+        0, 0, 200, 200, NULL, NULL, hInstance, NULL);
+    CustomListControl* pControl = (hwnd != NULL) ? GetControl(hwnd) : NULL;
+    if (pControl == NULL)
+    {
+        return false;
+    }
+    AccServer* pAcc = new (std::nothrow) AccServer(hwnd, pControl);
+    if (pAcc == NULL)
+    {
+        DestroyWindow(hwnd);
+        return false;
+    }
+    // The control releases this reference when it is destroyed.
+    pControl->SetAccServer(pAcc);
+
+    IEnumVARIANT* pSelectionEnum = NULL;
+    ULONGLONG replayStart = ReplayClock();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ReplayRecord& record = records[i];
+        switch (record.Type)
+        {
+        case QueryRecord_AddItem:
+            {
+                std::wstring name(record.Name);
+                pControl->AddItem(static_cast<ContactStatus>(record.Args[0]), &name[0]);
+                break;
+            }
+        case QueryRecord_RemoveSelected:
+            pControl->RemoveSelected();
+            break;
+        case QueryRecord_Selection:
+            pControl->SetSelection(record.Ranges, record.Args[0]);
+            break;
+        case QueryRecord_Grouped:
+            pControl->SetGrouped(record.Args[0] != 0);
+            break;
+        case QueryRecord_GroupExpanded:
+            pControl->SetGroupExpanded(record.Args[0], record.Args[1] != 0);
+            break;
+        case QueryRecord_SyncRoster:
+            {
+                // SyncRoster takes names that it can write to, so copy them.
+                std::vector<std::wstring> names(record.Roster.size());
+                std::vector<RosterEntry> roster(record.Roster.size());
+                for (size_t j = 0; j < roster.size(); j++)
+                {
+                    names[j] = record.Roster[j].Name;
+                    names[j].push_back(L'\0');
+                    roster[j].Id = record.Roster[j].Id;
+                    roster[j].Status = record.Roster[j].Status;
+                    roster[j].Name = &names[j][0];
+                }
+                pControl->SyncRoster(roster);
+                break;
+            }
+        case QueryRecord_ItemStatus:
+            pControl->SetItemStatus(record.Args[0], static_cast<ContactStatus>(record.Args[1]));
+            break;
+        case QueryRecord_Tiled:
+            pControl->SetTiled(record.Args[0] != 0);
+            break;
+        case QueryRecord_MoveItem:
+            pControl->MoveItem(record.Args[0], record.Args[1]);
+            break;
+        case QueryRecord_ItemName:
+            {
+                std::wstring name(record.Name);
+                pControl->SetItemName(record.Args[0], &name[0]);
+                break;
+            }
+        case QueryRecord_SortByName:
+            pControl->SortItemsByName();
+            pControl->FinishJobs();
+            break;
+        default:
+            {
+                ULONGLONG callStart = ReplayClock();
+                HRESULT hr = ReplayCall(pAcc, hwnd, record, &pSelectionEnum);
+                ULONGLONG elapsed = ReplayClock() - callStart;
+                pReport->TotalCalls++;
+                pReport->Calls[record.Type]++;
+                pReport->Nanoseconds[record.Type] += elapsed;
+                if (FAILED(hr))
+                {
+                    pReport->Failures[record.Type]++;
+                }
+                break;
+            }
+        }
+    }
+    pReport->TotalNanoseconds = ReplayClock() - replayStart;
+
+    if (pSelectionEnum != NULL)
+    {
+        pSelectionEnum->Release();
+    }
+    DestroyWindow(hwnd);
+    return true;
+}
+
+// Writes the replay results as text.
+//
+bool QueryReplay::WriteReport(const ReplayReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    fprintf(pFile, "Replayed %lu calls in %I64u ns\n", report.TotalCalls, report.TotalNanoseconds);
+    fprintf(pFile, "%-28s %10s %14s %10s %8s\n", "method", "calls", "total ns", "avg ns", "failed");
+    for (int m = 0; m < AccMethod_Count; m++)
+    {
+        if (report.Calls[m] == 0)
+        {
+            continue;
+        }
+        fprintf(pFile, "%-28s %10lu %14I64u %10I64u %8lu\n", GetAccMethodName(static_cast<AccMethod>(m)),
+            report.Calls[m], report.Nanoseconds[m], report.Nanoseconds[m] / report.Calls[m], report.Failures[m]);
+    }
+#ifdef ACCSERVER_STATS
+    fputs(MemoryStats::FormatReport().c_str(), pFile);
+#endif
+    fclose(pFile);
+    return true;
+}
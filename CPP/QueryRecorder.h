@@ -0,0 +1,84 @@
+/*************************************************************************************************
+* Description: Declarations for recording and replaying the calls that clients make on the
+* accessible object.
+*
+* A recording starts with a snapshot of the list, followed by one record for every
+* IAccessible and IEnumVARIANT call and for every change to the list or its selection.
+* Replaying it against a hidden copy of the control reissues the calls as fast as possible
+* and reports where the time went.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include "CustomControl.h"
+#include "AccStats.h"
+
+// Record types other than calls. Calls are recorded with their AccMethod value.
+enum QueryRecordType
+{
+    QueryRecord_AddItem = 64,       // Status, name length, name.
+    QueryRecord_RemoveSelected,     // No arguments.
+    QueryRecord_Selection,          // Focus index, range count, ranges.
+    QueryRecord_Grouped,            // 1 for the grouped view, 0 for the list.
+    QueryRecord_GroupExpanded,      // Group, 1 if expanded.
+    QueryRecord_SyncRoster,         // Entry count, then ID, status, name length, name for each.
+    QueryRecord_ItemStatus,         // Index, status.
+    QueryRecord_Tiled,              // 1 for the tile view, 0 for the list.
+    QueryRecord_MoveItem,           // Index, new index.
+    QueryRecord_ItemName,           // Index, name length, name.
+    QueryRecord_SortByName,         // No arguments.
+    QueryRecord_End = 255
+};
+
+// Results of a replay.
+struct ReplayReport
+{
+    ULONG     TotalCalls;
+    ULONGLONG TotalNanoseconds;
+    ULONG     Calls[AccMethod_Count];
+    ULONGLONG Nanoseconds[AccMethod_Count];
+    ULONG     Failures[AccMethod_Count];
+};
+
+namespace QueryRecorder
+{
+    bool Open(const WCHAR* path);
+    void Close();
+    bool IsRecording(const CustomListControl* pControl);
+    void SetPaused(bool paused);
+    void AttachControl(CustomListControl* pControl);
+    void DetachControl(const CustomListControl* pControl);
+
+    void RecordCall(const CustomListControl* pControl, AccMethod method, LONG arg1 = 0, LONG arg2 = 0, LONG arg3 = 0);
+    void RecordChildCall(const CustomListControl* pControl, AccMethod method, const VARIANT& varChild, LONG arg = 0);
+    void RecordHitTest(const CustomListControl* pControl, HWND hwnd, long xLeft, long yTop);
+    void RecordAddItem(const CustomListControl* pControl, ContactStatus status, const WCHAR* name);
+    void RecordRemoveSelected(const CustomListControl* pControl);
+    void RecordSelection(const CustomListControl* pControl, const SelectionRangeSet& selection, int focusIndex);
+    void RecordGrouped(const CustomListControl* pControl, bool grouped);
+    void RecordGroupExpanded(const CustomListControl* pControl, int group, bool expanded);
+    void RecordSyncRoster(const CustomListControl* pControl, const std::vector<RosterEntry>& roster);
+    void RecordItemStatus(const CustomListControl* pControl, int index, ContactStatus status);
+    void RecordTiled(const CustomListControl* pControl, bool tiled);
+    void RecordMoveItem(const CustomListControl* pControl, int index, int newIndex);
+    void RecordItemName(const CustomListControl* pControl, int index, const WCHAR* name);
+    void RecordFindChildren(const CustomListControl* pControl, const WCHAR* name, LONG match, LONG status);
+    void RecordSortByName(const CustomListControl* pControl);
+}
+
+namespace QueryReplay
+{
+    bool Replay(const WCHAR* tracePath, HINSTANCE hInstance, ReplayReport* pReport);
+    bool WriteReport(const ReplayReport& report, const WCHAR* reportPath);
+}
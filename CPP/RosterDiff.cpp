@@ -0,0 +1,214 @@
+/*************************************************************************************************
+* Description: Implementation of the difference between two orderings of contact IDs.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "RosterDiff.h"
+#include <unordered_map>
+
+// Value in the table of positions for an ID that is only in the new list.
+static const int NewOnly = -1;
+
+// Counts in a Fenwick tree, for sums of a prefix that change as items move.
+//
+class PrefixCounts
+{
+private:
+    std::vector<int> m_tree;
+
+public:
+    PrefixCounts(size_t size) : m_tree(size + 1, 0)
+    {
+    }
+
+    void Add(size_t position, int amount)
+    {
+        for (size_t i = position + 1; i < m_tree.size(); i += i & (0 - i))
+        {
+            m_tree[i] += amount;
+        }
+    }
+
+    // Gets the sum of the counts before position.
+    int Sum(size_t position) const
+    {
+        int sum = 0;
+        for (size_t i = position; i > 0; i -= i & (0 - i))
+        {
+            sum += m_tree[i];
+        }
+        return sum;
+    }
+};
+
+// Finds the edits that turn oldIds into newIds. Returns false if newIds
+// repeats an ID.
+//
+// The items that keep their order split the list into gaps: gap 0 before the
+// first of them, and gap g after the g'th. The edits are made in the order of
+// the new list, so each gap holds the item that starts it, then the items
+// already placed there, then the items still to be moved out of it, in their
+// old order. The index of a place in a gap is the number of items in the gaps
+// before it, plus those ahead of it in the gap.
+//
+bool RosterDiff::Compute(const std::vector<unsigned int>& oldIds, const std::vector<unsigned int>& newIds,
+    std::vector<RosterEdit>* pEdits)
+{
+    pEdits->clear();
+
+    // Join on the ID, noting where each old item goes.
+    std::unordered_map<unsigned int, int> oldPositions;
+    oldPositions.reserve(oldIds.size() + newIds.size());
+    for (size_t i = 0; i < oldIds.size(); i++)
+    {
+        oldPositions[oldIds[i]] = static_cast<int>(i);
+    }
+    std::vector<int> newPositions(oldIds.size(), -1);
+    for (size_t j = 0; j < newIds.size(); j++)
+    {
+        std::pair<std::unordered_map<unsigned int, int>::iterator, bool> result =
+            oldPositions.insert(std::make_pair(newIds[j], NewOnly));
+        int oldPosition = result.first->second;
+        if (!result.second && ((oldPosition == NewOnly) || (newPositions[oldPosition] >= 0)))
+        {
+            return false;
+        }
+        if (oldPosition != NewOnly)
+        {
+            newPositions[oldPosition] = static_cast<int>(j);
+        }
+    }
+
+    // Remove from the end, so that each index is right when it is applied.
+    for (size_t i = oldIds.size(); i-- > 0;)
+    {
+        if (newPositions[i] < 0)
+        {
+            RosterEdit edit = { RosterEdit_Remove, oldIds[i], static_cast<int>(i), 0, 0 };
+            pEdits->push_back(edit);
+        }
+    }
+
+    // The items that are kept, in their old order, and where they go.
+    std::vector<int> keptNewPositions;
+    std::vector<int> keptIndexOfNew(newIds.size(), -1);
+    keptNewPositions.reserve(oldIds.size());
+    for (size_t i = 0; i < oldIds.size(); i++)
+    {
+        if (newPositions[i] >= 0)
+        {
+            keptIndexOfNew[newPositions[i]] = static_cast<int>(keptNewPositions.size());
+            keptNewPositions.push_back(newPositions[i]);
+        }
+    }
+    size_t keptCount = keptNewPositions.size();
+
+    // Find the longest increasing subsequence of new positions. tails[n] is the
+    // kept item that ends the best subsequence of length n + 1 found so far.
+    std::vector<int> tails;
+    std::vector<int> previous(keptCount, -1);
+    for (size_t k = 0; k < keptCount; k++)
+    {
+        size_t low = 0;
+        size_t high = tails.size();
+        while (low < high)
+        {
+            size_t middle = (low + high) / 2;
+            if (keptNewPositions[tails[middle]] < keptNewPositions[k])
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        previous[k] = (low > 0) ? tails[low - 1] : -1;
+        if (low == tails.size())
+        {
+            tails.push_back(static_cast<int>(k));
+        }
+        else
+        {
+            tails[low] = static_cast<int>(k);
+        }
+    }
+    size_t stayCount = tails.size();
+    std::vector<int> stays(stayCount);
+    std::vector<bool> isStay(keptCount, false);
+    for (int k = tails.empty() ? -1 : tails.back(), n = static_cast<int>(stayCount) - 1; k >= 0; k = previous[k], n--)
+    {
+        stays[n] = k;
+        isStay[k] = true;
+    }
+
+    // Count the items in each gap, and mark those that are to move.
+    PrefixCounts gapCounts(stayCount + 1);
+    PrefixCounts toMove(keptCount);
+    std::vector<int> gapOfKept(keptCount);
+    std::vector<int> placed(stayCount + 1, 0);
+    int gap = 0;
+    for (size_t k = 0; k < keptCount; k++)
+    {
+        if (isStay[k])
+        {
+            gap++;
+        }
+        else
+        {
+            toMove.Add(k, 1);
+        }
+        gapOfKept[k] = gap;
+        gapCounts.Add(gap, 1);
+    }
+
+    // Insert and move in the order of the new list.
+    gap = 0;
+    for (size_t j = 0; j < newIds.size(); j++)
+    {
+        int k = keptIndexOfNew[j];
+        if ((k >= 0) && isStay[k])
+        {
+            gap++;
+            continue;
+        }
+        RosterEdit edit = { RosterEdit_Insert, newIds[j], 0, 0, static_cast<int>(j) };
+        if (k >= 0)
+        {
+            // Take the item out of its old gap.
+            int from = gapOfKept[k];
+            size_t firstInGap = (from > 0) ? stays[from - 1] + 1 : 0;
+            edit.Type = RosterEdit_Move;
+            edit.Index = gapCounts.Sum(from) + ((from > 0) ? 1 : 0) + placed[from]
+                + toMove.Sum(k) - toMove.Sum(firstInGap);
+            gapCounts.Add(from, -1);
+            toMove.Add(k, -1);
+        }
+        int target = gapCounts.Sum(gap) + ((gap > 0) ? 1 : 0) + placed[gap];
+        if (k >= 0)
+        {
+            edit.NewIndex = target;
+        }
+        else
+        {
+            edit.Index = target;
+        }
+        gapCounts.Add(gap, 1);
+        placed[gap]++;
+        pEdits->push_back(edit);
+    }
+    return true;
+}
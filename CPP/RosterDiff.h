@@ -0,0 +1,54 @@
+/*************************************************************************************************
+* Description: Declarations for the difference between two orderings of contact IDs, as the
+* smallest set of removals, insertions and moves that turns one into the other.
+*
+* Contacts are matched by ID through a hash table. Those in both lists keep their relative
+* order if they are in the longest increasing subsequence of their new positions, found by
+* patience sorting, and are moved otherwise, so the number of moves is the least possible.
+* The index in each edit is the one the item has when the edit is applied, with the edits
+* applied in order, as in the change log, and is found with Fenwick trees, so the whole
+* difference takes O(n log n) time.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Kinds of edit. The removals come first, from the end of the list, followed by
+// the insertions and moves in the order of the new list.
+enum RosterEditType
+{
+    RosterEdit_Remove,      // Item removed from Index.
+    RosterEdit_Insert,      // Item inserted at Index.
+    RosterEdit_Move         // Item moved from Index to NewIndex.
+};
+
+struct RosterEdit
+{
+    RosterEditType Type;
+    unsigned int Id;
+    int Index;
+    int NewIndex;           // For a move, the index after the item is taken out.
+    int Source;             // For an insertion or move, the position in the new list.
+};
+
+namespace RosterDiff
+{
+    bool Compute(const std::vector<unsigned int>& oldIds, const std::vector<unsigned int>& newIds,
+        std::vector<RosterEdit>* pEdits);
+}
@@ -0,0 +1,181 @@
+/*************************************************************************************************
+* Description: Implementation of the groups of the grouped view of the contact list.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "RosterGroups.h"
+#include <algorithm>
+
+// Creates the groups, empty and collapsed. The lists of members are built
+// when they are first needed.
+//
+RosterGroups::RosterGroups(int groupCount) : m_groups(groupCount)
+{
+    for (size_t g = 0; g < m_groups.size(); g++)
+    {
+        m_groups[g].Count = 0;
+        m_groups[g].Expanded = false;
+        m_groups[g].MembersCurrent = false;
+    }
+}
+
+int RosterGroups::GetGroupCount() const
+{
+    return static_cast<int>(m_groups.size());
+}
+
+int RosterGroups::GetMemberCount(int group) const
+{
+    return m_groups[group].Count;
+}
+
+bool RosterGroups::IsExpanded(int group) const
+{
+    return m_groups[group].Expanded;
+}
+
+// Expands or collapses a group. Its list of members is kept while it is
+// collapsed; call UpdateMembers after expanding a group in case the list is
+// out of date.
+//
+void RosterGroups::SetExpanded(int group, bool expanded)
+{
+    m_groups[group].Expanded = expanded;
+}
+
+// Gets the number of rows: one for each group, and one for each member of
+// an expanded group.
+//
+int RosterGroups::GetRowCount() const
+{
+    int rows = 0;
+    for (size_t g = 0; g < m_groups.size(); g++)
+    {
+        rows += 1 + (m_groups[g].Expanded ? m_groups[g].Count : 0);
+    }
+    return rows;
+}
+
+// Gets the group and member shown in a row. The cost is proportional to the
+// number of groups, not of members.
+//
+bool RosterGroups::GetRow(int row, Row* pRow) const
+{
+    if (row < 0)
+    {
+        return false;
+    }
+    for (size_t g = 0; g < m_groups.size(); g++)
+    {
+        int groupRows = 1 + (m_groups[g].Expanded ? m_groups[g].Count : 0);
+        if (row < groupRows)
+        {
+            pRow->Group = static_cast<int>(g);
+            pRow->Member = row - 1;
+            return true;
+        }
+        row -= groupRows;
+    }
+    return false;
+}
+
+// Gets the row that shows a group. Its members, if shown, follow it.
+//
+int RosterGroups::GetGroupRow(int group) const
+{
+    int row = 0;
+    for (int g = 0; g < group; g++)
+    {
+        row += 1 + (m_groups[g].Expanded ? m_groups[g].Count : 0);
+    }
+    return row;
+}
+
+// Gets the index of the item that is a member of a group, or -1 if the list
+// of members is out of date.
+//
+int RosterGroups::GetMemberIndex(int group, int member) const
+{
+    const Group& entry = m_groups[group];
+    if (!entry.MembersCurrent || (member < 0) || (member >= static_cast<int>(entry.Members.size())))
+    {
+        return -1;
+    }
+    return entry.Members[member];
+}
+
+// Gets the position among the members of a group of the item at an index, or
+// -1 if it is not a member, or the list of members is out of date.
+//
+int RosterGroups::FindMember(int group, int index) const
+{
+    const Group& entry = m_groups[group];
+    if (!entry.MembersCurrent)
+    {
+        return -1;
+    }
+    std::vector<int>::const_iterator found = std::lower_bound(entry.Members.begin(), entry.Members.end(), index);
+    if ((found == entry.Members.end()) || (*found != index))
+    {
+        return -1;
+    }
+    return static_cast<int>(found - entry.Members.begin());
+}
+
+// Counts an item that has joined a group. No other item may have moved since
+// the last change.
+//
+void RosterGroups::OnMemberAdded(int group, int index)
+{
+    Group& entry = m_groups[group];
+    entry.Count++;
+    if (entry.MembersCurrent)
+    {
+        entry.Members.insert(std::lower_bound(entry.Members.begin(), entry.Members.end(), index), index);
+    }
+}
+
+// Counts an item that has left a group, either because it was removed, or
+// because it changed group.
+//
+void RosterGroups::OnMemberRemoved(int group, int index)
+{
+    Group& entry = m_groups[group];
+    entry.Count--;
+    if (entry.MembersCurrent)
+    {
+        std::vector<int>::iterator found = std::lower_bound(entry.Members.begin(), entry.Members.end(), index);
+        if ((found != entry.Members.end()) && (*found == index))
+        {
+            entry.Members.erase(found);
+        }
+        else
+        {
+            entry.MembersCurrent = false;
+        }
+    }
+}
+
+// Marks the lists of members out of date after items have been removed or
+// reordered. The counts do not change.
+//
+void RosterGroups::OnItemsMoved()
+{
+    for (size_t g = 0; g < m_groups.size(); g++)
+    {
+        m_groups[g].MembersCurrent = false;
+    }
+}
@@ -0,0 +1,115 @@
+/*************************************************************************************************
+* Description: Declarations for the groups of the grouped view of the contact list.
+*
+* In the grouped view, each group is shown as a row, followed by a row for each of its members
+* when the group is expanded. The groups keep a count of their members, which the control
+* updates as contacts are added, removed and change status, so the number of rows, and the
+* group and member in a row, come from the counts without looking at the contacts.
+*
+* Which contacts are in a group is needed only for the rows of an expanded group. Each group
+* keeps the indexes of its members, in list order, but builds the list only when it is first
+* needed, and keeps it while the group is collapsed. A contact that joins or leaves a group
+* is added to or removed from the list in place. When contacts are removed or reordered, the
+* indexes of the others change, so the lists are marked out of date, and UpdateMembers
+* rebuilds those of the expanded groups in one pass over the contacts. Collapsing and
+* expanding a group only changes a flag.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+class RosterGroups
+{
+public:
+    // Member of the row that shows the group itself.
+    static const int GroupRow = -1;
+
+    // A row of the grouped view: a group, and a member of it or GroupRow.
+    struct Row
+    {
+        int Group;
+        int Member;
+    };
+
+    RosterGroups(int groupCount);
+
+    int GetGroupCount() const;
+    int GetMemberCount(int group) const;
+    bool IsExpanded(int group) const;
+    void SetExpanded(int group, bool expanded);
+
+    int GetRowCount() const;
+    bool GetRow(int row, Row* pRow) const;
+    int GetGroupRow(int group) const;
+    int GetMemberIndex(int group, int member) const;
+    int FindMember(int group, int index) const;
+
+    void OnMemberAdded(int group, int index);
+    void OnMemberRemoved(int group, int index);
+    void OnItemsMoved();
+
+    // Rebuilds the lists of members of the expanded groups that are out of
+    // date, in one pass over the items. groupOf(index) gives the group of
+    // the item at index.
+    template <typename GroupOf>
+    void UpdateMembers(int itemCount, GroupOf groupOf)
+    {
+        bool needed = false;
+        for (size_t g = 0; g < m_groups.size(); g++)
+        {
+            if (m_groups[g].Expanded && !m_groups[g].MembersCurrent)
+            {
+                // Clearing keeps the capacity, so a rebuild need not allocate.
+                m_groups[g].Members.clear();
+                m_groups[g].Members.reserve(m_groups[g].Count);
+                needed = true;
+            }
+        }
+        if (!needed)
+        {
+            return;
+        }
+        for (int i = 0; i < itemCount; i++)
+        {
+            Group& group = m_groups[groupOf(i)];
+            if (group.Expanded && !group.MembersCurrent)
+            {
+                group.Members.push_back(i);
+            }
+        }
+        for (size_t g = 0; g < m_groups.size(); g++)
+        {
+            if (m_groups[g].Expanded)
+            {
+                m_groups[g].MembersCurrent = true;
+            }
+        }
+    }
+
+private:
+    struct Group
+    {
+        int Count;
+        bool Expanded;
+        bool MembersCurrent;        // Members holds every member, at its current index.
+        std::vector<int> Members;   // Indexes of the members, in list order.
+    };
+
+    std::vector<Group> m_groups;
+};
@@ -0,0 +1,244 @@
+/*************************************************************************************************
+* Description: Implementation of the selection range set used by the custom list control.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "SelectionRanges.h"
+#include <algorithm>
+
+SelectionRangeSet::SelectionRangeSet() : m_count(0)
+{
+    // Room for a few ranges, so that selecting single items never allocates.
+    m_ranges.reserve(InitialRangeCapacity);
+}
+
+// Finds the position of the first range that ends after the specified index.
+// Returns the number of ranges if there is no such range.
+//
+int SelectionRangeSet::FindRange(int index) const
+{
+    int low = 0;
+    int high = static_cast<int>(m_ranges.size());
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (m_ranges[middle].Last <= index)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Empties the set.
+//
+void SelectionRangeSet::Clear()
+{
+    m_ranges.clear();
+    m_count = 0;
+}
+
+// Replaces the contents of the set with every index from 0 to itemCount - 1.
+//
+void SelectionRangeSet::SelectAll(int itemCount)
+{
+    Clear();
+    if (itemCount > 0)
+    {
+        Range all = { 0, itemCount };
+        m_ranges.push_back(all);
+        m_count = itemCount;
+    }
+}
+
+// Adds the indexes from first up to but not including last.
+//
+void SelectionRangeSet::AddRange(int first, int last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+
+    // Ranges that overlap or touch the new one are merged into it.
+    int low = FindRange(first - 1);
+    int high = low;
+    int size = static_cast<int>(m_ranges.size());
+    while ((high < size) && (m_ranges[high].First <= last))
+    {
+        first = std::min(first, m_ranges[high].First);
+        last = std::max(last, m_ranges[high].Last);
+        m_count -= m_ranges[high].Last - m_ranges[high].First;
+        high++;
+    }
+
+    Range merged = { first, last };
+    m_count += last - first;
+    if (high > low)
+    {
+        m_ranges[low] = merged;
+        m_ranges.erase(m_ranges.begin() + low + 1, m_ranges.begin() + high);
+    }
+    else
+    {
+        m_ranges.insert(m_ranges.begin() + low, merged);
+    }
+}
+
+// Removes the indexes from first up to but not including last.
+//
+void SelectionRangeSet::RemoveRange(int first, int last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+
+    int low = FindRange(first);
+    int high = low;
+    int size = static_cast<int>(m_ranges.size());
+    while ((high < size) && (m_ranges[high].First < last))
+    {
+        high++;
+    }
+    if (high == low)
+    {
+        return;
+    }
+
+    // Keep the parts of the outermost ranges that stick out of the removed span.
+    Range pieces[2];
+    int pieceCount = 0;
+    if (m_ranges[low].First < first)
+    {
+        Range left = { m_ranges[low].First, first };
+        pieces[pieceCount++] = left;
+    }
+    if (m_ranges[high - 1].Last > last)
+    {
+        Range right = { last, m_ranges[high - 1].Last };
+        pieces[pieceCount++] = right;
+    }
+
+    for (int i = low; i < high; i++)
+    {
+        m_count -= m_ranges[i].Last - m_ranges[i].First;
+    }
+    m_ranges.erase(m_ranges.begin() + low, m_ranges.begin() + high);
+    for (int i = 0; i < pieceCount; i++)
+    {
+        m_count += pieces[i].Last - pieces[i].First;
+    }
+    m_ranges.insert(m_ranges.begin() + low, pieces, pieces + pieceCount);
+}
+
+// Determines whether the index is in the set. O(log n) in the number of ranges.
+//
+bool SelectionRangeSet::Contains(int index) const
+{
+    int position = FindRange(index);
+    return (position < static_cast<int>(m_ranges.size())) && (m_ranges[position].First <= index);
+}
+
+bool SelectionRangeSet::IsEmpty() const
+{
+    return m_ranges.empty();
+}
+
+// Gets the number of indexes in the set.
+//
+int SelectionRangeSet::GetCount() const
+{
+    return m_count;
+}
+
+// Gets the lowest index in the set, or -1 if the set is empty.
+//
+int SelectionRangeSet::GetFirst() const
+{
+    return m_ranges.empty() ? -1 : m_ranges.front().First;
+}
+
+int SelectionRangeSet::GetRangeCount() const
+{
+    return static_cast<int>(m_ranges.size());
+}
+
+const SelectionRangeSet::Range& SelectionRangeSet::GetRange(int rangeIndex) const
+{
+    return m_ranges[rangeIndex];
+}
+
+const std::vector<SelectionRangeSet::Range>& SelectionRangeSet::GetRanges() const
+{
+    return m_ranges;
+}
+
+// Adjusts the set after count unselected items have been inserted at index.
+//
+void SelectionRangeSet::OnItemsInserted(int index, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    int position = FindRange(index);
+    int size = static_cast<int>(m_ranges.size());
+    if ((position < size) && (m_ranges[position].First < index))
+    {
+        // The insertion splits a range in two.
+        Range tail = { index, m_ranges[position].Last };
+        m_ranges[position].Last = index;
+        m_ranges.insert(m_ranges.begin() + position + 1, tail);
+        position++;
+        size++;
+    }
+    for (int i = position; i < size; i++)
+    {
+        m_ranges[i].First += count;
+        m_ranges[i].Last += count;
+    }
+}
+
+// Adjusts the set after count items starting at index have been removed.
+//
+void SelectionRangeSet::OnItemsRemoved(int index, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    RemoveRange(index, index + count);
+
+    int position = FindRange(index);
+    int size = static_cast<int>(m_ranges.size());
+    for (int i = position; i < size; i++)
+    {
+        m_ranges[i].First -= count;
+        m_ranges[i].Last -= count;
+    }
+
+    // Ranges on either side of the removed span may now touch.
+    if ((position > 0) && (position < size) && (m_ranges[position - 1].Last == m_ranges[position].First))
+    {
+        m_ranges[position - 1].Last = m_ranges[position].Last;
+        m_ranges.erase(m_ranges.begin() + position);
+    }
+}
@@ -0,0 +1,64 @@
+/*************************************************************************************************
+* Description: Declarations for the selection range set used by the custom list control.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <vector>
+
+// A set of item indexes, stored as sorted, non-overlapping, non-adjacent ranges.
+// Selecting everything is a single range, so the cost of an operation depends on
+// the number of ranges rather than on the number of selected items.
+//
+// This class has no dependency on Windows headers.
+//
+class SelectionRangeSet
+{
+public:
+    // A run of selected indexes, from First up to but not including Last.
+    struct Range
+    {
+        int First;
+        int Last;
+    };
+
+private:
+    static const int InitialRangeCapacity = 4;
+
+    std::vector<Range> m_ranges;
+    int m_count;                    // Total number of indexes in all ranges.
+
+    int FindRange(int index) const;
+
+public:
+    SelectionRangeSet();
+
+    void Clear();
+    void SelectAll(int itemCount);
+    void AddRange(int first, int last);
+    void RemoveRange(int first, int last);
+    bool Contains(int index) const;
+    bool IsEmpty() const;
+    int GetCount() const;
+    int GetFirst() const;
+    int GetRangeCount() const;
+    const Range& GetRange(int rangeIndex) const;
+    const std::vector<Range>& GetRanges() const;
+
+    void OnItemsInserted(int index, int count);
+    void OnItemsRemoved(int index, int count);
+};
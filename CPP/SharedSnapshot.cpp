@@ -0,0 +1,375 @@
+/*************************************************************************************************
+* Description: Implementation of the snapshot of the list that is published in shared memory.
+*
+* See SharedSnapshot.h for a description of the protocol.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "SharedSnapshot.h"
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace SharedSnapshot;
+
+static const unsigned int Signature = 0x534e5341;  // 'ASNS'
+static const unsigned int Version = 1;
+static const unsigned int OverflowSize = 0xffffffff;
+static const int ReadAttempts = 16;
+
+// One of the two buffers. Sequence is odd while the buffer is being written.
+struct SnapshotBuffer
+{
+    std::atomic<unsigned int> Sequence;
+    unsigned int Size;                  // Bytes of Data in use, or OverflowSize.
+    unsigned int Generation;            // Publish count when this buffer was written.
+    unsigned int Reserved;
+    unsigned char Data[BufferCapacity];
+};
+
+// The start of the region.
+struct SnapshotHeader
+{
+    unsigned int Signature;
+    unsigned int Version;
+    unsigned long long Owner;           // Window handle of the control.
+    std::atomic<unsigned int> Generation;   // Number of snapshots published.
+    std::atomic<unsigned int> ActiveBuffer; // The buffer readers should use.
+    unsigned int Reserved[10];          // Keeps the buffers off the header's cache line.
+    SnapshotBuffer Buffers[2];
+};
+
+void SharedSnapshot::FormatName(unsigned long long owner, char* name, size_t nameSize)
+{
+#ifdef _WIN32
+    _snprintf_s(name, nameSize, _TRUNCATE, "Local\\AccServerSnapshot-%I64x", owner);
+#else
+    snprintf(name, nameSize, "/AccServerSnapshot-%llx", owner);
+#endif
+}
+
+
+// SharedRegion class.
+//
+SharedRegion::SharedRegion() : m_handle(NULL), m_pView(NULL), m_size(0), m_created(false)
+{
+    m_name[0] = '\0';
+}
+
+SharedRegion::~SharedRegion()
+{
+    Close();
+}
+
+// Creates a region, or reuses one of the same name, and maps it for writing.
+//
+bool SharedRegion::Create(const char* name, size_t size)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        static_cast<DWORD>(size), name);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    m_pView = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+    if (m_pView == NULL)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_handle = mapping;
+#else
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* pView = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        pView = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (pView == MAP_FAILED)
+    {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    m_pView = pView;
+    m_handle = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+#endif
+    m_size = size;
+    m_created = true;
+    strncpy(m_name, name, sizeof(m_name) - 1);
+    m_name[sizeof(m_name) - 1] = '\0';
+    return true;
+}
+
+// Maps an existing region for reading.
+//
+bool SharedRegion::Open(const char* name, size_t size)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    m_pView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    if (m_pView == NULL)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_handle = mapping;
+#else
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* pView = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (pView == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    m_pView = pView;
+    m_handle = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+#endif
+    m_size = size;
+    m_created = false;
+    return true;
+}
+
+// Unmaps the region. The creator also removes the name, so that new readers
+// cannot open a region that is no longer being published.
+//
+void SharedRegion::Close()
+{
+    if (m_pView == NULL)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_pView);
+    CloseHandle(m_handle);
+#else
+    munmap(m_pView, m_size);
+    close(static_cast<int>(reinterpret_cast<intptr_t>(m_handle)));
+    if (m_created)
+    {
+        shm_unlink(m_name);
+    }
+#endif
+    m_pView = NULL;
+    m_handle = NULL;
+    m_size = 0;
+    m_created = false;
+}
+
+void* SharedRegion::GetView() const
+{
+    return m_pView;
+}
+
+
+// SnapshotPublisher class.
+//
+SnapshotPublisher::SnapshotPublisher() : m_pHeader(NULL)
+{
+}
+
+SnapshotPublisher::~SnapshotPublisher()
+{
+    Close();
+}
+
+// Creates the region for an owner window. Nothing can be read until the
+// first call to Publish.
+//
+bool SnapshotPublisher::Create(unsigned long long owner)
+{
+    Close();
+    char name[64];
+    FormatName(owner, name, sizeof(name));
+    if (!m_region.Create(name, sizeof(SnapshotHeader)))
+    {
+        return false;
+    }
+    m_pHeader = static_cast<SnapshotHeader*>(m_region.GetView());
+
+    // Only the headers need clearing; buffers are not read until a size is set.
+    m_pHeader->Signature = 0;
+    m_pHeader->Version = Version;
+    m_pHeader->Owner = owner;
+    m_pHeader->Generation.store(0, std::memory_order_relaxed);
+    m_pHeader->ActiveBuffer.store(0, std::memory_order_relaxed);
+    for (int b = 0; b < 2; b++)
+    {
+        m_pHeader->Buffers[b].Sequence.store(0, std::memory_order_relaxed);
+        m_pHeader->Buffers[b].Size = 0;
+        m_pHeader->Buffers[b].Generation = 0;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    m_pHeader->Signature = Signature;
+    return true;
+}
+
+void SnapshotPublisher::Close()
+{
+    m_region.Close();
+    m_pHeader = NULL;
+}
+
+bool SnapshotPublisher::IsOpen() const
+{
+    return m_pHeader != NULL;
+}
+
+// Publishes a new snapshot. If it is larger than BufferCapacity, readers are
+// told that the list has overflowed. Returns false in that case.
+//
+bool SnapshotPublisher::Publish(const void* data, size_t size)
+{
+    if (m_pHeader == NULL)
+    {
+        return false;
+    }
+    unsigned int active = m_pHeader->ActiveBuffer.load(std::memory_order_relaxed);
+    SnapshotBuffer& buffer = m_pHeader->Buffers[1 - active];
+    unsigned int generation = m_pHeader->Generation.load(std::memory_order_relaxed) + 1;
+    bool fits = (size <= BufferCapacity);
+
+    // Mark the buffer as being written before touching its contents.
+    unsigned int sequence = buffer.Sequence.load(std::memory_order_relaxed);
+    buffer.Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    buffer.Size = fits ? static_cast<unsigned int>(size) : OverflowSize;
+    buffer.Generation = generation;
+    if (fits)
+    {
+        memcpy(buffer.Data, data, size);
+    }
+    buffer.Sequence.store(sequence + 2, std::memory_order_release);
+
+    // Direct new readers to the buffer just written.
+    m_pHeader->ActiveBuffer.store(1 - active, std::memory_order_release);
+    m_pHeader->Generation.store(generation, std::memory_order_release);
+    return fits;
+}
+
+
+// SnapshotReader class.
+//
+SnapshotReader::SnapshotReader() : m_pHeader(NULL)
+{
+}
+
+// Maps the region published for an owner window.
+//
+bool SnapshotReader::Open(unsigned long long owner)
+{
+    Close();
+    char name[64];
+    FormatName(owner, name, sizeof(name));
+    if (!m_region.Open(name, sizeof(SnapshotHeader)))
+    {
+        return false;
+    }
+    SnapshotHeader* pHeader = static_cast<SnapshotHeader*>(m_region.GetView());
+    if ((pHeader->Signature != Signature) || (pHeader->Version != Version))
+    {
+        m_region.Close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    m_pHeader = pHeader;
+    return true;
+}
+
+void SnapshotReader::Close()
+{
+    m_region.Close();
+    m_pHeader = NULL;
+}
+
+unsigned long long SnapshotReader::GetOwner() const
+{
+    return (m_pHeader != NULL) ? m_pHeader->Owner : 0;
+}
+
+// Gets the number of snapshots published so far. A reader can poll this to
+// find out whether its copy is out of date.
+//
+unsigned int SnapshotReader::GetGeneration() const
+{
+    return (m_pHeader != NULL) ? m_pHeader->Generation.load(std::memory_order_acquire) : 0;
+}
+
+// Copies the latest snapshot. The copy can be unpacked with ChildRecords::Reader.
+//
+ReadResult SnapshotReader::Read(std::vector<unsigned char>* pData, unsigned int* pGeneration)
+{
+    if ((m_pHeader == NULL) || (GetGeneration() == 0))
+    {
+        return Read_Empty;
+    }
+    for (int attempt = 0; attempt < ReadAttempts; attempt++)
+    {
+        unsigned int active = m_pHeader->ActiveBuffer.load(std::memory_order_acquire);
+        const SnapshotBuffer& buffer = m_pHeader->Buffers[active & 1];
+        unsigned int sequence = buffer.Sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) != 0)
+        {
+            continue;
+        }
+        unsigned int size = buffer.Size;
+        unsigned int generation = buffer.Generation;
+        bool overflow = (size == OverflowSize);
+        if (!overflow && (size <= BufferCapacity))
+        {
+            // The copy may be torn; the sequence check below detects that.
+            pData->resize(size);
+            if (size > 0)
+            {
+                memcpy(&(*pData)[0], buffer.Data, size);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (buffer.Sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+        if (pGeneration != NULL)
+        {
+            *pGeneration = generation;
+        }
+        return overflow ? Read_Overflow : Read_OK;
+    }
+    return Read_Busy;
+}
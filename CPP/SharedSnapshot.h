@@ -0,0 +1,117 @@
+/*************************************************************************************************
+* Description: Declarations for the snapshot of the list that is published in shared memory.
+*
+* The list publishes its children as packed child records (see ChildRecords.h) in a named
+* shared-memory region, so that cooperating clients can read them without a cross-process
+* call, even while the UI thread is busy.
+*
+* The region holds two buffers. The publisher writes the buffer that readers are not
+* directed to, and then switches them over. Each buffer is protected by a sequence
+* number that is odd while the buffer is being written, so a reader that overlaps a
+* write sees the number change and tries again. Readers never block the publisher.
+*
+* Rectangles in the snapshot are relative to the control's client area, because the
+* control is not told when its parent window moves. The owner window handle is stored
+* in the region so that readers can convert them to screen coordinates.
+*
+* This code has no dependency on Windows headers. On Windows the region is a named
+* file mapping; elsewhere it is a POSIX shared-memory object.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+struct SnapshotHeader;
+
+namespace SharedSnapshot
+{
+    // Size of each of the two buffers. A list whose records do not fit is
+    // published as overflowed, and readers must fall back to IAccessible.
+    const size_t BufferCapacity = 256 * 1024;
+
+    // Result of SnapshotReader::Read.
+    enum ReadResult
+    {
+        Read_OK,
+        Read_Empty,             // Nothing has been published yet.
+        Read_Overflow,          // The list did not fit.
+        Read_Busy               // Every attempt overlapped a write.
+    };
+
+    // Formats the name of the region for an owner window.
+    void FormatName(unsigned long long owner, char* name, size_t nameSize);
+}
+
+// A mapped shared-memory region. Used by both ends.
+//
+class SharedRegion
+{
+private:
+    void* m_handle;             // File mapping handle, or file descriptor.
+    void* m_pView;
+    size_t m_size;
+    char m_name[64];
+    bool m_created;             // This end created the region.
+
+    SharedRegion(const SharedRegion&);
+    SharedRegion& operator=(const SharedRegion&);
+
+public:
+    SharedRegion();
+    ~SharedRegion();
+
+    bool Create(const char* name, size_t size);
+    bool Open(const char* name, size_t size);
+    void Close();
+    void* GetView() const;
+};
+
+// Publishes snapshots. Only one thread may publish to a region.
+//
+class SnapshotPublisher
+{
+private:
+    SharedRegion m_region;
+    SnapshotHeader* m_pHeader;
+
+public:
+    SnapshotPublisher();
+    ~SnapshotPublisher();
+
+    bool Create(unsigned long long owner);
+    void Close();
+    bool IsOpen() const;
+    bool Publish(const void* data, size_t size);
+};
+
+// Reads snapshots published by another process.
+//
+class SnapshotReader
+{
+private:
+    SharedRegion m_region;
+    SnapshotHeader* m_pHeader;
+
+public:
+    SnapshotReader();
+
+    bool Open(unsigned long long owner);
+    void Close();
+    unsigned long long GetOwner() const;
+    unsigned int GetGeneration() const;
+    SharedSnapshot::ReadResult Read(std::vector<unsigned char>* pData, unsigned int* pGeneration);
+};
@@ -0,0 +1,247 @@
+/*************************************************************************************************
+* Description: Implementation of the sort test.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "SortTest.h"
+#include "JobScheduler.h"
+#include "MemoryStats.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Messages to the hidden window.
+#define SORTTEST_RUNSLICE   (WM_APP + 1)
+#define SORTTEST_PROBE      (WM_APP + 2)    // wParam is the probe's index.
+
+// Probes posted at most, which is a few minutes' worth.
+static const ULONG MaxProbes = 200000;
+
+// Gets the current time in nanoseconds.
+//
+static ULONGLONG SortClock()
+{
+    static ULONGLONG frequency = 0;
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = static_cast<ULONGLONG>(value.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    ULONGLONG ticks = static_cast<ULONGLONG>(now.QuadPart);
+    return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
+// Compares names as the control does when it sorts.
+//
+struct CompareNames
+{
+    bool operator()(const WCHAR* pLeft, const WCHAR* pRight) const
+    {
+        return _wcsicmp(pLeft, pRight) < 0;
+    }
+};
+
+// Sorts names, a slice at a time, and keeps the result when it commits.
+//
+class NameSortJob : public TimeSlicedJob
+{
+private:
+    SlicedMergeSort<const WCHAR*, CompareNames> m_sort;
+    std::vector<const WCHAR*>* m_pResult;
+
+public:
+    // Names merged in each step, as for the control's sort.
+    static const size_t NamesPerStep = 1024;
+
+    NameSortJob(const std::vector<const WCHAR*>& names, std::vector<const WCHAR*>* pResult) : m_pResult(pResult)
+    {
+        m_sort.Reset(names);
+    }
+
+    virtual bool Step()
+    {
+        return m_sort.Step(NamesPerStep);
+    }
+
+    virtual void Commit()
+    {
+        m_pResult->swap(m_sort.GetItems());
+    }
+};
+
+// State of the hidden window while the job runs.
+struct SortTestWindow
+{
+    JobScheduler Scheduler;
+    std::unique_ptr<std::atomic<ULONGLONG>[]> PostTimes;    // Of each probe.
+    SortTestReport* pReport;
+};
+
+static LRESULT CALLBACK SortTestWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    SortTestWindow* pWindow = reinterpret_cast<SortTestWindow*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+    switch (message)
+    {
+    case SORTTEST_RUNSLICE:
+        pWindow->pReport->Slices++;
+        if (pWindow->Scheduler.RunSlice())
+        {
+            PostMessage(hwnd, SORTTEST_RUNSLICE, 0, 0);
+        }
+        else
+        {
+            PostQuitMessage(0);
+        }
+        return 0;
+
+    case SORTTEST_PROBE:
+        {
+            ULONGLONG wait = SortClock() - pWindow->PostTimes[wParam].load(std::memory_order_acquire);
+            pWindow->pReport->Probes++;
+            pWindow->pReport->TotalWaitNanoseconds += wait;
+            if (wait > pWindow->pReport->LongestWaitNanoseconds)
+            {
+                pWindow->pReport->LongestWaitNanoseconds = wait;
+            }
+            return 0;
+        }
+    }
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+void SortTest::GetDefaultOptions(SortTestOptions* pOptions)
+{
+    pOptions->Names = 500000;
+    pOptions->BudgetMicroseconds = JobScheduler::DefaultBudgetMicroseconds;
+}
+
+// Sorts the names in one call and then in slices, while probes measure how
+// long messages wait. Returns false if the window could not be created.
+//
+bool SortTest::Run(const SortTestOptions& options, HINSTANCE hInstance, SortTestReport* pReport)
+{
+    ZeroMemory(pReport, sizeof(SortTestReport));
+    pReport->Options = options;
+
+    // Many names are repeated, so that the sorts must also agree on ties.
+    std::vector<std::wstring> storage(options.Names);
+    std::vector<const WCHAR*> names(options.Names);
+    ULONG random = 1;
+    for (ULONG i = 0; i < options.Names; i++)
+    {
+        random = random * 1103515245 + 12345;
+        WCHAR name[32];
+        _snwprintf_s(name, _countof(name), _TRUNCATE, (i % 2 == 0) ? L"Contact %lu" : L"contact %lu",
+            (random >> 8) % (options.Names / 2 + 1));
+        storage[i] = name;
+        names[i] = storage[i].c_str();
+    }
+
+    std::vector<const WCHAR*> oneCall(names);
+    ULONGLONG start = SortClock();
+    std::stable_sort(oneCall.begin(), oneCall.end(), CompareNames());
+    pReport->OneCallNanoseconds = SortClock() - start;
+
+    WNDCLASS wc;
+    ZeroMemory(&wc, sizeof(wc));
+    wc.lpfnWndProc = SortTestWndProc;
+    wc.hInstance = hInstance;
+    wc.lpszClassName = L"SORTTEST";
+    RegisterClass(&wc);
+    HWND hwnd = CreateWindowEx(0, L"SORTTEST", NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, NULL);
+    SortTestWindow* pWindow = new (std::nothrow) SortTestWindow();
+    if (pWindow != NULL)
+    {
+        pWindow->PostTimes.reset(new (std::nothrow) std::atomic<ULONGLONG>[MaxProbes]);
+    }
+    if ((hwnd == NULL) || (pWindow == NULL) || (pWindow->PostTimes == NULL))
+    {
+        delete pWindow;
+        if (hwnd != NULL)
+        {
+            DestroyWindow(hwnd);
+        }
+        return false;
+    }
+    pWindow->pReport = pReport;
+    pWindow->Scheduler.SetBudget(options.BudgetMicroseconds);
+    SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pWindow));
+
+    std::vector<const WCHAR*> sliced;
+    start = SortClock();
+    pWindow->Scheduler.Add(new (std::nothrow) NameSortJob(names, &sliced));
+    PostMessage(hwnd, SORTTEST_RUNSLICE, 0, 0);
+
+    // The prober posts a message every millisecond, or as often as Sleep allows.
+    std::atomic<bool> stop(false);
+    std::thread prober([&]()
+    {
+        for (ULONG i = 0; (i < MaxProbes) && !stop; i++)
+        {
+            pWindow->PostTimes[i].store(SortClock(), std::memory_order_release);
+            PostMessage(hwnd, SORTTEST_PROBE, i, 0);
+            Sleep(1);
+        }
+    });
+    MSG msg;
+    while (GetMessage(&msg, NULL, 0, 0) > 0)
+    {
+        DispatchMessage(&msg);
+    }
+    pReport->SlicedNanoseconds = SortClock() - start;
+    stop = true;
+    prober.join();
+
+    // Probes still queued when the job finished did not wait for it, so they
+    // are not measured.
+    while (PeekMessage(&msg, hwnd, SORTTEST_PROBE, SORTTEST_PROBE, PM_REMOVE))
+    {
+    }
+    pReport->LongestSliceNanoseconds = pWindow->Scheduler.GetLongestSlice();
+    pReport->Agreed = (sliced == oneCall);
+    DestroyWindow(hwnd);
+    delete pWindow;
+    return true;
+}
+
+bool SortTest::WriteReport(const SortTestReport& report, const WCHAR* reportPath)
+{
+    FILE* pFile = NULL;
+    if ((_wfopen_s(&pFile, reportPath, L"w") != 0) || (pFile == NULL))
+    {
+        return false;
+    }
+    fprintf(pFile, "sort: %lu names; one call %.1f ms; in slices of %lu us, %.1f ms in %lu slices, longest %.2f ms\n",
+        report.Options.Names, report.OneCallNanoseconds / 1e6, report.Options.BudgetMicroseconds,
+        report.SlicedNanoseconds / 1e6, report.Slices, report.LongestSliceNanoseconds / 1e6);
+    fprintf(pFile, "messages: %lu handled during the sort; longest wait %.2f ms, average %.3f ms\n",
+        report.Probes, report.LongestWaitNanoseconds / 1e6,
+        (report.Probes > 0) ? report.TotalWaitNanoseconds / 1e6 / report.Probes : 0.0);
+    fprintf(pFile, "result: the sorts %s\n", report.Agreed ? "agree" : "DISAGREE");
+#ifdef ACCSERVER_STATS
+    fputs(MemoryStats::FormatReport().c_str(), pFile);
+#endif
+    fclose(pFile);
+    return true;
+}
@@ -0,0 +1,53 @@
+/*************************************************************************************************
+* Description: Declarations for the sort test, which measures how long messages wait while a
+* large sort runs on the UI thread in slices.
+*
+* Generated names are sorted twice: once in a single call, as a message handler would if the
+* sort were not split, and once as a job that the scheduler runs in slices on a hidden
+* window, between which the window's other messages are handled. While the job runs, a
+* second thread posts a message to the window every millisecond, and the time each waits
+* before it is handled is measured. The report gives the time of the single call against the
+* longest wait, the longest slice and the total time of the sliced sort, and whether the two
+* sorts agree.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <windows.h>
+
+struct SortTestOptions
+{
+    ULONG Names;
+    ULONG BudgetMicroseconds;       // For each slice.
+};
+
+struct SortTestReport
+{
+    SortTestOptions Options;
+    ULONGLONG OneCallNanoseconds;   // Sorting in a single call.
+    ULONGLONG SlicedNanoseconds;    // From scheduling the job to its commit.
+    ULONG Slices;
+    ULONGLONG LongestSliceNanoseconds;
+    ULONG Probes;                   // Messages handled while the job ran.
+    ULONGLONG LongestWaitNanoseconds;
+    ULONGLONG TotalWaitNanoseconds;
+    bool Agreed;                    // Both sorts gave the same order.
+};
+
+namespace SortTest
+{
+    void GetDefaultOptions(SortTestOptions* pOptions);
+    bool Run(const SortTestOptions& options, HINSTANCE hInstance, SortTestReport* pReport);
+    bool WriteReport(const SortTestReport& report, const WCHAR* reportPath);
+}
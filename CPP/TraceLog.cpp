@@ -0,0 +1,255 @@
+/*************************************************************************************************
+* Description: Implementation of span tracing in Chrome trace-event format.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "TraceLog.h"
+#include "MemoryStats.h"
+#include <string.h>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+// One begin or end record.
+struct TraceEvent
+{
+    unsigned long long Timestamp;   // Nanoseconds, from TraceClock.
+    const char* Name;
+    char Phase;                     // 'B' or 'E'.
+};
+
+// The events recorded by one thread. Only the owning thread writes; the
+// writer publishes each event by advancing WriteCount.
+struct TraceThreadBuffer
+{
+    TraceEvent Events[TraceLog::EventsPerThread];
+    std::atomic<unsigned int> WriteCount;   // Total events written, including overwritten ones.
+    unsigned int ThreadId;                  // Small sequential ID used as the trace "tid".
+    char Name[32];
+};
+
+std::atomic<bool> TraceLog::s_enabled(false);
+
+static TRACE_THREAD_LOCAL TraceThreadBuffer* t_pBuffer = NULL;
+
+// All buffers ever created. Buffers are never freed, so that events from
+// threads that have exited are still written out.
+static std::mutex s_registryLock;
+static std::vector<TraceThreadBuffer*> s_buffers;
+static unsigned long long s_origin = 0;
+
+// Gets a monotonic timestamp in nanoseconds.
+//
+static unsigned long long TraceClock()
+{
+#ifdef _WIN32
+    static unsigned long long perSecond = 0;
+    if (perSecond == 0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        perSecond = static_cast<unsigned long long>(frequency.QuadPart);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    unsigned long long ticks = static_cast<unsigned long long>(now.QuadPart);
+    return (ticks / perSecond) * 1000000000ULL + ((ticks % perSecond) * 1000000000ULL) / perSecond;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<unsigned long long>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// Gets the buffer for the current thread, creating it on first use.
+//
+static TraceThreadBuffer* GetThreadBuffer()
+{
+    TraceThreadBuffer* pBuffer = t_pBuffer;
+    if (pBuffer == NULL)
+    {
+        MEMSTATS_SCOPE(MemoryTag_Diagnostics);
+        pBuffer = new (std::nothrow) TraceThreadBuffer;
+        if (pBuffer == NULL)
+        {
+            return NULL;
+        }
+        pBuffer->WriteCount.store(0);
+        pBuffer->Name[0] = '\0';
+
+        std::lock_guard<std::mutex> lock(s_registryLock);
+        pBuffer->ThreadId = static_cast<unsigned int>(s_buffers.size()) + 1;
+        s_buffers.push_back(pBuffer);
+        t_pBuffer = pBuffer;
+    }
+    return pBuffer;
+}
+
+// Appends an event to the current thread's ring buffer.
+//
+static void Record(const char* name, char phase)
+{
+    TraceThreadBuffer* pBuffer = GetThreadBuffer();
+    if (pBuffer == NULL)
+    {
+        return;
+    }
+    unsigned int count = pBuffer->WriteCount.load(std::memory_order_relaxed);
+    TraceEvent& event = pBuffer->Events[count % TraceLog::EventsPerThread];
+    event.Timestamp = TraceClock();
+    event.Name = name;
+    event.Phase = phase;
+    pBuffer->WriteCount.store(count + 1, std::memory_order_release);
+}
+
+// Turns tracing on or off. Timestamps in the output are relative to the first
+// time tracing was turned on.
+//
+void TraceLog::SetEnabled(bool enabled)
+{
+    if (enabled && (s_origin == 0))
+    {
+        s_origin = TraceClock();
+    }
+    s_enabled.store(enabled);
+}
+
+// Names the current thread in the trace. The name is truncated to 31 characters.
+//
+void TraceLog::SetThreadName(const char* name)
+{
+    TraceThreadBuffer* pBuffer = GetThreadBuffer();
+    if (pBuffer != NULL)
+    {
+        size_t length = strlen(name);
+        if (length >= sizeof(pBuffer->Name))
+        {
+            length = sizeof(pBuffer->Name) - 1;
+        }
+        memcpy(pBuffer->Name, name, length);
+        pBuffer->Name[length] = '\0';
+    }
+}
+
+void TraceLog::BeginSpan(const char* name)
+{
+    Record(name, 'B');
+}
+
+void TraceLog::EndSpan(const char* name)
+{
+    Record(name, 'E');
+}
+
+// Discards all recorded events. Call this only while no spans are being recorded.
+//
+void TraceLog::Clear()
+{
+    std::lock_guard<std::mutex> lock(s_registryLock);
+    for (size_t i = 0; i < s_buffers.size(); i++)
+    {
+        s_buffers[i]->WriteCount.store(0);
+    }
+}
+
+// Writes a string as a JSON string literal.
+//
+static void WriteJsonString(FILE* pFile, const char* text)
+{
+    fputc('"', pFile);
+    for (const char* p = text; *p != '\0'; p++)
+    {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if ((c == '"') || (c == '\\'))
+        {
+            fputc('\\', pFile);
+            fputc(c, pFile);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(pFile, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, pFile);
+        }
+    }
+    fputc('"', pFile);
+}
+
+// Writes all recorded events as a Chrome trace-event JSON document. Events that
+// are recorded while this runs may or may not be included.
+//
+bool TraceLog::WriteChromeTrace(FILE* pFile)
+{
+    if (pFile == NULL)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_registryLock);
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", pFile);
+    bool first = true;
+    for (size_t b = 0; b < s_buffers.size(); b++)
+    {
+        const TraceThreadBuffer* pBuffer = s_buffers[b];
+        if (pBuffer->Name[0] != '\0')
+        {
+            fprintf(pFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",", pBuffer->ThreadId);
+            WriteJsonString(pFile, pBuffer->Name);
+            fputs("}}", pFile);
+            first = false;
+        }
+
+        unsigned int count = pBuffer->WriteCount.load(std::memory_order_acquire);
+        unsigned int start = (count > EventsPerThread) ? count - EventsPerThread : 0;
+        int depth = 0;
+        for (unsigned int i = start; i < count; i++)
+        {
+            const TraceEvent& event = pBuffer->Events[i % EventsPerThread];
+            // Skip end records whose begin record has been overwritten.
+            if (event.Phase == 'E')
+            {
+                if (depth == 0)
+                {
+                    continue;
+                }
+                depth--;
+            }
+            else
+            {
+                depth++;
+            }
+            unsigned long long relative = (event.Timestamp > s_origin) ? event.Timestamp - s_origin : 0;
+            fprintf(pFile, "%s\n{\"name\":", first ? "" : ",");
+            WriteJsonString(pFile, event.Name);
+            fprintf(pFile, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u}",
+                event.Phase, relative / 1000, static_cast<unsigned int>(relative % 1000), pBuffer->ThreadId);
+            first = false;
+        }
+    }
+    fputs("\n]}\n", pFile);
+    return ferror(pFile) == 0;
+}
@@ -0,0 +1,78 @@
+/*************************************************************************************************
+* Description: Declarations for span tracing in Chrome trace-event format.
+*
+* Spans are recorded into a ring buffer per thread and can be written out as JSON that
+* chrome://tracing and Perfetto open directly. Tracing is off until TraceLog::SetEnabled
+* is called; while off, a span costs one load and a branch.
+*
+* This file has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+#include <stdio.h>
+#include <atomic>
+
+namespace TraceLog
+{
+    // Number of events kept per thread. Older events are overwritten.
+    const unsigned int EventsPerThread = 16384;
+
+    extern std::atomic<bool> s_enabled;
+
+    inline bool IsEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool enabled);
+    void SetThreadName(const char* name);
+    void BeginSpan(const char* name);
+    void EndSpan(const char* name);
+    void Clear();
+    bool WriteChromeTrace(FILE* pFile);
+}
+
+// Records a span from construction to destruction. The name must be a string
+// literal or otherwise outlive the trace.
+//
+class TraceSpan
+{
+private:
+    const char* m_name;
+
+public:
+    TraceSpan(const char* name) : m_name(NULL)
+    {
+        if (TraceLog::IsEnabled())
+        {
+            m_name = name;
+            TraceLog::BeginSpan(name);
+        }
+    }
+
+    ~TraceSpan()
+    {
+        // End the span even if tracing was switched off in the middle of it,
+        // so that the begin record is matched.
+        if (m_name != NULL)
+        {
+            TraceLog::EndSpan(m_name);
+        }
+    }
+};
+
+#define TRACE_SPAN_JOIN2(a, b)  a##b
+#define TRACE_SPAN_JOIN(a, b)   TRACE_SPAN_JOIN2(a, b)
+#define TRACE_SPAN(name)        TraceSpan TRACE_SPAN_JOIN(traceSpan, __LINE__)(name)
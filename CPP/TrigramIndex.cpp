@@ -0,0 +1,789 @@
+/*************************************************************************************************
+* Description: Implementation of the trigram index used for substring search on very large lists.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "TrigramIndex.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Image layout:
+//
+//   TrigramHeader
+//   unsigned long long Keys[TrigramCount]         Trigrams, in ascending order.
+//   unsigned int Offsets[TrigramCount + 1]         Start of each posting list.
+//   unsigned char Postings[PostingBytes]
+//
+// Each posting list starts on a 4-byte boundary and holds:
+//
+//   unsigned int Count
+//   { unsigned int FirstId, DataOffset } Skips[(Count + BlockSize - 1) / BlockSize]
+//   Block data: for each block, the differences between its IDs after the first,
+//   7 bits to a byte, low bits first, with the high bit set on all but the last
+//   byte of each difference. DataOffset is relative to the end of the skip table.
+//
+struct TrigramHeader
+{
+    char Magic[4];
+    unsigned int Version;
+    unsigned int TrigramCount;
+    unsigned int Reserved;
+    unsigned long long Fingerprint; // Identifies the names the image was built from.
+    unsigned long long PostingBytes;
+};
+
+static const char ImageMagic[4] = { 'A', 'T', 'G', '1' };
+static const unsigned int ImageVersion = 1;
+
+// Merge the in-memory changes into a new image when they reach this size, or
+// a quarter of the image, whichever is larger.
+static const size_t MinMergePostings = 65536;
+
+static unsigned int ReadUInt32(const unsigned char* p)
+{
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void AppendUInt32(std::vector<unsigned char>* pData, unsigned int value)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+    pData->insert(pData->end(), p, p + sizeof(value));
+}
+
+static void AppendVarint(std::vector<unsigned char>* pData, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        pData->push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    pData->push_back(static_cast<unsigned char>(value));
+}
+
+// Finds the first ID at or after position that is not less than id, by
+// doubling the step until it passes id and then searching the last step.
+//
+static size_t Gallop(const std::vector<unsigned int>& list, size_t position, unsigned int id)
+{
+    size_t step = 1;
+    size_t low = position;
+    while ((low + step < list.size()) && (list[low + step] < id))
+    {
+        low += step;
+        step *= 2;
+    }
+    size_t high = (low + step < list.size()) ? low + step + 1 : list.size();
+    return std::lower_bound(list.begin() + low, list.begin() + high, id) - list.begin();
+}
+
+
+// PostingCursor class: reads one encoded posting list.
+//
+class PostingCursor
+{
+private:
+    const unsigned char* m_pSkips;
+    const unsigned char* m_pData;
+    const unsigned char* m_pEnd;
+    size_t m_count;
+    size_t m_blockCount;
+    size_t m_block;             // Block in m_ids, or m_blockCount if none.
+    unsigned int m_ids[TrigramIndex::BlockSize];
+    size_t m_idCount;
+    size_t m_position;          // Current ID in m_ids.
+
+    unsigned int GetFirstId(size_t block) const
+    {
+        return ReadUInt32(m_pSkips + block * 8);
+    }
+
+    // Decodes a block into m_ids. Returns false if the data is not valid.
+    //
+    bool DecodeBlock(size_t block)
+    {
+        size_t dataOffset = ReadUInt32(m_pSkips + block * 8 + 4);
+        if (dataOffset > static_cast<size_t>(m_pEnd - m_pData))
+        {
+            return false;
+        }
+        const unsigned char* p = m_pData + dataOffset;
+        size_t count = m_count - block * TrigramIndex::BlockSize;
+        if (count > TrigramIndex::BlockSize)
+        {
+            count = TrigramIndex::BlockSize;
+        }
+        unsigned int id = GetFirstId(block);
+        m_ids[0] = id;
+        for (size_t i = 1; i < count; i++)
+        {
+            unsigned int delta = 0;
+            for (int shift = 0; ; shift += 7)
+            {
+                if ((p == m_pEnd) || (shift > 28))
+                {
+                    return false;
+                }
+                unsigned char byte = *p++;
+                delta |= static_cast<unsigned int>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    break;
+                }
+            }
+            id += delta;
+            m_ids[i] = id;
+        }
+        m_block = block;
+        m_idCount = count;
+        m_position = 0;
+        return true;
+    }
+
+public:
+    PostingCursor() : m_pSkips(NULL), m_pData(NULL), m_pEnd(NULL), m_count(0), m_blockCount(0),
+        m_block(0), m_idCount(0), m_position(0)
+    {
+    }
+
+    // Starts reading a list. Returns false if the list is not valid.
+    //
+    bool Open(const unsigned char* pList, const unsigned char* pEnd)
+    {
+        if (pEnd - pList < 4)
+        {
+            return false;
+        }
+        m_count = ReadUInt32(pList);
+        m_blockCount = (m_count + TrigramIndex::BlockSize - 1) / TrigramIndex::BlockSize;
+        if (m_blockCount > static_cast<size_t>(pEnd - pList - 4) / 8)
+        {
+            return false;
+        }
+        m_pSkips = pList + 4;
+        m_pData = m_pSkips + m_blockCount * 8;
+        m_pEnd = pEnd;
+        m_block = m_blockCount;
+        m_idCount = 0;
+        m_position = 0;
+        return true;
+    }
+
+    size_t GetCount() const
+    {
+        return m_count;
+    }
+
+    // Moves to the next ID in the list, or the first one if the cursor has not
+    // moved yet, and gets it. Returns false at the end.
+    //
+    bool Next(unsigned int* pId)
+    {
+        if (m_block == m_blockCount)
+        {
+            if ((m_blockCount == 0) || !DecodeBlock(0))
+            {
+                return false;
+            }
+        }
+        else if (++m_position >= m_idCount)
+        {
+            if ((m_block + 1 >= m_blockCount) || !DecodeBlock(m_block + 1))
+            {
+                return false;
+            }
+        }
+        *pId = m_ids[m_position];
+        return true;
+    }
+
+    // Moves to the first ID that is not less than id, and gets it. Returns false
+    // if there is none. Calls must be made in ascending order of ID, so that the
+    // cursor only moves forward.
+    //
+    bool Seek(unsigned int id, unsigned int* pId)
+    {
+        if (m_blockCount == 0)
+        {
+            return false;
+        }
+
+        // Most calls are answered by the block already decoded.
+        if ((m_block != m_blockCount) && (m_position < m_idCount) && (id <= m_ids[m_idCount - 1]))
+        {
+            m_position = std::lower_bound(m_ids + m_position, m_ids + m_idCount, id) - m_ids;
+            *pId = m_ids[m_position];
+            return true;
+        }
+
+        // Gallop over the skip table to the last block whose first ID is not
+        // greater than id.
+        size_t low = (m_block == m_blockCount) ? 0 : m_block;
+        if (GetFirstId(low) <= id)
+        {
+            size_t step = 1;
+            while ((low + step < m_blockCount) && (GetFirstId(low + step) <= id))
+            {
+                low += step;
+                step *= 2;
+            }
+            size_t high = (low + step < m_blockCount) ? low + step : m_blockCount;
+            while (high - low > 1)
+            {
+                size_t middle = low + (high - low) / 2;
+                if (GetFirstId(middle) <= id)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+        }
+
+        if ((low != m_block) && !DecodeBlock(low))
+        {
+            return false;
+        }
+        m_position = std::lower_bound(m_ids + m_position, m_ids + m_idCount, id) - m_ids;
+        if (m_position == m_idCount)
+        {
+            // Every ID in the block is less than id, so the answer is the first
+            // ID of the next block.
+            if ((m_block + 1 >= m_blockCount) || !DecodeBlock(m_block + 1))
+            {
+                return false;
+            }
+        }
+        *pId = m_ids[m_position];
+        return true;
+    }
+};
+
+
+// TrigramIndex class.
+//
+TrigramIndex::TrigramIndex() : m_pImage(NULL), m_imageSize(0), m_pView(NULL), m_trigramCount(0),
+    m_keys(NULL), m_offsets(NULL), m_postings(NULL), m_addedPostings(0)
+{
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    Unmap();
+}
+
+// Gets the distinct trigrams of a folded string, in ascending order.
+//
+void TrigramIndex::GetTrigrams(const wchar_t* text, std::vector<unsigned long long>* pKeys)
+{
+    pKeys->clear();
+    size_t length = (text != NULL) ? wcslen(text) : 0;
+    for (size_t i = 0; i + 2 < length; i++)
+    {
+        pKeys->push_back((static_cast<unsigned long long>(static_cast<unsigned short>(text[i])) << 32)
+            | (static_cast<unsigned long long>(static_cast<unsigned short>(text[i + 1])) << 16)
+            | static_cast<unsigned short>(text[i + 2]));
+    }
+    std::sort(pKeys->begin(), pKeys->end());
+    pKeys->erase(std::unique(pKeys->begin(), pKeys->end()), pKeys->end());
+}
+
+// Encodes posting lists, whose IDs must be in ascending order, as an image.
+//
+void TrigramIndex::Encode(const PostingMap& lists, unsigned long long fingerprint, std::vector<unsigned char>* pImage)
+{
+    std::vector<unsigned long long> keys;
+    keys.reserve(lists.size());
+    for (PostingMap::const_iterator it = lists.begin(); it != lists.end(); ++it)
+    {
+        if (!it->second.empty())
+        {
+            keys.push_back(it->first);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned char> postings;
+    offsets.reserve(keys.size() + 1);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        const std::vector<unsigned int>& ids = lists.find(keys[i])->second;
+        offsets.push_back(static_cast<unsigned int>(postings.size()));
+        AppendUInt32(&postings, static_cast<unsigned int>(ids.size()));
+        size_t blockCount = (ids.size() + BlockSize - 1) / BlockSize;
+        size_t skips = postings.size();
+        postings.resize(skips + blockCount * 8);
+        size_t dataStart = postings.size();
+        for (size_t block = 0; block < blockCount; block++)
+        {
+            unsigned int first = ids[block * BlockSize];
+            unsigned int dataOffset = static_cast<unsigned int>(postings.size() - dataStart);
+            memcpy(&postings[skips + block * 8], &first, 4);
+            memcpy(&postings[skips + block * 8 + 4], &dataOffset, 4);
+            size_t end = (std::min)(ids.size(), (block + 1) * BlockSize);
+            for (size_t j = block * BlockSize + 1; j < end; j++)
+            {
+                AppendVarint(&postings, ids[j] - ids[j - 1]);
+            }
+        }
+        postings.resize((postings.size() + 3) & ~static_cast<size_t>(3));
+    }
+    offsets.push_back(static_cast<unsigned int>(postings.size()));
+
+    TrigramHeader header;
+    memcpy(header.Magic, ImageMagic, sizeof(header.Magic));
+    header.Version = ImageVersion;
+    header.TrigramCount = static_cast<unsigned int>(keys.size());
+    header.Reserved = 0;
+    header.Fingerprint = fingerprint;
+    header.PostingBytes = postings.size();
+
+    pImage->clear();
+    pImage->reserve(sizeof(header) + keys.size() * sizeof(keys[0]) + offsets.size() * sizeof(offsets[0])
+        + postings.size());
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&header);
+    pImage->insert(pImage->end(), p, p + sizeof(header));
+    if (!keys.empty())
+    {
+        p = reinterpret_cast<const unsigned char*>(&keys[0]);
+        pImage->insert(pImage->end(), p, p + keys.size() * sizeof(keys[0]));
+    }
+    p = reinterpret_cast<const unsigned char*>(&offsets[0]);
+    pImage->insert(pImage->end(), p, p + offsets.size() * sizeof(offsets[0]));
+    pImage->insert(pImage->end(), postings.begin(), postings.end());
+}
+
+// Checks an image and starts using it. The image must stay valid until it is
+// replaced.
+//
+bool TrigramIndex::Attach(const unsigned char* pImage, size_t size)
+{
+    if (size < sizeof(TrigramHeader))
+    {
+        return false;
+    }
+    TrigramHeader header;
+    memcpy(&header, pImage, sizeof(header));
+    if ((memcmp(header.Magic, ImageMagic, sizeof(header.Magic)) != 0) || (header.Version != ImageVersion))
+    {
+        return false;
+    }
+    size_t count = header.TrigramCount;
+    size_t tableSize = count * sizeof(unsigned long long) + (count + 1) * sizeof(unsigned int);
+    if ((count > size / 12) || (size - sizeof(header) < tableSize)
+        || (header.PostingBytes != size - sizeof(header) - tableSize))
+    {
+        return false;
+    }
+    const unsigned long long* keys = reinterpret_cast<const unsigned long long*>(pImage + sizeof(header));
+    const unsigned int* offsets = reinterpret_cast<const unsigned int*>(keys + count);
+    if ((offsets[0] != 0) || (offsets[count] != header.PostingBytes))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((offsets[i + 1] < offsets[i]) || ((offsets[i] & 3) != 0) || ((i > 0) && (keys[i] <= keys[i - 1])))
+        {
+            return false;
+        }
+    }
+
+    m_pImage = pImage;
+    m_imageSize = size;
+    m_trigramCount = count;
+    m_keys = keys;
+    m_offsets = offsets;
+    m_postings = reinterpret_cast<const unsigned char*>(offsets + count + 1);
+    return true;
+}
+
+// Releases a mapped image file.
+//
+void TrigramIndex::Unmap()
+{
+    if (m_pView != NULL)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pView);
+#else
+        munmap(m_pView, m_imageSize);
+#endif
+        m_pView = NULL;
+    }
+}
+
+void TrigramIndex::Clear()
+{
+    Unmap();
+    m_image.clear();
+    m_pImage = NULL;
+    m_imageSize = 0;
+    m_trigramCount = 0;
+    m_added.clear();
+    m_addedIds.clear();
+    m_removedIds.clear();
+    m_addedPostings = 0;
+}
+
+// Gets the posting list for a trigram in the image, or NULL if it has none.
+//
+const unsigned char* TrigramIndex::FindList(unsigned long long key, const unsigned char** pEnd) const
+{
+    const unsigned long long* pKey = std::lower_bound(m_keys, m_keys + m_trigramCount, key);
+    if ((pKey == m_keys + m_trigramCount) || (*pKey != key))
+    {
+        return NULL;
+    }
+    size_t i = pKey - m_keys;
+    *pEnd = m_postings + m_offsets[i + 1];
+    return m_postings + m_offsets[i];
+}
+
+// Adds a name, which must already be folded. Adding names in ascending order of
+// ID is fastest.
+//
+void TrigramIndex::Add(unsigned int itemId, const wchar_t* foldedName)
+{
+    std::vector<unsigned long long> keys;
+    GetTrigrams(foldedName, &keys);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        std::vector<unsigned int>& ids = m_added[keys[i]];
+        if (ids.empty() || (ids.back() < itemId))
+        {
+            ids.push_back(itemId);
+        }
+        else
+        {
+            ids.insert(std::lower_bound(ids.begin(), ids.end(), itemId), itemId);
+        }
+    }
+    m_addedIds.insert(itemId);
+    m_addedPostings += keys.size();
+
+    if (m_addedPostings + m_removedIds.size() > (std::max)(MinMergePostings, m_imageSize / 4))
+    {
+        Merge();
+    }
+}
+
+// Removes a name. foldedName must be the name the item was added with.
+//
+void TrigramIndex::Remove(unsigned int itemId, const wchar_t* foldedName)
+{
+    if (m_addedIds.erase(itemId) == 0)
+    {
+        m_removedIds.insert(itemId);
+        return;
+    }
+    std::vector<unsigned long long> keys;
+    GetTrigrams(foldedName, &keys);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        PostingMap::iterator it = m_added.find(keys[i]);
+        if (it == m_added.end())
+        {
+            continue;
+        }
+        std::vector<unsigned int>::iterator id = std::lower_bound(it->second.begin(), it->second.end(), itemId);
+        if ((id != it->second.end()) && (*id == itemId))
+        {
+            it->second.erase(id);
+            m_addedPostings--;
+        }
+        if (it->second.empty())
+        {
+            m_added.erase(it);
+        }
+    }
+}
+
+// Builds a new image that includes the changes made since the last one.
+//
+void TrigramIndex::Merge()
+{
+    PostingMap lists;
+    for (size_t i = 0; i < m_trigramCount; i++)
+    {
+        PostingCursor cursor;
+        if (!cursor.Open(m_postings + m_offsets[i], m_postings + m_offsets[i + 1]))
+        {
+            continue;
+        }
+        std::vector<unsigned int>& ids = lists[m_keys[i]];
+        ids.reserve(cursor.GetCount());
+        unsigned int id;
+        while (cursor.Next(&id))
+        {
+            if (m_removedIds.find(id) == m_removedIds.end())
+            {
+                ids.push_back(id);
+            }
+        }
+    }
+    for (PostingMap::const_iterator it = m_added.begin(); it != m_added.end(); ++it)
+    {
+        std::vector<unsigned int>& ids = lists[it->first];
+        size_t middle = ids.size();
+        ids.insert(ids.end(), it->second.begin(), it->second.end());
+        std::inplace_merge(ids.begin(), ids.begin() + middle, ids.end());
+    }
+
+    std::vector<unsigned char> image;
+    Encode(lists, 0, &image);
+    Unmap();
+    m_image.swap(image);
+    Attach(&m_image[0], m_image.size());
+    m_added.clear();
+    m_addedIds.clear();
+    m_removedIds.clear();
+    m_addedPostings = 0;
+}
+
+// Finds the items whose names contain every trigram of a folded string, in
+// ascending order of ID. These may contain the string, and must be checked
+// against the names. Returns false if the string is too short to use the index.
+//
+bool TrigramIndex::Find(const wchar_t* foldedText, std::vector<unsigned int>* pItemIds) const
+{
+    pItemIds->clear();
+    if ((foldedText == NULL) || (wcslen(foldedText) < MinQueryLength))
+    {
+        return false;
+    }
+    std::vector<unsigned long long> keys;
+    GetTrigrams(foldedText, &keys);
+
+    // Items in the image.
+    std::vector<unsigned int> fromImage;
+    std::vector<PostingCursor> cursors(keys.size());
+    bool inImage = true;
+    for (size_t i = 0; (i < keys.size()) && inImage; i++)
+    {
+        const unsigned char* pEnd = NULL;
+        const unsigned char* pList = FindList(keys[i], &pEnd);
+        inImage = (pList != NULL) && cursors[i].Open(pList, pEnd);
+    }
+    if (inImage)
+    {
+        std::vector<size_t> order(keys.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            for (size_t j = i; (j > 0) && (cursors[order[j]].GetCount() < cursors[order[j - 1]].GetCount()); j--)
+            {
+                std::swap(order[j], order[j - 1]);
+            }
+        }
+
+        // Walk the shortest list, and look for each of its IDs in the others.
+        // When another list has no ID between the current one and its next
+        // ID, the shortest list skips ahead to that ID.
+        PostingCursor& shortest = cursors[order[0]];
+        unsigned int id;
+        bool more = shortest.Next(&id);
+        while (more)
+        {
+            unsigned int next = id;
+            for (size_t i = 1; (i < order.size()) && (next == id); i++)
+            {
+                if (!cursors[order[i]].Seek(id, &next))
+                {
+                    more = false;
+                    break;
+                }
+            }
+            if (!more)
+            {
+                break;
+            }
+            if (next == id)
+            {
+                if (m_removedIds.find(id) == m_removedIds.end())
+                {
+                    fromImage.push_back(id);
+                }
+                more = shortest.Next(&id);
+            }
+            else
+            {
+                more = shortest.Seek(next, &id);
+            }
+        }
+    }
+
+    // Items added since the image was built.
+    std::vector<const std::vector<unsigned int>*> lists;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        PostingMap::const_iterator it = m_added.find(keys[i]);
+        if (it == m_added.end())
+        {
+            lists.clear();
+            break;
+        }
+        lists.push_back(&it->second);
+    }
+    std::vector<unsigned int> fromAdded;
+    if (!lists.empty())
+    {
+        const std::vector<unsigned int>* pShortest = lists[0];
+        for (size_t i = 1; i < lists.size(); i++)
+        {
+            if (lists[i]->size() < pShortest->size())
+            {
+                pShortest = lists[i];
+            }
+        }
+        std::vector<size_t> positions(lists.size(), 0);
+        for (size_t c = 0; c < pShortest->size(); c++)
+        {
+            unsigned int id = (*pShortest)[c];
+            bool found = true;
+            for (size_t i = 0; (i < lists.size()) && found; i++)
+            {
+                positions[i] = Gallop(*lists[i], positions[i], id);
+                found = (positions[i] < lists[i]->size()) && ((*lists[i])[positions[i]] == id);
+            }
+            if (found)
+            {
+                fromAdded.push_back(id);
+            }
+        }
+    }
+
+    // An item is never in both.
+    pItemIds->resize(fromImage.size() + fromAdded.size());
+    std::merge(fromImage.begin(), fromImage.end(), fromAdded.begin(), fromAdded.end(), pItemIds->begin());
+    return true;
+}
+
+// Gets the size in bytes of the current image, which is the size of the file
+// it would be saved to.
+//
+size_t TrigramIndex::GetImageSize() const
+{
+    return m_imageSize;
+}
+
+// Maps an image file saved for the names identified by fingerprint. Returns
+// false, leaving the index empty, if there is no such file or it was saved
+// for different names.
+//
+bool TrigramIndex::Load(const char* path, unsigned long long fingerprint)
+{
+    Clear();
+    void* pView = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && (fileSize.QuadPart >= static_cast<LONGLONG>(sizeof(TrigramHeader)))
+        && (static_cast<unsigned long long>(fileSize.QuadPart) <= static_cast<size_t>(-1)))
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+            // The view keeps the file open once the handles are closed.
+            pView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = static_cast<size_t>(fileSize.QuadPart);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if ((fstat(fd, &status) == 0) && (status.st_size >= static_cast<off_t>(sizeof(TrigramHeader))))
+    {
+        size = static_cast<size_t>(status.st_size);
+        pView = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pView == MAP_FAILED)
+        {
+            pView = NULL;
+        }
+    }
+    close(fd);
+#endif
+    if (pView == NULL)
+    {
+        return false;
+    }
+    m_pView = pView;
+    m_imageSize = size;
+
+    TrigramHeader header;
+    memcpy(&header, pView, sizeof(header));
+    if ((header.Fingerprint != fingerprint) || !Attach(static_cast<const unsigned char*>(pView), size))
+    {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+// Merges any changes into a new image and saves it for the names identified by
+// fingerprint.
+//
+bool TrigramIndex::Save(const char* path, unsigned long long fingerprint)
+{
+    // This also releases any mapped file, which may be the one being replaced.
+    Merge();
+    memcpy(&m_image[0] + offsetof(TrigramHeader, Fingerprint), &fingerprint, sizeof(fingerprint));
+
+    FILE* pFile = NULL;
+#ifdef _WIN32
+    if (fopen_s(&pFile, path, "wb") != 0)
+    {
+        pFile = NULL;
+    }
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (pFile == NULL)
+    {
+        return false;
+    }
+    bool written = (fwrite(&m_image[0], 1, m_image.size(), pFile) == m_image.size());
+    return (fclose(pFile) == 0) && written;
+}
@@ -0,0 +1,92 @@
+/*************************************************************************************************
+* Description: Declarations for the trigram index used for substring search on very large lists.
+*
+* For every three consecutive units of a folded name, the index holds the sorted list of
+* items whose names contain them (a posting list). A query of three or more units is
+* answered by intersecting the posting lists of its trigrams, which gives the items that
+* may contain the query; the caller checks those against the names.
+*
+* Posting lists are stored in blocks of BlockSize item IDs, each encoded as differences
+* from the previous ID in a variable number of bytes. A skip table holds the first ID
+* and position of each block, so that an intersection can gallop over the skip table
+* and decode only the blocks that might hold the IDs it is looking for.
+*
+* The encoded lists form an image that can be saved to a file and memory-mapped when the
+* application starts again, instead of being rebuilt. Items added or removed after the
+* image was built are kept in a small in-memory layer that is merged into a new image
+* when it grows. Images are in the byte order of the machine that wrote them.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class TrigramIndex
+{
+public:
+    // Item IDs in each encoded block.
+    static const size_t BlockSize = 128;
+
+    // Fewest units in a query that the index can answer.
+    static const size_t MinQueryLength = 3;
+
+private:
+    typedef std::unordered_map<unsigned long long, std::vector<unsigned int> > PostingMap;
+
+    // The encoded image, either owned or mapped from a file.
+    std::vector<unsigned char> m_image;
+    const unsigned char* m_pImage;
+    size_t m_imageSize;
+    void* m_pView;              // Mapped view of an image file, if any.
+
+    // Parsed from the image.
+    size_t m_trigramCount;
+    const unsigned long long* m_keys;
+    const unsigned int* m_offsets;
+    const unsigned char* m_postings;
+
+    // Changes since the image was built.
+    PostingMap m_added;                         // Sorted lists of items added since.
+    std::unordered_set<unsigned int> m_addedIds;
+    std::unordered_set<unsigned int> m_removedIds;  // Items in the image that were removed.
+    size_t m_addedPostings;
+
+    TrigramIndex(const TrigramIndex&);
+    TrigramIndex& operator=(const TrigramIndex&);
+
+    static void GetTrigrams(const wchar_t* text, std::vector<unsigned long long>* pKeys);
+    static void Encode(const PostingMap& lists, unsigned long long fingerprint, std::vector<unsigned char>* pImage);
+    bool Attach(const unsigned char* pImage, size_t size);
+    void Unmap();
+    const unsigned char* FindList(unsigned long long key, const unsigned char** pEnd) const;
+    void Merge();
+
+public:
+    TrigramIndex();
+    ~TrigramIndex();
+
+    void Clear();
+    void Add(unsigned int itemId, const wchar_t* foldedName);
+    void Remove(unsigned int itemId, const wchar_t* foldedName);
+    bool Find(const wchar_t* foldedText, std::vector<unsigned int>* pItemIds) const;
+    size_t GetImageSize() const;
+    bool Load(const char* path, unsigned long long fingerprint);
+    bool Save(const char* path, unsigned long long fingerprint);
+};
@@ -0,0 +1,305 @@
+/*************************************************************************************************
+* Description: Implementation of the thread pool that runs expensive work off the UI thread.
+*
+* See EntryPoint.cpp for a full description of this sample.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#include "WorkExecutor.h"
+#include "TraceLog.h"
+#include <new>
+
+#ifdef _WIN32
+#define EXECUTOR_THREAD_LOCAL __declspec(thread)
+#else
+#define EXECUTOR_THREAD_LOCAL __thread
+#endif
+
+// The executor and queue of the current worker thread, so that work submitted
+// from a worker goes on its own queue.
+static EXECUTOR_THREAD_LOCAL WorkExecutor* t_pExecutor = NULL;
+static EXECUTOR_THREAD_LOCAL size_t t_workerIndex = 0;
+
+
+// CancellationToken and CancellationSource classes.
+//
+CancellationToken::CancellationToken() : m_pCancelled(std::make_shared<std::atomic<bool> >(false))
+{
+}
+
+CancellationSource::CancellationSource()
+{
+}
+
+CancellationToken CancellationSource::GetToken() const
+{
+    return m_token;
+}
+
+void CancellationSource::Cancel()
+{
+    m_token.m_pCancelled->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationSource::IsCancelled() const
+{
+    return m_token.IsCancelled();
+}
+
+
+// WorkExecutor class.
+//
+WorkExecutor::WorkExecutor() : m_queuedCount(0), m_stopping(false), m_wakePending(false),
+    m_wake(NULL), m_wakeContext(NULL)
+{
+}
+
+WorkExecutor::~WorkExecutor()
+{
+    Stop();
+}
+
+// Starts the worker threads. If threadCount is 0, uses one fewer than the
+// number of processors, leaving one for the UI thread. wake is called, on a
+// worker thread, when completions are waiting to be run.
+//
+bool WorkExecutor::Start(size_t threadCount, WakeCallback wake, void* wakeContext)
+{
+    Stop();
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = (threadCount > 1) ? threadCount - 1 : 1;
+    }
+    m_wake = wake;
+    m_wakeContext = wakeContext;
+    m_stopping = false;
+    for (size_t i = 0; i <= threadCount; i++)
+    {
+        WorkQueue* pQueue = new (std::nothrow) WorkQueue();
+        if (pQueue == NULL)
+        {
+            Stop();
+            return false;
+        }
+        m_queues.push_back(pQueue);
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        m_threads.push_back(std::thread(&WorkExecutor::WorkerLoop, this, i));
+    }
+    return true;
+}
+
+// Stops the worker threads, after waiting for the items that are running.
+// Items that have not started, and completions that have not run, are
+// discarded without being called.
+//
+void WorkExecutor::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        m_threads[i].join();
+    }
+    m_threads.clear();
+
+    for (size_t i = 0; i < m_queues.size(); i++)
+    {
+        for (int priority = 0; priority < WorkPriority_Count; priority++)
+        {
+            for (size_t j = 0; j < m_queues[i]->Items[priority].size(); j++)
+            {
+                delete m_queues[i]->Items[priority][j];
+            }
+        }
+        delete m_queues[i];
+    }
+    m_queues.clear();
+    m_queuedCount = 0;
+
+    std::lock_guard<std::mutex> lock(m_completionLock);
+    for (size_t i = 0; i < m_completions.size(); i++)
+    {
+        delete m_completions[i];
+    }
+    m_completions.clear();
+    m_wakePending = false;
+}
+
+size_t WorkExecutor::GetThreadCount() const
+{
+    return m_threads.size();
+}
+
+// Queues work to run on a worker thread. If completion is not empty, it is
+// run by RunCompletions after the work has run, or instead of it if the work
+// was cancelled before it started. Work that is not running should check the
+// token from time to time and return early if it has been cancelled.
+//
+void WorkExecutor::Submit(const WorkFunction& work, const CompletionFunction& completion,
+    const CancellationToken& token, WorkPriority priority)
+{
+    if (m_queues.empty())
+    {
+        return;
+    }
+    WorkItem* pItem = new (std::nothrow) WorkItem();
+    if (pItem == NULL)
+    {
+        return;
+    }
+    pItem->Work = work;
+    pItem->Completion = completion;
+    pItem->Token = token;
+    pItem->Priority = priority;
+    pItem->Cancelled = false;
+
+    size_t index = (t_pExecutor == this) ? t_workerIndex : m_queues.size() - 1;
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->Lock);
+        m_queues[index]->Items[priority].push_back(pItem);
+    }
+    m_queuedCount++;
+
+    // Taking the lock ensures that a worker that has just found no work is
+    // either already waiting, and is woken, or has not yet checked the count.
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+    }
+    m_workAvailable.notify_one();
+}
+
+// Finds the next item for a worker to run, or NULL if there is none.
+//
+WorkExecutor::WorkItem* WorkExecutor::TakeWork(size_t index)
+{
+    // m_queues is complete before the first worker starts; m_threads is not.
+    size_t sharedIndex = m_queues.size() - 1;
+    size_t workerCount = sharedIndex;
+    for (int priority = 0; priority < WorkPriority_Count; priority++)
+    {
+        // Own queue, newest first, since its data is most likely in the cache.
+        {
+            WorkQueue* pQueue = m_queues[index];
+            std::lock_guard<std::mutex> lock(pQueue->Lock);
+            if (!pQueue->Items[priority].empty())
+            {
+                WorkItem* pItem = pQueue->Items[priority].back();
+                pQueue->Items[priority].pop_back();
+                return pItem;
+            }
+        }
+
+        // Then the shared queue and the other workers, oldest first.
+        for (size_t i = 0; i < workerCount; i++)
+        {
+            size_t victim = (i == 0) ? sharedIndex : (index + i) % workerCount;
+            WorkQueue* pQueue = m_queues[victim];
+            std::lock_guard<std::mutex> lock(pQueue->Lock);
+            if (!pQueue->Items[priority].empty())
+            {
+                WorkItem* pItem = pQueue->Items[priority].front();
+                pQueue->Items[priority].pop_front();
+                return pItem;
+            }
+        }
+    }
+    return NULL;
+}
+
+void WorkExecutor::WorkerLoop(size_t index)
+{
+    t_pExecutor = this;
+    t_workerIndex = index;
+    TraceLog::SetThreadName("Worker thread");
+    for (;;)
+    {
+        // Once stopping, leave the items that have not started for Stop to
+        // discard, rather than running the rest of the queue first.
+        if (m_stopping)
+        {
+            return;
+        }
+        WorkItem* pItem = TakeWork(index);
+        if (pItem != NULL)
+        {
+            m_queuedCount--;
+            if (!pItem->Token.IsCancelled())
+            {
+                TRACE_SPAN("WorkExecutor::Run");
+                pItem->Work(pItem->Token);
+            }
+            Complete(pItem, pItem->Token.IsCancelled());
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        while (!m_stopping && (m_queuedCount == 0))
+        {
+            m_workAvailable.wait(lock);
+        }
+        if (m_stopping)
+        {
+            return;
+        }
+    }
+}
+
+// Queues the completion of an item, and wakes the thread that runs
+// completions if it has not been woken already.
+//
+void WorkExecutor::Complete(WorkItem* pItem, bool cancelled)
+{
+    if (!pItem->Completion)
+    {
+        delete pItem;
+        return;
+    }
+    pItem->Cancelled = cancelled;
+    {
+        std::lock_guard<std::mutex> lock(m_completionLock);
+        m_completions.push_back(pItem);
+    }
+    if (!m_wakePending.exchange(true) && (m_wake != NULL))
+    {
+        m_wake(m_wakeContext);
+    }
+}
+
+// Runs the completions that are waiting. An item whose token was cancelled
+// after its work ran is reported as cancelled, since its result is no longer
+// wanted.
+//
+void WorkExecutor::RunCompletions()
+{
+    // Clear the flag first, so that a completion queued from now on wakes
+    // the thread again.
+    m_wakePending = false;
+    std::vector<WorkItem*> completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completionLock);
+        completions.swap(m_completions);
+    }
+    for (size_t i = 0; i < completions.size(); i++)
+    {
+        WorkItem* pItem = completions[i];
+        pItem->Completion(pItem->Cancelled || pItem->Token.IsCancelled());
+        delete pItem;
+    }
+}
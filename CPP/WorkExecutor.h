@@ -0,0 +1,138 @@
+/*************************************************************************************************
+* Description: Declarations for the thread pool that runs expensive work off the UI thread.
+*
+* Each worker thread has its own queue. Work submitted from a worker goes on that worker's
+* queue, and work submitted from any other thread goes on a shared queue. A worker takes
+* the newest item from its own queue, then the oldest from the shared queue, and then
+* steals the oldest from the other workers, always preferring higher-priority items.
+*
+* An item may have a completion, which is queued when the work finishes and run on the
+* thread that calls RunCompletions, normally the UI thread. The executor calls the wake
+* callback when the first completion is queued, and not again until RunCompletions has
+* run, so a burst of completions costs one posted message.
+*
+* This code has no dependency on Windows headers.
+*
+*
+*  Copyright (C) Microsoft Corporation.  All rights reserved.
+*
+* This source code is intended only as a supplement to Microsoft
+* Development Tools and/or on-line documentation.  See these other
+* materials for detailed information regarding Microsoft code samples.
+*
+* THIS CODE AND INFORMATION ARE PROVIDED AS IS WITHOUT WARRANTY OF ANY
+* KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*************************************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Priority of a work item. Waiting items of higher priority are started first.
+enum WorkPriority
+{
+    WorkPriority_High,          // The user is waiting for the result.
+    WorkPriority_Normal,
+    WorkPriority_Low,           // Speculative work, such as warming caches.
+    WorkPriority_Count
+};
+
+// Tells work whether it is still wanted. Copies share the same state.
+//
+class CancellationToken
+{
+private:
+    std::shared_ptr<std::atomic<bool> > m_pCancelled;
+
+    friend class CancellationSource;
+
+public:
+    CancellationToken();        // A token that is never cancelled.
+
+    bool IsCancelled() const
+    {
+        return m_pCancelled->load(std::memory_order_relaxed);
+    }
+};
+
+// Cancels the work that was given its tokens.
+//
+class CancellationSource
+{
+private:
+    CancellationToken m_token;
+
+public:
+    CancellationSource();
+
+    CancellationToken GetToken() const;
+    void Cancel();
+    bool IsCancelled() const;
+};
+
+// Runs work on a pool of threads.
+//
+class WorkExecutor
+{
+public:
+    typedef std::function<void(const CancellationToken& token)> WorkFunction;
+    typedef std::function<void(bool cancelled)> CompletionFunction;
+    typedef void (*WakeCallback)(void* context);
+
+private:
+    struct WorkItem
+    {
+        WorkFunction Work;
+        CompletionFunction Completion;
+        CancellationToken Token;
+        WorkPriority Priority;
+        bool Cancelled;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex Lock;
+        std::deque<WorkItem*> Items[WorkPriority_Count];
+    };
+
+    std::vector<WorkQueue*> m_queues;       // One per worker, then the shared queue.
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_queuedCount;
+    std::atomic<bool> m_stopping;
+    std::mutex m_sleepLock;
+    std::condition_variable m_workAvailable;
+
+    std::mutex m_completionLock;
+    std::vector<WorkItem*> m_completions;
+    std::atomic<bool> m_wakePending;        // The wake callback has been called since the last RunCompletions.
+    WakeCallback m_wake;
+    void* m_wakeContext;
+
+    WorkExecutor(const WorkExecutor&);
+    WorkExecutor& operator=(const WorkExecutor&);
+
+    void WorkerLoop(size_t index);
+    WorkItem* TakeWork(size_t index);
+    void Complete(WorkItem* pItem, bool cancelled);
+
+public:
+    WorkExecutor();
+    ~WorkExecutor();
+
+    bool Start(size_t threadCount, WakeCallback wake, void* wakeContext);
+    void Stop();
+    size_t GetThreadCount() const;
+    void Submit(const WorkFunction& work, const CompletionFunction& completion,
+        const CancellationToken& token, WorkPriority priority = WorkPriority_Normal);
+    void RunCompletions();
+};
@@ -12,4 +12,6 @@
 #define IDC_ONLINE                      1007
 #define IDC_NAME                        1008
 #define IDC_STATUS                      1009
+#define IDC_RENAME                      1010
+#define IDC_ONLINELISTBOX               1011
 #define IDC_STATIC                      -1